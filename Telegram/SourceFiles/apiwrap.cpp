@@ -1550,6 +1550,7 @@ void ApiWrap::leaveChannel(not_null<ChannelData*> channel) {
 		)).done([=](const MTPUpdates &result) {
 			_channelAmInRequests.remove(channel);
 			applyUpdates(result);
+			Local::clearHistorySlice(channel->id);
 		}).fail([=](const RPCError &error) {
 			_channelAmInRequests.remove(channel);
 		}).send();
@@ -96,8 +96,6 @@ namespace {
 	EmojiImagesMap MainEmojiMap;
 	QMap<int, EmojiImagesMap> OtherEmojiMap;
 
-	int32 serviceImageCacheSize = 0;
-
 } // namespace
 
 namespace App {
@@ -1531,8 +1529,6 @@ namespace {
 
 		clearStorageImages();
 		cSetServerBackgrounds(WallPapers());
-
-		serviceImageCacheSize = imageCacheSize();
 	}
 
 	void deinitMedia() {
@@ -1627,15 +1623,6 @@ namespace {
 		return i.value();
 	}
 
-	void checkImageCacheSize() {
-		int64 nowImageCacheSize = imageCacheSize();
-		if (nowImageCacheSize > serviceImageCacheSize + MemoryForImageCache) {
-			App::forgetMedia();
-			Auth().data().forgetMedia();
-			serviceImageCacheSize = imageCacheSize();
-		}
-	}
-
 	bool isValidPhone(QString phone) {
 		phone = phone.replace(QRegularExpression(qsl("[^\\d]")), QString());
 		return phone.length() >= 8 || phone == qsl("777") || phone == qsl("333") || phone == qsl("111") || (phone.startsWith(qsl("42")) && (phone.length() == 2 || phone.length() == 5 || phone == qsl("4242")));
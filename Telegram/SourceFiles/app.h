@@ -203,8 +203,6 @@ namespace App {
 	void initMedia();
 	void deinitMedia();
 
-	void checkImageCacheSize();
-
 	bool isValidPhone(QString phone);
 
 	enum LaunchState {
@@ -0,0 +1,101 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <atomic>
+
+namespace base {
+
+// Unbounded lock-free multiple producers / single consumer queue.
+//
+// push() may be called from any thread, pop() / empty() must be called
+// only by one thread at a time (the consumer). Values pushed by a single
+// producer are popped in the order they were pushed.
+//
+// pop() may return false while some push() is in progress even if other
+// values were pushed before that one, so a producer should notify the
+// consumer after its push() and the consumer should retry on that.
+template <typename Type>
+class mpsc_queue {
+public:
+	mpsc_queue() = default;
+	mpsc_queue(const mpsc_queue &other) = delete;
+	mpsc_queue &operator=(const mpsc_queue &other) = delete;
+
+	void push(Type &&value) {
+		push(new node(std::move(value)));
+	}
+	void push(const Type &value) {
+		push(new node(value));
+	}
+
+	bool pop(Type &value) {
+		auto tail = _tail;
+		auto next = tail->next.load(std::memory_order_acquire);
+		if (tail == &_stub) {
+			if (!next) {
+				return false;
+			}
+			_tail = tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (!next) {
+			if (tail != _head.load(std::memory_order_acquire)) {
+				// Some producer has not linked its node yet.
+				return false;
+			}
+			push(&_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (!next) {
+				return false;
+			}
+		}
+		_tail = next;
+		value = std::move(tail->value);
+		delete tail;
+		return true;
+	}
+
+	bool empty() const {
+		return (_tail == &_stub)
+			&& !_stub.next.load(std::memory_order_acquire);
+	}
+
+	~mpsc_queue() {
+		auto value = Type();
+		while (pop(value)) {
+		}
+	}
+
+private:
+	struct node {
+		node() = default;
+		explicit node(Type &&value) : value(std::move(value)) {
+		}
+		explicit node(const Type &value) : value(value) {
+		}
+
+		std::atomic<node*> next = nullptr;
+		Type value = Type();
+	};
+
+	void push(node *added) {
+		added->next.store(nullptr, std::memory_order_relaxed);
+		const auto previous = _head.exchange(
+			added,
+			std::memory_order_acq_rel);
+		previous->next.store(added, std::memory_order_release);
+	}
+
+	node _stub;
+	std::atomic<node*> _head = &_stub; // written by producers
+	node *_tail = &_stub; // used only by the consumer
+
+};
+
+} // namespace base
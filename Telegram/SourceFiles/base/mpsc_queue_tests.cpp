@@ -0,0 +1,174 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "base/mpsc_queue.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct message {
+	int producer = 0;
+	int index = 0;
+	std::vector<int> payload; // like a small serialized response
+};
+
+message make_message(int producer, int index) {
+	return message{
+		producer,
+		index,
+		std::vector<int>(8 + (index % 64), index) };
+}
+
+class mutex_queue {
+public:
+	void push(message &&value) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_values.push_back(std::move(value));
+	}
+	bool pop(message &value) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_values.empty()) {
+			return false;
+		}
+		value = std::move(_values.front());
+		_values.pop_front();
+		return true;
+	}
+
+private:
+	std::mutex _mutex;
+	std::deque<message> _values;
+
+};
+
+// Pushes synthetic traffic from several producers, checks that nothing
+// is lost and that the order of each producer is preserved.
+template <typename Queue>
+void run_traffic(Queue &queue, int producers, int count) {
+	auto threads = std::vector<std::thread>();
+	for (auto producer = 0; producer != producers; ++producer) {
+		threads.emplace_back([&queue, producer, count] {
+			for (auto index = 0; index != count; ++index) {
+				queue.push(make_message(producer, index));
+			}
+		});
+	}
+	auto expected = std::vector<int>(producers, 0);
+	auto received = 0;
+	auto value = message();
+	while (received != producers * count) {
+		if (!queue.pop(value)) {
+			std::this_thread::yield();
+			continue;
+		}
+		REQUIRE(value.producer >= 0);
+		REQUIRE(value.producer < producers);
+		REQUIRE(value.index == expected[value.producer]);
+		REQUIRE(value.payload.size() == size_t(8 + (value.index % 64)));
+		++expected[value.producer];
+		++received;
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	REQUIRE(!queue.pop(value));
+}
+
+template <typename Queue>
+double measure_traffic(int producers, int count) {
+	const auto start = std::chrono::steady_clock::now();
+	auto queue = std::make_unique<Queue>();
+	run_traffic(*queue, producers, count);
+	const auto finish = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+} // namespace
+
+TEST_CASE("mpsc_queue basic operations", "[mpsc_queue]") {
+	base::mpsc_queue<std::string> queue;
+	auto value = std::string();
+
+	SECTION("empty queue has nothing to pop") {
+		REQUIRE(queue.empty());
+		REQUIRE(!queue.pop(value));
+	}
+	SECTION("values are popped in the push order") {
+		queue.push("a");
+		queue.push("b");
+		queue.push("c");
+		REQUIRE(!queue.empty());
+		REQUIRE(queue.pop(value));
+		REQUIRE(value == "a");
+		queue.push("d");
+		REQUIRE(queue.pop(value));
+		REQUIRE(value == "b");
+		REQUIRE(queue.pop(value));
+		REQUIRE(value == "c");
+		REQUIRE(queue.pop(value));
+		REQUIRE(value == "d");
+		REQUIRE(queue.empty());
+		REQUIRE(!queue.pop(value));
+	}
+	SECTION("queue may be reused after it was drained") {
+		for (auto i = 0; i != 10; ++i) {
+			queue.push(std::to_string(i));
+			REQUIRE(queue.pop(value));
+			REQUIRE(value == std::to_string(i));
+			REQUIRE(!queue.pop(value));
+		}
+	}
+	SECTION("values left in the queue are destroyed with it") {
+		auto counter = std::make_shared<int>(0);
+		{
+			base::mpsc_queue<std::shared_ptr<int>> owning;
+			owning.push(counter);
+			owning.push(counter);
+			REQUIRE(counter.use_count() == 3);
+		}
+		REQUIRE(counter.use_count() == 1);
+	}
+}
+
+TEST_CASE("mpsc_queue under synthetic traffic", "[mpsc_queue]") {
+	SECTION("single producer") {
+		base::mpsc_queue<message> queue;
+		run_traffic(queue, 1, 100000);
+	}
+	SECTION("several producers") {
+		base::mpsc_queue<message> queue;
+		run_traffic(queue, 4, 50000);
+	}
+}
+
+TEST_CASE("mpsc_queue stress benchmark", "[.][mpsc_queue][benchmark]") {
+	const auto count = 1000000;
+	for (const auto producers : { 1, 2, 4 }) {
+		const auto lockfree = measure_traffic<base::mpsc_queue<message>>(
+			producers,
+			count / producers);
+		const auto locked = measure_traffic<mutex_queue>(
+			producers,
+			count / producers);
+		WARN(std::to_string(producers)
+			+ " producers, "
+			+ std::to_string(count)
+			+ " messages: mpsc_queue "
+			+ std::to_string(int(lockfree))
+			+ " ms, mutex queue "
+			+ std::to_string(int(locked))
+			+ " ms");
+	}
+}
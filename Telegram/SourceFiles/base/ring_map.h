@@ -0,0 +1,305 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include "base/flat_map.h"
+
+namespace base {
+
+// Ordered map for keys that mostly grow, like mtproto message ids.
+//
+// Values are kept sorted in a vector that is used as a ring buffer:
+// new keys are appended to the back, erased values are only marked as
+// removed and skipped by the iterators, removed values in front are
+// dropped right away and the ones in the middle are compacted out when
+// the vector is full. So in the steady state nothing is allocated or
+// moved for each added and erased value, even if the values are erased
+// in random order.
+//
+// Any insertion invalidates all iterators, erase() invalidates only the
+// erased ones.
+template <typename Key, typename Type>
+class ring_map {
+	using pair_type = flat_multi_map_pair_type<Key, Type>;
+
+	struct slot {
+		template <typename OtherKey, typename OtherType>
+		slot(OtherKey &&key, OtherType &&value)
+		: pair(std::forward<OtherKey>(key), std::forward<OtherType>(value)) {
+		}
+
+		pair_type pair;
+		bool alive = true;
+	};
+	using impl_t = std::vector<slot>;
+
+	template <typename Slot, typename Pair>
+	class iterator_impl {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = pair_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Pair*;
+		using reference = Pair&;
+
+		iterator_impl() = default;
+		template <typename OtherSlot, typename OtherPair>
+		iterator_impl(const iterator_impl<OtherSlot, OtherPair> &other)
+		: _current(other._current)
+		, _end(other._end) {
+		}
+
+		reference operator*() const {
+			return _current->pair;
+		}
+		pointer operator->() const {
+			return &_current->pair;
+		}
+		iterator_impl &operator++() {
+			do {
+				++_current;
+			} while (_current != _end && !_current->alive);
+			return *this;
+		}
+		iterator_impl operator++(int) {
+			auto result = *this;
+			++*this;
+			return result;
+		}
+
+		// The first slot is always alive, so we never run out of range.
+		iterator_impl &operator--() {
+			do {
+				--_current;
+			} while (!_current->alive);
+			return *this;
+		}
+		iterator_impl operator--(int) {
+			auto result = *this;
+			--*this;
+			return result;
+		}
+
+		template <typename OtherSlot, typename OtherPair>
+		bool operator==(
+				const iterator_impl<OtherSlot, OtherPair> &other) const {
+			return (_current == other._current);
+		}
+		template <typename OtherSlot, typename OtherPair>
+		bool operator!=(
+				const iterator_impl<OtherSlot, OtherPair> &other) const {
+			return (_current != other._current);
+		}
+
+	private:
+		iterator_impl(Slot *current, Slot *end)
+		: _current(current)
+		, _end(end) {
+		}
+
+		template <typename OtherSlot, typename OtherPair>
+		friend class iterator_impl;
+		friend class ring_map;
+
+		Slot *_current = nullptr;
+		Slot *_end = nullptr;
+
+	};
+
+public:
+	using value_type = pair_type;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using pointer = pair_type*;
+	using const_pointer = const pair_type*;
+	using reference = pair_type&;
+	using const_reference = const pair_type&;
+	using iterator = iterator_impl<slot, pair_type>;
+	using const_iterator = iterator_impl<const slot, const pair_type>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	size_type size() const {
+		return _size;
+	}
+	bool empty() const {
+		return !_size;
+	}
+	void clear() {
+		_impl.clear();
+		_first = 0;
+		_size = 0;
+	}
+
+	iterator begin() {
+		return { _impl.data() + _first, _impl.data() + _impl.size() };
+	}
+	iterator end() {
+		const auto end = _impl.data() + _impl.size();
+		return { end, end };
+	}
+	const_iterator begin() const {
+		return { _impl.data() + _first, _impl.data() + _impl.size() };
+	}
+	const_iterator end() const {
+		const auto end = _impl.data() + _impl.size();
+		return { end, end };
+	}
+	const_iterator cbegin() const {
+		return begin();
+	}
+	const_iterator cend() const {
+		return end();
+	}
+	reverse_iterator rbegin() {
+		return reverse_iterator(end());
+	}
+	reverse_iterator rend() {
+		return reverse_iterator(begin());
+	}
+	const_reverse_iterator rbegin() const {
+		return const_reverse_iterator(end());
+	}
+	const_reverse_iterator rend() const {
+		return const_reverse_iterator(begin());
+	}
+
+	reference front() {
+		return *begin();
+	}
+	const_reference front() const {
+		return *begin();
+	}
+	reference back() {
+		return *std::prev(end());
+	}
+	const_reference back() const {
+		return *std::prev(end());
+	}
+
+	iterator find(const Key &key) {
+		const auto where = lowerBound(key);
+		return (where != _impl.end() && where->alive && !(key < where->pair.first))
+			? iteratorAt(where)
+			: end();
+	}
+	const_iterator find(const Key &key) const {
+		return const_cast<ring_map*>(this)->find(key);
+	}
+	bool contains(const Key &key) const {
+		return find(key) != end();
+	}
+
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(const Key &key, Args&&... args) {
+		return tryEmplace(key, std::forward<Args>(args)...);
+	}
+	Type &operator[](const Key &key) {
+		return tryEmplace(key).first->second;
+	}
+
+	bool remove(const Key &key) {
+		const auto where = find(key);
+		if (where == end()) {
+			return false;
+		}
+		erase(where);
+		return true;
+	}
+	iterator erase(const_iterator where) {
+		const auto current = const_cast<slot*>(where._current);
+		current->alive = false;
+		current->pair.second = Type();
+		--_size;
+		while (_first != _impl.size() && !_impl[_first].alive) {
+			++_first;
+		}
+		auto result = iterator(current, _impl.data() + _impl.size());
+		return ++result;
+	}
+	iterator erase(const_iterator from, const_iterator till) {
+		while (from != till) {
+			from = erase(from);
+		}
+		return iterator(
+			const_cast<slot*>(till._current),
+			_impl.data() + _impl.size());
+	}
+
+private:
+	typename impl_t::iterator lowerBound(const Key &key) {
+		return std::lower_bound(
+			_impl.begin() + _first,
+			_impl.end(),
+			key,
+			[](const slot &a, const Key &b) { return a.pair.first < b; });
+	}
+	iterator iteratorAt(typename impl_t::iterator where) {
+		return { &*where, _impl.data() + _impl.size() };
+	}
+
+	template <typename... Args>
+	std::pair<iterator, bool> tryEmplace(const Key &key, Args&&... args) {
+		if (!_size) {
+			clear();
+		}
+		if (_impl.size() == _impl.capacity()) {
+			makeRoom();
+		}
+		if (_impl.size() == _first || _impl.back().pair.first < key) {
+			_impl.emplace_back(key, Type(std::forward<Args>(args)...));
+			++_size;
+			return { iteratorAt(_impl.end() - 1), true };
+		}
+		auto where = lowerBound(key);
+		if (!(key < where->pair.first)) {
+			if (where->alive) {
+				return { iteratorAt(where), false };
+			}
+		} else if (where != _impl.begin() + _first
+			&& !(where - 1)->alive) {
+			// Reuse the removed slot before, the keys stay sorted.
+			--where;
+		} else if (where->alive) {
+			where = _impl.emplace(where, key, Type(std::forward<Args>(args)...));
+			++_size;
+			return { iteratorAt(where), true };
+		}
+		const_cast<Key&>(where->pair.first) = key;
+		where->pair.second = Type(std::forward<Args>(args)...);
+		where->alive = true;
+		++_size;
+		return { iteratorAt(where), true };
+	}
+
+	// Drops all the removed slots and grows the vector if that didn't
+	// free at least a quarter of it, so that the compaction is amortized.
+	void makeRoom() {
+		_impl.erase(
+			std::remove_if(
+				_impl.begin(),
+				_impl.end(),
+				[](const slot &value) { return !value.alive; }),
+			_impl.end());
+		_first = 0;
+		const auto capacity = _impl.capacity();
+		if (_impl.size() + capacity / 4 >= capacity) {
+			_impl.reserve(std::max(capacity * 2, size_type(16)));
+		}
+	}
+
+	impl_t _impl;
+	size_type _first = 0;
+	size_type _size = 0;
+
+};
+
+} // namespace base
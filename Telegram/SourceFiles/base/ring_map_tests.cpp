@@ -0,0 +1,267 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "base/ring_map.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+template <typename Map>
+void check_same(const base::ring_map<int64_t, int64_t> &v, const Map &m) {
+	REQUIRE(v.size() == m.size());
+	REQUIRE(v.empty() == m.empty());
+	auto i = v.begin();
+	for (const auto &[key, value] : m) {
+		REQUIRE(i != v.end());
+		REQUIRE(i->first == key);
+		REQUIRE(i->second == value);
+		++i;
+	}
+	REQUIRE(i == v.end());
+	if (!m.empty()) {
+		REQUIRE(v.front().first == m.begin()->first);
+		REQUIRE(v.back().first == m.rbegin()->first);
+		REQUIRE(v.rbegin()->first == m.rbegin()->first);
+	}
+}
+
+} // namespace
+
+TEST_CASE("ring_maps should keep items sorted by key", "[ring_map]") {
+	base::ring_map<int, string> v;
+	v.emplace(0, "a");
+	v.emplace(5, "b");
+	v.emplace(4, "d");
+	v.emplace(2, "e");
+
+	auto checkSorted = [&] {
+		auto prev = v.begin();
+		REQUIRE(prev != v.end());
+		for (auto i = next(prev); i != v.end(); prev = i, ++i) {
+			REQUIRE(prev->first < i->first);
+		}
+	};
+	REQUIRE(v.size() == 4);
+	checkSorted();
+
+	SECTION("adding item puts it in the right position") {
+		v.emplace(3, "c");
+		REQUIRE(v.size() == 5);
+		REQUIRE(v.find(3) != v.end());
+		REQUIRE(v.find(3)->second == "c");
+		checkSorted();
+	}
+	SECTION("emplace doesn't replace the existing value") {
+		const auto result = v.emplace(4, "x");
+		REQUIRE(!result.second);
+		REQUIRE(result.first->second == "d");
+		REQUIRE(v.size() == 4);
+	}
+	SECTION("assigning by existing key replaces the value") {
+		v[4] = "x";
+		REQUIRE(v.size() == 4);
+		REQUIRE(v.find(4)->second == "x");
+	}
+	SECTION("erase skips the removed items") {
+		REQUIRE(v.remove(2));
+		REQUIRE(!v.remove(2));
+		REQUIRE(!v.contains(2));
+		REQUIRE(v.size() == 3);
+		REQUIRE(next(v.begin())->first == 4);
+		REQUIRE(prev(v.end(), 2)->first == 4);
+		checkSorted();
+	}
+	SECTION("removed slot is reused for a key in between") {
+		v.remove(4);
+		v[3] = "c";
+		REQUIRE(v.size() == 4);
+		REQUIRE(v.find(3)->second == "c");
+		REQUIRE(v.find(4) == v.end());
+		checkSorted();
+	}
+	SECTION("erasing from front and back updates bounds") {
+		v.erase(v.begin());
+		v.erase(prev(v.end()));
+		REQUIRE(v.size() == 2);
+		REQUIRE(v.front().first == 2);
+		REQUIRE(v.back().first == 4);
+		REQUIRE(v.rbegin()->first == 4);
+		v[1] = "f";
+		REQUIRE(v.front().first == 1);
+		checkSorted();
+	}
+	SECTION("range erase removes the oldest items") {
+		v.erase(v.begin(), next(v.begin(), 3));
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.front().first == 5);
+		v.erase(v.begin());
+		REQUIRE(v.empty());
+		REQUIRE(v.begin() == v.end());
+		v[1] = "a";
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.front().first == 1);
+	}
+}
+
+TEST_CASE("ring_maps release erased values", "[ring_map]") {
+	base::ring_map<int, shared_ptr<int>> v;
+	auto value = make_shared<int>(1);
+	v[1] = value;
+	v[2] = value;
+	REQUIRE(value.use_count() == 3);
+	v.remove(2);
+	REQUIRE(value.use_count() == 2);
+	v.clear();
+	REQUIRE(value.use_count() == 1);
+}
+
+TEST_CASE("ring_maps work like std::map", "[ring_map]") {
+	auto random = mt19937(0);
+	for (auto round = 0; round != 20; ++round) {
+		base::ring_map<int64_t, int64_t> v;
+		std::map<int64_t, int64_t> m;
+		auto nextKey = int64_t(0);
+		const auto keysRange = int64_t(1 + round * 10);
+		for (auto i = 0; i != 5000; ++i) {
+			const auto action = random() % 8;
+			if (action < 3) {
+				nextKey += 1 + (random() % 3);
+				v[nextKey] = m[nextKey] = i;
+			} else if (action == 3) {
+				const auto key = nextKey - int64_t(random() % keysRange);
+				v[key] = m[key] = i;
+			} else if (action == 4) {
+				const auto key = nextKey - int64_t(random() % keysRange);
+				REQUIRE(v.remove(key) == (m.erase(key) > 0));
+			} else if (action == 5 && !m.empty()) {
+				const auto count = random() % (m.size() + 1);
+				v.erase(v.begin(), next(v.begin(), count));
+				m.erase(m.begin(), next(m.begin(), count));
+			} else if (action == 6 && !m.empty()) {
+				v.erase(prev(v.end()));
+				m.erase(prev(m.end()));
+			} else {
+				const auto key = nextKey - int64_t(random() % keysRange);
+				const auto i = v.find(key);
+				const auto j = m.find(key);
+				REQUIRE((i == v.end()) == (j == m.end()));
+				if (j != m.end()) {
+					REQUIRE(i->second == j->second);
+				}
+			}
+			if (!(i % 97)) {
+				check_same(v, m);
+			}
+		}
+		check_same(v, m);
+	}
+}
+
+namespace {
+
+// Synthetic load like mtproto request bookkeeping: messages are sent with
+// growing ids, most are acked soon in random order, some are resent with
+// new ids and the acked ids are trimmed from the front to a fixed size.
+template <typename Map>
+uint64_t simulate_acks(int outstanding, int iterations) {
+	auto random = mt19937(0);
+	auto sent = Map();
+	auto acked = Map();
+	auto nextId = int64_t(0);
+	auto checksum = uint64_t(0);
+	for (auto i = 0; i != outstanding; ++i) {
+		++nextId;
+		sent[nextId] = nextId;
+	}
+	for (auto i = 0; i != iterations; ++i) {
+		++nextId;
+		sent[nextId] = nextId;
+
+		// Ack one of the older messages and the ones left too far behind.
+		const auto ackId = nextId - outstanding
+			+ int64_t(random() % (outstanding / 8 + 1));
+		auto j = sent.find(ackId);
+		if (j != sent.end()) {
+			acked[j->first] = j->second;
+			sent.erase(j);
+		}
+		while (sent.begin()->first < nextId - 2 * outstanding) {
+			acked[sent.begin()->first] = sent.begin()->second;
+			sent.erase(sent.begin());
+		}
+
+		// Resend one of the messages with a new id.
+		if (!(i % 16)) {
+			const auto resendId = nextId - int64_t(random() % outstanding);
+			auto k = sent.find(resendId);
+			if (k != sent.end()) {
+				const auto value = k->second;
+				sent.erase(k);
+				++nextId;
+				sent[nextId] = value;
+			}
+		}
+
+		while (acked.size() > 400) {
+			checksum += acked.begin()->first;
+			acked.erase(acked.begin());
+		}
+	}
+	return checksum + sent.size();
+}
+
+template <typename Map>
+double measure_acks(int outstanding, int iterations, uint64_t &checksum) {
+	const auto start = chrono::steady_clock::now();
+	checksum = simulate_acks<Map>(outstanding, iterations);
+	const auto finish = chrono::steady_clock::now();
+	return chrono::duration<double, milli>(finish - start).count();
+}
+
+} // namespace
+
+TEST_CASE("ring_maps ack processing", "[ring_map]") {
+	auto ring = uint64_t(0);
+	auto tree = uint64_t(0);
+	measure_acks<base::ring_map<int64_t, int64_t>>(100, 10000, ring);
+	measure_acks<std::map<int64_t, int64_t>>(100, 10000, tree);
+	REQUIRE(ring == tree);
+}
+
+TEST_CASE("ring_maps ack processing benchmark", "[.][ring_map][benchmark]") {
+	const auto iterations = 200000;
+	for (const auto outstanding : { 100, 1000, 5000 }) {
+		auto ring = uint64_t(0);
+		auto tree = uint64_t(0);
+		const auto ringTime = measure_acks<base::ring_map<int64_t, int64_t>>(
+			outstanding,
+			iterations,
+			ring);
+		const auto treeTime = measure_acks<std::map<int64_t, int64_t>>(
+			outstanding,
+			iterations,
+			tree);
+		REQUIRE(ring == tree);
+		WARN(to_string(outstanding)
+			+ " outstanding, "
+			+ to_string(iterations)
+			+ " messages: ring_map "
+			+ to_string(int(ringTime))
+			+ " ms, std::map "
+			+ to_string(int(treeTime))
+			+ " ms");
+	}
+}
@@ -510,7 +510,15 @@ void DocumentData::forget() {
 	thumb->forget();
 	if (sticker()) sticker()->img->forget();
 	replyPreview->forget();
-	_data.clear();
+	setData(QByteArray());
+}
+
+void DocumentData::setData(const QByteArray &data) {
+	const auto was = _data.size();
+	_data = data;
+	if (const auto delta = _data.size() - was) {
+		_session->data().documentDataSizeChanged(delta);
+	}
 }
 
 void DocumentData::automaticLoad(const HistoryItem *item) {
@@ -643,7 +651,7 @@ bool DocumentData::loaded(FilePathResolveType type) const {
 		} else {
 			auto that = const_cast<DocumentData*>(this);
 			that->_location = FileLocation(_loader->fileName());
-			that->_data = _loader->bytes();
+			that->setData(_loader->bytes());
 			if (that->sticker() && !_loader->imagePixmap().isNull()) {
 				that->sticker()->img = ImagePtr(_data, _loader->imageFormat(), _loader->imagePixmap());
 			}
@@ -1100,7 +1108,7 @@ bool DocumentData::setRemoteVersion(int32 version) {
 	}
 	_version = version;
 	_location = FileLocation();
-	_data = QByteArray();
+	setData(QByteArray());
 	status = FileReady;
 	if (loading()) {
 		destroyLoaderDelayed();
@@ -1134,7 +1142,7 @@ void DocumentData::collectLocalData(DocumentData *local) {
 	if (local == this) return;
 
 	if (!local->_data.isEmpty()) {
-		_data = local->_data;
+		setData(local->_data);
 		if (isVoiceMessage()) {
 			if (!Local::copyAudio(local->mediaKey(), mediaKey())) {
 				Local::writeAudio(mediaKey(), _data);
@@ -141,9 +141,7 @@ public:
 	int32 duration() const;
 	bool isImage() const;
 	void recountIsImage();
-	void setData(const QByteArray &data) {
-		_data = data;
-	}
+	void setData(const QByteArray &data);
 
 	bool setRemoteVersion(int32 version); // Returns true if version has changed.
 	void setRemoteLocation(int32 dc, uint64 access);
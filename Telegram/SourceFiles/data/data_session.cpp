@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "observer_peer.h"
 #include "auth_session.h"
 #include "apiwrap.h"
+#include "mainwidget.h"
 #include "history/history.h"
 #include "history/history_item_components.h"
 #include "history/history_media.h"
@@ -28,6 +29,10 @@ namespace {
 
 using ViewElement = HistoryView::Element;
 
+// Sticker, animation and voice bytes are not counted by the images cache,
+// all media is forgotten when they grow over this size.
+constexpr auto kMemoryForDocumentsData = 64 * 1024 * 1024;
+
 // s: box 100x100
 // m: box 320x320
 // x: box 800x800
@@ -489,6 +494,45 @@ void Session::clearPinnedDialogs() {
 	}
 }
 
+void Session::startChatListBatch() {
+	++_chatListBatchLevel;
+}
+
+void Session::finishChatListBatch() {
+	Expects(_chatListBatchLevel > 0);
+
+	if (--_chatListBatchLevel > 0) {
+		return;
+	}
+	const auto main = App::main();
+	if (!main) {
+		_chatListBatchKeys.clear();
+		return;
+	}
+	auto keys = std::vector<Dialogs::Key>();
+	keys.reserve(_chatListBatchKeys.size());
+	for (const auto &key : base::take(_chatListBatchKeys)) {
+		const auto entry = key.entry();
+		if (!entry->needUpdateInChatList()) {
+			continue;
+		} else if (entry->sortKeyInChatList()) {
+			keys.push_back(key);
+		} else {
+			// Same as Entry::setChatListExistence() without a sort key.
+			main->removeDialog(key);
+		}
+	}
+	if (!keys.empty()) {
+		main->createDialogs(keys);
+	}
+}
+
+void Session::deferChatListUpdate(const Dialogs::Key &key) {
+	Expects(chatListBatchActive());
+
+	_chatListBatchKeys.emplace(key);
+}
+
 void Session::reorderTwoPinnedDialogs(
 		const Dialogs::Key &key1,
 		const Dialogs::Key &key2) {
@@ -1584,6 +1628,22 @@ void Session::forgetMedia() {
 	}
 }
 
+void Session::documentDataSizeChanged(int delta) {
+	_documentsDataSize += delta;
+	if (_documentsDataSize > kMemoryForDocumentsData
+		&& !_forgetMediaScheduled) {
+		// DocumentData::loaded() reads the data right after setting it.
+		_forgetMediaScheduled = true;
+		crl::on_main(_session, [=] {
+			_forgetMediaScheduled = false;
+			if (_documentsDataSize > kMemoryForDocumentsData) {
+				App::forgetMedia();
+				forgetMedia();
+			}
+		});
+	}
+}
+
 void Session::setMimeForwardIds(MessageIdsList &&list) {
 	_mimeForwardIds = std::move(list);
 }
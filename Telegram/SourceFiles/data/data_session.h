@@ -203,6 +203,15 @@ public:
 		const Dialogs::Key &key1,
 		const Dialogs::Key &key2);
 
+	// While a chat list batch is active the chats list positions are
+	// updated once for all the changed entries when the batch finishes.
+	void startChatListBatch();
+	void finishChatListBatch();
+	bool chatListBatchActive() const {
+		return (_chatListBatchLevel > 0);
+	}
+	void deferChatListUpdate(const Dialogs::Key &key);
+
 	void photoLoadSettingsChanged();
 	void voiceLoadSettingsChanged();
 	void animationLoadSettingsChanged();
@@ -359,6 +368,7 @@ public:
 	rpl::producer<FeedId> defaultFeedIdValue() const;
 
 	void forgetMedia();
+	void documentDataSizeChanged(int delta);
 
 	void setMimeForwardIds(MessageIdsList &&list);
 	MessageIdsList takeMimeForwardIds();
@@ -535,7 +545,12 @@ private:
 	base::flat_set<not_null<WebPageData*>> _webpagesUpdated;
 	base::flat_set<not_null<GameData*>> _gamesUpdated;
 
+	int64 _documentsDataSize = 0;
+	bool _forgetMediaScheduled = false;
+
 	std::deque<Dialogs::Key> _pinnedDialogs;
+	int _chatListBatchLevel = 0;
+	base::flat_set<Dialogs::Key> _chatListBatchKeys;
 	base::flat_map<FeedId, std::unique_ptr<Feed>> _feeds;
 	rpl::variable<FeedId> _defaultFeedId = FeedId();
 	Groups _groups;
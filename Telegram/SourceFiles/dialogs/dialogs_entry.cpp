@@ -9,6 +9,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "dialogs/dialogs_key.h"
 #include "dialogs/dialogs_indexed_list.h"
+#include "auth_session.h"
+#include "data/data_session.h"
 #include "mainwidget.h"
 #include "styles/style_dialogs.h"
 #include "history/history_item.h"
@@ -57,7 +59,12 @@ void Entry::updateChatListSortPosition() {
 	_sortKeyInChatList = isPinnedDialog()
 		? PinnedDialogPos(_pinnedIndex)
 		: DialogPosFromDate(adjustChatListDate());
-	if (needUpdateInChatList()) {
+	if (!needUpdateInChatList()) {
+		return;
+	}
+	if (AuthSession::Exists() && Auth().data().chatListBatchActive()) {
+		Auth().data().deferChatListUpdate(_key);
+	} else {
 		setChatListExistence(true);
 	}
 }
@@ -135,6 +142,16 @@ not_null<Row*> Entry::addToChatList(
 	return mainChatListLink(list);
 }
 
+not_null<Row*> Entry::appendToChatList(
+		Mode list,
+		not_null<IndexedList*> indexed) {
+	if (!inChatList(list)) {
+		chatListLinks(list) = indexed->append(_key);
+		changedInChatListHook(list, true);
+	}
+	return mainChatListLink(list);
+}
+
 void Entry::removeFromChatList(
 		Dialogs::Mode list,
 		not_null<Dialogs::IndexedList*> indexed) {
@@ -44,7 +44,11 @@ public:
 		return !chatListLinks(list).empty();
 	}
 	int posInChatList(Mode list) const;
+	const RowsByLetter &chatListLinks(Mode list) const;
 	not_null<Row*> addToChatList(Mode list, not_null<IndexedList*> indexed);
+	not_null<Row*> appendToChatList(
+		Mode list,
+		not_null<IndexedList*> indexed);
 	void removeFromChatList(Mode list, not_null<IndexedList*> indexed);
 	void removeChatListEntryByLetter(Mode list, QChar letter);
 	void addChatListEntryByLetter(
@@ -104,7 +108,6 @@ private:
 
 	void setChatListExistence(bool exists);
 	RowsByLetter &chatListLinks(Mode list);
-	const RowsByLetter &chatListLinks(Mode list) const;
 	Row *mainChatListLink(Mode list) const;
 
 	Dialogs::Key _key;
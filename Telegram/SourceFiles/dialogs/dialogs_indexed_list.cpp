@@ -20,9 +20,15 @@ IndexedList::IndexedList(SortMode sortMode)
 }
 
 RowsByLetter IndexedList::addToEnd(Key key) {
+	auto result = append(key);
+	adjustByPos(result);
+	return result;
+}
+
+RowsByLetter IndexedList::append(Key key) {
 	RowsByLetter result;
 	if (!_list.contains(key)) {
-		result.emplace(0, _list.addToEnd(key));
+		result.emplace(0, _list.append(key));
 		for (auto ch : key.entry()->chatsListFirstLetters()) {
 			auto j = _index.find(ch);
 			if (j == _index.cend()) {
@@ -30,8 +36,9 @@ RowsByLetter IndexedList::addToEnd(Key key) {
 					ch,
 					std::make_unique<List>(_sortMode)).first;
 			}
-			result.emplace(ch, j->second->addToEnd(key));
+			result.emplace(ch, j->second->append(key));
 		}
+		indexWords(key);
 	}
 	return result;
 }
@@ -51,6 +58,7 @@ Row *IndexedList::addByName(Key key) {
 		}
 		j->second->addByName(key);
 	}
+	indexWords(key);
 	return result;
 }
 
@@ -66,6 +74,23 @@ void IndexedList::adjustByPos(const RowsByLetter &links) {
 	}
 }
 
+void IndexedList::adjustByPos(
+		const std::vector<not_null<const RowsByLetter*>> &links) {
+	auto rows = base::flat_map<QChar, std::vector<not_null<Row*>>>();
+	for (const auto entryLinks : links) {
+		for (const auto [ch, row] : *entryLinks) {
+			rows[ch].push_back(row);
+		}
+	}
+	for (const auto &[ch, list] : rows) {
+		if (ch == QChar(0)) {
+			_list.adjustByPos(list);
+		} else if (const auto it = _index.find(ch); it != _index.cend()) {
+			it->second->adjustByPos(list);
+		}
+	}
+}
+
 void IndexedList::moveToTop(Key key) {
 	if (_list.moveToTop(key)) {
 		for (auto ch : key.entry()->chatsListFirstLetters()) {
@@ -121,6 +146,9 @@ void IndexedList::adjustByName(
 	const auto mainRow = _list.adjustByName(key);
 	if (!mainRow) return;
 
+	unindexWords(key);
+	indexWords(key);
+
 	auto toRemove = oldLetters;
 	auto toAdd = base::flat_set<QChar>();
 	for (auto ch : key.entry()->chatsListFirstLetters()) {
@@ -160,6 +188,9 @@ void IndexedList::adjustNames(
 	auto mainRow = _list.getRow(key);
 	if (!mainRow) return;
 
+	unindexWords(key);
+	indexWords(key);
+
 	auto toRemove = oldLetters;
 	auto toAdd = base::flat_set<QChar>();
 	for (auto ch : key.entry()->chatsListFirstLetters()) {
@@ -185,7 +216,17 @@ void IndexedList::adjustNames(
 				ch,
 				std::make_unique<List>(_sortMode)).first;
 		}
-		auto row = j->second->addToEnd(key);
+		// While a chats list batch is active the letter lists may hold
+		// rows that are not at their places yet, the new row is placed
+		// together with them when the batch finishes.
+		const auto deferred = (_sortMode == SortMode::Date)
+			&& Auth().data().chatListBatchActive();
+		auto row = deferred
+			? j->second->append(key)
+			: j->second->addToEnd(key);
+		if (deferred) {
+			Auth().data().deferChatListUpdate(key);
+		}
 		if (_sortMode == SortMode::Date) {
 			history->addChatListEntryByLetter(list, ch, row);
 		}
@@ -199,11 +240,143 @@ void IndexedList::del(Key key, Row *replacedBy) {
 				it->second->del(key, replacedBy);
 			}
 		}
+		unindexWords(key);
 	}
 }
 
 void IndexedList::clear() {
 	_index.clear();
+	_wordsIndex.clear();
+	_indexedWords.clear();
+	_lastFilterWords.clear();
+	_lastFilterKeys.clear();
+}
+
+std::vector<not_null<Row*>> IndexedList::filtered(
+		const QStringList &words) {
+	if (words.isEmpty() || isEmpty()) {
+		return {};
+	}
+	const List *list = nullptr;
+	for (const auto &word : words) {
+		const auto found = filtered(word[0]);
+		if (found->isEmpty()) {
+			return {};
+		}
+		if (!list || list->size() > found->size()) {
+			list = found;
+		}
+	}
+
+	// Everything that matches the extended words matched the old ones.
+	const auto extended = [&](const QString &was) {
+		return std::any_of(words.begin(), words.end(), [&](
+				const QString &word) {
+			return word.startsWith(was);
+		});
+	};
+	auto keys = std::vector<Key>();
+	if (!_lastFilterWords.isEmpty()
+		&& std::all_of(
+			_lastFilterWords.begin(),
+			_lastFilterWords.end(),
+			extended)) {
+		keys = base::take(_lastFilterKeys);
+	} else {
+		const auto longest = std::max_element(
+			words.begin(),
+			words.end(),
+			[](const QString &a, const QString &b) {
+				return a.size() < b.size();
+			});
+		if (auto found = keysByWordPrefix(*longest, list->size())) {
+			keys = std::move(*found);
+		} else {
+			keys.reserve(list->size());
+			for (const auto row : *list) {
+				keys.push_back(row->key());
+			}
+		}
+	}
+	keys.erase(ranges::remove_if(keys, [&](Key key) {
+		return !matchesWords(key, words);
+	}), keys.end());
+	_lastFilterWords = words;
+	_lastFilterKeys = keys;
+
+	auto result = std::vector<not_null<Row*>>();
+	result.reserve(keys.size());
+	for (const auto key : keys) {
+		if (const auto row = list->getRow(key)) {
+			result.push_back(row);
+		}
+	}
+	ranges::sort(result, std::less<>(), [](not_null<Row*> row) {
+		return row->pos();
+	});
+	return result;
+}
+
+void IndexedList::indexWords(Key key) {
+	const auto &words = key.entry()->chatsListNameWords();
+	for (const auto &word : words) {
+		_wordsIndex[word].insert(key);
+	}
+	_indexedWords.emplace(key, words);
+	_lastFilterWords.clear();
+	_lastFilterKeys.clear();
+}
+
+void IndexedList::unindexWords(Key key) {
+	const auto i = _indexedWords.find(key);
+	if (i == _indexedWords.end()) {
+		return;
+	}
+	for (const auto &word : i->second) {
+		const auto j = _wordsIndex.find(word);
+		if (j != _wordsIndex.end()) {
+			j->second.remove(key);
+			if (j->second.empty()) {
+				_wordsIndex.erase(j);
+			}
+		}
+	}
+	_indexedWords.erase(i);
+	_lastFilterWords.clear();
+	_lastFilterKeys.clear();
+}
+
+base::optional<std::vector<Key>> IndexedList::keysByWordPrefix(
+		const QString &prefix,
+		int limit) const {
+	auto result = std::vector<Key>();
+	for (auto i = _wordsIndex.lower_bound(prefix)
+		; i != _wordsIndex.end() && i->first.startsWith(prefix)
+		; ++i) {
+		result.insert(result.end(), i->second.begin(), i->second.end());
+		if (int(result.size()) > limit) {
+			return base::none;
+		}
+	}
+	ranges::sort(result);
+	result.erase(ranges::unique(result), result.end());
+	return result;
+}
+
+bool IndexedList::matchesWords(Key key, const QStringList &words) const {
+	const auto &nameWords = key.entry()->chatsListNameWords();
+	for (const auto &word : words) {
+		const auto found = std::any_of(
+			nameWords.begin(),
+			nameWords.end(),
+			[&](const QString &nameWord) {
+				return nameWord.startsWith(word);
+			});
+		if (!found) {
+			return false;
+		}
+	}
+	return true;
 }
 
 IndexedList::~IndexedList() {
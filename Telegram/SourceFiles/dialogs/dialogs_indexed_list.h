@@ -19,8 +19,10 @@ public:
 	IndexedList(SortMode sortMode);
 
 	RowsByLetter addToEnd(Key key);
+	RowsByLetter append(Key key);
 	Row *addByName(Key key);
 	void adjustByPos(const RowsByLetter &links);
+	void adjustByPos(const std::vector<not_null<const RowsByLetter*>> &links);
 	void moveToTop(Key key);
 
 	// row must belong to this indexed list all().
@@ -50,6 +52,10 @@ public:
 		return &_empty;
 	}
 
+	// Rows having a name word starting with each of the 'words', in the
+	// order of the smallest filtered(QChar) list for their first letters.
+	std::vector<not_null<Row*>> filtered(const QStringList &words);
+
 	~IndexedList();
 
 	// Part of List interface is duplicated here for all() list.
@@ -83,10 +89,26 @@ private:
 		not_null<History*> history,
 		const base::flat_set<QChar> &oldChars);
 
+	void indexWords(Key key);
+	void unindexWords(Key key);
+	base::optional<std::vector<Key>> keysByWordPrefix(
+		const QString &prefix,
+		int limit) const;
+	bool matchesWords(Key key, const QStringList &words) const;
+
 	SortMode _sortMode;
 	List _list, _empty;
 	base::flat_map<QChar, std::unique_ptr<List>> _index;
 
+	// Name words prefix index, updated together with the letters index.
+	std::map<QString, base::flat_set<Key>> _wordsIndex;
+	std::map<Key, base::flat_set<QString>> _indexedWords;
+
+	// Result of the last filtered(words) call, it is narrowed down when
+	// the words are extended and dropped when the index is changed.
+	QStringList _lastFilterWords;
+	std::vector<Key> _lastFilterKeys;
+
 };
 
 } // namespace Dialogs
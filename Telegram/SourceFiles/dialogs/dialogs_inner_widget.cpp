@@ -26,6 +26,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mainwindow.h"
 #include "mainwidget.h"
 #include "storage/localstorage.h"
+#include "storage/storage_facade.h"
+#include "storage/storage_search_index.h"
 #include "apiwrap.h"
 #include "window/themes/window_theme.h"
 #include "observer_peer.h"
@@ -1173,14 +1175,14 @@ void DialogsInner::onDialogRowReplaced(
 	}
 }
 
-void DialogsInner::createDialog(Dialogs::Key key) {
+bool DialogsInner::canCreateDialog(Dialogs::Key key) const {
 	if (const auto history = key.history()) {
 		if (history->peer->loadedStatus
 			!= PeerData::LoadedStatus::FullLoaded) {
 			LOG(("API Error: "
 				"DialogsInner::createDialog() called for a non loaded peer!"
 				));
-			return;
+			return false;
 		}
 		
 		if (cDialogsType()) {
@@ -1196,9 +1198,21 @@ void DialogsInner::createDialog(Dialogs::Key key) {
 				bit = 0x4;
 			
 			if (~cDialogsType() & bit)
-				return;
+				return false;
 		}
 	}
+	return true;
+}
+
+void DialogsInner::createDialog(Dialogs::Key key) {
+	if (!canCreateDialog(key)) {
+		return;
+	} else if (Auth().data().chatListBatchActive()) {
+		// The batched rows are not at their places yet, so this one is
+		// placed together with them in createDialogs().
+		Auth().data().deferChatListUpdate(key);
+		return;
+	}
 
 	const auto entry = key.entry();
 	auto creating = !entry->inChatList(Dialogs::Mode::All);
@@ -1252,6 +1266,74 @@ void DialogsInner::createDialog(Dialogs::Key key) {
 	}
 }
 
+std::vector<Dialogs::Key> DialogsInner::createDialogs(
+		const std::vector<Dialogs::Key> &keys) {
+	auto result = std::vector<Dialogs::Key>();
+	auto all = std::vector<not_null<const Dialogs::RowsByLetter*>>();
+	auto important = std::vector<not_null<const Dialogs::RowsByLetter*>>();
+	all.reserve(keys.size());
+
+	// Keep the first visible row that is not moved in its place on the
+	// screen, like dialogMoved() does for the rows moved one by one.
+	const auto anchor = [&]() -> Dialogs::Row* {
+		if (_state != State::Default || _dragging || _visibleTop <= 0) {
+			return nullptr;
+		}
+		const auto changed = base::flat_set<Dialogs::Key>(
+			keys.begin(),
+			keys.end());
+		const auto rows = shownDialogs();
+		const auto from = rows->cfind(
+			_visibleTop - dialogsOffset(),
+			st::dialogsRowHeight);
+		for (auto i = from; i != rows->cend(); ++i) {
+			if (!changed.contains((*i)->key())) {
+				return *i;
+			}
+		}
+		return nullptr;
+	}();
+	const auto anchorPosition = anchor ? anchor->pos() : 0;
+
+	for (const auto key : keys) {
+		if (!canCreateDialog(key)) {
+			continue;
+		}
+		const auto entry = key.entry();
+		if (!entry->inChatList(Dialogs::Mode::All)) {
+			const auto mainRow = entry->appendToChatList(
+				Dialogs::Mode::All,
+				_dialogs.get());
+			_contactsNoDialogs->del(key, mainRow);
+			result.push_back(key);
+		}
+		all.push_back(&entry->chatListLinks(Dialogs::Mode::All));
+		if (_dialogsImportant && entry->toImportant()) {
+			entry->appendToChatList(
+				Dialogs::Mode::Important,
+				_dialogsImportant.get());
+			important.push_back(
+				&entry->chatListLinks(Dialogs::Mode::Important));
+		}
+	}
+	if (all.empty()) {
+		return result;
+	}
+
+	// The new rows were appended unsorted, they are moved to their places
+	// together with the changed ones and the list is repainted once.
+	_dialogs->adjustByPos(all);
+	if (!important.empty()) {
+		_dialogsImportant->adjustByPos(important);
+	}
+	refresh();
+	if (anchor && anchor->pos() != anchorPosition) {
+		emit dialogsMoved(
+			(anchor->pos() - anchorPosition) * st::dialogsRowHeight);
+	}
+	return result;
+}
+
 void DialogsInner::removeDialog(Dialogs::Key key) {
 	if (key == _menuKey && _menu) {
 		InvokeQueued(this, [this] { _menu = nullptr; });
@@ -1592,80 +1674,19 @@ void DialogsInner::onFilterUpdate(QString newFilter, bool force) {
 		if (_filter.isEmpty() && !_searchFromUser) {
 			clearFilter();
 		} else {
-			QStringList::const_iterator fb = words.cbegin(), fe = words.cend(), fi;
-
 			_state = State::Filtered;
 			_waitingForSearch = true;
 			_filterResults.clear();
 			_filterResultsGlobal.clear();
 			if (!_searchInChat && !words.isEmpty()) {
-				const Dialogs::List *toFilter = nullptr;
-				if (!_dialogs->isEmpty()) {
-					for (fi = fb; fi != fe; ++fi) {
-						auto found = _dialogs->filtered(fi->at(0));
-						if (found->isEmpty()) {
-							toFilter = nullptr;
-							break;
-						}
-						if (!toFilter || toFilter->size() > found->size()) {
-							toFilter = found;
-						}
-					}
-				}
-				const Dialogs::List *toFilterContacts = nullptr;
-				if (!_contactsNoDialogs->isEmpty()) {
-					for (fi = fb; fi != fe; ++fi) {
-						auto found = _contactsNoDialogs->filtered(fi->at(0));
-						if (found->isEmpty()) {
-							toFilterContacts = nullptr;
-							break;
-						}
-						if (!toFilterContacts || toFilterContacts->size() > found->size()) {
-							toFilterContacts = found;
-						}
-					}
-				}
-				_filterResults.reserve((toFilter ? toFilter->size() : 0)
-					+ (toFilterContacts ? toFilterContacts->size() : 0));
-				if (toFilter) {
-					for (const auto row : *toFilter) {
-						const auto &nameWords = row->entry()->chatsListNameWords();
-						auto nb = nameWords.cbegin(), ne = nameWords.cend(), ni = nb;
-						for (fi = fb; fi != fe; ++fi) {
-							auto filterWord = *fi;
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(filterWord)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
-							_filterResults.push_back(row);
-						}
-					}
+				const auto dialogs = _dialogs->filtered(words);
+				const auto contacts = _contactsNoDialogs->filtered(words);
+				_filterResults.reserve(dialogs.size() + contacts.size());
+				for (const auto row : dialogs) {
+					_filterResults.push_back(row);
 				}
-				if (toFilterContacts) {
-					for (const auto row : *toFilterContacts) {
-						const auto &nameWords = row->entry()->chatsListNameWords();
-						auto nb = nameWords.cbegin(), ne = nameWords.cend(), ni = nb;
-						for (fi = fb; fi != fe; ++fi) {
-							auto filterWord = *fi;
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(filterWord)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
-							_filterResults.push_back(row);
-						}
-					}
+				for (const auto row : contacts) {
+					_filterResults.push_back(row);
 				}
 			}
 			refresh(true);
@@ -1713,6 +1734,8 @@ DialogsInner::~DialogsInner() {
 void DialogsInner::clearSearchResults(bool clearPeerSearchResults) {
 	if (clearPeerSearchResults) _peerSearchResults.clear();
 	_searchResults.clear();
+	_localSearchResults.clear();
+	_searchServerComplete = false;
 	_searchedCount = _searchedMigratedCount = 0;
 	_lastSearchDate = 0;
 	_lastSearchPeer = 0;
@@ -1843,6 +1866,9 @@ bool DialogsInner::searchReceived(
 		const QVector<MTPMessage> &messages,
 		DialogsSearchRequestType type,
 		int fullCount) {
+	auto local = (type == DialogsSearchPeerFromStart)
+		? base::take(_localSearchResults)
+		: std::vector<FullMsgId>();
 	if (type == DialogsSearchFromStart || type == DialogsSearchPeerFromStart) {
 		clearSearchResults(false);
 	}
@@ -1883,6 +1909,11 @@ bool DialogsInner::searchReceived(
 	} else {
 		_searchedCount = fullCount;
 	}
+	if (!local.empty()) {
+		mergeLocalSearchResults(
+			std::move(local),
+			messages.size() >= fullCount);
+	}
 	if (_waitingForSearch
 		&& (!_searchResults.empty()
 			|| !_searchInMigrated
@@ -1894,6 +1925,87 @@ bool DialogsInner::searchReceived(
 	return lastDateFound != 0;
 }
 
+void DialogsInner::localSearchReceived(
+		not_null<PeerData*> peer,
+		const std::vector<Storage::SearchIndexMessage> &messages) {
+	clearSearchResults(false);
+	const auto peerId = peer->id;
+	const auto channel = peer->asChannel();
+	const auto channelId = peerToChannel(peerId);
+	_localSearchResults.reserve(messages.size());
+	for (const auto &message : messages) {
+		const auto fullId = FullMsgId(channelId, message.messageId);
+		_localSearchResults.push_back(fullId);
+		if (const auto item = App::histItemById(fullId)) {
+			addLocalSearchResult(item);
+		} else {
+			// Not loaded yet, for example after a restart.
+			Auth().api().requestMessageData(
+				channel,
+				message.messageId,
+				base::lambda_guarded(this, [=](ChannelData*, MsgId) {
+					localSearchResultLoaded(peerId, fullId);
+				}));
+		}
+	}
+	if (_waitingForSearch && !_searchResults.empty()) {
+		_waitingForSearch = false;
+	}
+	refresh();
+}
+
+void DialogsInner::localSearchResultLoaded(PeerId peerId, FullMsgId fullId) {
+	if (ranges::find(_localSearchResults, fullId)
+		== _localSearchResults.end()) {
+		return;
+	} else if (const auto item = App::histItemById(fullId)) {
+		if (addLocalSearchResult(item)) {
+			_waitingForSearch = false;
+			refresh();
+		}
+	} else {
+		// The message was deleted while we were not tracking it.
+		Auth().storage().remove(Storage::SearchIndexRemoveOne(
+			peerId,
+			fullId.msg));
+	}
+}
+
+void DialogsInner::mergeLocalSearchResults(
+		std::vector<FullMsgId> &&local,
+		bool serverComplete) {
+	_localSearchResults = std::move(local);
+	_searchServerComplete = serverComplete;
+	for (const auto &fullId : _localSearchResults) {
+		if (const auto item = App::histItemById(fullId)) {
+			addLocalSearchResult(item);
+		}
+	}
+}
+
+// Server results are sorted from the newest and paginated by the id of
+// the oldest one, so local results older than that are added only if
+// the server has already returned everything it found.
+bool DialogsInner::addLocalSearchResult(not_null<HistoryItem*> item) {
+	if (!_searchServerComplete && item->id < _lastSearchId) {
+		return false;
+	}
+	const auto has = [&](const std::unique_ptr<Dialogs::FakeRow> &row) {
+		return (row->item() == item);
+	};
+	if (ranges::find_if(_searchResults, has) != _searchResults.end()) {
+		return false;
+	}
+	const auto older = [&](const std::unique_ptr<Dialogs::FakeRow> &row) {
+		return (row->item()->id < item->id);
+	};
+	_searchResults.insert(
+		ranges::find_if(_searchResults, older),
+		std::make_unique<Dialogs::FakeRow>(_searchInChat, item));
+	++_searchedCount;
+	return true;
+}
+
 void DialogsInner::peerSearchReceived(
 		const QString &query,
 		const QVector<MTPPeer> &my,
@@ -1920,13 +2032,7 @@ void DialogsInner::peerSearchReceived(
 			if (alreadyAdded(peer)) {
 				continue;
 			}
-			const auto prev = nullptr, next = nullptr;
-			const auto position = 0;
-			auto row = std::make_unique<Dialogs::Row>(
-				App::history(peer),
-				prev,
-				next,
-				position);
+			auto row = std::make_unique<Dialogs::Row>(App::history(peer));
 			const auto [i, ok] = _filterResultsGlobal.emplace(
 				peer,
 				std::move(row));
@@ -1998,6 +2104,9 @@ void DialogsInner::notify_historyMuteUpdated(History *history) {
 			return;
 		}
 		refresh();
+	} else if (Auth().data().chatListBatchActive()) {
+		// Added to the important list with the other batched rows.
+		Auth().data().deferChatListUpdate(history);
 	} else {
 		bool creating = !history->inChatList(Dialogs::Mode::Important);
 		if (creating) {
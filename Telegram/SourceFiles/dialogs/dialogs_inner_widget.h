@@ -28,6 +28,10 @@ namespace Window {
 class Controller;
 } // namespace Window
 
+namespace Storage {
+struct SearchIndexMessage;
+} // namespace Storage
+
 class DialogsInner : public Ui::SplittedWidget, public RPCSender, private base::Subscriber {
 	Q_OBJECT
 
@@ -41,6 +45,9 @@ public:
 		const QVector<MTPMessage> &result,
 		DialogsSearchRequestType type,
 		int fullCount);
+	void localSearchReceived(
+		not_null<PeerData*> peer,
+		const std::vector<Storage::SearchIndexMessage> &messages);
 	void peerSearchReceived(
 		const QString &query,
 		const QVector<MTPPeer> &my,
@@ -53,6 +60,10 @@ public:
 	void selectSkipPage(int32 pixels, int32 direction);
 
 	void createDialog(Dialogs::Key key);
+
+	// Adds and moves all the chats at once, returns the added ones.
+	std::vector<Dialogs::Key> createDialogs(
+		const std::vector<Dialogs::Key> &keys);
 	void removeDialog(Dialogs::Key key);
 	void repaintDialogRow(Dialogs::Mode list, not_null<Dialogs::Row*> row);
 	void repaintDialogRow(not_null<History*> history, MsgId messageId);
@@ -120,6 +131,7 @@ signals:
 	void draggingScrollDelta(int delta);
 	void mustScrollTo(int scrollToTop, int scrollToBottom);
 	void dialogMoved(int movedFrom, int movedTo);
+	void dialogsMoved(int scrollDelta);
 	void searchMessages();
 	void searchResultChosen();
 	void cancelSearchInChat();
@@ -158,6 +170,7 @@ private:
 	bool chooseHashtag();
 	ChosenRow computeChosenRow() const;
 
+	bool canCreateDialog(Dialogs::Key key) const;
 	void userIsContactUpdated(not_null<UserData*> user);
 	void mousePressReleased(Qt::MouseButton button);
 	void clearIrrelevantState();
@@ -268,6 +281,11 @@ private:
 
 	void clearSelection();
 	void clearSearchResults(bool clearPeerSearchResults = true);
+	void mergeLocalSearchResults(
+		std::vector<FullMsgId> &&local,
+		bool serverComplete);
+	bool addLocalSearchResult(not_null<HistoryItem*> item);
+	void localSearchResultLoaded(PeerId peerId, FullMsgId fullId);
 	void updateSelectedRow(Dialogs::Key key = Dialogs::Key());
 
 	Dialogs::IndexedList *shownDialogs() const;
@@ -340,6 +358,8 @@ private:
 	int _peerSearchPressed = -1;
 
 	SearchResults _searchResults;
+	std::vector<FullMsgId> _localSearchResults;
+	bool _searchServerComplete = false;
 	int _searchedCount = 0;
 	int _searchedMigratedCount = 0;
 	int _searchedSelected = -1;
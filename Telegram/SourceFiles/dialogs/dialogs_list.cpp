@@ -16,94 +16,48 @@ namespace Dialogs {
 
 List::List(SortMode sortMode)
 : _last(std::make_unique<Row>(nullptr))
-, _begin(_last.get())
-, _end(_last.get())
-, _sortMode(sortMode)
-, _current(_last.get()) {
+, _tree(_last.get())
+, _sortMode(sortMode) {
 }
 
-void List::adjustCurrent(int32 y, int32 h) const {
-	if (isEmpty()) return;
-
-	int32 pos = (y > 0) ? (y / h) : 0;
-	while (_current->_pos > pos && _current != _begin) {
-		_current = _current->_prev;
-	}
-	while (_current->_pos + 1 <= pos && _current->_next != _end) {
-		_current = _current->_next;
-	}
+// Moves the row up past the rows that should be after it or down past
+// the rows that should be before it, assuming the others are sorted.
+// 'compare' returns < 0 for a row that should be before this one.
+template <typename Compare>
+void List::moveSorted(not_null<Row*> row, Compare compare) {
+	const auto pos = row->pos();
+	_tree.detach(row);
+	const auto before = _tree.countWhile([&](not_null<Row*> other) {
+		return compare(other) < 0;
+	});
+	const auto notAfter = _tree.countWhile([&](not_null<Row*> other) {
+		return compare(other) <= 0;
+	});
+	_tree.attach(row, _tree.at(snap(pos, before, notAfter)));
 }
 
 Row *List::addToEnd(Key key) {
-	const auto result = new Row(key, _end->_prev, _end, _end->_pos);
-	_end->_pos++;
-	if (_begin == _end) {
-		_begin = _current = result;
-	} else {
-		_end->_prev->_next = result;
-	}
-	_rowByKey.emplace(key, result);
-	++_count;
-	_end->_prev = result;
+	const auto result = append(key);
 	if (_sortMode == SortMode::Date) {
 		adjustByPos(result);
 	}
 	return result;
 }
 
-bool List::insertBefore(Row *row, Row *before) {
-	if (row == before) {
-		return false;
-	}
-
-	if (_current == row) {
-		_current = row->_prev;
-	}
-
-	const auto updateTill = row->_prev;
-	remove(row);
-
-	// insert row
-	row->_next = before; // update row
-	row->_prev = before->_prev;
-	row->_next->_prev = row; // update row->next
-	if (row->_prev) { // update row->prev
-		row->_prev->_next = row;
-	} else {
-		_begin = row;
-	}
-
-	// update pos
-	for (auto n = row; n != updateTill; n = n->_next) {
-		n->_next->_pos++;
-		row->_pos--;
-	}
-	return true;
+Row *List::append(Key key) {
+	const auto result = new Row(key);
+	_tree.attach(result, _tree.last());
+	_rowByKey.emplace(key, result);
+	++_count;
+	return result;
 }
 
-bool List::insertAfter(Row *row, Row *after) {
-	if (row == after) {
+bool List::insertBefore(not_null<Row*> row, not_null<Row*> before) {
+	if (row == before) {
 		return false;
 	}
-
-	if (_current == row) {
-		_current = row->_next;
-	}
-
-	const auto updateFrom = row->_next;
-	remove(row);
-
-	// insert row
-	row->_prev = after; // update row
-	row->_next = after->_next;
-	row->_prev->_next = row; // update row->prev
-	row->_next->_prev = row; // update row->next
-
-	// update pos
-	for (auto n = updateFrom; n != row; n = n->_next) {
-		n->_pos--;
-		row->_pos++;
-	}
+	_tree.detach(row);
+	_tree.attach(row, before);
 	return true;
 }
 
@@ -115,18 +69,11 @@ Row *List::adjustByName(Key key) {
 
 	const auto row = i->second;
 	const auto name = key.entry()->chatsListName();
-	auto change = row;
-	while (change->_prev
-		&& change->_prev->entry()->chatsListName().compare(name, Qt::CaseInsensitive) < 0) {
-		change = change->_prev;
-	}
-	if (!insertBefore(row, change)) {
-		while (change->_next != _end
-			&& change->_next->entry()->chatsListName().compare(name, Qt::CaseInsensitive) < 0) {
-			change = change->_next;
-		}
-		insertAfter(row, change);
-	}
+	moveSorted(row, [&](not_null<Row*> other) {
+		return other->entry()->chatsListName().compare(
+			name,
+			Qt::CaseInsensitive);
+	});
 	return row;
 }
 
@@ -136,42 +83,47 @@ Row *List::addByName(Key key) {
 	}
 
 	const auto row = addToEnd(key);
-	auto change = row;
 	const auto name = key.entry()->chatsListName();
-	while (change->_prev
-		&& change->_prev->entry()->chatsListName().compare(name, Qt::CaseInsensitive) > 0) {
-		change = change->_prev;
-	}
-	if (!insertBefore(row, change)) {
-		while (change->_next != _end
-			&& change->_next->entry()->chatsListName().compare(name, Qt::CaseInsensitive) < 0) {
-			change = change->_next;
-		}
-		insertAfter(row, change);
-	}
+	moveSorted(row, [&](not_null<Row*> other) {
+		return other->entry()->chatsListName().compare(
+			name,
+			Qt::CaseInsensitive);
+	});
 	return row;
 }
 
 void List::adjustByPos(Row *row) {
-	if (_sortMode != SortMode::Date || !_begin) return;
-
-	Row *change = row;
-	if (change != _begin && _begin->sortKey() < row->sortKey()) {
-		change = _begin;
-	} else {
-		while (change->_prev && change->_prev->sortKey() < row->sortKey()) {
-			change = change->_prev;
-		}
-	}
-	if (!insertBefore(row, change)) {
-		if (change->_next != _end && _end->_prev->sortKey() > row->sortKey()) {
-			change = _end->_prev;
-		} else {
-			while (change->_next != _end && change->_next->sortKey() > row->sortKey()) {
-				change = change->_next;
-			}
-		}
-		insertAfter(row, change);
+	if (_sortMode != SortMode::Date) return;
+
+	const auto sortKey = row->sortKey();
+	moveSorted(row, [&](not_null<Row*> other) {
+		const auto otherSortKey = other->sortKey();
+		return (otherSortKey > sortKey)
+			? -1
+			: (otherSortKey < sortKey)
+			? 1
+			: 0;
+	});
+}
+
+// Takes all the (different) rows out and puts them back in the sort
+// key order, so that each changed row is moved only once in a batch.
+void List::adjustByPos(const std::vector<not_null<Row*>> &rows) {
+	if (_sortMode != SortMode::Date || rows.empty()) return;
+
+	auto sorted = rows;
+	ranges::sort(sorted, [](not_null<Row*> a, not_null<Row*> b) {
+		return a->sortKey() > b->sortKey();
+	});
+	for (const auto row : sorted) {
+		_tree.detach(row);
+	}
+	for (const auto row : sorted) {
+		const auto sortKey = row->sortKey();
+		const auto pos = _tree.countWhile([&](not_null<Row*> other) {
+			return (other->sortKey() >= sortKey);
+		});
+		_tree.attach(row, _tree.at(pos));
 	}
 }
 
@@ -181,7 +133,7 @@ bool List::moveToTop(Key key) {
 		return false;
 	}
 
-	insertBefore(i->second, _begin);
+	insertBefore(i->second, _tree.first());
 	return true;
 }
 
@@ -196,14 +148,7 @@ bool List::del(Key key, Row *replacedBy) {
 		emit App::main()->dialogRowReplaced(row, replacedBy);
 	}
 
-	if (row == _current) {
-		_current = row->_next;
-	}
-	for (auto change = row->_next; change != _end; change = change->_next) {
-		--change->_pos;
-	}
-	--_end->_pos;
-	remove(row);
+	_tree.detach(row);
 	delete row;
 	--_count;
 	_rowByKey.erase(i);
@@ -211,22 +156,13 @@ bool List::del(Key key, Row *replacedBy) {
 	return true;
 }
 
-void List::remove(Row *row) {
-	row->_next->_prev = row->_prev; // update row->next
-	if (row->_prev) { // update row->prev
-		row->_prev->_next = row->_next;
-	} else {
-		_begin = row->_next;
-	}
-}
-
 void List::clear() {
-	while (_begin != _end) {
-		_current = _begin;
-		_begin = _begin->_next;
-		delete _current;
+	for (auto row = _tree.first(); row != _tree.last();) {
+		const auto removed = row;
+		row = next(row);
+		delete removed;
 	}
-	_current = _begin;
+	_tree.reset();
 	_rowByKey.clear();
 	_count = 0;
 }
@@ -42,12 +42,16 @@ public:
 	}
 
 	Row *addToEnd(Key key);
+
+	// Adds a row to the end without sorting it, for the batched updates
+	// that are followed by adjustByPos() with all the changed rows.
+	Row *append(Key key);
 	Row *adjustByName(Key key);
 	Row *addByName(Key key);
 	bool moveToTop(Key key);
 	void adjustByPos(Row *row);
+	void adjustByPos(const std::vector<not_null<Row*>> &rows);
 	bool del(Key key, Row *replacedBy = nullptr);
-	void remove(Row *row);
 	void clear();
 
 	class const_iterator {
@@ -79,48 +83,51 @@ public:
 	friend class const_iterator;
 	using iterator = const_iterator;
 
-	const_iterator cbegin() const { return const_iterator(_begin); }
-	const_iterator cend() const { return const_iterator(_end); }
+	const_iterator cbegin() const { return const_iterator(_tree.first()); }
+	const_iterator cend() const { return const_iterator(_tree.last()); }
 	const_iterator begin() const { return cbegin(); }
 	const_iterator end() const { return cend(); }
-	iterator begin() { return iterator(_begin); }
-	iterator end() { return iterator(_end); }
+	iterator begin() { return iterator(_tree.first()); }
+	iterator end() { return iterator(_tree.last()); }
 	const_iterator cfind(Row *value) const { return value ? const_iterator(value) : cend(); }
 	const_iterator find(Row *value) const { return cfind(value); }
 	iterator find(Row *value) { return value ? iterator(value) : end(); }
 	const_iterator cfind(int y, int h) const {
-		adjustCurrent(y, h);
-		return iterator(_current);
+		if (isEmpty()) {
+			return cend();
+		}
+		const auto pos = (y > 0) ? (y / h) : 0;
+		return const_iterator(_tree.at(std::min(pos, size() - 1)));
 	}
 	const_iterator find(int y, int h) const { return cfind(y, h); }
-	iterator find(int y, int h) {
-		adjustCurrent(y, h);
-		return iterator(_current);
-	}
+	iterator find(int y, int h) { return cfind(y, h); }
 
 	~List();
 
 private:
-	void adjustCurrent(int y, int h) const;
-	bool insertBefore(Row *row, Row *before);
-	bool insertAfter(Row *row, Row *after);
+	using Tree = details::ListTree<Row>;
+
+	template <typename Compare>
+	void moveSorted(not_null<Row*> row, Compare compare);
+	bool insertBefore(not_null<Row*> row, not_null<Row*> before);
+
 	static Row *next(Row *row) {
-		return row->_next;
+		return Tree::next(row);
 	}
 	static Row *prev(Row *row) {
-		return row->_prev;
+		return Tree::prev(row);
 	}
 
+	// Rows are kept both in a linked list for iteration and in an
+	// order statistics tree for O(log n) positions and reordering.
+	// The _last row is always the last node of the tree.
 	std::unique_ptr<Row> _last;
-	Row *_begin;
-	Row *_end;
+	Tree _tree;
 	SortMode _sortMode;
 	int _count = 0;
 
 	std::map<Key, not_null<Row*>> _rowByKey;
 
-	mutable Row *_current; // cache
-
 };
 
 } // namespace Dialogs
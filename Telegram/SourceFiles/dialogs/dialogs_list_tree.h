@@ -0,0 +1,219 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <cstdint>
+
+namespace Dialogs {
+namespace details {
+
+template <typename Node>
+class ListTree;
+
+// Node of a ListTree: it is both in a doubly linked list for iteration
+// and in an order statistics treap for O(log n) positions and moves.
+template <typename Node>
+class ListTreeNode {
+public:
+	// Index of the node in its list, zero for a node outside of a list.
+	int pos() const {
+		auto result = _left ? _left->_size : 0;
+		for (auto node = this; node->_parent; node = node->_parent) {
+			const auto parent = node->_parent;
+			if (parent->_right == node) {
+				result += (parent->_left ? parent->_left->_size : 0) + 1;
+			}
+		}
+		return result;
+	}
+
+private:
+	friend class ListTree<Node>;
+
+	Node *_prev = nullptr;
+	Node *_next = nullptr;
+
+	// Treap by _priority, _size is the count of nodes in the subtree.
+	Node *_parent = nullptr;
+	Node *_left = nullptr;
+	Node *_right = nullptr;
+	int _size = 1;
+	std::uint32_t _priority = 0;
+
+};
+
+// The nodes are owned by the user of the tree. The sentinel node passed
+// to the constructor is always the last one, so attach(node, before)
+// with the sentinel as 'before' appends a node to the list.
+template <typename Node>
+class ListTree {
+public:
+	explicit ListTree(Node *last) : _begin(last), _end(last), _root(last) {
+		_end->_priority = generatePriority();
+	}
+	ListTree(const ListTree &other) = delete;
+	ListTree &operator=(const ListTree &other) = delete;
+
+	Node *first() const {
+		return _begin;
+	}
+	Node *last() const {
+		return _end;
+	}
+	static Node *next(const Node *node) {
+		return node->_next;
+	}
+	static Node *prev(const Node *node) {
+		return node->_prev;
+	}
+
+	// The sentinel is at(count), where count is the number of nodes.
+	Node *at(int pos) const {
+		auto node = _root;
+		while (true) {
+			const auto left = subtreeSize(node->_left);
+			if (pos < left) {
+				node = node->_left;
+			} else if (pos > left) {
+				pos -= left + 1;
+				node = node->_right;
+			} else {
+				return node;
+			}
+		}
+	}
+
+	// Counts nodes from the beginning of the list while 'predicate' holds.
+	// The sentinel is never passed to the 'predicate'.
+	template <typename Predicate>
+	int countWhile(Predicate predicate) const {
+		auto result = 0;
+		for (auto node = _root; node;) {
+			if (node != _end && predicate(node)) {
+				result += subtreeSize(node->_left) + 1;
+				node = node->_right;
+			} else {
+				node = node->_left;
+			}
+		}
+		return result;
+	}
+
+	void attach(Node *node, Node *before) {
+		node->_next = before;
+		node->_prev = before->_prev;
+		before->_prev = node;
+		if (node->_prev) {
+			node->_prev->_next = node;
+		} else {
+			_begin = node;
+		}
+
+		// The previous node is the rightmost one in the 'before' left subtree.
+		node->_left = node->_right = nullptr;
+		node->_size = 1;
+		node->_priority = generatePriority();
+		if (!before->_left) {
+			before->_left = node;
+			node->_parent = before;
+		} else {
+			node->_prev->_right = node;
+			node->_parent = node->_prev;
+		}
+		for (auto parent = node->_parent; parent; parent = parent->_parent) {
+			++parent->_size;
+		}
+		while (node->_parent && node->_parent->_priority < node->_priority) {
+			rotateUp(node);
+		}
+	}
+
+	void detach(Node *node) {
+		node->_next->_prev = node->_prev;
+		if (node->_prev) {
+			node->_prev->_next = node->_next;
+		} else {
+			_begin = node->_next;
+		}
+
+		while (node->_left || node->_right) {
+			const auto left = node->_left;
+			const auto right = node->_right;
+			rotateUp((!right || (left && left->_priority > right->_priority))
+				? left
+				: right);
+		}
+		const auto parent = node->_parent;
+		(parent->_left == node ? parent->_left : parent->_right) = nullptr;
+		for (auto above = parent; above; above = above->_parent) {
+			--above->_size;
+		}
+		node->_parent = nullptr;
+	}
+
+	// Leaves only the sentinel in the tree, the nodes are not touched.
+	void reset() {
+		_end->_prev = nullptr;
+		_end->_parent = _end->_left = _end->_right = nullptr;
+		_end->_size = 1;
+		_begin = _root = _end;
+	}
+
+private:
+	static int subtreeSize(const Node *node) {
+		return node ? node->_size : 0;
+	}
+
+	void rotateUp(Node *node) {
+		const auto parent = node->_parent;
+		const auto grandParent = parent->_parent;
+		if (parent->_left == node) {
+			parent->_left = node->_right;
+			if (node->_right) {
+				node->_right->_parent = parent;
+			}
+			node->_right = parent;
+		} else {
+			parent->_right = node->_left;
+			if (node->_left) {
+				node->_left->_parent = parent;
+			}
+			node->_left = parent;
+		}
+		parent->_parent = node;
+		node->_parent = grandParent;
+		if (!grandParent) {
+			_root = node;
+		} else if (grandParent->_left == parent) {
+			grandParent->_left = node;
+		} else {
+			grandParent->_right = node;
+		}
+		node->_size = parent->_size;
+		parent->_size = subtreeSize(parent->_left)
+			+ subtreeSize(parent->_right)
+			+ 1;
+	}
+
+	std::uint32_t generatePriority() {
+		// xorshift32 is enough to keep the treap balanced.
+		_seed ^= _seed << 13;
+		_seed ^= _seed >> 17;
+		_seed ^= _seed << 5;
+		return _seed;
+	}
+
+	Node *_begin = nullptr;
+	Node *_end = nullptr;
+	Node *_root = nullptr;
+	std::uint32_t _seed = 0x9E3779B9U;
+
+};
+
+} // namespace details
+} // namespace Dialogs
@@ -0,0 +1,148 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "dialogs/dialogs_list_tree.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct TestNode : Dialogs::details::ListTreeNode<TestNode> {
+	explicit TestNode(int value) : value(value) {
+	}
+
+	int value = 0;
+};
+
+using Tree = Dialogs::details::ListTree<TestNode>;
+
+class Checked {
+public:
+	Checked() : _last(-1), _tree(&_last) {
+	}
+
+	int count() const {
+		return int(_reference.size());
+	}
+	void insert(int pos, int value) {
+		_nodes.push_back(std::make_unique<TestNode>(value));
+		const auto node = _nodes.back().get();
+		_tree.attach(node, _tree.at(pos));
+		_reference.insert(begin(_reference) + pos, node);
+	}
+	void remove(int pos) {
+		const auto node = _reference[pos];
+		_tree.detach(node);
+		_reference.erase(begin(_reference) + pos);
+	}
+	void move(int from, int to) {
+		const auto node = _reference[from];
+		_tree.detach(node);
+		_reference.erase(begin(_reference) + from);
+		_tree.attach(node, _tree.at(to));
+		_reference.insert(begin(_reference) + to, node);
+	}
+
+	// Inserts to the place that countWhile() finds in a sorted list,
+	// like Dialogs::List::adjustByPos() does with the sort keys.
+	void insertSorted(int value) {
+		const auto pos = _tree.countWhile([&](TestNode *node) {
+			return node->value >= value;
+		});
+		insert(pos, value);
+	}
+
+	void check() const {
+		auto index = 0;
+		for (auto node = _tree.first(); node != _tree.last(); ++index) {
+			REQUIRE(index < count());
+			REQUIRE(node == _reference[index]);
+			REQUIRE(node->pos() == index);
+			REQUIRE(_tree.at(index) == node);
+			node = Tree::next(node);
+		}
+		REQUIRE(index == count());
+		REQUIRE(_tree.at(count()) == &_last);
+		REQUIRE(_last.pos() == count());
+		if (count() > 0) {
+			REQUIRE(Tree::prev(&_last) == _reference.back());
+			REQUIRE(Tree::prev(_tree.first()) == nullptr);
+		} else {
+			REQUIRE(_tree.first() == &_last);
+		}
+	}
+	void checkSorted() const {
+		check();
+		REQUIRE(std::is_sorted(
+			begin(_reference),
+			end(_reference),
+			[](TestNode *a, TestNode *b) { return a->value > b->value; }));
+	}
+
+private:
+	TestNode _last;
+	Tree _tree;
+	std::vector<TestNode*> _reference;
+	std::vector<std::unique_ptr<TestNode>> _nodes;
+
+};
+
+} // namespace
+
+TEST_CASE("dialogs list tree matches a vector", "[dialogs_list_tree]") {
+	auto generator = std::mt19937(42);
+	const auto random = [&](int count) {
+		return int(generator() % unsigned(count));
+	};
+
+	SECTION("random inserts, removes and moves") {
+		Checked list;
+		for (auto i = 0; i != 5000; ++i) {
+			const auto action = random(10);
+			if (action < 5 || list.count() < 2) {
+				list.insert(random(list.count() + 1), i);
+			} else if (action < 7) {
+				list.remove(random(list.count()));
+			} else {
+				list.move(random(list.count()), random(list.count()));
+			}
+			if (i % 50 == 0) {
+				list.check();
+			}
+		}
+		list.check();
+		while (list.count() > 0) {
+			list.remove(random(list.count()));
+		}
+		list.check();
+	}
+	SECTION("appending and removing from the front") {
+		Checked list;
+		for (auto i = 0; i != 1000; ++i) {
+			list.insert(list.count(), i);
+			if (i % 3 == 0) {
+				list.remove(0);
+			}
+		}
+		list.check();
+	}
+	SECTION("sorted inserts through countWhile") {
+		Checked list;
+		for (auto i = 0; i != 2000; ++i) {
+			list.insertSorted(random(300));
+			if (i % 100 == 0) {
+				list.checkSorted();
+			}
+		}
+		list.checkSorted();
+	}
+}
@@ -29,6 +29,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "window/window_slide_animation.h"
 #include "profile/profile_channel_controllers.h"
 #include "storage/storage_media_prepare.h"
+#include "storage/storage_facade.h"
+#include "storage/storage_search_index.h"
 #include "data/data_session.h"
 #include "styles/style_dialogs.h"
 #include "styles/style_window.h"
@@ -103,6 +105,7 @@ DialogsWidget::DialogsWidget(QWidget *parent, not_null<Window::Controller*> cont
 	connect(_inner, SIGNAL(draggingScrollDelta(int)), this, SLOT(onDraggingScrollDelta(int)));
 	connect(_inner, SIGNAL(mustScrollTo(int,int)), _scroll, SLOT(scrollToY(int,int)));
 	connect(_inner, SIGNAL(dialogMoved(int,int)), this, SLOT(onDialogMoved(int,int)));
+	connect(_inner, SIGNAL(dialogsMoved(int)), this, SLOT(onDialogsMoved(int)));
 	connect(_inner, SIGNAL(searchMessages()), this, SLOT(onNeedSearchMessages()));
 	connect(_inner, SIGNAL(searchResultChosen()), this, SLOT(onCancel()));
 	connect(_inner, SIGNAL(completeHashtag(QString)), this, SLOT(onCompleteHashtag(QString)));
@@ -199,8 +202,20 @@ void DialogsWidget::activate() {
 void DialogsWidget::createDialog(Dialogs::Key key) {
 	const auto creating = !key.entry()->inChatList(Dialogs::Mode::All);
 	_inner->createDialog(key);
+	if (creating) {
+		removeMigratedDialog(key);
+	}
+}
+
+void DialogsWidget::createDialogs(const std::vector<Dialogs::Key> &keys) {
+	for (const auto key : _inner->createDialogs(keys)) {
+		removeMigratedDialog(key);
+	}
+}
+
+void DialogsWidget::removeMigratedDialog(Dialogs::Key key) {
 	const auto history = key.history();
-	if (creating && history && history->peer->migrateFrom()) {
+	if (history && history->peer->migrateFrom()) {
 		if (const auto migrated = App::historyLoaded(
 				history->peer->migrateFrom())) {
 			if (migrated->inChatList(Dialogs::Mode::All)) {
@@ -502,6 +517,9 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 		_searchFull = _searchFullMigrated = false;
 		MTP::cancel(base::take(_searchRequest));
 		if (const auto peer = _searchInChat.peer()) {
+			if (!_searchQueryFrom) {
+				searchLocal(peer);
+			}
 			const auto flags = _searchQueryFrom
 				? MTP_flags(MTPmessages_Search::Flag::f_from_id)
 				: MTP_flags(0);
@@ -582,6 +600,18 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 	return result;
 }
 
+void DialogsWidget::searchLocal(not_null<PeerData*> peer) {
+	_searchLocalLifetime.destroy();
+	Auth().storage().query(Storage::SearchIndexQuery(
+		peer->id,
+		TextUtilities::PrepareSearchWords(_searchQuery),
+		0,
+		SearchPerPage)
+	) | rpl::start_with_next([=](const Storage::SearchIndexResult &result) {
+		_inner->localSearchReceived(peer, result.messages);
+	}, _searchLocalLifetime);
+}
+
 bool DialogsWidget::searchForPeersRequired(const QString &query) const {
 	if (_searchInChat || query.isEmpty()) {
 		return false;
@@ -769,6 +799,10 @@ void DialogsWidget::searchReceived(
 	}
 
 	if (_searchRequest == requestId) {
+		if (type == DialogsSearchPeerFromStart) {
+			// Local results that are not ready yet are not needed anymore.
+			_searchLocalLifetime.destroy();
+		}
 		switch (result.type()) {
 		case mtpc_messages_messages: {
 			auto &d = result.c_messages_messages();
@@ -1054,6 +1088,7 @@ void DialogsWidget::clearSearchCache() {
 	_searchQuery = QString();
 	_searchQueryFrom = nullptr;
 	MTP::cancel(base::take(_searchRequest));
+	_searchLocalLifetime.destroy();
 }
 
 void DialogsWidget::showJumpToDate() {
@@ -1400,3 +1435,7 @@ void DialogsWidget::onDialogMoved(int movedFrom, int movedTo) {
 		_scroll->scrollToY(st + st::dialogsRowHeight);
 	}
 }
+
+void DialogsWidget::onDialogsMoved(int scrollDelta) {
+	_scroll->scrollToY(_scroll->scrollTop() + scrollDelta);
+}
@@ -58,6 +58,7 @@ public:
 	void loadDialogs();
 	void loadPinnedDialogs();
 	void createDialog(Dialogs::Key key);
+	void createDialogs(const std::vector<Dialogs::Key> &keys);
 	void removeDialog(Dialogs::Key key);
 	void repaintDialogRow(Dialogs::Mode list, not_null<Dialogs::Row*> row);
 	void repaintDialogRow(not_null<History*> history, MsgId messageId);
@@ -112,6 +113,7 @@ public slots:
 	void onCompleteHashtag(QString tag);
 
 	void onDialogMoved(int movedFrom, int movedTo);
+	void onDialogsMoved(int scrollDelta);
 	bool onSearchMessages(bool searchCache = false);
 	void onNeedSearchMessages();
 
@@ -131,6 +133,7 @@ protected:
 
 private:
 	void animationCallback();
+	void removeMigratedDialog(Dialogs::Key key);
 	void dialogsReceived(
 		const MTPmessages_Dialogs &result,
 		mtpRequestId requestId);
@@ -152,6 +155,7 @@ private:
 		const QVector<MTPMessage> &messages);
 
 	bool searchForPeersRequired(const QString &query) const;
+	void searchLocal(not_null<PeerData*> peer);
 	void setSearchInChat(Dialogs::Key chat, UserData *from = nullptr);
 	void showJumpToDate();
 	void showSearchFrom();
@@ -221,6 +225,7 @@ private:
 
 	using SearchQueries = QMap<mtpRequestId, QString>;
 	SearchQueries _searchQueries;
+	rpl::lifetime _searchLocalLifetime;
 
 	using PeerSearchCache = QMap<QString, MTPcontacts_Found>;
 	PeerSearchCache _peerSearchCache;
@@ -30,6 +30,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_facade.h"
 #include "storage/storage_shared_media.h"
 #include "storage/storage_feed_messages.h"
+#include "storage/storage_search_index.h"
 #include "data/data_channel_admins.h"
 #include "data/data_feed.h"
 #include "ui/text_options.h"
@@ -632,7 +633,9 @@ HistoryItem *History::createItem(
 		if (detachExistingItem) {
 			result->removeMainView();
 		}
-		if (message.type() == mtpc_message) {
+		if (_unconfirmedCachedItems.remove(messageId)) {
+			App::updateEditedMessage(message);
+		} else if (message.type() == mtpc_message) {
 			const auto media = message.c_message().has_media()
 				? &message.c_message().vmedia
 				: nullptr;
@@ -1238,7 +1241,6 @@ void History::mainViewRemoved(
 }
 
 void History::newItemAdded(not_null<HistoryItem*> item) {
-	App::checkImageCacheSize();
 	item->indexAsNewItem();
 	if (const auto from = item->from() ? item->from()->asUser() : nullptr) {
 		if (from == item->author()) {
@@ -2283,7 +2285,7 @@ HistoryItem *History::lastSentMessage() const {
 	return nullptr;
 }
 
-void History::resizeToWidth(int newWidth) {
+void History::resizeToWidth(int newWidth, int syncHeight) {
 	const auto resizeAllItems = (_width != newWidth);
 
 	if (!resizeAllItems && !hasPendingResizedItems()) {
@@ -2292,14 +2294,124 @@ void History::resizeToWidth(int newWidth) {
 	_flags &= ~(Flag::f_has_pending_resized_items);
 
 	_width = newWidth;
+	if (resizeAllItems) {
+		estimateHeights(newWidth);
+		resizeAroundScrollTop(syncHeight);
+	}
 	int y = 0;
 	for (const auto &block : blocks) {
 		block->setY(y);
-		y += block->resizeGetHeight(newWidth, resizeAllItems);
+		y += block->resizeGetHeight(newWidth);
 	}
 	_height = y;
 }
 
+void History::estimateHeights(int newWidth) {
+	for (const auto &block : blocks) {
+		for (const auto &message : block->messages) {
+			message->estimateHeight(newWidth);
+			if (message->heightEstimated()) {
+				_flags |= Flag::f_has_estimated_items;
+			}
+		}
+	}
+}
+
+void History::resizeAroundScrollTop(int syncHeight) {
+	if (isEmpty()) {
+		return;
+	}
+	const auto resizeWhile = [&](Element *view, int height, auto next) {
+		for (; view && height > 0; view = (view->*next)()) {
+			if (view->heightEstimated()) {
+				view->resizeGetHeight(_width);
+			}
+			height -= view->height();
+		}
+	};
+	if (scrollTopItem) {
+		resizeWhile(
+			scrollTopItem,
+			scrollTopOffset + syncHeight,
+			&Element::nextInBlocks);
+		resizeWhile(
+			scrollTopItem->previousInBlocks(),
+			syncHeight,
+			&Element::previousInBlocks);
+	} else {
+		resizeWhile(
+			blocks.back()->messages.back().get(),
+			syncHeight,
+			&Element::previousInBlocks);
+	}
+}
+
+bool History::hasEstimatedItems() const {
+	return _flags & Flag::f_has_estimated_items;
+}
+
+bool History::resizeEstimatedItems(int count) {
+	if (!hasEstimatedItems()) {
+		return false;
+	}
+	const auto anchor = scrollTopItem
+		? scrollTopItem
+		: isEmpty()
+		? nullptr
+		: blocks.back()->messages.back().get();
+	auto left = count;
+	const auto resize = [&](not_null<Element*> view) {
+		if (view->heightEstimated()) {
+			view->resizeGetHeight(_width);
+			--left;
+		}
+	};
+	for (auto view = anchor; view && left > 0; view = view->nextInBlocks()) {
+		resize(view);
+	}
+	for (auto view = anchor ? anchor->previousInBlocks() : nullptr
+		; view && left > 0
+		; view = view->previousInBlocks()) {
+		resize(view);
+	}
+	if (left > 0) {
+		_flags &= ~Flag::f_has_estimated_items;
+	}
+	if (left < count) {
+		setHasPendingResizedItems();
+	}
+	return hasEstimatedItems();
+}
+
+bool History::resizeEstimatedItemsIn(int top, int bottom) {
+	if (!hasEstimatedItems()) {
+		return false;
+	}
+	auto result = false;
+	for (const auto &block : blocks) {
+		const auto blockTop = block->y();
+		if (blockTop >= bottom) {
+			break;
+		} else if (blockTop + block->height() <= top) {
+			continue;
+		}
+		for (const auto &message : block->messages) {
+			const auto messageTop = blockTop + message->y();
+			if (messageTop >= bottom) {
+				break;
+			} else if (messageTop + message->height() > top
+				&& message->heightEstimated()) {
+				message->resizeGetHeight(_width);
+				result = true;
+			}
+		}
+	}
+	if (result) {
+		setHasPendingResizedItems();
+	}
+	return result;
+}
+
 ChannelId History::channelId() const {
 	return peerToChannel(peer->id);
 }
@@ -2520,12 +2632,17 @@ QVector<MsgId> History::collectMessagesFromUserToDelete(
 
 void History::clear() {
 	clearBlocks(false);
+	Local::clearHistorySlice(peer->id);
 }
 
 void History::unloadBlocks() {
 	clearBlocks(true);
 }
 
+void History::markCachedItemUnconfirmed(MsgId id) {
+	_unconfirmedCachedItems.emplace(id);
+}
+
 void History::clearBlocks(bool leaveItems) {
 	_unreadBarView = nullptr;
 	_firstUnreadView = nullptr;
@@ -2536,10 +2653,19 @@ void History::clearBlocks(bool leaveItems) {
 	}
 	if (leaveItems) {
 		Auth().data().notifyHistoryUnloaded(this);
+
+		// Items are not displayed without views, keep their texts cold.
+		for (const auto &block : blocks) {
+			for (const auto &view : block->messages) {
+				view->data()->makeTextCold();
+			}
+		}
 	} else {
 		setLastMessage(nullptr);
 		notifies.clear();
+		_unconfirmedCachedItems.clear();
 		Auth().data().notifyHistoryCleared(this);
+		Auth().storage().remove(Storage::SearchIndexRemoveAll(peer->id));
 	}
 	blocks.clear();
 	if (leaveItems) {
@@ -2648,11 +2774,11 @@ HistoryBlock::HistoryBlock(not_null<History*> history)
 : _history(history) {
 }
 
-int HistoryBlock::resizeGetHeight(int newWidth, bool resizeAllItems) {
+int HistoryBlock::resizeGetHeight(int newWidth) {
 	auto y = 0;
 	for (const auto &message : messages) {
 		message->setY(y);
-		if (resizeAllItems || message->pendingResize()) {
+		if (message->pendingResize() && !message->heightEstimated()) {
 			y += message->resizeGetHeight(newWidth);
 		} else {
 			y += message->height();
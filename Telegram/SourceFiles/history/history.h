@@ -136,6 +136,10 @@ public:
 	void unloadBlocks();
 	void clearUpTill(MsgId availableMinId);
 
+	// The item was created from the cached history page and the server
+	// didn't return it yet, it is edited when it is received again.
+	void markCachedItemUnconfirmed(MsgId id);
+
 	void applyGroupAdminChanges(
 		const base::flat_map<UserId, bool> &changes);
 
@@ -244,9 +248,18 @@ public:
 	MsgId msgIdForRead() const;
 	HistoryItem *lastSentMessage() const;
 
-	void resizeToWidth(int newWidth);
+	// When the width changes only syncHeight pixels around scrollTopItem
+	// (or at the bottom) are laid out, other items get estimated heights.
+	void resizeToWidth(int newWidth, int syncHeight);
 	int height() const;
 
+	// Lay out items with estimated heights, nearest to scrollTopItem
+	// first or the ones in [top, bottom) of the history coordinates.
+	// Both mark the history as having pending resized items if needed.
+	bool hasEstimatedItems() const;
+	bool resizeEstimatedItems(int count);
+	bool resizeEstimatedItemsIn(int top, int bottom);
+
 	void itemRemoved(not_null<HistoryItem*> item);
 	void itemVanished(not_null<HistoryItem*> item);
 
@@ -381,6 +394,7 @@ private:
 
 	enum class Flag {
 		f_has_pending_resized_items = (1 << 0),
+		f_has_estimated_items = (1 << 1),
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) {
@@ -396,6 +410,10 @@ private:
 	// helper method for countScrollState(int top)
 	void countScrollTopItem(int top);
 
+	// helper methods for resizeToWidth(int newWidth, int syncHeight)
+	void estimateHeights(int newWidth);
+	void resizeAroundScrollTop(int syncHeight);
+
 	HistoryItem *addNewToLastBlock(const MTPMessage &msg, NewMessageType type);
 
 	// this method just removes a block from the blocks list
@@ -486,6 +504,7 @@ private:
 	base::optional<int> _unreadCount;
 	base::optional<int> _unreadMentionsCount;
 	base::flat_set<MsgId> _unreadMentions;
+	base::flat_set<MsgId> _unconfirmedCachedItems;
 	base::optional<HistoryItem*> _lastMessage;
 
 	// A pointer to the block that is currently being built.
@@ -528,7 +547,7 @@ public:
 	void remove(not_null<Element*> view);
 	void refreshView(not_null<Element*> view);
 
-	int resizeGetHeight(int newWidth, bool resizeAllItems);
+	int resizeGetHeight(int newWidth);
 	int y() const {
 		return _y;
 	}
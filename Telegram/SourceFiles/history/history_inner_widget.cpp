@@ -40,6 +40,11 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace {
 
 constexpr auto kScrollDateHideTimeout = 1000;
+constexpr auto kColdTextsTimeout = 3000;
+
+// Message texts further than that many visible area heights from the
+// visible area are made cold, they'll be parsed again when displayed.
+constexpr auto kColdTextsDistance = 3;
 
 // Helper binary search for an item in a list that is not completely
 // above the given top of the visible area or below the given bottom of the visible area
@@ -115,7 +120,8 @@ HistoryInner::HistoryInner(
 , _widget(historyWidget)
 , _scroll(scroll)
 , _scrollDateCheck([this] { scrollDateCheck(); })
-, _scrollDateHideTimer([this] { scrollDateHideByTimer(); }) {
+, _scrollDateHideTimer([this] { scrollDateHideByTimer(); })
+, _coldTextsTimer([this] { makeInvisibleTextsCold(); }) {
 	_touchSelectTimer.setSingleShot(true);
 	connect(&_touchSelectTimer, SIGNAL(timeout()), this, SLOT(onTouchSelect()));
 
@@ -1914,9 +1920,9 @@ void HistoryInner::recountHistoryGeometry() {
 		accumulate_max(oldHistoryPaddingTop, st::msgMargin.top() + st::msgMargin.bottom() + st::msgPadding.top() + st::msgPadding.bottom() + st::msgNameFont->height + st::botDescSkip + _botAbout->height);
 	}
 
-	_history->resizeToWidth(_contentWidth);
+	_history->resizeToWidth(_contentWidth, visibleHeight);
 	if (_migrated) {
-		_migrated->resizeToWidth(_contentWidth);
+		_migrated->resizeToWidth(_contentWidth, visibleHeight);
 	}
 
 	// with migrated history we perhaps do not need to display first _history message
@@ -2024,8 +2030,43 @@ void HistoryInner::setFirstLoading(bool loading) {
 	update();
 }
 
+bool HistoryInner::resizeEstimatedItems(int count) {
+	_history->resizeEstimatedItems(count);
+	if (_migrated) {
+		_migrated->resizeEstimatedItems(count);
+	}
+	const auto resized = hasPendingResizedItems();
+	if (resized) {
+		// Resizing warms the texts, they're made cold again after the
+		// last resize step without waiting for the next scroll.
+		_coldTextsTimer.callOnce(kColdTextsTimeout);
+	}
+	return resized;
+}
+
+bool HistoryInner::resizeEstimatedItemsIn(int top, int bottom) {
+	auto result = false;
+	if (const auto htop = historyTop(); htop >= 0) {
+		result = _history->resizeEstimatedItemsIn(top - htop, bottom - htop)
+			|| result;
+	}
+	if (const auto mtop = migratedTop(); mtop >= 0) {
+		result = _migrated->resizeEstimatedItemsIn(top - mtop, bottom - mtop)
+			|| result;
+	}
+	return result;
+}
+
+bool HistoryInner::hasEstimatedItems() const {
+	return _history->hasEstimatedItems()
+		|| (_migrated && _migrated->hasEstimatedItems());
+}
+
 void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	auto scrolledUp = (top < _visibleAreaTop);
+	if (!hasPendingResizedItems()) {
+		cancelHiddenLocalLoads(top, bottom);
+	}
 	_visibleAreaTop = top;
 	_visibleAreaBottom = bottom;
 
@@ -2061,6 +2102,52 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	} else {
 		scrollDateHideByTimer();
 	}
+	_coldTextsTimer.callOnce(kColdTextsTimeout);
+}
+
+void HistoryInner::cancelHiddenLocalLoads(int top, int bottom) {
+	enumerateItems<EnumItemsDirection::TopToBottom>([&](
+			not_null<Element*> view,
+			int itemtop,
+			int itembottom) {
+		if (itembottom <= top || itemtop >= bottom) {
+			if (const auto media = view->media()) {
+				media->cancelLocalLoads();
+			}
+		}
+		return true;
+	});
+}
+
+void HistoryInner::makeInvisibleTextsCold() {
+	if (hasPendingResizedItems()) {
+		_coldTextsTimer.callOnce(kColdTextsTimeout);
+		return;
+	}
+	const auto distance = kColdTextsDistance
+		* (_visibleAreaBottom - _visibleAreaTop);
+	const auto from = _visibleAreaTop - distance;
+	const auto till = _visibleAreaBottom + distance;
+	const auto makeCold = [&](History *history, int historyTop) {
+		if (!history || historyTop < 0) {
+			return;
+		}
+		for (const auto &block : history->blocks) {
+			const auto blockTop = historyTop + block->y();
+			const auto blockVisible = (blockTop < till)
+				&& (blockTop + block->height() > from);
+			for (const auto &view : block->messages) {
+				const auto top = blockTop + view->y();
+				if (!blockVisible
+					|| top >= till
+					|| top + view->height() <= from) {
+					view->data()->makeTextCold();
+				}
+			}
+		}
+	};
+	makeCold(_migrated, migratedTop());
+	makeCold(_history, historyTop());
 }
 
 bool HistoryInner::displayScrollDate() const {
@@ -59,6 +59,12 @@ public:
 	void recountHistoryGeometry();
 	void updateSize();
 
+	// Lay out some of the items that got estimated heights after resize,
+	// return true if the geometry should be updated after that.
+	bool resizeEstimatedItems(int count);
+	bool resizeEstimatedItemsIn(int top, int bottom);
+	bool hasEstimatedItems() const;
+
 	void repaintItem(const HistoryItem *item);
 	void repaintItem(const Element *view);
 
@@ -189,6 +195,10 @@ private:
 
 	void scrollDateCheck();
 	void scrollDateHideByTimer();
+	void makeInvisibleTextsCold();
+
+	// The items in the visible area are enumerated before it is changed.
+	void cancelHiddenLocalLoads(int top, int bottom);
 	bool canHaveFromUserpics() const;
 	void mouseActionStart(const QPoint &screenPos, Qt::MouseButton button);
 	void mouseActionUpdate();
@@ -360,4 +370,6 @@ private:
 	int _scrollDateLastItemTop = 0;
 	ClickHandlerPtr _scrollDateLink;
 
+	base::Timer _coldTextsTimer;
+
 };
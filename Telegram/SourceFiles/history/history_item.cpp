@@ -27,6 +27,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_facade.h"
 #include "storage/storage_shared_media.h"
 #include "storage/storage_feed_messages.h"
+#include "storage/storage_search_index.h"
 #include "auth_session.h"
 #include "apiwrap.h"
 #include "media/media_audio.h"
@@ -41,6 +42,17 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace {
 
+auto ColdTextStats = HistoryColdTextStats();
+
+int CountColdTextMemoryUsage(const TextWithEntities &text) {
+	auto result = int(sizeof(QChar)) * text.text.capacity()
+		+ int(sizeof(EntityInText)) * text.entities.size();
+	for (const auto &entity : text.entities) {
+		result += int(sizeof(QChar)) * entity.data().size();
+	}
+	return result;
+}
+
 not_null<HistoryItem*> CreateUnsupportedMessage(
 		not_null<History*> history,
 		MsgId msgId,
@@ -71,6 +83,13 @@ not_null<HistoryItem*> CreateUnsupportedMessage(
 
 } // namespace
 
+struct HistoryItem::ColdText {
+	TextWithEntities text;
+	int skipBlockWidth = 0;
+	int skipBlockHeight = 0;
+	int bytesSaved = 0;
+};
+
 void HistoryItem::HistoryItem::Destroyer::operator()(HistoryItem *value) {
 	if (value) {
 		value->destroy();
@@ -250,6 +269,9 @@ void HistoryItem::destroy() {
 					types,
 					id));
 			}
+			Auth().storage().remove(Storage::SearchIndexRemoveOne(
+				history->peer->id,
+				id));
 		} else {
 			Auth().api().cancelLocalItem(this);
 		}
@@ -318,6 +340,18 @@ void HistoryItem::setRealId(MsgId newId) {
 
 	Auth().data().notifyItemIdChange({ this, oldId });
 	Auth().data().requestItemRepaint(this);
+	indexSearchText(originalText().text);
+}
+
+void HistoryItem::indexSearchText(const QString &text) {
+	if (!IsServerMsgId(id)) {
+		return;
+	}
+	Auth().storage().add(Storage::SearchIndexAddNew(
+		history()->peer->id,
+		id,
+		date(),
+		text));
 }
 
 bool HistoryItem::isPinned() const {
@@ -557,7 +591,7 @@ MessageGroupId HistoryItem::groupId() const {
 }
 
 bool HistoryItem::isEmpty() const {
-	return _text.isEmpty()
+	return emptyText()
 		&& !_media
 		&& !Has<HistoryMessageLogEntryOriginal>();
 }
@@ -567,7 +601,7 @@ QString HistoryItem::notificationText() const {
 		if (_media) {
 			return _media->notificationText();
 		} else if (!emptyText()) {
-			return _text.originalText();
+			return originalTextWithEntities().text;
 		}
 		return QString();
 	};
@@ -584,7 +618,7 @@ QString HistoryItem::inDialogsText(DrawInDialog way) const {
 		if (_media) {
 			return _media->chatsListText();
 		} else if (!emptyText()) {
-			return TextUtilities::Clean(_text.originalText());
+			return TextUtilities::Clean(originalTextWithEntities().text);
 		}
 		return QString();
 	};
@@ -630,7 +664,64 @@ void HistoryItem::drawInDialog(
 	}
 }
 
+void HistoryItem::makeTextCold() {
+	// Service message texts have links set by setLink(), they can't be
+	// parsed again from the original text with entities.
+	if (_coldText || !toHistoryMessage() || _text.isEmpty()) {
+		return;
+	}
+	auto cold = std::make_unique<ColdText>();
+	cold->text = _text.originalTextWithEntities();
+	cold->text.text.squeeze();
+	cold->skipBlockWidth = _text.skipBlockWidth();
+	cold->skipBlockHeight = _text.skipBlockHeight();
+	cold->bytesSaved = _text.countMemoryUsage()
+		- CountColdTextMemoryUsage(cold->text)
+		- int(sizeof(ColdText));
+	if (cold->bytesSaved <= 0) {
+		return;
+	}
+
+	// The natural size of the text stays the same, so _textWidth and
+	// _textHeight are still valid when it is parsed again.
+	_text = Text(int(st::msgMinWidth));
+	++ColdTextStats.count;
+	ColdTextStats.bytesSaved += cold->bytesSaved;
+	_coldText = std::move(cold);
+}
+
+Text &HistoryItem::text() {
+	if (const auto cold = base::take(_coldText)) {
+		--ColdTextStats.count;
+		ColdTextStats.bytesSaved -= cold->bytesSaved;
+		_text.setMarkedText(
+			st::messageTextStyle,
+			cold->text,
+			Ui::ItemTextOptions(this));
+		if (cold->skipBlockWidth) {
+			_text.updateSkipBlock(
+				cold->skipBlockWidth,
+				cold->skipBlockHeight);
+		}
+	}
+	return _text;
+}
+
+void HistoryItem::forgetColdText() {
+	if (const auto cold = base::take(_coldText)) {
+		--ColdTextStats.count;
+		ColdTextStats.bytesSaved -= cold->bytesSaved;
+	}
+}
+
+TextWithEntities HistoryItem::originalTextWithEntities() const {
+	return _coldText
+		? _coldText->text
+		: _text.originalTextWithEntities();
+}
+
 HistoryItem::~HistoryItem() {
+	forgetColdText();
 	Auth().data().notifyItemRemoved(this);
 	App::historyUnregItem(this);
 	if (id < 0 && !App::quitting()) {
@@ -642,6 +733,10 @@ QDateTime ItemDateTime(not_null<const HistoryItem*> item) {
 	return ParseDateTime(item->date());
 }
 
+HistoryColdTextStats GetHistoryColdTextStats() {
+	return ColdTextStats;
+}
+
 ClickHandlerPtr goToMessageClickHandler(
 		not_null<HistoryItem*> item,
 		FullMsgId returnToId) {
@@ -116,10 +116,12 @@ public:
 	bool mentionsMe() const {
 		if (cTagMention()) {
 			if ((history()->peer->isMegagroup() || history()->peer->isChat()) && !hasViews()) {
-				if (_text.originalText().contains("@everyuser", Qt::CaseInsensitive))
+				// The text may be cold, read it without warming.
+				const auto text = originalTextWithEntities().text;
+				if (text.contains("@everyuser", Qt::CaseInsensitive))
 					return true;
 
-				if (_text.originalText().contains("@admin", Qt::CaseInsensitive)) {
+				if (text.contains("@admin", Qt::CaseInsensitive)) {
 					if (auto chat = history()->peer->asChat())
 						if (chat->amCreator())
 							return true;
@@ -223,9 +225,13 @@ public:
 		Text &cache) const;
 
 	bool emptyText() const {
-		return _text.isEmpty();
+		return !_coldText && _text.isEmpty();
 	}
 
+	// Message text far from the visible area can be kept unparsed, it is
+	// parsed again from the source text when it is needed.
+	void makeTextCold();
+
 	bool isPinned() const;
 	bool canPin() const;
 	virtual bool allowsForward() const;
@@ -296,6 +302,7 @@ protected:
 
 	void finishEdition(int oldKeyboardTop);
 	void finishEditionToEmpty();
+	void indexSearchText(const QString &text);
 
 	const not_null<History*> _history;
 	not_null<PeerData*> _from;
@@ -313,6 +320,13 @@ protected:
 
 	void setGroupId(MessageGroupId groupId);
 
+	Text &text();
+	const Text &text() const {
+		return const_cast<HistoryItem*>(this)->text();
+	}
+	void forgetColdText();
+	TextWithEntities originalTextWithEntities() const;
+
 	Text _text = { int(st::msgMinWidth) };
 	int _textWidth = -1;
 	int _textHeight = 0;
@@ -320,7 +334,10 @@ protected:
 	std::unique_ptr<Data::Media> _media;
 
 private:
+	struct ColdText;
+
 	TimeId _date = 0;
+	std::unique_ptr<ColdText> _coldText;
 
 	HistoryView::Element *_mainView = nullptr;
 	friend class HistoryView::Element;
@@ -331,6 +348,14 @@ private:
 
 QDateTime ItemDateTime(not_null<const HistoryItem*> item);
 
+struct HistoryColdTextStats {
+	int count = 0;
+	int64 bytesSaved = 0;
+};
+
+// Counters of the message texts made cold by HistoryItem::makeTextCold().
+HistoryColdTextStats GetHistoryColdTextStats();
+
 ClickHandlerPtr goToMessageClickHandler(
 	not_null<PeerData*> peer,
 	MsgId msgId,
@@ -10,6 +10,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "history/history_item.h"
 #include "history/view/history_view_element.h"
 #include "history/view/history_view_cursor_state.h"
+#include "data/data_photo.h"
+#include "data/data_document.h"
 #include "storage/storage_shared_media.h"
 #include "ui/text_options.h"
 
@@ -24,6 +26,17 @@ Storage::SharedMediaTypesMask HistoryMedia::sharedMediaTypes() const {
 	return {};
 }
 
+void HistoryMedia::cancelLocalLoads() const {
+	if (const auto photo = getPhoto()) {
+		photo->thumb->cancelLocalLoad();
+		photo->medium->cancelLocalLoad();
+		photo->full->cancelLocalLoad();
+	}
+	if (const auto document = getDocument()) {
+		document->thumb->cancelLocalLoad();
+	}
+}
+
 bool HistoryMedia::isDisplayed() const {
 	return true;
 }
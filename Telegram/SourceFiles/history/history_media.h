@@ -136,6 +136,10 @@ public:
 		return nullptr;
 	}
 
+	// Cancel reading the images from the local cache when the media is
+	// scrolled out of the visible area, they're read again when painted.
+	virtual void cancelLocalLoads() const;
+
 	void playAnimation() {
 		playAnimation(false);
 	}
@@ -364,6 +364,12 @@ PhotoData *HistoryGroupedMedia::getPhoto() const {
 	return main()->getPhoto();
 }
 
+void HistoryGroupedMedia::cancelLocalLoads() const {
+	for (const auto &part : _parts) {
+		part.content->cancelLocalLoads();
+	}
+}
+
 DocumentData *HistoryGroupedMedia::getDocument() const {
 	return main()->getDocument();
 }
@@ -49,6 +49,7 @@ public:
 
 	PhotoData *getPhoto() const override;
 	DocumentData *getDocument() const override;
+	void cancelLocalLoads() const override;
 
 	TextWithEntities selectedText(TextSelection selection) const override;
 
@@ -909,6 +909,7 @@ void HistoryMessage::applyEditionToEmpty() {
 	setReplyMarkup(nullptr);
 	refreshMedia(nullptr);
 	setEmptyText();
+	indexSearchText(QString());
 	setViewsCount(-1);
 
 	finishEditionToEmpty();
@@ -966,6 +967,7 @@ void HistoryMessage::setText(const TextWithEntities &textWithEntities) {
 		}
 	}
 
+	forgetColdText();
 	if (_media && _media->consumeMessageText(textWithEntities)) {
 		setEmptyText();
 	} else {
@@ -984,9 +986,11 @@ void HistoryMessage::setText(const TextWithEntities &textWithEntities) {
 		_textWidth = -1;
 		_textHeight = 0;
 	}
+	indexSearchText(textWithEntities.text);
 }
 
 void HistoryMessage::setEmptyText() {
+	forgetColdText();
 	_text.setMarkedText(
 		st::messageTextStyle,
 		{ QString(), EntitiesInText() },
@@ -1042,18 +1046,18 @@ TextWithEntities HistoryMessage::originalText() const {
 	if (emptyText()) {
 		return { QString(), EntitiesInText() };
 	}
-	return _text.originalTextWithEntities();
+	return originalTextWithEntities();
 }
 
 TextWithEntities HistoryMessage::clipboardText() const {
 	if (emptyText()) {
 		return { QString(), EntitiesInText() };
 	}
-	return _text.originalTextWithEntities(AllTextSelection, ExpandLinksAll);
+	return text().originalTextWithEntities(AllTextSelection, ExpandLinksAll);
 }
 
 bool HistoryMessage::textHasLinks() const {
-	return emptyText() ? false : _text.hasLinks();
+	return emptyText() ? false : text().hasLinks();
 }
 
 void HistoryMessage::setViewsCount(int32 count) {
@@ -92,6 +92,8 @@ constexpr auto kShowMembersDropdownTimeoutMs = 300;
 constexpr auto kDisplayEditTimeWarningMs = 300 * 1000;
 constexpr auto kFullDayInMs = 86400 * 1000;
 constexpr auto kCancelTypingActionTimeout = TimeMs(5000);
+constexpr auto kResizeEstimatedItemsPerStep = 100;
+constexpr auto kResizeEstimatedItemsDelay = TimeMs(0);
 
 ApiWrap::RequestMessageDataCallback replyEditMessageDataCallback() {
 	return [](ChannelData *channel, MsgId msgId) {
@@ -101,6 +103,41 @@ ApiWrap::RequestMessageDataCallback replyEditMessageDataCallback() {
 	};
 }
 
+PeerId PeerFromUser(const MTPUser &user) {
+	switch (user.type()) {
+	case mtpc_user: return peerFromUser(user.c_user().vid);
+	case mtpc_userEmpty: return peerFromUser(user.c_userEmpty().vid);
+	}
+	return 0;
+}
+
+PeerId PeerFromChat(const MTPChat &chat) {
+	switch (chat.type()) {
+	case mtpc_chat: return peerFromChat(chat.c_chat().vid);
+	case mtpc_chatEmpty: return peerFromChat(chat.c_chatEmpty().vid);
+	case mtpc_chatForbidden: return peerFromChat(chat.c_chatForbidden().vid);
+	case mtpc_channel: return peerFromChannel(chat.c_channel().vid);
+	case mtpc_channelForbidden:
+		return peerFromChannel(chat.c_channelForbidden().vid);
+	}
+	return 0;
+}
+
+// Cached users and chats may be outdated, so only the ones
+// that were not received from the server yet are used.
+template <typename Type, typename Method>
+QVector<Type> FilterNotLoaded(const QVector<Type> &list, Method peerId) {
+	auto result = QVector<Type>();
+	result.reserve(list.size());
+	for (const auto &entry : list) {
+		const auto id = peerId(entry);
+		if (id && !App::peerLoaded(id)) {
+			result.push_back(entry);
+		}
+	}
+	return result;
+}
+
 void ActivateWindowDelayed(not_null<Window::Controller*> controller) {
 	const auto window = controller->window();
 	const auto weak = make_weak(window.get());
@@ -430,6 +467,7 @@ HistoryWidget::HistoryWidget(
 , _attachDragState(DragState::None)
 , _attachDragDocument(this)
 , _attachDragPhoto(this)
+, _a_highlight(animation(this, &HistoryWidget::step_highlight))
 , _sendActionStopTimer([this] { cancelTypingAction(); })
 , _topShadow(this) {
 	setAcceptDrops(true);
@@ -472,7 +510,7 @@ HistoryWidget::HistoryWidget(
 
 	_scrollTimer.setSingleShot(false);
 
-	_highlightTimer.setCallback([this] { updateHighlightedMessage(); });
+	_resizeEstimatedTimer.setCallback([this] { resizeEstimatedItems(); });
 
 	_membersDropdownShowTimer.setSingleShot(true);
 	connect(&_membersDropdownShowTimer, SIGNAL(timeout()), this, SLOT(onMembersDropdownShow()));
@@ -810,7 +848,7 @@ void HistoryWidget::enqueueMessageHighlight(
 		}
 	}
 	auto enqueueMessageId = [this](MsgId universalId) {
-		if (_highlightQueue.empty() && !_highlightTimer.isActive()) {
+		if (_highlightQueue.empty() && !_a_highlight.animating()) {
 			highlightMessage(universalId);
 		} else if (_highlightedMessageId != universalId
 			&& !base::contains(_highlightQueue, universalId)) {
@@ -829,14 +867,14 @@ void HistoryWidget::enqueueMessageHighlight(
 void HistoryWidget::highlightMessage(MsgId universalMessageId) {
 	_highlightStart = getms();
 	_highlightedMessageId = universalMessageId;
-	_highlightTimer.callEach(AnimationTimerDelta);
+	_a_highlight.start();
 
 	adjustHighlightedMessageToMigrated();
 }
 
 void HistoryWidget::adjustHighlightedMessageToMigrated() {
 	if (_history
-		&& _highlightTimer.isActive()
+		&& _a_highlight.animating()
 		&& _highlightedMessageId > 0
 		&& _migrated
 		&& !_migrated->isEmpty()
@@ -853,7 +891,7 @@ void HistoryWidget::adjustHighlightedMessageToMigrated() {
 }
 
 void HistoryWidget::checkNextHighlight() {
-	if (_highlightTimer.isActive()) {
+	if (_a_highlight.animating()) {
 		return;
 	}
 	auto nextHighlight = [this] {
@@ -873,6 +911,10 @@ void HistoryWidget::checkNextHighlight() {
 	highlightMessage(nextHighlight);
 }
 
+void HistoryWidget::step_highlight(TimeMs ms, bool timer) {
+	updateHighlightedMessage();
+}
+
 void HistoryWidget::updateHighlightedMessage() {
 	const auto item = getItemFromHistoryOrMigrated(_highlightedMessageId);
 	const auto view = item ? item->mainView() : nullptr;
@@ -896,13 +938,13 @@ TimeMs HistoryWidget::highlightStartTime(not_null<const HistoryItem*> item) cons
 		}
 		return false;
 	};
-	return (isHighlighted(item) && _highlightTimer.isActive())
+	return (isHighlighted(item) && _a_highlight.animating())
 		? _highlightStart
 		: 0;
 }
 
 void HistoryWidget::stopMessageHighlight() {
-	_highlightTimer.cancel();
+	_a_highlight.stop();
 	_highlightedMessageId = 0;
 	checkNextHighlight();
 }
@@ -1779,7 +1821,6 @@ void HistoryWidget::showHistory(const PeerId &peerId, MsgId showAtMsgId, bool re
 	if (_peer) {
 		App::forgetMedia();
 		Auth().data().forgetMedia();
-		_serviceImageCacheSize = imageCacheSize();
 		Auth().downloader().clearPriorities();
 
 		_history = App::history(_peer);
@@ -1886,7 +1927,10 @@ void HistoryWidget::clearAllLoadRequests() {
 	if (_firstLoadRequest) MTP::cancel(_firstLoadRequest);
 	if (_preloadRequest) MTP::cancel(_preloadRequest);
 	if (_preloadDownRequest) MTP::cancel(_preloadDownRequest);
+	if (_cachedSliceRequest) MTP::cancel(_cachedSliceRequest);
 	_preloadRequest = _preloadDownRequest = _firstLoadRequest = 0;
+	_cachedSliceRequest = 0;
+	_cachedSliceIds.clear();
 }
 
 void HistoryWidget::updateFieldSubmitSettings() {
@@ -2311,6 +2355,9 @@ bool HistoryWidget::messagesFailed(const RPCError &error, mtpRequestId requestId
 		controller()->showBackFromStack();
 	} else if (_delayedShowAtRequest == requestId) {
 		_delayedShowAtRequest = 0;
+	} else if (_cachedSliceRequest == requestId) {
+		_cachedSliceRequest = 0;
+		_cachedSliceIds.clear();
 	}
 	return true;
 }
@@ -2318,23 +2365,29 @@ bool HistoryWidget::messagesFailed(const RPCError &error, mtpRequestId requestId
 void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages &messages, mtpRequestId requestId) {
 	if (!_history) {
 		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _delayedShowAtRequest = 0;
+		_cachedSliceRequest = 0;
 		return;
 	}
 
 	bool toMigrated = (peer == _peer->migrateFrom());
 	if (peer != _peer && !toMigrated) {
 		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _delayedShowAtRequest = 0;
+		_cachedSliceRequest = 0;
 		return;
 	}
 
 	auto count = 0;
 	const QVector<MTPMessage> emptyList, *histList = &emptyList;
+	const QVector<MTPUser> emptyUsers, *histUsers = &emptyUsers;
+	const QVector<MTPChat> emptyChats, *histChats = &emptyChats;
 	switch (messages.type()) {
 	case mtpc_messages_messages: {
 		auto &d(messages.c_messages_messages());
 		App::feedUsers(d.vusers);
 		App::feedChats(d.vchats);
 		histList = &d.vmessages.v;
+		histUsers = &d.vusers.v;
+		histChats = &d.vchats.v;
 		count = histList->size();
 	} break;
 	case mtpc_messages_messagesSlice: {
@@ -2342,6 +2395,8 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 		App::feedUsers(d.vusers);
 		App::feedChats(d.vchats);
 		histList = &d.vmessages.v;
+		histUsers = &d.vusers.v;
+		histChats = &d.vchats.v;
 		count = d.vcount.v;
 	} break;
 	case mtpc_messages_channelMessages: {
@@ -2354,6 +2409,8 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 		App::feedUsers(d.vusers);
 		App::feedChats(d.vchats);
 		histList = &d.vmessages.v;
+		histUsers = &d.vusers.v;
+		histChats = &d.vchats.v;
 		count = d.vcount.v;
 	} break;
 	case mtpc_messages_messagesNotModified: {
@@ -2401,12 +2458,48 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 		}
 		addMessagesToFront(peer, *histList);
 		_firstLoadRequest = 0;
+		if (!toMigrated) {
+			writeCachedSlice(*histList, *histUsers, *histChats);
+		}
 		if (_history->loadedAtTop() && _history->isEmpty() && count > 0) {
 			firstLoadMessages();
 			return;
 		}
 
 		historyLoaded();
+	} else if (_cachedSliceRequest == requestId) {
+		_cachedSliceRequest = 0;
+		applyCachedSliceDifference(*histList);
+
+		if (_preloadRequest) MTP::cancel(_preloadRequest);
+		if (_preloadDownRequest) MTP::cancel(_preloadDownRequest);
+		_preloadRequest = _preloadDownRequest = 0;
+
+		// Keep the message the user is reading from the cached page.
+		const auto anchor = _history->scrollTopItem
+			? _history->scrollTopItem->data().get()
+			: nullptr;
+		const auto anchorOffset = _history->scrollTopOffset;
+		_history->unloadBlocks();
+		_firstLoadRequest = -1; // hack - don't updateListSize yet
+		addMessagesToFront(peer, *histList);
+		_firstLoadRequest = 0;
+		writeCachedSlice(*histList, *histUsers, *histChats);
+		if (_history->loadedAtTop() && _history->isEmpty() && count > 0) {
+			firstLoadMessages();
+			return;
+		}
+
+		const auto anchorView = anchor ? anchor->mainView() : nullptr;
+		if (_historyInited && (!anchor || anchorView)) {
+			_history->scrollTopItem = anchorView;
+			_history->scrollTopOffset = anchorOffset;
+			updateHistoryGeometry();
+			updateBotKeyboard();
+		} else {
+			_historyInited = false;
+			historyLoaded();
+		}
 	} else if (_delayedShowAtRequest == requestId) {
 		if (toMigrated) {
 			_history->unloadBlocks();
@@ -2458,7 +2551,9 @@ void HistoryWidget::windowShown() {
 
 bool HistoryWidget::doWeReadServerHistory() const {
 	if (!_history || !_list) return true;
-	if (_firstLoadRequest || _a_show.animating()) return false;
+	if (_firstLoadRequest || _cachedSliceRequest || _a_show.animating()) {
+		return false;
+	}
 	if (_history->loadedAtBottom()) {
 		int scrollTop = _scroll->scrollTop();
 		if (scrollTop + 1 > _scroll->scrollTopMax()) return true;
@@ -2484,7 +2579,7 @@ bool HistoryWidget::doWeReadMentions() const {
 }
 
 void HistoryWidget::firstLoadMessages() {
-	if (!_history || _firstLoadRequest) return;
+	if (!_history || _firstLoadRequest || _cachedSliceRequest) return;
 
 	auto from = _peer;
 	auto offsetId = 0;
@@ -2526,6 +2621,9 @@ void HistoryWidget::firstLoadMessages() {
 	auto minId = 0;
 	auto historyHash = 0;
 
+	const auto cached = (from == _peer)
+		&& _history->isEmpty()
+		&& Local::hasHistorySlice(_peer->id, offsetId);
 	_firstLoadRequest = MTP::send(
 		MTPmessages_GetHistory(
 			from->input,
@@ -2536,8 +2634,18 @@ void HistoryWidget::firstLoadMessages() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)),
-		rpcDone(&HistoryWidget::messagesReceived, from),
+		rpcParseInBackground(
+			rpcDone(&HistoryWidget::messagesReceived, from)),
 		rpcFail(&HistoryWidget::messagesFailed));
+	if (cached) {
+		const auto requestId = _firstLoadRequest;
+		Local::readHistorySlice(
+			_peer->id,
+			offsetId,
+			base::lambda_guarded(this, [=](Local::HistorySlice &&slice) {
+				cachedSliceLoaded(requestId, std::move(slice));
+			}));
+	}
 }
 
 void HistoryWidget::loadMessages() {
@@ -2573,7 +2681,8 @@ void HistoryWidget::loadMessages() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)),
-		rpcDone(&HistoryWidget::messagesReceived, from->peer.get()),
+		rpcParseInBackground(
+			rpcDone(&HistoryWidget::messagesReceived, from->peer.get())),
 		rpcFail(&HistoryWidget::messagesFailed));
 }
 
@@ -2613,7 +2722,8 @@ void HistoryWidget::loadMessagesDown() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)),
-		rpcDone(&HistoryWidget::messagesReceived, from->peer.get()),
+		rpcParseInBackground(
+			rpcDone(&HistoryWidget::messagesReceived, from->peer.get())),
 		rpcFail(&HistoryWidget::messagesFailed));
 }
 
@@ -2665,12 +2775,12 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)),
-		rpcDone(&HistoryWidget::messagesReceived, from),
+		rpcParseInBackground(
+			rpcDone(&HistoryWidget::messagesReceived, from)),
 		rpcFail(&HistoryWidget::messagesFailed));
 }
 
 void HistoryWidget::onScroll() {
-	App::checkImageCacheSize();
 	preloadHistoryIfNeeded();
 	visibleAreaUpdated();
 	if (!_synteticScrollEvent) {
@@ -2698,6 +2808,18 @@ void HistoryWidget::visibleAreaUpdated() {
 	if (_list && !_scroll->isHidden()) {
 		auto scrollTop = _scroll->scrollTop();
 		auto scrollBottom = scrollTop + _scroll->height();
+		if (_list->resizeEstimatedItemsIn(scrollTop, scrollBottom)) {
+			// Lay out the blocks right away, so that the items below the
+			// resized ones are not painted once at their old positions.
+			if (_inUpdateHistoryGeometry) {
+				updateListSize();
+				crl::on_main(this, [=] { handlePendingHistoryUpdate(); });
+			} else {
+				handlePendingHistoryUpdate();
+			}
+			scrollTop = _scroll->scrollTop();
+			scrollBottom = scrollTop + _scroll->height();
+		}
 		_list->visibleAreaUpdated(scrollTop, scrollBottom);
 		if (_history->loadedAtBottom() && (_history->unreadCount() > 0 || (_migrated && _migrated->unreadCount() > 0))) {
 			const auto unread = firstUnreadMessage();
@@ -4709,6 +4831,12 @@ void HistoryWidget::updateHistoryGeometry(bool initial, bool loadedDown, const S
 	if (_firstLoadRequest || _a_show.animating()) {
 		return; // scrollTopMax etc are not working after recountHistoryGeometry()
 	}
+	const auto wasInUpdateHistoryGeometry = std::exchange(
+		_inUpdateHistoryGeometry,
+		true);
+	const auto guard = gsl::finally([&] {
+		_inUpdateHistoryGeometry = wasInUpdateHistoryGeometry;
+	});
 
 	auto newScrollHeight = height() - _topBar->height();
 	if (!editingMessage() && (isBlocked() || isBotStart() || isJoinChannel() || isMuteUnmute())) {
@@ -4757,6 +4885,9 @@ void HistoryWidget::updateHistoryGeometry(bool initial, bool loadedDown, const S
 
 	updateListSize();
 	_updateHistoryGeometryRequired = false;
+	if (_list->hasEstimatedItems() && !_resizeEstimatedTimer.isActive()) {
+		_resizeEstimatedTimer.callOnce(kResizeEstimatedItemsDelay);
+	}
 
 	if ((!initial && !wasAtBottom)
 		|| (loadedDown
@@ -4820,6 +4951,18 @@ void HistoryWidget::updateListSize() {
 	_updateHistoryGeometryRequired = true;
 }
 
+void HistoryWidget::resizeEstimatedItems() {
+	if (!_list) {
+		return;
+	}
+	if (_list->resizeEstimatedItems(kResizeEstimatedItemsPerStep)) {
+		handlePendingHistoryUpdate();
+	}
+	if (_list->hasEstimatedItems()) {
+		_resizeEstimatedTimer.callOnce(kResizeEstimatedItemsDelay);
+	}
+}
+
 bool HistoryWidget::hasPendingResizedItems() const {
 	return (_history && _history->hasPendingResizedItems())
 		|| (_migrated && _migrated->hasPendingResizedItems());
@@ -4870,6 +5013,96 @@ void HistoryWidget::addMessagesToBack(PeerData *peer, const QVector<MTPMessage>
 	}
 }
 
+void HistoryWidget::cachedSliceLoaded(
+		mtpRequestId requestId,
+		Local::HistorySlice &&slice) {
+	// Show the cached slice only if the server one was not received yet.
+	if (!_history
+		|| _firstLoadRequest != requestId
+		|| !_history->isEmpty()) {
+		return;
+	}
+	_firstLoadRequest = 0;
+	if (showCachedSlice(slice)) {
+		_cachedSliceRequest = requestId;
+	} else {
+		_firstLoadRequest = requestId;
+	}
+}
+
+bool HistoryWidget::showCachedSlice(const Local::HistorySlice &slice) {
+	if (slice.messages.isEmpty()) {
+		return false;
+	}
+	App::feedUsers(MTP_vector<MTPUser>(
+		FilterNotLoaded(slice.users, PeerFromUser)));
+	App::feedChats(MTP_vector<MTPChat>(
+		FilterNotLoaded(slice.chats, PeerFromChat)));
+
+	// Remember the items that were created from the cache,
+	// they're checked against the server slice when it arrives.
+	_cachedSliceIds.clear();
+	_cachedSliceIds.reserve(slice.messages.size());
+	for (const auto &message : slice.messages) {
+		const auto id = idFromMessage(message);
+		if (id && !App::histItemById(_channel, id)) {
+			_cachedSliceIds.push_back(id);
+		}
+	}
+	addMessagesToFront(_peer, slice.messages);
+	if (_history->isEmpty()) {
+		_cachedSliceIds.clear();
+		return false;
+	}
+	historyLoaded();
+	return true;
+}
+
+void HistoryWidget::applyCachedSliceDifference(
+		const QVector<MTPMessage> &messages) {
+	const auto cached = base::take(_cachedSliceIds);
+	auto received = base::flat_set<MsgId>();
+	for (const auto &message : messages) {
+		if (const auto id = idFromMessage(message)) {
+			received.emplace(id);
+		}
+	}
+	for (const auto &message : messages) {
+		if (base::contains(cached, idFromMessage(message))) {
+			App::updateEditedMessage(message);
+		}
+	}
+
+	// Items inside the actual slice range that are not in it were
+	// deleted already. Items outside of the range could be still there,
+	// they're left as unloaded items by the following unloadBlocks() and
+	// they're edited if they're received again.
+	const auto minId = received.empty() ? MsgId(0) : received.front();
+	const auto maxId = received.empty() ? MsgId(0) : received.back();
+	for (const auto id : cached) {
+		if (received.contains(id)) {
+			continue;
+		} else if (id > minId && id < maxId) {
+			if (const auto item = App::histItemById(_channel, id)) {
+				item->destroy();
+			}
+		} else {
+			_history->markCachedItemUnconfirmed(id);
+		}
+	}
+}
+
+void HistoryWidget::writeCachedSlice(
+		const QVector<MTPMessage> &messages,
+		const QVector<MTPUser> &users,
+		const QVector<MTPChat> &chats) {
+	Local::writeHistorySlice(_peer->id, {
+		messages,
+		users,
+		chats,
+		_history->loadedAtBottom() });
+}
+
 void HistoryWidget::countHistoryShowFrom() {
 	if (_migrated
 		&& _showAtMsgId == ShowAtUnreadMsgId
@@ -69,6 +69,10 @@ enum class MimeDataState;
 struct PreparedList;
 } // namespace Storage
 
+namespace Local {
+struct HistorySlice;
+} // namespace Local
+
 namespace HistoryView {
 class TopBarWidget;
 } // namespace HistoryView
@@ -281,6 +285,7 @@ public:
 	void previewCancel();
 
 	void step_recording(float64 ms, bool timer);
+	void step_highlight(TimeMs ms, bool timer);
 	void stopRecording(bool send);
 
 	void onListEscapePressed();
@@ -633,6 +638,15 @@ private:
 	bool messagesFailed(const RPCError &error, mtpRequestId requestId);
 	void addMessagesToFront(PeerData *peer, const QVector<MTPMessage> &messages);
 	void addMessagesToBack(PeerData *peer, const QVector<MTPMessage> &messages);
+	void cachedSliceLoaded(
+		mtpRequestId requestId,
+		Local::HistorySlice &&slice);
+	bool showCachedSlice(const Local::HistorySlice &slice);
+	void applyCachedSliceDifference(const QVector<MTPMessage> &messages);
+	void writeCachedSlice(
+		const QVector<MTPMessage> &messages,
+		const QVector<MTPUser> &users,
+		const QVector<MTPChat> &chats);
 
 	struct BotCallbackInfo {
 		UserData *bot;
@@ -658,6 +672,7 @@ private:
 	};
 	void updateHistoryGeometry(bool initial = false, bool loadedDown = false, const ScrollChange &change = { ScrollChangeNone, 0 });
 	void updateListSize();
+	void resizeEstimatedItems();
 
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const;
@@ -730,6 +745,10 @@ private:
 	MsgId _delayedShowAtMsgId = -1;
 	mtpRequestId _delayedShowAtRequest = 0;
 
+	// Shown from the local cache while the first slice is requested.
+	mtpRequestId _cachedSliceRequest = 0;
+	std::vector<MsgId> _cachedSliceIds;
+
 	object_ptr<HistoryView::TopBarWidget> _topBar;
 	object_ptr<Ui::ScrollArea> _scroll;
 	QPointer<HistoryInner> _list;
@@ -830,7 +849,6 @@ private:
 
 	TextUpdateEvents _textUpdateEvents = (TextUpdateEvents() | TextUpdateEvent::SaveDraft | TextUpdateEvent::SendTyping);
 
-	int64 _serviceImageCacheSize = 0;
 	QString _confirmSource;
 
 	Animation _a_show;
@@ -842,9 +860,12 @@ private:
 
 	MsgId _highlightedMessageId = 0;
 	std::deque<MsgId> _highlightQueue;
-	base::Timer _highlightTimer;
+	BasicAnimation _a_highlight;
 	TimeMs _highlightStart = 0;
 
+	base::Timer _resizeEstimatedTimer;
+	bool _inUpdateHistoryGeometry = false;
+
 	QMap<QPair<not_null<History*>, SendAction::Type>, mtpRequestId> _sendActionRequests;
 	base::Timer _sendActionStopTimer;
 
@@ -27,6 +27,10 @@ namespace {
 // A new message from the same sender is attached to previous within 15 minutes.
 constexpr int kAttachMessageToPreviousSecondsDelta = 900;
 
+// Widths that differ less than that are considered the same for the
+// cached height, the estimated height is fixed by the next layout anyway.
+constexpr int kHeightCacheWidthBucket = 8;
+
 } // namespace
 
 TextSelection UnshiftItemSelection(
@@ -219,6 +223,45 @@ bool Element::pendingResize() const {
 	return _flags & Flag::NeedsResize;
 }
 
+void Element::estimateHeight(int newWidth) {
+	if (!width()) {
+		// Never laid out yet, nothing to estimate from.
+		return;
+	}
+	if (!heightEstimated()) {
+		rememberHeight(width(), height());
+	}
+	const auto bucket = newWidth / kHeightCacheWidthBucket;
+	const auto i = ranges::find_if(_cachedHeights, [&](
+			const CachedHeight &cached) {
+		return cached.width
+			&& (cached.width / kHeightCacheWidthBucket == bucket);
+	});
+	const auto estimated = (i != end(_cachedHeights))
+		? i->height
+		: height();
+	_flags |= Flag::HeightEstimated;
+	setCurrentSize(QSize(newWidth, estimated));
+}
+
+void Element::rememberHeight(int width, int height) {
+	const auto bucket = width / kHeightCacheWidthBucket;
+	auto i = ranges::find_if(_cachedHeights, [&](
+			const CachedHeight &cached) {
+		return cached.width
+			&& (cached.width / kHeightCacheWidthBucket == bucket);
+	});
+	if (i == end(_cachedHeights)) {
+		i = end(_cachedHeights) - 1;
+	}
+	std::rotate(begin(_cachedHeights), i, i + 1);
+	_cachedHeights.front() = { width, height };
+}
+
+bool Element::heightEstimated() const {
+	return _flags & Flag::HeightEstimated;
+}
+
 bool Element::isAttachedToPrevious() const {
 	return _flags & Flag::AttachedToPrevious;
 }
@@ -394,9 +437,13 @@ QSize Element::countOptimalSize() {
 }
 
 QSize Element::countCurrentSize(int newWidth) {
+	_flags &= ~Flag::HeightEstimated;
 	if (_flags & Flag::NeedsResize) {
 		_flags &= ~Flag::NeedsResize;
 		initDimensions();
+
+		// The content has changed, the heights of old layouts are wrong.
+		_cachedHeights = {};
 	}
 	return performCountCurrentSize(newWidth);
 }
@@ -114,6 +114,7 @@ public:
 		AttachedToPrevious = 0x02,
 		AttachedToNext     = 0x04,
 		HiddenByGroup      = 0x08,
+		HeightEstimated    = 0x10,
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) { return true; }
@@ -134,6 +135,11 @@ public:
 
 	void setPendingResize();
 	bool pendingResize() const;
+
+	// Takes a height for the new width without laying the element out,
+	// the exact height is known after the next resizeGetHeight() call.
+	void estimateHeight(int newWidth);
+	bool heightEstimated() const;
 	bool isUnderCursor() const;
 
 	bool isAttachedToPrevious() const;
@@ -269,6 +275,7 @@ private:
 	virtual QSize performCountCurrentSize(int newWidth) = 0;
 
 	void refreshMedia();
+	void rememberHeight(int width, int height);
 
 	const not_null<ElementDelegate*> _delegate;
 	const not_null<HistoryItem*> _data;
@@ -280,6 +287,16 @@ private:
 
 	Flags _flags = Flag::NeedsResize;
 
+	// Heights of the latest layouts for different widths, most recent
+	// first, good for the estimation when the width returns back, like
+	// after maximizing and restoring the window or toggling a column.
+	struct CachedHeight {
+		int width = 0;
+		int height = 0;
+	};
+	static constexpr auto kCachedHeightsCount = 3;
+	std::array<CachedHeight, kCachedHeightsCount> _cachedHeights;
+
 	HistoryBlock *_block = nullptr;
 	int _indexInBlock = -1;
 
@@ -240,7 +240,7 @@ ListWidget::ListWidget(
 , _scrollDateCheck([this] { scrollDateCheck(); })
 , _applyUpdatedScrollState([this] { applyUpdatedScrollState(); })
 , _selectEnabled(_delegate->listAllowsMultiSelect())
-, _highlightTimer([this] { updateHighlightedMessage(); }) {
+, _highlightAnimation(animation(this, &ListWidget::step_highlight)) {
 	setMouseTracking(true);
 	_scrollDateHideTimer.setCallback([this] { scrollDateHideByTimer(); });
 	Auth().data().viewRepaintRequest(
@@ -423,13 +423,17 @@ void ListWidget::highlightMessage(FullMsgId itemId) {
 		if (const auto view = viewForItem(item)) {
 			_highlightStart = getms();
 			_highlightedMessageId = itemId;
-			_highlightTimer.callEach(AnimationTimerDelta);
+			_highlightAnimation.start();
 
 			repaintItem(view);
 		}
 	}
 }
 
+void ListWidget::step_highlight(TimeMs ms, bool timer) {
+	updateHighlightedMessage();
+}
+
 void ListWidget::updateHighlightedMessage() {
 	if (const auto item = App::histItemById(_highlightedMessageId)) {
 		if (const auto view = viewForItem(item)) {
@@ -440,7 +444,7 @@ void ListWidget::updateHighlightedMessage() {
 			}
 		}
 	}
-	_highlightTimer.cancel();
+	_highlightAnimation.stop();
 	_highlightedMessageId = FullMsgId();
 }
 
@@ -1112,7 +1116,7 @@ void ListWidget::elementAnimationAutoplayAsync(
 TimeMs ListWidget::elementHighlightTime(
 		not_null<const HistoryView::Element*> element) {
 	if (element->data()->fullId() == _highlightedMessageId) {
-		if (_highlightTimer.isActive()) {
+		if (_highlightAnimation.animating()) {
 			return getms() - _highlightStart;
 		}
 	}
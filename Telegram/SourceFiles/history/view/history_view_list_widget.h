@@ -383,6 +383,7 @@ private:
 	void applyUpdatedScrollState();
 	void scrollToAnimationCallback(FullMsgId attachToId);
 
+	void step_highlight(TimeMs ms, bool timer);
 	void updateHighlightedMessage();
 
 	// This function finds all history items that are displayed and calls template method
@@ -479,7 +480,7 @@ private:
 
 	TimeMs _highlightStart = 0;
 	FullMsgId _highlightedMessageId;
-	base::Timer _highlightTimer;
+	BasicAnimation _highlightAnimation;
 
 	rpl::lifetime _viewerLifetime;
 
@@ -1062,6 +1062,7 @@ void MainWidget::deleteConversation(
 			history->markFullyLoaded();
 		}
 	}
+	Local::clearHistorySlice(peer->id);
 	if (const auto channel = peer->asChannel()) {
 		channel->ptsWaitingForShortPoll(-1);
 	}
@@ -1961,6 +1962,10 @@ void MainWidget::createDialog(Dialogs::Key key) {
 	_dialogs->createDialog(key);
 }
 
+void MainWidget::createDialogs(const std::vector<Dialogs::Key> &keys) {
+	_dialogs->createDialogs(keys);
+}
+
 void MainWidget::choosePeer(PeerId peerId, MsgId showAtMsgId) {
 	if (selectingPeer()) {
 		offerPeer(peerId);
@@ -3438,9 +3443,11 @@ void MainWidget::feedChannelDifference(
 	App::feedChats(data.vchats);
 
 	_handlingChannelDifference = true;
+	Auth().data().startChatListBatch();
 	feedMessageIds(data.vother_updates);
 	App::feedMsgs(data.vnew_messages, NewMessageUnread);
 	feedUpdateVector(data.vother_updates, true);
+	Auth().data().finishChatListBatch();
 	_handlingChannelDifference = false;
 }
 
@@ -3591,9 +3598,12 @@ void MainWidget::feedDifference(
 	Auth().checkAutoLock();
 	App::feedUsers(users);
 	App::feedChats(chats);
+
+	Auth().data().startChatListBatch();
 	feedMessageIds(other);
 	App::feedMsgs(msgs, NewMessageUnread);
 	feedUpdateVector(other, true);
+	Auth().data().finishChatListBatch();
 }
 
 bool MainWidget::failDifference(const RPCError &error) {
@@ -3671,7 +3681,7 @@ void MainWidget::getDifference() {
 
 	_ptsWaiter.setRequesting(true);
 
-	MTP::send(MTPupdates_GetDifference(MTP_flags(0), MTP_int(_ptsWaiter.current()), MTPint(), MTP_int(updDate), MTP_int(updQts)), rpcDone(&MainWidget::gotDifference), rpcFail(&MainWidget::failDifference));
+	MTP::send(MTPupdates_GetDifference(MTP_flags(0), MTP_int(_ptsWaiter.current()), MTPint(), MTP_int(updDate), MTP_int(updQts)), rpcParseInBackground(rpcDone(&MainWidget::gotDifference)), rpcFail(&MainWidget::failDifference));
 }
 
 void MainWidget::getChannelDifference(ChannelData *channel, ChannelDifferenceRequest from) {
@@ -3696,7 +3706,7 @@ void MainWidget::getChannelDifference(ChannelData *channel, ChannelDifferenceReq
 			flags = 0; // No force flag when requesting for short poll.
 		}
 	}
-	MTP::send(MTPupdates_GetChannelDifference(MTP_flags(flags), channel->inputChannel, filter, MTP_int(channel->pts()), MTP_int(MTPChannelGetDifferenceLimit)), rpcDone(&MainWidget::gotChannelDifference, channel), rpcFail(&MainWidget::failChannelDifference, channel));
+	MTP::send(MTPupdates_GetChannelDifference(MTP_flags(flags), channel->inputChannel, filter, MTP_int(channel->pts()), MTP_int(MTPChannelGetDifferenceLimit)), rpcParseInBackground(rpcDone(&MainWidget::gotChannelDifference, channel)), rpcFail(&MainWidget::failChannelDifference, channel));
 }
 
 void MainWidget::mtpPing() {
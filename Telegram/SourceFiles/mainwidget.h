@@ -109,6 +109,7 @@ public:
 	void activate();
 
 	void createDialog(Dialogs::Key key);
+	void createDialogs(const std::vector<Dialogs::Key> &keys);
 	void removeDialog(Dialogs::Key key);
 	void repaintDialogRow(Dialogs::Mode list, not_null<Dialogs::Row*> row);
 	void repaintDialogRow(not_null<History*> history, MsgId messageId);
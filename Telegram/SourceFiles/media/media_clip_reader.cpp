@@ -25,8 +25,17 @@ namespace Media {
 namespace Clip {
 namespace {
 
-QVector<QThread*> threads;
-QVector<Manager*> managers;
+QThread *thread = nullptr;
+Manager *manager = nullptr;
+
+int PoolSlotsCount() {
+	// Leave some of the crl::async pool threads for other tasks.
+	static const auto result = snap(
+		QThread::idealThreadCount() / 2,
+		1,
+		int(ClipThreadsCount));
+	return result;
+}
 
 QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bool hasAlpha, QImage &cache) {
 	auto needResize = (original.width() != request.framew) || (original.height() != request.frameh);
@@ -96,23 +105,12 @@ Reader::Reader(not_null<DocumentData*> document, FullMsgId msgId, Callback &&cal
 }
 
 void Reader::init(const FileLocation &location, const QByteArray &data) {
-	if (threads.size() < ClipThreadsCount) {
-		_threadIndex = threads.size();
-		threads.push_back(new QThread());
-		managers.push_back(new Manager(threads.back()));
-		threads.back()->start();
-	} else {
-		_threadIndex = int32(rand_value<uint32>() % threads.size());
-		int32 loadLevel = 0x7FFFFFFF;
-		for (int32 i = 0, l = threads.size(); i < l; ++i) {
-			int32 level = managers.at(i)->loadLevel();
-			if (level < loadLevel) {
-				_threadIndex = i;
-				loadLevel = level;
-			}
-		}
+	if (!thread) {
+		thread = new QThread();
+		manager = new Manager(thread);
+		thread->start();
 	}
-	managers.at(_threadIndex)->append(this, location, data);
+	manager->append(this, location, data);
 }
 
 Reader::Frame *Reader::frameToShow(int32 *index) const { // 0 means not ready
@@ -184,15 +182,15 @@ void Reader::moveToNextWrite() const {
 	}
 }
 
-void Reader::callback(Reader *reader, int32 threadIndex, Notification notification) {
+void Reader::callback(Reader *reader, Notification notification) {
 	// check if reader is not deleted already
-	if (managers.size() > threadIndex && managers.at(threadIndex)->carries(reader) && reader->_callback) {
+	if (manager && manager->carries(reader) && reader->_callback) {
 		reader->_callback(notification);
 	}
 }
 
 void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, ImageRoundRadius radius, RectParts corners) {
-	if (managers.size() <= _threadIndex) error();
+	if (!manager) error();
 	if (_state == State::Error) return;
 
 	if (_step.loadAcquire() == WaitingForRequestStep) {
@@ -207,7 +205,7 @@ void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, Image
 		request.corners = corners;
 		_frames[0].request = _frames[1].request = _frames[2].request = request;
 		moveToNextShow();
-		managers.at(_threadIndex)->start(this);
+		manager->start(this);
 	}
 }
 
@@ -223,9 +221,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 		frame->displayed.storeRelease(1);
 		if (_autoPausedGif.loadAcquire()) {
 			_autoPausedGif.storeRelease(0);
-			if (managers.size() <= _threadIndex) error();
+			if (!manager) error();
 			if (_state != State::Error) {
-				managers.at(_threadIndex)->update(this);
+				manager->update(this);
 			}
 		}
 	} else {
@@ -256,9 +254,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 
 	moveToNextShow();
 
-	if (managers.size() <= _threadIndex) error();
+	if (!manager) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->update(this);
+		manager->update(this);
 	}
 
 	return frame->pix;
@@ -303,11 +301,11 @@ TimeMs Reader::getDurationMs() const {
 }
 
 void Reader::pauseResumeVideo() {
-	if (managers.size() <= _threadIndex) error();
+	if (!manager) error();
 	if (_state == State::Error) return;
 
 	_videoPauseRequest.storeRelease(1 - _videoPauseRequest.loadAcquire());
-	managers.at(_threadIndex)->start(this);
+	manager->start(this);
 }
 
 bool Reader::videoPaused() const {
@@ -327,9 +325,9 @@ State Reader::state() const {
 }
 
 void Reader::stop() {
-	if (managers.size() <= _threadIndex) error();
+	if (!manager) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->stop(this);
+		manager->stop(this);
 		_width = _height = 0;
 	}
 }
@@ -595,7 +593,7 @@ private:
 
 };
 
-Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false) {
+Manager::Manager(QThread *thread) : _poolSlots(PoolSlotsCount()) {
 	moveToThread(thread);
 	connect(thread, SIGNAL(started()), this, SLOT(process()));
 	connect(thread, SIGNAL(finished()), this, SLOT(finish()));
@@ -610,7 +608,6 @@ Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false
 
 void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data) {
 	reader->_private = new ReaderPrivate(reader, location, data);
-	_loadLevel.fetchAndAddRelaxed(AverageGifSize);
 	update(reader);
 }
 
@@ -662,14 +659,14 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 	if (result == ProcessResult::Error) {
 		if (it != _readerPointers.cend()) {
 			it.key()->error();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+			emit callback(it.key(), NotificationReinit);
 			_readerPointers.erase(it);
 		}
 		return false;
 	} else if (result == ProcessResult::Finished) {
 		if (it != _readerPointers.cend()) {
 			it.key()->finished();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+			emit callback(it.key(), NotificationReinit);
 		}
 		return false;
 	}
@@ -678,7 +675,6 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 	}
 
 	if (result == ProcessResult::Started) {
-		_loadLevel.fetchAndAddRelaxed(reader->_width * reader->_height - AverageGifSize);
 		it.key()->_durationMs = reader->_durationMs;
 		it.key()->_hasAudio = reader->_hasAudio;
 	}
@@ -706,30 +702,23 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 		if (result == ProcessResult::Started) {
 			reader->startedAt(ms);
 			it.key()->moveToNextWrite();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+			emit callback(it.key(), NotificationReinit);
 		}
 	} else if (result == ProcessResult::Paused) {
 		it.key()->moveToNextWrite();
-		emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+		emit callback(it.key(), NotificationReinit);
 	} else if (result == ProcessResult::Repaint) {
 		it.key()->moveToNextWrite();
-		emit callback(it.key(), it.key()->threadIndex(), NotificationRepaint);
+		emit callback(it.key(), NotificationRepaint);
 	}
 	return true;
 }
 
 Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
 	if (!handleProcessResult(reader, result, ms)) {
-		_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
-		delete reader;
 		return ResultHandleRemove;
 	}
 
-	_processingInThread->eventDispatcher()->processEvents(QEventLoop::AllEvents);
-	if (_processingInThread->isInterruptionRequested()) {
-		return ResultHandleStop;
-	}
-
 	if (result == ProcessResult::Repaint) {
 		{
 			QMutexLocker lock(&_readerPointersMutex);
@@ -752,14 +741,88 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 	return ResultHandleContinue;
 }
 
-void Manager::process() {
-	if (_processingInThread) {
-		_needReProcess = true;
-		return;
+void Manager::processInPool(ReaderPrivate *reader) {
+	const auto ms = getms();
+	const auto state = handleResult(reader, reader->process(ms), ms);
+
+	// The slot is free before process() is invoked, so that it can be
+	// used for the next due frame. The mutex is held for clear() to wait
+	// for the signal to be emitted after the slot is released.
+	QMutexLocker lock(&_processedMutex);
+	_processed.emplace_back(reader, state);
+	_poolSlots.release();
+	emit processDelayed();
+}
+
+void Manager::takeProcessed() {
+	auto processed = [&] {
+		QMutexLocker lock(&_processedMutex);
+		return base::take(_processed);
+	}();
+	const auto ms = getms();
+	for (const auto &[reader, state] : processed) {
+		const auto i = _readers.find(reader);
+		Assert(i != _readers.end());
+		if (state == ResultHandleRemove) {
+			delete reader;
+			_readers.erase(i);
+			continue;
+		}
+		i->inPool = false;
+		if (reader->_videoPausedAtMs) {
+			i->when = ms + 86400 * 1000ULL;
+		} else if (reader->_nextFrameWhen && reader->_started) {
+			i->when = reader->_nextFrameWhen;
+		} else {
+			i->when = (ms + 86400 * 1000ULL);
+		}
 	}
+}
 
+void Manager::dispatchDue(std::vector<ReaderPrivate*> &&due) {
+	struct Candidate {
+		ReaderPrivate *reader = nullptr;
+		bool hidden = false;
+		TimeMs when = 0;
+	};
+	auto candidates = std::vector<Candidate>();
+	candidates.reserve(due.size());
+	{
+		// The first frames and the frames of the clips that were shown
+		// are needed right now, others can be paused anyway.
+		QMutexLocker lock(&_readerPointersMutex);
+		for (const auto reader : due) {
+			auto hidden = false;
+			if (reader->_started) {
+				auto it = constUnsafeFindReaderPointer(reader);
+				auto showing = (it != _readerPointers.cend())
+					? it.key()->frameToShow()
+					: nullptr;
+				hidden = !showing || (showing->displayed.loadAcquire() <= 0);
+			}
+			candidates.push_back({ reader, hidden, _readers[reader].when });
+		}
+	}
+	ranges::sort(candidates, [](const Candidate &a, const Candidate &b) {
+		return (a.hidden != b.hidden) ? b.hidden : (a.when < b.when);
+	});
+	for (const auto &candidate : candidates) {
+		if (!_poolSlots.tryAcquire()) {
+			// The rest will be dispatched when some frames are ready.
+			break;
+		}
+		const auto reader = candidate.reader;
+		_readers[reader].inPool = true;
+		crl::async([=] {
+			processInPool(reader);
+		});
+	}
+}
+
+void Manager::process() {
 	_timer.stop();
-	_processingInThread = thread();
+
+	takeProcessed();
 
 	bool checkAllReaders = false;
 	auto ms = getms(), minms = ms + 86400 * 1000LL;
@@ -769,9 +832,12 @@ void Manager::process() {
 			if (it->loadAcquire() && it.key()->_private != nullptr) {
 				auto i = _readers.find(it.key()->_private);
 				if (i == _readers.cend()) {
-					_readers.insert(it.key()->_private, 0);
+					_readers.insert(it.key()->_private, Processing());
+				} else if (i->inPool) {
+					// Will be updated when the frame is processed.
+					continue;
 				} else {
-					i.value() = ms;
+					i->when = ms;
 					if (i.key()->_autoPausedGif && !it.key()->_autoPausedGif.loadAcquire()) {
 						i.key()->_autoPausedGif = false;
 					}
@@ -789,50 +855,40 @@ void Manager::process() {
 		checkAllReaders = (_readers.size() > _readerPointers.size());
 	}
 
+	auto due = std::vector<ReaderPrivate*>();
 	for (auto i = _readers.begin(), e = _readers.end(); i != e;) {
 		ReaderPrivate *reader = i.key();
-		if (i.value() <= ms) {
-			ResultHandleState state = handleResult(reader, reader->process(ms), ms);
-			if (state == ResultHandleRemove) {
-				i = _readers.erase(i);
-				continue;
-			} else if (state == ResultHandleStop) {
-				_processingInThread = 0;
-				return;
-			}
-			ms = getms();
-			if (reader->_videoPausedAtMs) {
-				i.value() = ms + 86400 * 1000ULL;
-			} else if (reader->_nextFrameWhen && reader->_started) {
-				i.value() = reader->_nextFrameWhen;
-			} else {
-				i.value() = (ms + 86400 * 1000ULL);
-			}
+		if (i->inPool) {
+			++i;
+			continue;
+		} else if (i->when <= ms) {
+			due.push_back(reader);
+			++i;
+			continue;
 		} else if (checkAllReaders) {
 			QMutexLocker lock(&_readerPointersMutex);
 			auto it = constUnsafeFindReaderPointer(reader);
 			if (it == _readerPointers.cend()) {
-				_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
 				delete reader;
 				i = _readers.erase(i);
 				continue;
 			}
 		}
-		if (!reader->_autoPausedGif && i.value() < minms) {
-			minms = i.value();
+		if (!reader->_autoPausedGif && i->when < minms) {
+			minms = i->when;
 		}
 		++i;
 	}
+	if (!due.empty()) {
+		dispatchDue(std::move(due));
+	}
 
 	ms = getms();
-	if (_needReProcess || minms <= ms) {
-		_needReProcess = false;
+	if (minms <= ms) {
 		_timer.start(1);
 	} else {
 		_timer.start(minms - ms);
 	}
-
-	_processingInThread = 0;
 }
 
 void Manager::finish() {
@@ -841,6 +897,13 @@ void Manager::finish() {
 }
 
 void Manager::clear() {
+	// Wait for the frames being processed in the pool.
+	_poolSlots.acquire(PoolSlotsCount());
+	_poolSlots.release(PoolSlotsCount());
+	{
+		QMutexLocker lock(&_processedMutex);
+		_processed.clear();
+	}
 	{
 		QMutexLocker lock(&_readerPointersMutex);
 		for (auto it = _readerPointers.begin(), e = _readerPointers.end(); it != e; ++it) {
@@ -896,16 +959,12 @@ FileMediaInformation::Video PrepareForSending(const QString &fname, const QByteA
 }
 
 void Finish() {
-	if (!threads.isEmpty()) {
-		for (int32 i = 0, l = threads.size(); i < l; ++i) {
-			threads.at(i)->quit();
-			DEBUG_LOG(("Waiting for clipThread to finish: %1").arg(i));
-			threads.at(i)->wait();
-			delete managers.at(i);
-			delete threads.at(i);
-		}
-		threads.clear();
-		managers.clear();
+	if (thread) {
+		thread->quit();
+		DEBUG_LOG(("Waiting for clipThread to finish"));
+		thread->wait();
+		delete base::take(manager);
+		delete base::take(thread);
 	}
 }
 
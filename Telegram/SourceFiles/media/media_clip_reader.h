@@ -51,7 +51,7 @@ public:
 	Reader(const QString &filepath, Callback &&callback, Mode mode = Mode::Gif, TimeMs seekMs = 0);
 	Reader(not_null<DocumentData*> document, FullMsgId msgId, Callback &&callback, Mode mode = Mode::Gif, TimeMs seekMs = 0);
 
-	static void callback(Reader *reader, int threadIndex, Notification notification); // reader can be deleted
+	static void callback(Reader *reader, Notification notification); // reader can be deleted
 
 	void setAutoplay() {
 		_autoplay = true;
@@ -86,9 +86,6 @@ public:
 		return _autoPausedGif.loadAcquire();
 	}
 	bool videoPaused() const;
-	int threadIndex() const {
-		return _threadIndex;
-	}
 
 	int width() const;
 	int height() const;
@@ -156,7 +153,6 @@ private:
 
 	QAtomicInt _autoPausedGif = 0;
 	QAtomicInt _videoPauseRequest = 0;
-	int32 _threadIndex;
 
 	bool _autoplay = false;
 
@@ -181,15 +177,17 @@ enum class ProcessResult {
 	Wait,
 };
 
+// Keeps the frame deadlines of all the readers in its own thread and
+// decodes the due frames in the crl::async thread pool, at most one
+// frame of each reader at a time. Only a part of the pool threads is
+// used, when more frames are due than can be decoded at once the
+// displayed clips go first, then the earliest ones.
 class Manager : public QObject {
 	Q_OBJECT
 
 public:
 
 	Manager(QThread *thread);
-	int32 loadLevel() const {
-		return _loadLevel.load();
-	}
 	void append(Reader *reader, const FileLocation &location, const QByteArray &data);
 	void start(Reader *reader);
 	void update(Reader *reader);
@@ -200,7 +198,7 @@ public:
 signals:
 	void processDelayed();
 
-	void callback(Media::Clip::Reader *reader, qint32 threadIndex, qint32 notification);
+	void callback(Media::Clip::Reader *reader, qint32 notification);
 
 public slots:
 	void process();
@@ -210,7 +208,6 @@ private:
 
 	void clear();
 
-	QAtomicInt _loadLevel;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
 	ReaderPointers _readerPointers;
 	mutable QMutex _readerPointersMutex;
@@ -222,17 +219,26 @@ private:
 
 	enum ResultHandleState {
 		ResultHandleRemove,
-		ResultHandleStop,
 		ResultHandleContinue,
 	};
 	ResultHandleState handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms);
 
-	typedef QMap<ReaderPrivate*, TimeMs> Readers;
+	void processInPool(ReaderPrivate *reader);
+	void takeProcessed();
+	void dispatchDue(std::vector<ReaderPrivate*> &&due);
+
+	struct Processing {
+		TimeMs when = 0;
+		bool inPool = false;
+	};
+	using Readers = QMap<ReaderPrivate*, Processing>;
 	Readers _readers;
 
+	QSemaphore _poolSlots;
+	std::vector<std::pair<ReaderPrivate*, ResultHandleState>> _processed;
+	QMutex _processedMutex;
+
 	QTimer _timer;
-	QThread *_processingInThread;
-	bool _needReProcess;
 
 };
 
@@ -691,6 +691,7 @@ void MediaView::clearData() {
 }
 
 MediaView::~MediaView() {
+	pauseLoaders();
 	delete base::take(_menu);
 }
 
@@ -2576,6 +2577,39 @@ void MediaView::preloadData(int delta) {
 	}
 }
 
+void MediaView::pauseLoaders() {
+	if (!AuthSession::Exists()) {
+		return;
+	}
+
+	// Nobody waits for the files of the hidden viewer, so their queued
+	// local cache reads shouldn't delay the reads of the visible ones.
+	const auto pause = [](const Entity &entity) {
+		if (const auto photo = base::get_if<not_null<PhotoData*>>(&entity.data)) {
+			(*photo)->full->pause();
+		} else if (const auto document = base::get_if<not_null<DocumentData*>>(&entity.data)) {
+			if (const auto sticker = (*document)->sticker()) {
+				sticker->img->pause();
+			}
+			(*document)->thumb->pause();
+		}
+	};
+	if (_photo) {
+		_photo->full->pause();
+	}
+	if (_index) {
+		const auto from = *_index - kPreloadCount;
+		const auto till = *_index + kPreloadCount + 1;
+		for (auto index = from; index != till; ++index) {
+			pause(entityByIndex(index));
+		}
+	}
+}
+
+void MediaView::hideEvent(QHideEvent *e) {
+	pauseLoaders();
+}
+
 void MediaView::mousePressEvent(QMouseEvent *e) {
 	updateOver(e->pos());
 	if (_menu || !_receiveMouse) return;
@@ -77,6 +77,7 @@ public:
 
 protected:
 	void paintEvent(QPaintEvent *e) override;
+	void hideEvent(QHideEvent *e) override;
 
 	void keyPressEvent(QKeyEvent *e) override;
 	void wheelEvent(QWheelEvent *e) override;
@@ -139,6 +140,7 @@ private:
 	void moveToScreen();
 	bool moveToNext(int delta);
 	void preloadData(int delta);
+	void pauseLoaders();
 	struct Entity {
 		base::optional_variant<
 			not_null<PhotoData*>,
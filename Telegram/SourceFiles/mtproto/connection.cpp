@@ -234,9 +234,9 @@ ModExpFirst CreateModExp(
 
 void wrapInvokeAfter(mtpRequest &to, const mtpRequest &from, const mtpRequestMap &haveSent, int32 skipBeforeRequest = 0) {
 	mtpMsgId afterId(*(mtpMsgId*)(from->after->data() + 4));
-	mtpRequestMap::const_iterator i = afterId ? haveSent.constFind(afterId) : haveSent.cend();
+	mtpRequestMap::const_iterator i = afterId ? haveSent.find(afterId) : haveSent.cend();
 	int32 size = to->size(), lenInInts = (from.innerLength() >> 2), headlen = 4, fulllen = headlen + lenInInts;
-	if (i == haveSent.constEnd()) { // no invoke after or such msg was not sent or was completed recently
+	if (i == haveSent.cend()) { // no invoke after or such msg was not sent or was completed recently
 		to->resize(size + fulllen + skipBeforeRequest);
 		if (skipBeforeRequest) {
 			memcpy(to->data() + size, from->constData() + 4, headlen * sizeof(mtpPrime));
@@ -520,6 +520,7 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 	QWriteLocker locker2(sessionData->toResendMutex());
 	QWriteLocker locker3(sessionData->toSendMutex());
 	QWriteLocker locker4(sessionData->wereAckedMutex());
+	sessionData->applyQueuedToSend();
 	mtpRequestMap &haveSent(sessionData->haveSentMap());
 	mtpRequestIdsMap &toResend(sessionData->toResendMap());
 	mtpPreRequestMap &toSend(sessionData->toSendMap());
@@ -530,13 +531,13 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 	typedef QMap<mtpMsgId, mtpMsgId> Replaces;
 	Replaces replaces;
 	for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-		if (!mtpRequestData::isSentContainer(i.value())) {
-			if (!*(mtpMsgId*)(i.value()->constData() + 4)) continue;
+		if (!mtpRequestData::isSentContainer(i->second)) {
+			if (!*(mtpMsgId*)(i->second->constData() + 4)) continue;
 
-			mtpMsgId id = i.key();
+			mtpMsgId id = i->first;
 			if (id > newId) {
 				while (true) {
-					if (toResend.constFind(newId) == toResend.cend() && wereAcked.constFind(newId) == wereAcked.cend() && haveSent.constFind(newId) == haveSent.cend()) {
+					if (!toResend.contains(newId) && !wereAcked.contains(newId) && !haveSent.contains(newId)) {
 						break;
 					}
 					mtpMsgId m = msgid();
@@ -548,22 +549,22 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 				MTP_LOG(_shiftedDcId, ("Replacing msgId %1 to %2!").arg(id).arg(newId));
 				replaces.insert(id, newId);
 				id = newId;
-				*(mtpMsgId*)(i.value()->data() + 4) = id;
+				*(mtpMsgId*)(i->second->data() + 4) = id;
 			}
-			setSeqNumbers.insert(id, i.value());
+			setSeqNumbers[id] = i->second;
 		}
 	}
 	for (mtpRequestIdsMap::const_iterator i = toResend.cbegin(), e = toResend.cend(); i != e; ++i) { // collect all non-container requests
-		mtpPreRequestMap::const_iterator j = toSend.constFind(i.value());
+		mtpPreRequestMap::const_iterator j = toSend.find(i->second);
 		if (j == toSend.cend()) continue;
 
-		if (!mtpRequestData::isSentContainer(j.value())) {
-			if (!*(mtpMsgId*)(j.value()->constData() + 4)) continue;
+		if (!mtpRequestData::isSentContainer(j->second)) {
+			if (!*(mtpMsgId*)(j->second->constData() + 4)) continue;
 
-			mtpMsgId id = i.key();
+			mtpMsgId id = i->first;
 			if (id > newId) {
 				while (true) {
-					if (toResend.constFind(newId) == toResend.cend() && wereAcked.constFind(newId) == wereAcked.cend() && haveSent.constFind(newId) == haveSent.cend()) {
+					if (!toResend.contains(newId) && !wereAcked.contains(newId) && !haveSent.contains(newId)) {
 						break;
 					}
 					mtpMsgId m = msgid();
@@ -575,9 +576,9 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 				MTP_LOG(_shiftedDcId, ("Replacing msgId %1 to %2!").arg(id).arg(newId));
 				replaces.insert(id, newId);
 				id = newId;
-				*(mtpMsgId*)(j.value()->data() + 4) = id;
+				*(mtpMsgId*)(j->second->data() + 4) = id;
 			}
-			setSeqNumbers.insert(id, j.value());
+			setSeqNumbers[id] = j->second;
 		}
 	}
 
@@ -586,34 +587,34 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 	sessionData->setSession(session);
 
 	for (mtpRequestMap::const_iterator i = setSeqNumbers.cbegin(), e = setSeqNumbers.cend(); i != e; ++i) { // generate new seq_numbers
-		bool wasNeedAck = (*(i.value()->data() + 6) & 1);
-		*(i.value()->data() + 6) = sessionData->nextRequestSeqNumber(wasNeedAck);
+		bool wasNeedAck = (*(i->second->data() + 6) & 1);
+		*(i->second->data() + 6) = sessionData->nextRequestSeqNumber(wasNeedAck);
 	}
 	if (!replaces.isEmpty()) {
 		for (Replaces::const_iterator i = replaces.cbegin(), e = replaces.cend(); i != e; ++i) { // replace msgIds keys in all data structs
 			mtpRequestMap::iterator j = haveSent.find(i.key());
 			if (j != haveSent.cend()) {
-				mtpRequest req = j.value();
+				mtpRequest req = j->second;
 				haveSent.erase(j);
-				haveSent.insert(i.value(), req);
+				haveSent[i.value()] = req;
 			}
 			mtpRequestIdsMap::iterator k = toResend.find(i.key());
 			if (k != toResend.cend()) {
-				mtpRequestId req = k.value();
+				mtpRequestId req = k->second;
 				toResend.erase(k);
-				toResend.insert(i.value(), req);
+				toResend[i.value()] = req;
 			}
 			k = wereAcked.find(i.key());
 			if (k != wereAcked.cend()) {
-				mtpRequestId req = k.value();
+				mtpRequestId req = k->second;
 				wereAcked.erase(k);
-				wereAcked.insert(i.value(), req);
+				wereAcked[i.value()] = req;
 			}
 		}
 		for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) { // replace msgIds in saved containers
-			if (mtpRequestData::isSentContainer(i.value())) {
-				mtpMsgId *ids = (mtpMsgId *)(i.value()->data() + 8);
-				for (uint32 j = 0, l = (i.value()->size() - 8) >> 1; j < l; ++j) {
+			if (mtpRequestData::isSentContainer(i->second)) {
+				mtpMsgId *ids = (mtpMsgId *)(i->second->data() + 8);
+				for (uint32 j = 0, l = (i->second->size() - 8) >> 1; j < l; ++j) {
 					Replaces::const_iterator k = replaces.constFind(ids[j]);
 					if (k != replaces.cend()) {
 						ids[j] = k.value();
@@ -664,7 +665,7 @@ mtpMsgId ConnectionPrivate::replaceMsgId(mtpRequest &request, mtpMsgId newId) {
 			mtpRequestMap &haveSent(sessionData->haveSentMap());
 
 			while (true) {
-				if (toResend.constFind(newId) == toResend.cend() && wereAcked.constFind(newId) == wereAcked.cend() && haveSent.constFind(newId) == haveSent.cend()) {
+				if (!toResend.contains(newId) && !wereAcked.contains(newId) && !haveSent.contains(newId)) {
 					break;
 				}
 				mtpMsgId m = msgid();
@@ -675,27 +676,27 @@ mtpMsgId ConnectionPrivate::replaceMsgId(mtpRequest &request, mtpMsgId newId) {
 
 			mtpRequestIdsMap::iterator i = toResend.find(oldMsgId);
 			if (i != toResend.cend()) {
-				mtpRequestId req = i.value();
+				mtpRequestId req = i->second;
 				toResend.erase(i);
-				toResend.insert(newId, req);
+				toResend[newId] = req;
 			}
 
 			mtpRequestIdsMap::iterator j = wereAcked.find(oldMsgId);
 			if (j != wereAcked.cend()) {
-				mtpRequestId req = j.value();
+				mtpRequestId req = j->second;
 				wereAcked.erase(j);
-				wereAcked.insert(newId, req);
+				wereAcked[newId] = req;
 			}
 
 			mtpRequestMap::iterator k = haveSent.find(oldMsgId);
 			if (k != haveSent.cend()) {
-				mtpRequest req = k.value();
+				mtpRequest req = k->second;
 				haveSent.erase(k);
-				haveSent.insert(newId, req);
+				haveSent[newId] = req;
 			}
 
 			for (k = haveSent.begin(); k != haveSent.cend(); ++k) {
-				mtpRequest req(k.value());
+				mtpRequest req(k->second);
 				if (mtpRequestData::isSentContainer(req)) {
 					mtpMsgId *ids = (mtpMsgId *)(req->data() + 8);
 					for (uint32 i = 0, l = (req->size() - 8) >> 1; i < l; ++i) {
@@ -803,10 +804,10 @@ void ConnectionPrivate::tryToSend() {
 		{
 			QWriteLocker locker(sessionData->stateRequestMutex());
 			mtpMsgIdsSet &ids(sessionData->stateRequestMap());
-			if (!ids.isEmpty()) {
+			if (!ids.empty()) {
 				stateReq.reserve(ids.size());
 				for (mtpMsgIdsSet::const_iterator i = ids.cbegin(), e = ids.cend(); i != e; ++i) {
-					stateReq.push_back(MTP_long(i.key()));
+					stateReq.push_back(MTP_long(i->first));
 				}
 			}
 			ids.clear();
@@ -851,7 +852,11 @@ void ConnectionPrivate::tryToSend() {
 		QWriteLocker locker1(sessionData->toSendMutex());
 
 		mtpPreRequestMap toSendDummy, &toSend(prependOnly ? toSendDummy : sessionData->toSendMap());
-		if (prependOnly) locker1.unlock();
+		if (prependOnly) {
+			locker1.unlock();
+		} else {
+			sessionData->applyQueuedToSend();
+		}
 
 		uint32 toSendCount = toSend.size();
 		if (pingRequest) ++toSendCount;
@@ -862,7 +867,7 @@ void ConnectionPrivate::tryToSend() {
 
 		if (!toSendCount) return; // nothing to send
 
-		mtpRequest first = pingRequest ? pingRequest : (ackRequest ? ackRequest : (resendRequest ? resendRequest : (stateRequest ? stateRequest : (httpWaitRequest ? httpWaitRequest : toSend.cbegin().value()))));
+		mtpRequest first = pingRequest ? pingRequest : (ackRequest ? ackRequest : (resendRequest ? resendRequest : (stateRequest ? stateRequest : (httpWaitRequest ? httpWaitRequest : toSend.cbegin()->second))));
 		if (toSendCount == 1 && first->msDate > 0) { // if can send without container
 			toSendRequest = first;
 			if (!prependOnly) {
@@ -884,7 +889,7 @@ void ConnectionPrivate::tryToSend() {
 
 					QWriteLocker locker2(sessionData->haveSentMutex());
 					mtpRequestMap &haveSent(sessionData->haveSentMap());
-					haveSent.insert(msgId, toSendRequest);
+					haveSent[msgId] = toSendRequest;
 
 					if (needsLayer && !toSendRequest->needsLayer) needsLayer = false;
 					if (toSendRequest->after) {
@@ -910,7 +915,7 @@ void ConnectionPrivate::tryToSend() {
 					needAnyResponse = true;
 				} else {
 					QWriteLocker locker3(sessionData->wereAckedMutex());
-					sessionData->wereAckedMap().insert(msgId, toSendRequest->requestId);
+					sessionData->wereAckedMap()[msgId] = toSendRequest->requestId;
 				}
 			}
 		} else { // send in container
@@ -922,8 +927,8 @@ void ConnectionPrivate::tryToSend() {
 			if (stateRequest) containerSize += mtpRequestData::messageSize(stateRequest);
 			if (httpWaitRequest) containerSize += mtpRequestData::messageSize(httpWaitRequest);
 			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
-				containerSize += mtpRequestData::messageSize(i.value());
-				if (needsLayer && i.value()->needsLayer) {
+				containerSize += mtpRequestData::messageSize(i->second);
+				if (needsLayer && i->second->needsLayer) {
 					containerSize += initSizeInInts;
 					willNeedInit = true;
 				}
@@ -959,7 +964,7 @@ void ConnectionPrivate::tryToSend() {
 				needAnyResponse = true;
 			}
 			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
-				mtpRequest &req(i.value());
+				mtpRequest &req(i->second);
 				mtpMsgId msgId = prepareToSend(req, bigMsgId);
 				if (msgId > bigMsgId) msgId = replaceMsgId(req, bigMsgId);
 				if (msgId >= bigMsgId) bigMsgId = msgid();
@@ -984,11 +989,11 @@ void ConnectionPrivate::tryToSend() {
 							*(toSendRequest->data() + reqNeedsLayer + 3) += initSize;
 							added = true;
 						}
-						haveSent.insert(msgId, req);
+						haveSent[msgId] = req;
 
 						needAnyResponse = true;
 					} else {
-						wereAcked.insert(msgId, req->requestId);
+						wereAcked[msgId] = req->requestId;
 					}
 				}
 				if (!added) {
@@ -1000,7 +1005,7 @@ void ConnectionPrivate::tryToSend() {
 			if (stateRequest) {
 				mtpMsgId msgId = placeToContainer(toSendRequest, bigMsgId, haveSentArr, stateRequest);
 				stateRequest->msDate = 0; // 0 for state request, do not request state of it
-				haveSent.insert(msgId, stateRequest);
+				haveSent[msgId] = stateRequest;
 			}
 			if (resendRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, resendRequest);
 			if (ackRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, ackRequest);
@@ -1009,7 +1014,7 @@ void ConnectionPrivate::tryToSend() {
 			mtpMsgId contMsgId = prepareToSend(toSendRequest, bigMsgId);
 			*(mtpMsgId*)(haveSentIdsWrap->data() + 4) = contMsgId;
 			(*haveSentIdsWrap)[6] = 0; // for container, msDate = 0, seqNo = 0
-			haveSent.insert(contMsgId, haveSentIdsWrap);
+			haveSent[contMsgId] = haveSentIdsWrap;
 			toSend.clear();
 		}
 	}
@@ -1529,16 +1534,9 @@ void ConnectionPrivate::handleReceived() {
 			emit sendAnythingAsync(MTPAckSendWaiting);
 		}
 
-		bool emitSignal = false;
-		{
-			QReadLocker locker(sessionData->haveReceivedMutex());
-			emitSignal = !sessionData->haveReceivedResponses().isEmpty() || !sessionData->haveReceivedUpdates().isEmpty();
-			if (emitSignal) {
-				DEBUG_LOG(("MTP Info: emitting needToReceive() - need to parse in another thread, %1 responses, %2 updates.").arg(sessionData->haveReceivedResponses().size()).arg(sessionData->haveReceivedUpdates().size()));
-			}
-		}
-
-		if (emitSignal) {
+		if (_receivedResponses || _receivedUpdates) {
+			DEBUG_LOG(("MTP Info: emitting needToReceive() - need to parse in another thread, %1 responses, %2 updates.").arg(_receivedResponses).arg(_receivedUpdates));
+			_receivedResponses = _receivedUpdates = 0;
 			emit needToReceive();
 		}
 
@@ -1681,11 +1679,11 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 						QWriteLocker locker(sessionData->haveSentMutex());
 						mtpRequestMap &haveSent(sessionData->haveSentMap());
 
-						mtpRequestMap::const_iterator i = haveSent.constFind(resendId);
+						mtpRequestMap::const_iterator i = haveSent.find(resendId);
 						if (i == haveSent.cend()) {
 							LOG(("Message Error: Container not found!"));
 						} else {
-							request = i.value();
+							request = i->second;
 						}
 					}
 					if (request) {
@@ -1817,7 +1815,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 						state |= 0x02;
 					} else {
 						state |= 0x04;
-						if (wereAcked.constFind(reqMsgId) != wereAckedEnd) {
+						if (wereAcked.find(reqMsgId) != wereAckedEnd) {
 							state |= 0x80; // we know, that server knows, that we received request
 						}
 						if (msgIdState == ReceivedMsgIds::State::NeedsAck) { // need ack, so we sent ack
@@ -1846,7 +1844,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		{ // find this request in session-shared sent requests map
 			QReadLocker locker(sessionData->haveSentMutex());
 			const mtpRequestMap &haveSent(sessionData->haveSentMap());
-			mtpRequestMap::const_iterator replyTo = haveSent.constFind(reqMsgId);
+			mtpRequestMap::const_iterator replyTo = haveSent.find(reqMsgId);
 			if (replyTo == haveSent.cend()) { // do not look in toResend, because we do not resend msgs_state_req requests
 				DEBUG_LOG(("Message Error: such message was not sent recently %1").arg(reqMsgId));
 				return (badTime ? HandleResult::Ignored : HandleResult::Success);
@@ -1859,7 +1857,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 				badTime = false;
 			}
-			requestBuffer = replyTo.value();
+			requestBuffer = replyTo->second;
 		}
 		QVector<MTPlong> toAckReq(1, MTP_long(reqMsgId)), toAck;
 		requestsAcked(toAck, true);
@@ -2024,9 +2022,17 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		auto requestId = wasSent(reqMsgId.v);
 		if (requestId && requestId != mtpRequestId(0xFFFFFFFF)) {
-			// Save rpc_result for processing in the main thread.
-			QWriteLocker locker(sessionData->haveReceivedMutex());
-			sessionData->haveReceivedResponses().insert(requestId, response);
+			// Save rpc_result for processing in the main thread,
+			// read it right here if the request handler allows that.
+			auto parsed = _instance->parseResponse(
+				requestId,
+				response.constData(),
+				response.constData() + response.size());
+			sessionData->pushReceived(
+				requestId,
+				std::move(response),
+				std::move(parsed));
+			++_receivedResponses;
 		} else {
 			DEBUG_LOG(("RPC Info: requestId not found for msgId %1").arg(reqMsgId.v));
 		}
@@ -2057,8 +2063,8 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			const mtpRequestMap &haveSent(sessionData->haveSentMap());
 			toResend.reserve(haveSent.size());
 			for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-				if (i.key() >= firstMsgId) break;
-				if (i.value()->requestId) toResend.push_back(i.key());
+				if (i->first >= firstMsgId) break;
+				if (i->second->requestId) toResend.push_back(i->first);
 			}
 		}
 		resendMany(toResend, 10, true);
@@ -2067,8 +2073,8 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		if (from > start) memcpy(update.data(), start, (from - start) * sizeof(mtpPrime));
 
 		// Notify main process about new session - need to get difference.
-		QWriteLocker locker(sessionData->haveReceivedMutex());
-		sessionData->haveReceivedUpdates().push_back(SerializedMessage(update));
+		sessionData->pushReceived(0, std::move(update));
+		++_receivedUpdates;
 	} return HandleResult::Success;
 
 	case mtpc_ping: {
@@ -2124,8 +2130,8 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		if (end > from) memcpy(update.data(), from, (end - from) * sizeof(mtpPrime));
 
 		// Notify main process about the new updates.
-		QWriteLocker locker(sessionData->haveReceivedMutex());
-		sessionData->haveReceivedUpdates().push_back(SerializedMessage(update));
+		sessionData->pushReceived(0, std::move(update));
+		++_receivedUpdates;
 
 		if (cons != mtpc_updatesTooLong
 			&& cons != mtpc_updateShortMessage
@@ -2224,23 +2230,23 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 				mtpMsgId msgId = ids[i].v;
 				mtpRequestMap::iterator req = haveSent.find(msgId);
 				if (req != haveSent.cend()) {
-					if (!req.value()->msDate) {
+					if (!req->second->msDate) {
 						DEBUG_LOG(("Message Info: container ack received, msgId %1").arg(ids[i].v));
-						uint32 inContCount = ((*req)->size() - 8) / 2;
-						const mtpMsgId *inContId = (const mtpMsgId *)(req.value()->constData() + 8);
+						uint32 inContCount = (req->second->size() - 8) / 2;
+						const mtpMsgId *inContId = (const mtpMsgId *)(req->second->constData() + 8);
 						toAckMore.reserve(toAckMore.size() + inContCount);
 						for (uint32 j = 0; j < inContCount; ++j) {
 							toAckMore.push_back(MTP_long(*(inContId++)));
 						}
 						haveSent.erase(req);
 					} else {
-						mtpRequestId reqId = req.value()->requestId;
+						mtpRequestId reqId = req->second->requestId;
 						bool moveToAcked = byResponse;
 						if (!moveToAcked) { // ignore ACK, if we need a response (if we have a handler)
 							moveToAcked = !_instance->hasCallbacks(reqId);
 						}
 						if (moveToAcked) {
-							wereAcked.insert(msgId, reqId);
+							wereAcked[msgId] = reqId;
 							haveSent.erase(req);
 						} else {
 							DEBUG_LOG(("Message Info: ignoring ACK for msgId %1 because request %2 requires a response").arg(msgId).arg(reqId));
@@ -2252,19 +2258,20 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 					mtpRequestIdsMap &toResend(sessionData->toResendMap());
 					mtpRequestIdsMap::iterator reqIt = toResend.find(msgId);
 					if (reqIt != toResend.cend()) {
-						mtpRequestId reqId = reqIt.value();
+						mtpRequestId reqId = reqIt->second;
 						bool moveToAcked = byResponse;
 						if (!moveToAcked) { // ignore ACK, if we need a response (if we have a handler)
 							moveToAcked = !_instance->hasCallbacks(reqId);
 						}
 						if (moveToAcked) {
 							QWriteLocker locker4(sessionData->toSendMutex());
+							sessionData->applyQueuedToSend();
 							mtpPreRequestMap &toSend(sessionData->toSendMap());
 							mtpPreRequestMap::iterator req = toSend.find(reqId);
 							if (req != toSend.cend()) {
-								wereAcked.insert(msgId, req.value()->requestId);
-								if (req.value()->requestId != reqId) {
-									DEBUG_LOG(("Message Error: for msgId %1 found resent request, requestId %2, contains requestId %3").arg(msgId).arg(reqId).arg(req.value()->requestId));
+								wereAcked[msgId] = req->second->requestId;
+								if (req->second->requestId != reqId) {
+									DEBUG_LOG(("Message Error: for msgId %1 found resent request, requestId %2, contains requestId %3").arg(msgId).arg(reqId).arg(req->second->requestId));
 								} else {
 									DEBUG_LOG(("Message Info: acked msgId %1 that was prepared to resend, requestId %2").arg(msgId).arg(reqId));
 								}
@@ -2290,7 +2297,7 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 			while (ackedCount-- > MTPIdsBufferSize) {
 				auto i = wereAcked.begin();
 				clearedBecauseTooOld.push_back(RPCCallbackClear(
-					i.key(),
+					i->first,
 					RPCError::TimeoutError));
 				wereAcked.erase(i);
 			}
@@ -2844,7 +2851,7 @@ void ConnectionPrivate::dhClientParamsAnswered() {
 		DEBUG_LOG(("AuthKey Info: auth key gen succeed, id: %1, server salt: %2").arg(authKey->keyId()).arg(serverSalt));
 
 		sessionData->owner()->notifyKeyCreated(std::move(authKey)); // slot will call authKeyCreated()
-		sessionData->clear(_instance);
+		sessionData->clear();
 		unlockKey();
 	} return;
 
@@ -3115,7 +3122,8 @@ bool ConnectionPrivate::sendRequest(mtpRequest &request, bool needAnyResponse, Q
 	MTPint128 &msgKey(*(MTPint128*)(encryptedSHA + 4));
 	hashSha1(request->constData(), (fullSize - padding) * sizeof(mtpPrime), encryptedSHA);
 
-	mtpBuffer result;
+	auto &result = _sendBuffer;
+	result.resize(0);
 	result.resize(9 + fullSize);
 	*((uint64*)&result[2]) = keyId;
 	*((MTPint128*)&result[4]) = msgKey;
@@ -3131,7 +3139,8 @@ bool ConnectionPrivate::sendRequest(mtpRequest &request, bool needAnyResponse, Q
 	SHA256_Update(&msgKeyLargeContext, request->constData(), fullSize * sizeof(mtpPrime));
 	SHA256_Final(encryptedSHA256, &msgKeyLargeContext);
 
-	mtpBuffer result;
+	auto &result = _sendBuffer;
+	result.resize(0);
 	result.resize(9 + fullSize);
 	*((uint64*)&result[2]) = keyId;
 	*((MTPint128*)&result[4]) = msgKey;
@@ -3156,20 +3165,20 @@ mtpRequestId ConnectionPrivate::wasSent(mtpMsgId msgId) const {
 	{
 		QReadLocker locker(sessionData->haveSentMutex());
 		const mtpRequestMap &haveSent(sessionData->haveSentMap());
-		mtpRequestMap::const_iterator i = haveSent.constFind(msgId);
-		if (i != haveSent.cend()) return i.value()->requestId ? i.value()->requestId : mtpRequestId(0xFFFFFFFF);
+		mtpRequestMap::const_iterator i = haveSent.find(msgId);
+		if (i != haveSent.cend()) return i->second->requestId ? i->second->requestId : mtpRequestId(0xFFFFFFFF);
 	}
 	{
 		QReadLocker locker(sessionData->toResendMutex());
 		const mtpRequestIdsMap &toResend(sessionData->toResendMap());
-		mtpRequestIdsMap::const_iterator i = toResend.constFind(msgId);
-		if (i != toResend.cend()) return i.value();
+		mtpRequestIdsMap::const_iterator i = toResend.find(msgId);
+		if (i != toResend.cend()) return i->second;
 	}
 	{
 		QReadLocker locker(sessionData->wereAckedMutex());
 		const mtpRequestIdsMap &wereAcked(sessionData->wereAckedMap());
-		mtpRequestIdsMap::const_iterator i = wereAcked.constFind(msgId);
-		if (i != wereAcked.cend()) return i.value();
+		mtpRequestIdsMap::const_iterator i = wereAcked.find(msgId);
+		if (i != wereAcked.cend()) return i->second;
 	}
 	return 0;
 }
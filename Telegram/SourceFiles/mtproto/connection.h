@@ -259,6 +259,14 @@ private:
 	SessionData *sessionData = nullptr;
 	std::unique_ptr<ConnectionOptions> _connectionOptions;
 
+	// Pushed to sessionData since the last needToReceive() signal.
+	int _receivedResponses = 0;
+	int _receivedUpdates = 0;
+
+	// Encrypted packet, reused by sendRequest() to avoid an allocation
+	// for each sent message, connections copy the data they send.
+	mtpBuffer _sendBuffer;
+
 	bool myKeyLock = false;
 	void lockKey();
 	void unlockKey();
@@ -21,6 +21,92 @@ uint32 MTPstring::innerLength() const {
 	return l;
 }
 
+namespace {
+
+constexpr auto kPoolClassesCount = 4;
+constexpr auto kPoolMaxInClass = 64;
+
+// 64, 256, 1024 and 4096 mtpPrime-s.
+constexpr uint32 PoolClassCapacity(int index) {
+	return (64U << (2 * index));
+}
+
+// Most of the requests are small and short-lived, so instead of allocating
+// a new mtpRequestData with its buffer for each of them we reuse the ones
+// that were already acked or answered. Buffers larger than the largest
+// class (file parts, for example) are not kept.
+class RequestsPoolData {
+public:
+	mtpRequestData *take(uint32 capacity);
+	void release(mtpRequestData *request);
+
+private:
+	QMutex _mutex;
+	std::array<std::vector<mtpRequestData*>, kPoolClassesCount> _free;
+
+};
+
+mtpRequestData *RequestsPoolData::take(uint32 capacity) {
+	for (auto index = 0; index != kPoolClassesCount; ++index) {
+		const auto classCapacity = PoolClassCapacity(index);
+		if (capacity > classCapacity) {
+			continue;
+		}
+		{
+			QMutexLocker lock(&_mutex);
+			auto &list = _free[index];
+			if (!list.empty()) {
+				const auto result = list.back();
+				list.pop_back();
+				return result;
+			}
+		}
+		const auto result = new mtpRequestData(true);
+		result->reserve(classCapacity);
+		return result;
+	}
+	const auto result = new mtpRequestData(true);
+	result->reserve(capacity);
+	return result;
+}
+
+void RequestsPoolData::release(mtpRequestData *request) {
+	const auto capacity = uint32(request->capacity());
+	auto index = kPoolClassesCount - 1;
+	while (index >= 0 && capacity < PoolClassCapacity(index)) {
+		--index;
+	}
+	if (index < 0
+		|| capacity > 2 * PoolClassCapacity(kPoolClassesCount - 1)
+		|| !request->isDetached()) {
+		delete request;
+		return;
+	}
+
+	// Releasing "after" may release another request to this pool,
+	// so it is destroyed only when the mutex is already unlocked.
+	const auto after = base::take(request->after);
+	request->resize(0);
+	request->msDate = 0;
+	request->requestId = 0;
+	request->needsLayer = false;
+	{
+		QMutexLocker lock(&_mutex);
+		auto &list = _free[index];
+		if (list.size() < kPoolMaxInClass) {
+			list.push_back(base::take(request));
+		}
+	}
+	delete request;
+}
+
+RequestsPoolData &RequestsPool() {
+	static const auto result = new RequestsPoolData();
+	return *result;
+}
+
+} // namespace
+
 void MTPstring::read(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons) {
 	if (from + 1 > end) throw mtpErrorInsufficient();
 	if (cons != mtpc_string) throw mtpErrorUnexpected(cons, "MTPstring");
@@ -106,8 +192,10 @@ bool mtpRequestData::needAckByType(mtpTypeId type) {
 
 mtpRequest mtpRequestData::prepare(uint32 requestSize, uint32 maxSize) {
 	if (!maxSize) maxSize = requestSize;
-	mtpRequest result(new mtpRequestData(true));
-	result->reserve(8 + maxSize + _padding(maxSize)); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	const auto capacity = 8 + maxSize + _padding(maxSize); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	mtpRequest result(RequestsPool().take(capacity), [](mtpRequestData *data) {
+		RequestsPool().release(data);
+	});
 	result->resize(7);
 	result->push_back(requestSize << 2);
 	return result;
@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "core/basic_types.h"
 #include "base/flags.h"
+#include "base/ring_map.h"
 
 namespace MTP {
 
@@ -34,6 +35,10 @@ public:
     explicit mtpRequest(mtpRequestData *ptr)
 	: std::shared_ptr<mtpRequestData>(ptr) {
 	}
+	template <typename Deleter>
+	mtpRequest(mtpRequestData *ptr, Deleter deleter)
+	: std::shared_ptr<mtpRequestData>(ptr, std::move(deleter)) {
+	}
 
 	uint32 innerLength() const;
 	void write(mtpBuffer &to) const;
@@ -84,21 +89,18 @@ private:
 
 };
 
-using mtpPreRequestMap = QMap<mtpRequestId, mtpRequest>;
-using mtpRequestMap = QMap<mtpMsgId, mtpRequest>;
-using mtpMsgIdsSet = QMap<mtpMsgId, bool>;
+using mtpPreRequestMap = base::ring_map<mtpRequestId, mtpRequest>;
+using mtpRequestMap = base::ring_map<mtpMsgId, mtpRequest>;
+using mtpMsgIdsSet = base::ring_map<mtpMsgId, bool>;
 
-class mtpRequestIdsMap : public QMap<mtpMsgId, mtpRequestId> {
+class mtpRequestIdsMap : public base::ring_map<mtpMsgId, mtpRequestId> {
 public:
-	using ParentType = QMap<mtpMsgId, mtpRequestId>;
-
 	mtpMsgId min() const {
-		return size() ? cbegin().key() : 0;
+		return empty() ? 0 : begin()->first;
 	}
 
 	mtpMsgId max() const {
-		ParentType::const_iterator e(cend());
-		return size() ? (--e).key() : 0;
+		return empty() ? 0 : rbegin()->first;
 	}
 };
 
@@ -78,7 +78,15 @@ public:
 		RPCResponseHandler &&callbacks);
 	mtpRequest getRequest(mtpRequestId requestId);
 	void clearCallbacksDelayed(std::vector<RPCCallbackClear> &&ids);
-	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	RPCParsedResponse parseResponse(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end);
+	void execCallback(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end,
+		RPCParsedResponse &&parsed);
 	bool hasCallbacks(mtpRequestId requestId);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
@@ -850,10 +858,37 @@ void Instance::Private::clearCallbacks(
 	}
 }
 
-void Instance::Private::execCallback(
+RPCParsedResponse Instance::Private::parseResponse(
 		mtpRequestId requestId,
 		const mtpPrime *from,
 		const mtpPrime *end) {
+	auto onDone = RPCDoneHandlerPtr();
+	{
+		QMutexLocker locker(&_parserMapLock);
+		auto it = _parserMap.find(requestId);
+		if (it != _parserMap.cend()
+			&& it->second.onDone
+			&& it->second.onDone->parseInBackground()) {
+			onDone = it->second.onDone;
+		}
+	}
+	if (!onDone || from >= end || *from == mtpc_rpc_error) {
+		return nullptr;
+	}
+	try {
+		return onDone->parse(from, end);
+	} catch (Exception &) {
+		// The response will be parsed once again in execCallback()
+		// and the error will be reported from the main thread.
+		return nullptr;
+	}
+}
+
+void Instance::Private::execCallback(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end,
+		RPCParsedResponse &&parsed) {
 	RPCResponseHandler h;
 	{
 		QMutexLocker locker(&_parserMapLock);
@@ -880,7 +915,9 @@ void Instance::Private::execCallback(
 					return;
 				}
 			} else {
-				if (h.onDone) {
+				if (h.onDone && parsed) {
+					h.onDone->done(requestId, std::move(parsed));
+				} else if (h.onDone) {
 					(*h.onDone)(requestId, from, end);
 				}
 			}
@@ -1496,8 +1533,19 @@ void Instance::clearCallbacksDelayed(std::vector<RPCCallbackClear> &&ids) {
 	_private->clearCallbacksDelayed(std::move(ids));
 }
 
-void Instance::execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
-	_private->execCallback(requestId, from, end);
+RPCParsedResponse Instance::parseResponse(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end) {
+	return _private->parseResponse(requestId, from, end);
+}
+
+void Instance::execCallback(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end,
+		RPCParsedResponse &&parsed) {
+	_private->execCallback(requestId, from, end, std::move(parsed));
 }
 
 bool Instance::hasCallbacks(mtpRequestId requestId) {
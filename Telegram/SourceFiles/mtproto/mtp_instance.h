@@ -124,7 +124,17 @@ public:
 	mtpRequest getRequest(mtpRequestId requestId);
 	void clearCallbacksDelayed(std::vector<RPCCallbackClear> &&ids);
 
-	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	// Called in the connection thread, returns nullptr if the response
+	// should be parsed in the main thread by execCallback().
+	RPCParsedResponse parseResponse(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end);
+	void execCallback(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end,
+		RPCParsedResponse &&parsed);
 	bool hasCallbacks(mtpRequestId requestId);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
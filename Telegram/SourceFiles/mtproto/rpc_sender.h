@@ -67,15 +67,52 @@ inline bool isDefaultHandledError(const RPCError &error) {
 
 } // namespace MTP
 
+// Result of RPCAbstractDoneHandler::parse(), a pointer to the typed response.
+using RPCParsedResponse = std::shared_ptr<void>;
+
 class RPCAbstractDoneHandler { // abstract done
 public:
 	virtual void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) = 0;
+
+	// If parseInBackground() is set the response is read by parse() in the
+	// connection thread and the result is passed to done() in the main thread.
+	// Handlers that don't receive a typed result return nullptr from parse(),
+	// then operator() is called in the main thread as usual.
+	virtual RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const {
+		return nullptr;
+	}
+	virtual void done(mtpRequestId requestId, RPCParsedResponse &&parsed) {
+	}
+
+	void setParseInBackground(bool parseInBackground) {
+		_parseInBackground = parseInBackground;
+	}
+	bool parseInBackground() const {
+		return _parseInBackground;
+	}
+
 	virtual ~RPCAbstractDoneHandler() {
 	}
 
+private:
+	bool _parseInBackground = false;
+
 };
 using RPCDoneHandlerPtr = std::shared_ptr<RPCAbstractDoneHandler>;
 
+template <typename TResponse>
+inline RPCParsedResponse rpcParseResponse(const mtpPrime *from, const mtpPrime *end) {
+	auto result = std::make_shared<TResponse>();
+	result->read(from, end);
+	return std::move(result);
+}
+
+template <typename TResponse>
+inline TResponse rpcTakeParsed(RPCParsedResponse &&parsed) {
+	const auto result = std::static_pointer_cast<TResponse>(base::take(parsed));
+	return std::move(*result);
+}
+
 class RPCAbstractFailHandler { // abstract fail
 public:
 	virtual bool operator()(mtpRequestId requestId, const RPCError &e) = 0;
@@ -140,6 +177,12 @@ public:
 		response.read(from, end);
 		(*_onDone)(std::move(response));
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		(*_onDone)(rpcTakeParsed<TResponse>(std::move(parsed)));
+	}
 
 private:
 	CallbackType _onDone;
@@ -158,6 +201,12 @@ public:
 		response.read(from, end);
 		(*_onDone)(std::move(response), requestId);
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		(*_onDone)(rpcTakeParsed<TResponse>(std::move(parsed)), requestId);
+	}
 
 private:
 	CallbackType _onDone;
@@ -297,6 +346,11 @@ inline RPCDoneHandlerPtr rpcDone(TReturn (*onDone)(mtpRequestId)) { // done(req_
 	return RPCDoneHandlerPtr(new RPCDoneHandlerNoReq<TReturn>(onDone));
 }
 
+inline RPCDoneHandlerPtr rpcParseInBackground(RPCDoneHandlerPtr &&handler) {
+	handler->setParseInBackground(true);
+	return std::move(handler);
+}
+
 inline RPCFailHandlerPtr rpcFail(bool (*onFail)(const RPCError &)) { // fail(error)
 	return RPCFailHandlerPtr(new RPCFailHandlerPlain(onFail));
 }
@@ -387,6 +441,14 @@ public:
 			(static_cast<TReceiver*>(_owner)->*_onDone)(std::move(response));
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (_owner) {
+			(static_cast<TReceiver*>(_owner)->*_onDone)(rpcTakeParsed<TResponse>(std::move(parsed)));
+		}
+	}
 
 private:
 	CallbackType _onDone;
@@ -407,6 +469,14 @@ public:
 			(static_cast<TReceiver*>(_owner)->*_onDone)(std::move(response), requestId);
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (_owner) {
+			(static_cast<TReceiver*>(_owner)->*_onDone)(rpcTakeParsed<TResponse>(std::move(parsed)), requestId);
+		}
+	}
 
 private:
 	CallbackType _onDone;
@@ -493,6 +563,14 @@ public:
 			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, std::move(response));
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (_owner) {
+			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, rpcTakeParsed<TResponse>(std::move(parsed)));
+		}
+	}
 
 private:
 	CallbackType _onDone;
@@ -514,6 +592,14 @@ public:
 			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, std::move(response), requestId);
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (_owner) {
+			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, rpcTakeParsed<TResponse>(std::move(parsed)), requestId);
+		}
+	}
 
 private:
 	CallbackType _onDone;
@@ -885,6 +971,14 @@ public:
 			this->_handler(std::move(response));
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (this->_handler) {
+			this->_handler(rpcTakeParsed<TResponse>(std::move(parsed)));
+		}
+	}
 
 };
 
@@ -899,6 +993,14 @@ public:
 			this->_handler(std::move(response), requestId);
 		}
 	}
+	RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+		return rpcParseResponse<TResponse>(from, end);
+	}
+	void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+		if (this->_handler) {
+			this->_handler(rpcTakeParsed<TResponse>(std::move(parsed)), requestId);
+		}
+	}
 
 };
 
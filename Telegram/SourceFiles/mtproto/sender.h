@@ -64,6 +64,18 @@ class Sender {
 					Policy::handle(std::move(handler), requestId, std::move(result));
 				}
 			}
+			RPCParsedResponse parse(const mtpPrime *from, const mtpPrime *end) const override {
+				return rpcParseResponse<Response>(from, end);
+			}
+			void done(mtpRequestId requestId, RPCParsedResponse &&parsed) override {
+				auto handler = std::move(_handler);
+				_sender->senderRequestHandled(requestId);
+
+				if (handler) {
+					auto result = rpcTakeParsed<Response>(std::move(parsed));
+					Policy::handle(std::move(handler), requestId, std::move(result));
+				}
+			}
 
 		private:
 			not_null<Sender*> _sender;
@@ -148,6 +160,9 @@ class Sender {
 		void setAfter(mtpRequestId requestId) noexcept {
 			_afterRequestId = requestId;
 		}
+		void setParseInBackground() noexcept {
+			_parseInBackground = true;
+		}
 
 		ShiftedDcId takeDcId() const noexcept {
 			return _dcId;
@@ -156,6 +171,9 @@ class Sender {
 			return _canWait;
 		}
 		RPCDoneHandlerPtr takeOnDone() noexcept {
+			if (_done && _parseInBackground) {
+				_done->setParseInBackground(true);
+			}
 			return std::move(_done);
 		}
 		RPCFailHandlerPtr takeOnFail() {
@@ -185,6 +203,7 @@ class Sender {
 		base::variant<FailPlainHandler, FailRequestIdHandler> _fail;
 		FailSkipPolicy _failSkipPolicy = FailSkipPolicy::Simple;
 		mtpRequestId _afterRequestId = 0;
+		bool _parseInBackground = false;
 
 	};
 
@@ -237,6 +256,10 @@ public:
 			setAfter(requestId);
 			return *this;
 		}
+		[[nodiscard]] SpecificRequestBuilder &parseInBackground() noexcept {
+			setParseInBackground();
+			return *this;
+		}
 
 		mtpRequestId send() {
 			const auto id = MainInstance()->send(
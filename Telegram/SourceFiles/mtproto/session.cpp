@@ -59,29 +59,19 @@ void SessionData::setKey(const AuthKeyPtr &key) {
 	}
 }
 
-void SessionData::clear(Instance *instance) {
+void SessionData::clear() {
 	auto clearCallbacks = std::vector<RPCCallbackClear>();
 	{
-		QReadLocker locker1(haveSentMutex()), locker2(toResendMutex()), locker3(haveReceivedMutex()), locker4(wereAckedMutex());
-		auto receivedResponsesEnd = _receivedResponses.cend();
-		clearCallbacks.reserve(_haveSent.size() + _wereAcked.size());
+		QReadLocker locker1(haveSentMutex()), locker2(toResendMutex()), locker3(wereAckedMutex());
+		clearCallbacks.reserve(_haveSent.size() + _toResend.size() + _wereAcked.size());
 		for (auto i = _haveSent.cbegin(), e = _haveSent.cend(); i != e; ++i) {
-			auto requestId = i.value()->requestId;
-			if (!_receivedResponses.contains(requestId)) {
-				clearCallbacks.push_back(requestId);
-			}
+			clearCallbacks.push_back(i->second->requestId);
 		}
 		for (auto i = _toResend.cbegin(), e = _toResend.cend(); i != e; ++i) {
-			auto requestId = i.value();
-			if (!_receivedResponses.contains(requestId)) {
-				clearCallbacks.push_back(requestId);
-			}
+			clearCallbacks.push_back(i->second);
 		}
 		for (auto i = _wereAcked.cbegin(), e = _wereAcked.cend(); i != e; ++i) {
-			auto requestId = i.value();
-			if (!_receivedResponses.contains(requestId)) {
-				clearCallbacks.push_back(requestId);
-			}
+			clearCallbacks.push_back(i->second);
 		}
 	}
 	{
@@ -100,7 +90,7 @@ void SessionData::clear(Instance *instance) {
 		QWriteLocker locker(receivedIdsMutex());
 		_receivedIds.clear();
 	}
-	instance->clearCallbacksDelayed(std::move(clearCallbacks));
+	_owner->clearCallbacksDelayed(std::move(clearCallbacks));
 }
 
 Session::Session(not_null<Instance*> instance, ShiftedDcId shiftedDcId) : QObject()
@@ -290,21 +280,21 @@ void Session::checkRequestsByTimer() {
 		uint32 haveSentCount(haveSent.size());
 		auto ms = getms(true);
 		for (mtpRequestMap::iterator i = haveSent.begin(), e = haveSent.end(); i != e; ++i) {
-			mtpRequest &req(i.value());
+			mtpRequest &req(i->second);
 			if (req->msDate > 0) {
 				if (req->msDate + MTPCheckResendTimeout < ms) { // need to resend or check state
 					if (mtpRequestData::messageSize(req) < MTPResendThreshold) { // resend
 						resendingIds.reserve(haveSentCount);
-						resendingIds.push_back(i.key());
+						resendingIds.push_back(i->first);
 					} else {
 						req->msDate = ms;
 						stateRequestIds.reserve(haveSentCount);
-						stateRequestIds.push_back(i.key());
+						stateRequestIds.push_back(i->first);
 					}
 				}
-			} else if (unixtime() > (int32)(i.key() >> 32) + MTPContainerLives) {
+			} else if (unixtime() > (int32)(i->first >> 32) + MTPContainerLives) {
 				removingIds.reserve(haveSentCount);
-				removingIds.push_back(i.key());
+				removingIds.push_back(i->first);
 			}
 		}
 	}
@@ -314,7 +304,7 @@ void Session::checkRequestsByTimer() {
 		{
 			QWriteLocker locker(data.stateRequestMutex());
 			for (uint32 i = 0, l = stateRequestIds.size(); i < l; ++i) {
-				data.stateRequestMap().insert(stateRequestIds[i], true);
+				data.stateRequestMap()[stateRequestIds[i]] = true;
 			}
 		}
 		sendAnything(MTPCheckResendWaiting);
@@ -333,8 +323,8 @@ void Session::checkRequestsByTimer() {
 			for (uint32 i = 0, l = removingIds.size(); i < l; ++i) {
 				auto j = haveSent.find(removingIds[i]);
 				if (j != haveSent.cend()) {
-					if (j.value()->requestId) {
-						clearCallbacks.push_back(j.value()->requestId);
+					if (j->second->requestId) {
+						clearCallbacks.push_back(j->second->requestId);
 					}
 					haveSent.erase(j);
 				}
@@ -355,6 +345,7 @@ void Session::onResetDone() {
 void Session::cancel(mtpRequestId requestId, mtpMsgId msgId) {
 	if (requestId) {
 		QWriteLocker locker(data.toSendMutex());
+		data.applyQueuedToSend();
 		data.toSendMap().remove(requestId);
 	}
 	if (msgId) {
@@ -368,7 +359,7 @@ void Session::ping() {
 	sendAnything(0);
 }
 
-int32 Session::requestState(mtpRequestId requestId) const {
+int32 Session::requestState(mtpRequestId requestId) {
 	int32 result = MTP::RequestSent;
 
 	bool connected = false;
@@ -392,8 +383,9 @@ int32 Session::requestState(mtpRequestId requestId) const {
 	if (!requestId) return MTP::RequestSent;
 
 	QWriteLocker locker(data.toSendMutex());
+	data.applyQueuedToSend();
 	const mtpPreRequestMap &toSend(data.toSendMap());
-	mtpPreRequestMap::const_iterator i = toSend.constFind(requestId);
+	mtpPreRequestMap::const_iterator i = toSend.find(requestId);
 	if (i != toSend.cend()) {
 		return MTP::RequestSending;
 	} else {
@@ -449,7 +441,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 			return 0;
 		}
 
-		request = i.value();
+		request = i->second;
 		haveSent.erase(i);
 	}
 	if (mtpRequestData::isSentContainer(request)) { // for container just resend all messages we can
@@ -464,7 +456,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 		sendPrepared(request, msCanWait, false);
 		{
 			QWriteLocker locker(data.toResendMutex());
-			data.toResendMap().insert(msgId, request->requestId);
+			data.toResendMap()[msgId] = request->requestId;
 		}
 		return request->requestId;
 	} else {
@@ -485,7 +477,7 @@ void Session::resendAll() {
 		const mtpRequestMap &haveSent(data.haveSentMap());
 		toResend.reserve(haveSent.size());
 		for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-			if (i.value()->requestId) toResend.push_back(i.key());
+			if (i->second->requestId) toResend.push_back(i->first);
 		}
 	}
 	for (uint32 i = 0, l = toResend.size(); i < l; ++i) {
@@ -518,15 +510,11 @@ mtpRequestId Session::send(
 }
 
 void Session::sendPrepared(const mtpRequest &request, TimeMs msCanWait, bool newRequest) { // returns true, if emit of needToSend() is needed
-	{
-		QWriteLocker locker(data.toSendMutex());
-		data.toSendMap().insert(request->requestId, request);
-
-		if (newRequest) {
-			*(mtpMsgId*)(request->data() + 4) = 0;
-			*(request->data() + 6) = 0;
-		}
+	if (newRequest) {
+		*(mtpMsgId*)(request->data() + 4) = 0;
+		*(request->data() + 6) = 0;
 	}
+	data.queueToSend(request);
 
 	DEBUG_LOG(("MTP Info: added, requestId %1").arg(request->requestId));
 
@@ -588,36 +576,58 @@ void Session::tryToReceive() {
 		auto requestId = mtpRequestId(0);
 		auto isUpdate = false;
 		auto message = SerializedMessage();
-		{
-			QWriteLocker locker(data.haveReceivedMutex());
-			auto &responses = data.haveReceivedResponses();
-			auto response = responses.begin();
-			if (response == responses.cend()) {
-				auto &updates = data.haveReceivedUpdates();
-				auto update = updates.begin();
-				if (update == updates.cend()) {
-					return;
-				} else {
-					message = std::move(*update);
-					isUpdate = true;
-					updates.pop_front();
-				}
+		auto parsed = RPCParsedResponse();
+		takeReceived();
+		auto response = _receivedResponses.begin();
+		if (response == _receivedResponses.end()) {
+			auto update = _receivedUpdates.begin();
+			if (update == _receivedUpdates.end()) {
+				return;
 			} else {
-				requestId = response.key();
-				message = std::move(response.value());
-				responses.erase(response);
+				message = std::move(*update);
+				isUpdate = true;
+				_receivedUpdates.pop_front();
 			}
+		} else {
+			requestId = response.key();
+			message = std::move(response.value().message);
+			parsed = std::move(response.value().parsed);
+			_receivedResponses.erase(response);
 		}
 		if (isUpdate) {
 			if (dcWithShift == bareDcId(dcWithShift)) { // call globalCallback only in main session
 				_instance->globalCallback(message.constData(), message.constData() + message.size());
 			}
 		} else {
-			_instance->execCallback(requestId, message.constData(), message.constData() + message.size());
+			_instance->execCallback(requestId, message.constData(), message.constData() + message.size(), std::move(parsed));
+		}
+	}
+}
+
+void Session::takeReceived() {
+	auto received = ReceivedMessage();
+	while (data.popReceived(received)) {
+		if (received.requestId) {
+			_receivedResponses.insert(
+				received.requestId,
+				std::move(received));
+		} else {
+			_receivedUpdates.push_back(std::move(received.message));
 		}
 	}
 }
 
+void Session::clearCallbacksDelayed(std::vector<RPCCallbackClear> &&ids) {
+	crl::on_main(this, [=, list = std::move(ids)]() mutable {
+		takeReceived();
+		list.erase(std::remove_if(list.begin(), list.end(), [&](
+				const RPCCallbackClear &clear) {
+			return _receivedResponses.contains(clear.requestId);
+		}), list.end());
+		_instance->clearCallbacksDelayed(std::move(list));
+	});
+}
+
 Session::~Session() {
 	Assert(_connection == nullptr);
 }
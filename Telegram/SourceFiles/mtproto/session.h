@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "core/single_timer.h"
 #include "mtproto/rpc_sender.h"
+#include "base/mpsc_queue.h"
 
 namespace MTP {
 
@@ -24,10 +25,10 @@ class Connection;
 class ReceivedMsgIds {
 public:
 	bool registerMsgId(mtpMsgId msgId, bool needAck) {
-		auto i = _idsNeedAck.constFind(msgId);
+		auto i = _idsNeedAck.find(msgId);
 		if (i == _idsNeedAck.cend()) {
-			if (_idsNeedAck.size() < MTPIdsBufferSize || msgId > min()) {
-				_idsNeedAck.insert(msgId, needAck);
+			if (int(_idsNeedAck.size()) < MTPIdsBufferSize || msgId > min()) {
+				_idsNeedAck.emplace(msgId, needAck);
 				return true;
 			}
 			MTP_LOG(-1, ("No need to handle - %1 < min = %2").arg(msgId).arg(min()));
@@ -38,18 +39,20 @@ public:
 	}
 
 	mtpMsgId min() const {
-		return _idsNeedAck.isEmpty() ? 0 : _idsNeedAck.cbegin().key();
+		return _idsNeedAck.empty() ? 0 : _idsNeedAck.begin()->first;
 	}
 
 	mtpMsgId max() const {
-		auto end = _idsNeedAck.cend();
-		return _idsNeedAck.isEmpty() ? 0 : (--end).key();
+		return _idsNeedAck.empty() ? 0 : _idsNeedAck.rbegin()->first;
 	}
 
 	void shrink() {
-		auto size = _idsNeedAck.size();
-		while (size-- > MTPIdsBufferSize) {
-			_idsNeedAck.erase(_idsNeedAck.begin());
+		const auto size = int(_idsNeedAck.size());
+		if (size > MTPIdsBufferSize) {
+			const auto begin = _idsNeedAck.begin();
+			_idsNeedAck.erase(
+				begin,
+				std::next(begin, size - MTPIdsBufferSize));
 		}
 	}
 
@@ -59,11 +62,11 @@ public:
 		NoAckNeeded,
 	};
 	State lookup(mtpMsgId msgId) const {
-		auto i = _idsNeedAck.constFind(msgId);
+		auto i = _idsNeedAck.find(msgId);
 		if (i == _idsNeedAck.cend()) {
 			return State::NotFound;
 		}
-		return i.value() ? State::NeedsAck : State::NoAckNeeded;
+		return i->second ? State::NeedsAck : State::NoAckNeeded;
 	}
 
 	void clear() {
@@ -71,7 +74,7 @@ public:
 	}
 
 private:
-	QMap<mtpMsgId, bool> _idsNeedAck;
+	base::ring_map<mtpMsgId, bool> _idsNeedAck;
 
 };
 
@@ -85,6 +88,12 @@ inline bool ResponseNeedsAck(const SerializedMessage &response) {
 	return (seqNo & 0x01) ? true : false;
 }
 
+struct ReceivedMessage {
+	mtpRequestId requestId = 0; // zero for updates
+	SerializedMessage message;
+	RPCParsedResponse parsed; // read in the connection thread, if allowed
+};
+
 struct ConnectionOptions {
 	ConnectionOptions() = default;
 	ConnectionOptions(
@@ -185,9 +194,6 @@ public:
 	not_null<QReadWriteLock*> receivedIdsMutex() const {
 		return &_receivedIdsLock;
 	}
-	not_null<QReadWriteLock*> haveReceivedMutex() const {
-		return &_haveReceivedLock;
-	}
 	not_null<QReadWriteLock*> stateRequestMutex() const {
 		return &_stateRequestLock;
 	}
@@ -222,18 +228,6 @@ public:
 	const mtpRequestIdsMap &wereAckedMap() const {
 		return _wereAcked;
 	}
-	QMap<mtpRequestId, SerializedMessage> &haveReceivedResponses() {
-		return _receivedResponses;
-	}
-	const QMap<mtpRequestId, SerializedMessage> &haveReceivedResponses() const {
-		return _receivedResponses;
-	}
-	QList<SerializedMessage> &haveReceivedUpdates() {
-		return _receivedUpdates;
-	}
-	const QList<SerializedMessage> &haveReceivedUpdates() const {
-		return _receivedUpdates;
-	}
 	mtpMsgIdsSet &stateRequestMap() {
 		return _stateRequest;
 	}
@@ -241,6 +235,31 @@ public:
 		return _stateRequest;
 	}
 
+	// New requests are pushed to a lock-free queue from any thread and
+	// moved to toSendMap() by the thread that locks toSendMutex() for
+	// writing, so that only one consumer pops from the queue at a time.
+	void queueToSend(const mtpRequest &request) {
+		_toSendQueue.push(request);
+	}
+	void applyQueuedToSend() {
+		auto request = mtpRequest();
+		while (_toSendQueue.pop(request)) {
+			_toSend[request->requestId] = request;
+		}
+	}
+
+	// Responses and updates are pushed from the connection thread
+	// and popped in the main thread.
+	void pushReceived(
+			mtpRequestId requestId,
+			SerializedMessage &&message,
+			RPCParsedResponse &&parsed = nullptr) {
+		_received.push({ requestId, std::move(message), std::move(parsed) });
+	}
+	bool popReceived(ReceivedMessage &message) {
+		return _received.pop(message);
+	}
+
 	not_null<Session*> owner() {
 		return _owner;
 	}
@@ -255,7 +274,7 @@ public:
 		return result * 2 + (needAck ? 1 : 0);
 	}
 
-	void clear(Instance *instance);
+	void clear();
 
 private:
 	uint64 _session = 0;
@@ -277,8 +296,8 @@ private:
 	mtpRequestIdsMap _wereAcked; // map of msg_id -> request_id, this msg_ids already were acked or do not need ack
 	mtpMsgIdsSet _stateRequest; // set of msg_id's, whose state should be requested
 
-	QMap<mtpRequestId, SerializedMessage> _receivedResponses; // map of request_id -> response that should be processed in the main thread
-	QList<SerializedMessage> _receivedUpdates; // list of updates that should be processed in the main thread
+	base::mpsc_queue<mtpRequest> _toSendQueue; // requests that should be added to _toSend
+	base::mpsc_queue<ReceivedMessage> _received; // responses and updates that should be processed in the main thread
 
 	// mutexes
 	mutable QReadWriteLock _lock;
@@ -287,7 +306,6 @@ private:
 	mutable QReadWriteLock _toResendLock;
 	mutable QReadWriteLock _receivedIdsLock;
 	mutable QReadWriteLock _wereAckedLock;
-	mutable QReadWriteLock _haveReceivedLock;
 	mutable QReadWriteLock _stateRequestLock;
 
 };
@@ -314,7 +332,7 @@ public:
 
 	void ping();
 	void cancel(mtpRequestId requestId, mtpMsgId msgId);
-	int32 requestState(mtpRequestId requestId) const;
+	int32 requestState(mtpRequestId requestId);
 	int32 getState() const;
 	QString transport() const;
 
@@ -332,6 +350,10 @@ public:
 		TimeMs msCanWait = 0,
 		bool newRequest = true);
 
+	// May be called from any thread, the callbacks of the requests with
+	// already received, but not yet processed responses are not cleared.
+	void clearCallbacksDelayed(std::vector<RPCCallbackClear> &&ids);
+
 	~Session();
 
 signals:
@@ -369,6 +391,7 @@ private:
 		RPCResponseHandler &&callbacks);
 	mtpRequest getRequest(mtpRequestId requestId);
 	bool rpcErrorOccured(mtpRequestId requestId, const RPCFailHandlerPtr &onFail, const RPCError &err);
+	void takeReceived();
 
 	not_null<Instance*> _instance;
 	std::unique_ptr<Connection> _connection;
@@ -378,6 +401,10 @@ private:
 
 	SessionData data;
 
+	// Taken from data, processed in the main thread.
+	QMap<mtpRequestId, ReceivedMessage> _receivedResponses;
+	QList<SerializedMessage> _receivedUpdates;
+
 	ShiftedDcId dcWithShift = 0;
 	std::shared_ptr<Dcenter> dc;
 
@@ -0,0 +1,808 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/cache/storage_cache_database.h"
+
+namespace Storage {
+namespace Cache {
+namespace {
+
+constexpr char kDataMagic[] = { 'T', 'D', 'C', '$' };
+constexpr char kIndexMagic[] = { 'T', 'D', 'C', 'I' };
+constexpr auto kMagicLength = int(sizeof(kDataMagic));
+constexpr auto kFormatVersion = qint32(1);
+constexpr auto kDataHeaderSize = int64(kMagicLength + sizeof(qint32));
+constexpr auto kPruneInterval = TimeId(60 * 60);
+constexpr auto kEvictTargetPart = 0.9;
+
+enum RecordType : uchar {
+	RecordPut = 0x01,
+	RecordRemove = 0x02,
+	RecordLink = 0x03,
+};
+
+struct RecordHeader {
+	uchar type = 0;
+	uchar tag = 0;
+	uint16 reserved = 0;
+	uint32 time = 0;
+	uint64 high = 0;
+	uint64 low = 0;
+	uint32 size = 0;
+	int32 checksum = 0;
+};
+static_assert(sizeof(RecordHeader) == 32, "Bad RecordHeader size.");
+constexpr auto kRecordHeaderSize = int64(sizeof(RecordHeader));
+constexpr auto kChecksumOffset = uint32(kRecordHeaderSize - sizeof(int32));
+
+struct LinkPayload {
+	int64 offset = 0;
+	int32 size = 0;
+	int32 reserved = 0;
+};
+static_assert(sizeof(LinkPayload) == 16, "Bad LinkPayload size.");
+
+struct IndexHeader {
+	char magic[kMagicLength] = { 0 };
+	qint32 version = 0;
+	int64 covered = 0;
+	int64 wasted = 0;
+	uint32 count = 0;
+	int32 reserved = 0;
+};
+static_assert(sizeof(IndexHeader) == 32, "Bad IndexHeader size.");
+
+struct IndexRecord {
+	uchar tag = 0;
+	uchar reserved[3] = { 0 };
+	uint32 useTime = 0;
+	uint64 high = 0;
+	uint64 low = 0;
+	int64 offset = 0;
+	int32 size = 0;
+	int32 reserved2 = 0;
+};
+static_assert(sizeof(IndexRecord) == 40, "Bad IndexRecord size.");
+
+int32 HeaderChecksum(const RecordHeader &header) {
+	return hashCrc32(&header, kChecksumOffset);
+}
+
+bool ValidHeader(const RecordHeader &header) {
+	if (header.checksum != HeaderChecksum(header)) {
+		return false;
+	}
+	switch (header.type) {
+	case RecordPut: return true;
+	case RecordRemove: return (header.size == 0);
+	case RecordLink: return (header.size == sizeof(LinkPayload));
+	}
+	return false;
+}
+
+QByteArray SerializeRecord(
+		uchar type,
+		uchar tag,
+		const Key &key,
+		TimeId time,
+		const QByteArray &payload) {
+	auto header = RecordHeader();
+	header.type = type;
+	header.tag = tag;
+	header.time = uint32(time);
+	header.high = key.high;
+	header.low = key.low;
+	header.size = uint32(payload.size());
+	header.checksum = HeaderChecksum(header);
+
+	auto result = QByteArray();
+	result.reserve(kRecordHeaderSize + payload.size());
+	result.append(reinterpret_cast<const char*>(&header), kRecordHeaderSize);
+	result.append(payload);
+	return result;
+}
+
+QByteArray SerializeLink(int64 offset, int32 size) {
+	auto link = LinkPayload();
+	link.offset = offset;
+	link.size = size;
+	return QByteArray(reinterpret_cast<const char*>(&link), sizeof(link));
+}
+
+} // namespace
+
+size_t Database::IndexKeyHash::operator()(const IndexKey &value) const {
+	return std::hash<uint64>()(value.key.high
+		^ (value.key.low * 0x9E3779B97F4A7C15ULL)
+		^ value.tag);
+}
+
+Database::Database(const QString &path, const Settings &settings)
+: _path(path.endsWith('/') ? path : (path + '/'))
+, _settings(settings)
+, _flushTimer([=] { flush(); }) {
+}
+
+QString Database::dataPath() const {
+	return _path + qsl("data");
+}
+
+QString Database::indexPath() const {
+	return _path + qsl("index");
+}
+
+bool Database::createDataFile(QFile &file) const {
+	if (!file.open(QIODevice::WriteOnly)) {
+		LOG(("Cache Error: Could not create '%1'.").arg(file.fileName()));
+		return false;
+	}
+	const auto version = kFormatVersion;
+	return (file.write(kDataMagic, kMagicLength) == kMagicLength)
+		&& (file.write(
+			reinterpret_cast<const char*>(&version),
+			sizeof(version)) == sizeof(version));
+}
+
+bool Database::openFiles() {
+	_reader.setFileName(dataPath());
+	_writer.setFileName(dataPath());
+	return _reader.open(QIODevice::ReadOnly | QIODevice::Unbuffered)
+		&& _writer.open(QIODevice::ReadWrite);
+}
+
+void Database::closeFiles() {
+	_reader.close();
+	_writer.close();
+}
+
+bool Database::open() {
+	QMutexLocker lock(&_mutex);
+	if (_opened) {
+		return true;
+	}
+	if (!QDir().exists(_path)) {
+		QDir().mkpath(_path);
+	}
+	const auto validHeader = [&] {
+		char magic[kMagicLength] = { 0 };
+		auto version = qint32(0);
+		return (_reader.read(magic, kMagicLength) == kMagicLength)
+			&& !memcmp(magic, kDataMagic, kMagicLength)
+			&& (_reader.read(
+				reinterpret_cast<char*>(&version),
+				sizeof(version)) == sizeof(version))
+			&& (version > 0)
+			&& (version <= kFormatVersion);
+	};
+	if (!openFiles() || !validHeader()) {
+		closeFiles();
+		QFile::remove(indexPath());
+		QFile data(dataPath());
+		if (!createDataFile(data)) {
+			return false;
+		}
+		data.close();
+		if (!openFiles()) {
+			LOG(("Cache Error: Could not open '%1'.").arg(dataPath()));
+			closeFiles();
+			return false;
+		}
+	}
+	_written = _writer.size();
+
+	auto covered = kDataHeaderSize;
+	if (!readIndex(_written, covered)) {
+		_index.clear();
+		_payloadUsers.clear();
+		_stats.clear();
+		_totalSize = _wasted = 0;
+		covered = kDataHeaderSize;
+	}
+	replayBinlog(covered);
+	_opened = true;
+
+	LOG(("Cache Info: Opened '%1' with %2 entries, %3 bytes, %4 wasted."
+		).arg(_path
+		).arg(_index.size()
+		).arg(_totalSize
+		).arg(_wasted));
+
+	_queue.async([=] {
+		enforceLimits();
+		if (compactionNeeded()) {
+			compact();
+		}
+	});
+	return true;
+}
+
+bool Database::readIndex(int64 dataSize, int64 &covered) {
+	QFile file(indexPath());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	const auto bytes = file.readAll();
+	file.close();
+
+	auto header = IndexHeader();
+	const auto headerSize = int(sizeof(IndexHeader));
+	const auto checksumSize = int(sizeof(int32));
+	if (bytes.size() < headerSize + checksumSize) {
+		return false;
+	}
+	memcpy(&header, bytes.constData(), headerSize);
+	const auto recordsSize = int64(header.count) * sizeof(IndexRecord);
+	if (memcmp(header.magic, kIndexMagic, kMagicLength)
+		|| header.version != kFormatVersion
+		|| header.covered < kDataHeaderSize
+		|| header.covered > dataSize
+		|| bytes.size() != headerSize + recordsSize + checksumSize) {
+		LOG(("Cache Error: Bad index file header."));
+		return false;
+	}
+	auto checksum = int32(0);
+	const auto checksumPosition = bytes.size() - checksumSize;
+	memcpy(&checksum, bytes.constData() + checksumPosition, checksumSize);
+	if (checksum != hashCrc32(bytes.constData(), checksumPosition)) {
+		LOG(("Cache Error: Bad index file checksum."));
+		return false;
+	}
+
+	_index.reserve(header.count);
+	auto record = IndexRecord();
+	for (auto i = 0; i != int(header.count); ++i) {
+		memcpy(
+			&record,
+			bytes.constData() + headerSize + i * sizeof(IndexRecord),
+			sizeof(IndexRecord));
+		if (record.offset < kDataHeaderSize
+			|| record.size < 0
+			|| record.offset + record.size > header.covered) {
+			LOG(("Cache Error: Bad index file record."));
+			return false;
+		}
+		auto key = IndexKey();
+		key.tag = record.tag;
+		key.key.high = record.high;
+		key.key.low = record.low;
+		auto entry = Entry();
+		entry.offset = record.offset;
+		entry.size = record.size;
+		entry.useTime = TimeId(record.useTime);
+		insertEntry(key, entry);
+	}
+	_wasted = header.wasted;
+	covered = header.covered;
+	return true;
+}
+
+bool Database::replayBinlog(int64 from) {
+	const auto truncate = [&](int64 position) {
+		LOG(("Cache Error: Bad binlog record at %1, truncating %2 bytes."
+			).arg(position
+			).arg(_written - position));
+		_writer.resize(position);
+		_written = position;
+		return false;
+	};
+	auto position = from;
+	while (position < _written) {
+		auto header = RecordHeader();
+		if (!_reader.seek(position)
+			|| _reader.read(
+				reinterpret_cast<char*>(&header),
+				kRecordHeaderSize) != kRecordHeaderSize
+			|| !ValidHeader(header)
+			|| position + kRecordHeaderSize + header.size > _written) {
+			return truncate(position);
+		}
+		auto key = IndexKey();
+		key.tag = header.tag;
+		key.key.high = header.high;
+		key.key.low = header.low;
+		switch (header.type) {
+		case RecordPut: {
+			auto entry = Entry();
+			entry.offset = position + kRecordHeaderSize;
+			entry.size = int32(header.size);
+			entry.useTime = TimeId(header.time);
+			insertEntry(key, entry);
+		} break;
+		case RecordRemove: {
+			const auto i = _index.find(key);
+			if (i != _index.end()) {
+				eraseEntry(i);
+			}
+			_wasted += kRecordHeaderSize;
+		} break;
+		case RecordLink: {
+			auto link = LinkPayload();
+			if (_reader.read(
+				reinterpret_cast<char*>(&link),
+				sizeof(link)) != sizeof(link)
+				|| link.offset < kDataHeaderSize
+				|| link.size < 0
+				|| link.offset + link.size > position) {
+				return truncate(position);
+			}
+			auto entry = Entry();
+			entry.offset = link.offset;
+			entry.size = link.size;
+			entry.useTime = TimeId(header.time);
+			insertEntry(key, entry);
+		} break;
+		}
+		position += kRecordHeaderSize + header.size;
+	}
+	return true;
+}
+
+bool Database::writeIndex() {
+	auto records = QByteArray();
+	records.reserve(int(_index.size() * sizeof(IndexRecord)));
+	auto count = uint32(0);
+	auto record = IndexRecord();
+	for (const auto &[key, entry] : _index) {
+		if (entry.offset + entry.size > _written) {
+			// Not flushed yet, will be replayed from the binlog.
+			continue;
+		}
+		record.tag = key.tag;
+		record.useTime = uint32(entry.useTime);
+		record.high = key.key.high;
+		record.low = key.key.low;
+		record.offset = entry.offset;
+		record.size = entry.size;
+		records.append(
+			reinterpret_cast<const char*>(&record),
+			sizeof(IndexRecord));
+		++count;
+	}
+	auto header = IndexHeader();
+	memcpy(header.magic, kIndexMagic, kMagicLength);
+	header.version = kFormatVersion;
+	header.covered = _written;
+	header.wasted = _wasted;
+	header.count = count;
+
+	auto bytes = QByteArray();
+	bytes.reserve(int(sizeof(IndexHeader) + records.size() + sizeof(int32)));
+	bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	bytes.append(records);
+	const auto checksum = hashCrc32(bytes.constData(), bytes.size());
+	bytes.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+	QSaveFile file(indexPath());
+	if (!file.open(QIODevice::WriteOnly)
+		|| file.write(bytes) != bytes.size()
+		|| !file.commit()) {
+		LOG(("Cache Error: Could not write '%1'.").arg(indexPath()));
+		return false;
+	}
+	return true;
+}
+
+void Database::insertEntry(const IndexKey &key, const Entry &entry) {
+	const auto i = _index.find(key);
+	if (i != _index.end()) {
+		eraseEntry(i);
+	}
+	_index.emplace(key, entry);
+	auto &stats = _stats[key.tag];
+	++stats.count;
+	stats.size += entry.size;
+	if (++_payloadUsers[entry.offset] == 1) {
+		_totalSize += entry.size;
+	}
+}
+
+void Database::eraseEntry(Index::iterator i) {
+	auto &stats = _stats[i->first.tag];
+	--stats.count;
+	stats.size -= i->second.size;
+	_wasted += kRecordHeaderSize;
+	const auto users = _payloadUsers.find(i->second.offset);
+	Assert(users != _payloadUsers.end());
+	if (--users->second == 0) {
+		_payloadUsers.erase(users);
+		_totalSize -= i->second.size;
+		_wasted += i->second.size;
+	}
+	_index.erase(i);
+}
+
+void Database::appendRecord(
+		uchar type,
+		const IndexKey &key,
+		TimeId time,
+		const QByteArray &payload) {
+	_pending.append(SerializeRecord(type, key.tag, key.key, time, payload));
+}
+
+int64 Database::virtualEnd() const {
+	return _written + _flushing.size() + _pending.size();
+}
+
+QByteArray Database::readPayloadLocked(const Entry &entry) {
+	if (entry.offset >= _written) {
+		auto position = entry.offset - _written;
+		if (position < _flushing.size()) {
+			return _flushing.mid(position, entry.size);
+		}
+		position -= _flushing.size();
+		return _pending.mid(position, entry.size);
+	}
+	if (!_reader.seek(entry.offset)) {
+		return QByteArray();
+	}
+	auto result = _reader.read(entry.size);
+	return (result.size() == entry.size) ? result : QByteArray();
+}
+
+void Database::put(uint8 tag, const Key &key, QByteArray value) {
+	const auto now = unixtime();
+	{
+		QMutexLocker lock(&_mutex);
+		if (!_opened) {
+			return;
+		}
+		const auto index = IndexKey{ tag, key };
+		auto entry = Entry();
+		entry.offset = virtualEnd() + kRecordHeaderSize;
+		entry.size = value.size();
+		entry.useTime = now;
+		appendRecord(RecordPut, index, now, value);
+		insertEntry(index, entry);
+	}
+	scheduleFlush();
+}
+
+QByteArray Database::get(uint8 tag, const Key &key) {
+	QMutexLocker lock(&_mutex);
+	const auto i = _index.find(IndexKey{ tag, key });
+	if (i == _index.end()) {
+		return QByteArray();
+	}
+	i->second.useTime = unixtime();
+	return readPayloadLocked(i->second);
+}
+
+bool Database::contains(uint8 tag, const Key &key) const {
+	QMutexLocker lock(&_mutex);
+	return (_index.find(IndexKey{ tag, key }) != _index.end());
+}
+
+bool Database::copy(uint8 tag, const Key &from, const Key &to) {
+	const auto now = unixtime();
+	{
+		QMutexLocker lock(&_mutex);
+		const auto i = _index.find(IndexKey{ tag, from });
+		if (i == _index.end()) {
+			return false;
+		}
+		const auto index = IndexKey{ tag, to };
+		auto entry = i->second;
+		entry.useTime = now;
+		appendRecord(
+			RecordLink,
+			index,
+			now,
+			SerializeLink(entry.offset, entry.size));
+		insertEntry(index, entry);
+	}
+	scheduleFlush();
+	return true;
+}
+
+void Database::remove(uint8 tag, const Key &key) {
+	{
+		QMutexLocker lock(&_mutex);
+		const auto index = IndexKey{ tag, key };
+		const auto i = _index.find(index);
+		if (i == _index.end()) {
+			return;
+		}
+		appendRecord(RecordRemove, index, unixtime(), QByteArray());
+		eraseEntry(i);
+		_wasted += kRecordHeaderSize;
+	}
+	scheduleFlush();
+}
+
+void Database::clear() {
+	_queue.sync([=] {
+		QMutexLocker lock(&_mutex);
+		closeFiles();
+		_index.clear();
+		_payloadUsers.clear();
+		_stats.clear();
+		_totalSize = _wasted = 0;
+		_flushing.clear();
+		_pending.clear();
+		QFile::remove(indexPath());
+		QFile::remove(dataPath());
+
+		QFile data(dataPath());
+		const auto created = createDataFile(data);
+		data.close();
+		_written = kDataHeaderSize;
+		_opened = created && openFiles();
+	});
+}
+
+Stats Database::stats(uint8 tag) const {
+	QMutexLocker lock(&_mutex);
+	const auto i = _stats.find(tag);
+	return (i != _stats.end()) ? i->second : Stats();
+}
+
+void Database::scheduleFlush() {
+	auto pending = 0;
+	{
+		QMutexLocker lock(&_mutex);
+		pending = _pending.size();
+	}
+	if (pending >= _settings.writeBundleSize) {
+		_flushTimer.cancel();
+		flush();
+	} else if (!_flushTimer.isActive()) {
+		_flushTimer.callOnce(_settings.writeBundleDelay);
+	}
+}
+
+void Database::flush() {
+	_queue.async([=] {
+		writeBundle();
+		enforceLimits();
+		if (compactionNeeded()) {
+			compact();
+		}
+	});
+}
+
+void Database::writeBundle() {
+	{
+		QMutexLocker lock(&_mutex);
+		if (!_opened || _pending.isEmpty()) {
+			return;
+		}
+		std::swap(_flushing, _pending);
+	}
+	const auto written = _writer.seek(_written)
+		&& (_writer.write(_flushing) == _flushing.size())
+		&& _writer.flush();
+
+	QMutexLocker lock(&_mutex);
+	if (written) {
+		_written += _flushing.size();
+	} else {
+		LOG(("Cache Error: Could not write %1 bytes to '%2'."
+			).arg(_flushing.size()
+			).arg(dataPath()));
+		_flushing.append(_pending);
+		std::swap(_flushing, _pending);
+	}
+	_flushing.clear();
+}
+
+void Database::enforceLimits() {
+	QMutexLocker lock(&_mutex);
+	if (!_opened) {
+		return;
+	}
+	const auto now = unixtime();
+	const auto sizeLimit = _settings.totalSizeLimit;
+	const auto timeLimit = _settings.totalTimeLimit;
+	const auto checkSize = (sizeLimit > 0) && (_totalSize > sizeLimit);
+	const auto checkTime = (timeLimit > 0)
+		&& (now - _lastPruneTime >= kPruneInterval);
+	if (!checkSize && !checkTime) {
+		return;
+	}
+	if (checkTime) {
+		_lastPruneTime = now;
+	}
+
+	auto byUseTime = std::vector<std::pair<TimeId, IndexKey>>();
+	byUseTime.reserve(_index.size());
+	for (const auto &[key, entry] : _index) {
+		byUseTime.emplace_back(entry.useTime, key);
+	}
+	ranges::sort(byUseTime, [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+
+	const auto deadline = now - timeLimit;
+	const auto target = int64(sizeLimit * kEvictTargetPart);
+	auto evicted = 0;
+	for (const auto &[useTime, key] : byUseTime) {
+		const auto outdated = checkTime && (useTime < deadline);
+		const auto oversized = checkSize && (_totalSize > target);
+		if (!outdated && !oversized) {
+			break;
+		}
+		appendRecord(RecordRemove, key, now, QByteArray());
+		eraseEntry(_index.find(key));
+		_wasted += kRecordHeaderSize;
+		++evicted;
+	}
+	if (evicted > 0) {
+		LOG(("Cache Info: Evicted %1 entries, %2 bytes left."
+			).arg(evicted
+			).arg(_totalSize));
+	}
+}
+
+bool Database::compactionNeeded() const {
+	QMutexLocker lock(&_mutex);
+	return _opened
+		&& (_wasted >= _settings.compactAfterExcess)
+		&& (_wasted >= virtualEnd() * _settings.compactAfterFullSize);
+}
+
+void Database::compact() {
+	struct Item {
+		IndexKey key;
+		Entry entry;
+	};
+	auto items = std::vector<Item>();
+	auto snapshotWritten = int64();
+	{
+		QMutexLocker lock(&_mutex);
+		snapshotWritten = _written;
+		items.reserve(_index.size());
+		for (const auto &[key, entry] : _index) {
+			if (entry.offset + entry.size <= snapshotWritten) {
+				items.push_back({ key, entry });
+			}
+		}
+	}
+
+	// Read the old data file sequentially while copying live records.
+	ranges::sort(items, [](const Item &a, const Item &b) {
+		return a.entry.offset < b.entry.offset;
+	});
+
+	const auto compactedPath = _path + qsl("data-compact");
+	QFile source(dataPath());
+	QFile compacted(compactedPath);
+	const auto fail = [&] {
+		LOG(("Cache Error: Could not compact '%1'.").arg(_path));
+		compacted.close();
+		QFile::remove(compactedPath);
+	};
+	if (!source.open(QIODevice::ReadOnly) || !createDataFile(compacted)) {
+		return fail();
+	}
+
+	auto size = kDataHeaderSize;
+	auto remap = std::unordered_map<int64, int64>();
+	auto copied = std::unordered_map<IndexKey, int64, IndexKeyHash>();
+	remap.reserve(items.size());
+	copied.reserve(items.size());
+	const auto write = [&](const IndexKey &key, const Entry &entry, const QByteArray &payload) {
+		const auto mapped = remap.find(entry.offset);
+		const auto link = (mapped != remap.end());
+		const auto record = SerializeRecord(
+			link ? RecordLink : RecordPut,
+			key.tag,
+			key.key,
+			entry.useTime,
+			link ? SerializeLink(mapped->second, entry.size) : payload);
+		if (compacted.write(record) != record.size()) {
+			return false;
+		}
+		if (!link) {
+			remap.emplace(entry.offset, size + kRecordHeaderSize);
+		}
+		size += record.size();
+		return true;
+	};
+	for (const auto &item : items) {
+		auto payload = QByteArray();
+		if (remap.find(item.entry.offset) == remap.end()) {
+			if (!source.seek(item.entry.offset)) {
+				continue;
+			}
+			payload = source.read(item.entry.size);
+			if (payload.size() != item.entry.size) {
+				continue;
+			}
+		}
+		if (!write(item.key, item.entry, payload)) {
+			return fail();
+		}
+		copied.emplace(item.key, item.entry.offset);
+	}
+	source.close();
+
+	// Now copy everything that was changed while we were working.
+	QMutexLocker lock(&_mutex);
+	if (!_opened) {
+		return fail();
+	}
+	auto updated = Index();
+	updated.reserve(_index.size());
+	for (const auto &[key, entry] : _index) {
+		const auto i = copied.find(key);
+		if (i == copied.end() || i->second != entry.offset) {
+			auto payload = QByteArray();
+			if (remap.find(entry.offset) == remap.end()) {
+				payload = readPayloadLocked(entry);
+				if (payload.size() != entry.size) {
+					continue;
+				}
+			}
+			if (!write(key, entry, payload)) {
+				return fail();
+			}
+		}
+		auto moved = entry;
+		moved.offset = remap[entry.offset];
+		updated.emplace(key, moved);
+	}
+	if (!compacted.flush()) {
+		return fail();
+	}
+	compacted.close();
+
+	closeFiles();
+	QFile::remove(dataPath());
+	if (!QFile::rename(compactedPath, dataPath())) {
+		LOG(("Cache Error: Could not replace '%1', clearing.").arg(dataPath()));
+		updated.clear();
+		QFile data(dataPath());
+		createDataFile(data);
+		size = kDataHeaderSize;
+	}
+	const auto was = _written + _pending.size();
+	_index.clear();
+	_payloadUsers.clear();
+	_stats.clear();
+	_totalSize = 0;
+	for (const auto &[key, entry] : updated) {
+		insertEntry(key, entry);
+	}
+	_written = size;
+	_pending.clear();
+	_wasted = 0;
+	_opened = openFiles();
+	if (_opened) {
+		writeIndex();
+	}
+	LOG(("Cache Info: Compacted '%1' from %2 to %3 bytes."
+		).arg(_path
+		).arg(was
+		).arg(size));
+}
+
+void Database::close() {
+	_queue.sync([=] {
+		writeBundle();
+
+		QMutexLocker lock(&_mutex);
+		if (!_opened) {
+			return;
+		}
+		writeIndex();
+		closeFiles();
+		_opened = false;
+		_index.clear();
+		_payloadUsers.clear();
+		_stats.clear();
+		_totalSize = _wasted = 0;
+		_pending.clear();
+	});
+}
+
+Database::~Database() {
+	_flushTimer.cancel();
+	close();
+}
+
+} // namespace Cache
+} // namespace Storage
@@ -0,0 +1,151 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/timer.h"
+
+namespace Storage {
+namespace Cache {
+
+// Content key of a cached blob, for example a StorageKey or a hash of an url.
+struct Key {
+	uint64 high = 0;
+	uint64 low = 0;
+};
+
+inline bool operator==(const Key &a, const Key &b) {
+	return (a.high == b.high) && (a.low == b.low);
+}
+
+inline bool operator!=(const Key &a, const Key &b) {
+	return !(a == b);
+}
+
+inline bool operator<(const Key &a, const Key &b) {
+	return std::tie(a.high, a.low) < std::tie(b.high, b.low);
+}
+
+struct Settings {
+	int64 totalSizeLimit = 1024 * 1024 * 1024; // 0 - no limit
+	TimeId totalTimeLimit = 31 * 24 * 60 * 60; // 0 - no limit
+	int writeBundleSize = 256 * 1024;
+	TimeMs writeBundleDelay = 15 * 1000;
+	int64 compactAfterExcess = 8 * 1024 * 1024;
+	float64 compactAfterFullSize = 0.1;
+};
+
+struct Stats {
+	int count = 0;
+	int64 size = 0;
+};
+
+// Append-only storage for many small blobs in a single data file.
+//
+// Each put / remove / copy is appended to the data file as a binlog
+// record, the in-memory index is rebuilt from the compact index file
+// (a snapshot written on close and after compaction) plus the binlog
+// tail that follows it. Writes are bundled and performed on a background
+// queue together with limits enforcement and compaction.
+//
+// put() / copy() / remove() are called from the main thread, get() /
+// contains() / stats() may be called from any thread. open() / clear() /
+// close() block while the files are read or recreated, so they may be
+// called from any thread as well. The object owns a main thread timer and
+// is destroyed on the main thread, it is closed then if it is still open.
+class Database {
+public:
+	Database(const QString &path, const Settings &settings = Settings());
+
+	bool open();
+	void close();
+
+	void put(uint8 tag, const Key &key, QByteArray value);
+	QByteArray get(uint8 tag, const Key &key);
+	bool contains(uint8 tag, const Key &key) const;
+	bool copy(uint8 tag, const Key &from, const Key &to);
+	void remove(uint8 tag, const Key &key);
+	void clear();
+
+	void flush();
+	Stats stats(uint8 tag) const;
+
+	~Database();
+
+private:
+	struct IndexKey {
+		uint8 tag = 0;
+		Key key;
+
+		inline bool operator==(const IndexKey &other) const {
+			return (tag == other.tag) && (key == other.key);
+		}
+	};
+	struct IndexKeyHash {
+		size_t operator()(const IndexKey &value) const;
+	};
+	struct Entry {
+		int64 offset = 0; // of the payload, not of the record header
+		int32 size = 0;
+		TimeId useTime = 0;
+	};
+	using Index = std::unordered_map<IndexKey, Entry, IndexKeyHash>;
+
+	// Copies share the payload of the original entry, the payload bytes
+	// are counted only once and are wasted only with the last user.
+	using PayloadUsers = std::unordered_map<int64, int>;
+
+	QString dataPath() const;
+	QString indexPath() const;
+	bool openFiles();
+	void closeFiles();
+	bool createDataFile(QFile &file) const;
+	bool readIndex(int64 dataSize, int64 &covered);
+	bool replayBinlog(int64 from);
+	bool writeIndex();
+
+	void appendRecord(
+		uchar type,
+		const IndexKey &key,
+		TimeId time,
+		const QByteArray &payload);
+	void insertEntry(const IndexKey &key, const Entry &entry);
+	void eraseEntry(Index::iterator i);
+	QByteArray readPayloadLocked(const Entry &entry);
+	int64 virtualEnd() const;
+
+	void scheduleFlush();
+	void writeBundle();
+	void enforceLimits();
+	bool compactionNeeded() const;
+	void compact();
+
+	QString _path;
+	Settings _settings;
+
+	mutable QMutex _mutex;
+	Index _index;
+	PayloadUsers _payloadUsers;
+	base::flat_map<uint8, Stats> _stats;
+	int64 _totalSize = 0;
+	int64 _wasted = 0;
+	TimeId _lastPruneTime = 0;
+
+	QFile _reader; // guarded by _mutex
+	QFile _writer; // used only on _queue
+	int64 _written = 0;
+	QByteArray _flushing;
+	QByteArray _pending;
+	bool _opened = false;
+
+	base::Timer _flushTimer;
+	crl::queue _queue;
+
+};
+
+} // namespace Cache
+} // namespace Storage
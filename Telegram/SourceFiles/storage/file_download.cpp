@@ -17,9 +17,23 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "core/crash_reports.h"
 
 namespace Storage {
+namespace {
+
+// Part size is fixed for now, see mtpFileLoader::partSize().
+constexpr auto kDownloadPartSize = 128 * 1024;
+constexpr auto kDefaultSessionWindow = 8;
+constexpr auto kMinSessionWindow = 2;
+constexpr auto kMaxSessionWindow = 64;
+constexpr auto kWindowQueuedMin = 1.;
+constexpr auto kWindowQueuedMax = 3.;
+constexpr auto kMinSampleDuration = TimeMs(500);
+constexpr auto kMinRttResetTimeout = TimeMs(30000);
+
+} // namespace
 
 Downloader::Downloader()
 : _delayedLoadersDestroyer([this] { _delayedDestroyedLoaders.clear(); }) {
+	ClearStalePartialDownloads();
 }
 
 void Downloader::delayedDestroyLoader(std::unique_ptr<FileLoader> loader) {
@@ -31,26 +45,117 @@ void Downloader::clearPriorities() {
 	++_priority;
 }
 
-void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
+Downloader::SessionsInDc &Downloader::sessionsInDc(MTP::DcId dcId) {
+	auto it = _sessions.find(dcId);
+	if (it == _sessions.cend()) {
+		auto sessions = SessionsInDc();
+		for (auto &session : sessions) {
+			session.window = kDefaultSessionWindow;
+		}
+		it = _sessions.emplace(dcId, sessions).first;
+	}
+	return it->second;
+}
+
+void Downloader::requestSent(MTP::DcId dcId, int index, int amount) {
 	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it == _requestedBytesAmount.cend()) {
-		it = _requestedBytesAmount.emplace(dcId, RequestedInDc { { 0 } }).first;
+
+	auto &session = sessionsInDc(dcId)[index];
+	if (!session.queries && !session.sampleStart) {
+		session.sampleStart = getms(true);
 	}
-	it->second[index] += amount;
-	if (it->second[index]) {
+	session.requested += amount;
+	++session.queries;
+	if (session.queries >= session.window) {
+		session.windowLimited = true;
+	}
+	Messenger::Instance().killDownloadSessionsStop(dcId);
+}
+
+void Downloader::requestFinished(MTP::DcId dcId, int index, int amount) {
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
+
+	auto &session = sessionsInDc(dcId)[index];
+	Assert(session.queries > 0);
+	session.requested -= amount;
+	--session.queries;
+	if (session.requested) {
 		Messenger::Instance().killDownloadSessionsStop(dcId);
 	} else {
 		Messenger::Instance().killDownloadSessionsStart(dcId);
 	}
 }
 
+void Downloader::partReceived(
+		MTP::DcId dcId,
+		int index,
+		int amount,
+		TimeMs duration) {
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
+
+	auto &session = sessionsInDc(dcId)[index];
+	const auto now = getms(true);
+	const auto sample = std::max(duration, TimeMs(1));
+	session.rtt = session.rtt
+		? ((session.rtt * 7 + sample) / 8)
+		: sample;
+	if (!session.minRtt
+		|| sample < session.minRtt
+		|| now - session.minRttTime > kMinRttResetTimeout) {
+		session.minRtt = sample;
+		session.minRttTime = now;
+	}
+	session.sampleReceived += amount;
+	++session.sampleParts;
+	if (!session.sampleStart) {
+		session.sampleStart = now - sample;
+	}
+	if (now - session.sampleStart >= std::max(session.rtt, kMinSampleDuration)) {
+		updateWindow(session, now);
+	}
+}
+
+void Downloader::updateWindow(SessionState &session, TimeMs now) {
+	const auto duration = now - session.sampleStart;
+	const auto received = base::take(session.sampleReceived);
+	const auto parts = base::take(session.sampleParts);
+	const auto limited = base::take(session.windowLimited);
+	session.sampleStart = session.queries ? now : 0;
+	if (!limited || duration <= 0 || !parts || !received) {
+		// Not enough parts were requested to tell anything about the link.
+		return;
+	}
+
+	// Compare the throughput we would have with an empty link queue
+	// (window / minRtt) to the measured one, the difference multiplied
+	// by minRtt is the amount of parts waiting in the queues somewhere.
+	// Thumbnails and last parts are smaller than kDownloadPartSize,
+	// so the actually received average part size is used.
+	const auto partSize = float64(received) / parts;
+	const auto expected = session.window * partSize / session.minRtt;
+	const auto actual = float64(received) / duration;
+	const auto queued = (expected - actual) * session.minRtt / partSize;
+	if (queued < kWindowQueuedMin) {
+		const auto add = session.slowStart ? session.window : 1;
+		session.window = std::min(session.window + add, kMaxSessionWindow);
+	} else if (queued > kWindowQueuedMax) {
+		session.slowStart = false;
+		session.window = std::max(session.window - 1, kMinSessionWindow);
+	}
+}
+
 int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
 	auto result = 0;
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it != _requestedBytesAmount.cend()) {
+	auto it = _sessions.find(dcId);
+	if (it != _sessions.cend()) {
+		const auto &sessions = it->second;
+		const auto free = [&](int index) {
+			return sessions[index].window - sessions[index].queries;
+		};
 		for (auto i = 1; i != MTP::kDownloadSessionsCount; ++i) {
-			if (it->second[i] < it->second[result]) {
+			if (free(i) > free(result)
+				|| (free(i) == free(result)
+					&& sessions[i].requested < sessions[result].requested)) {
 				result = i;
 			}
 		}
@@ -58,6 +163,25 @@ int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
 	return result;
 }
 
+int Downloader::queriesLimit(MTP::DcId dcId) const {
+	auto it = _sessions.find(dcId);
+	if (it == _sessions.cend()) {
+		return kDefaultSessionWindow * MTP::kDownloadSessionsCount;
+	}
+	auto result = 0;
+	for (const auto &session : it->second) {
+		result += session.window;
+	}
+	return result;
+}
+
+int Downloader::loaderQueriesLimit(MTP::DcId dcId) const {
+	// Leave some of the window for other files, so that small
+	// thumbnails are not queued behind a large document.
+	const auto limit = queriesLimit(dcId);
+	return std::max(limit - limit / 4, 1);
+}
+
 Downloader::~Downloader() {
 	// The file loaders have pointer to downloader and they cancel
 	// requests in destructor where they use that pointer, so all
@@ -71,12 +195,72 @@ namespace {
 
 constexpr auto kDownloadPhotoPartSize = 64 * 1024; // 64kb for photo
 constexpr auto kDownloadDocumentPartSize = 128 * 1024; // 128kb for document
-constexpr auto kMaxFileQueries = 16; // max 16 file parts downloaded at the same time
 constexpr auto kMaxWebFileQueries = 8; // max 8 http[s] files downloaded at the same time
-constexpr auto kDownloadCdnPartSize = 128 * 1024; // 128kb for cdn requests
+constexpr auto kDownloadCdnPartSize = Storage::kDownloadPartSize; // 128kb for cdn requests
+constexpr auto kMinStreamingFileSize = 4 * 1024 * 1024; // stream documents of 4mb and more
+constexpr auto kStreamingStateMagic = 0x54504454U; // 'TDPT'
+constexpr auto kStreamingFilePostfix = ".tdpart";
+constexpr auto kStreamingStatePostfix = ".state";
+constexpr auto kStalePartialDownloadAge = 7 * 24 * 60 * 60; // a week
+constexpr auto kStreamingStateWriteInterval = 2 * 1024 * 1024; // each 2mb
+
+struct StreamingState {
+	uint32 magic = 0;
+	int32 size = 0;
+	uint64 id = 0;
+	int32 version = 0;
+	int32 offset = 0;
+	int32 reserved = 0;
+	int32 checksum = 0;
+};
+static_assert(sizeof(StreamingState) == 32, "Bad StreamingState size!");
+
+int32 StreamingStateChecksum(const StreamingState &state) {
+	return hashCrc32(&state, offsetof(StreamingState, checksum));
+}
 
 } // namespace
 
+namespace Storage {
+
+void ClearStalePartialDownloads() {
+	// Files are downloaded to the default folder, to the one chosen in
+	// the settings, to the temp folder or to the last folder chosen in
+	// the "Save as" dialog, so the partial files are looked for in all.
+	auto paths = base::flat_set<QString>();
+	const auto add = [&](const QString &path) {
+		if (!path.isEmpty()) {
+			paths.emplace(QDir::cleanPath(path));
+		}
+	};
+	add(psDownloadPath());
+	add(cTempDir());
+	if (Global::DownloadPath() != qsl("tmp")) {
+		add(Global::DownloadPath());
+	}
+	add(cDialogLastPath());
+	crl::async([paths = std::move(paths)] {
+		const auto deadline = QDateTime::currentDateTime().addSecs(
+			-kStalePartialDownloadAge);
+		const auto part = qsl("*") + qstr(kStreamingFilePostfix);
+		const auto filters = QStringList()
+			<< part
+			<< (part + qstr(kStreamingStatePostfix));
+		for (const auto &path : paths) {
+			const auto files = QDir(path).entryInfoList(
+				filters,
+				QDir::Files | QDir::Hidden);
+			for (const auto &info : files) {
+				if (info.lastModified() < deadline) {
+					QFile::remove(info.absoluteFilePath());
+				}
+			}
+		}
+	});
+}
+
+} // namespace Storage
+
 struct FileLoaderQueue {
 	FileLoaderQueue(int queriesLimit) : queriesLimit(queriesLimit) {
 	}
@@ -156,7 +340,10 @@ bool FileLoader::setFileName(const QString &fileName) {
 		return fileName.isEmpty() || (fileName == _filename);
 	}
 	_filename = fileName;
-	_file.setFileName(_filename);
+	if (!_fileIsOpen) {
+		// A partial file loaded only to the cache is moved here later.
+		_file.setFileName(_filename);
+	}
 	return true;
 }
 
@@ -199,9 +386,18 @@ void FileLoader::removeFromQueue() {
 
 void FileLoader::pause() {
 	removeFromQueue();
+	cancelLocalTask();
 	_paused = true;
 }
 
+void FileLoader::cancelLocalTask() {
+	if (_localTaskId) {
+		// The consumer is not interested right now, try again on start().
+		Local::cancelTask(base::take(_localTaskId));
+		_localStatus = LocalNotTried;
+	}
+}
+
 FileLoader::~FileLoader() {
 	if (_localTaskId) {
 		Local::cancelTask(_localTaskId);
@@ -251,15 +447,26 @@ void FileLoader::start(bool loadFirst, bool prior) {
 	if (_paused) {
 		_paused = false;
 	}
-	if (_finished || tryLoadLocal()) return;
+	if (_finished) return;
+	if (tryLoadLocal()) {
+		if (_localTaskId && prior) {
+			// Visible consumers restart their loaders on each paint,
+			// so their local tasks are moved ahead of the stale ones.
+			Local::prioritizeTask(
+				_localTaskId,
+				_downloader->currentPriority());
+		}
+		return;
+	}
 
 	if (_fromCloud == LoadFromLocalOnly) {
 		cancel();
 		return;
 	}
 
-	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileIsOpen) {
-		_fileIsOpen = _file.open(QIODevice::WriteOnly);
+	if (((!_filename.isEmpty() && _toCache == LoadToFileOnly) || streaming())
+		&& !_fileIsOpen) {
+		_fileIsOpen = openFile();
 		if (!_fileIsOpen) {
 			return cancel(true);
 		}
@@ -360,13 +567,16 @@ void FileLoader::cancel() {
 
 void FileLoader::cancel(bool fail) {
 	bool started = currentOffset(true) > 0;
+	if (_localTaskId) {
+		Local::cancelTask(base::take(_localTaskId));
+	}
 	cancelRequests();
 	_cancelled = true;
 	_finished = true;
 	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
-		_file.remove();
+		removeFile();
+	} else {
+		removePartialFile();
 	}
 	_data = QByteArray();
 	removeFromQueue();
@@ -383,6 +593,16 @@ void FileLoader::cancel(bool fail) {
 	loadNext();
 }
 
+bool FileLoader::openFile() {
+	return _file.open(QIODevice::WriteOnly);
+}
+
+void FileLoader::removeFile() {
+	_file.close();
+	_fileIsOpen = false;
+	_file.remove();
+}
+
 void FileLoader::startLoading(bool loadFirst, bool prior) {
 	if ((_queue->queriesCount >= _queue->queriesLimit && (!loadFirst || !prior)) || _finished) {
 		return;
@@ -397,7 +617,7 @@ mtpFileLoader::mtpFileLoader(const StorageImageLocation *location, int32 size, L
 	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
 	auto i = queues.find(shiftedDcId);
 	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
+		i = queues.insert(shiftedDcId, FileLoaderQueue(_downloader->queriesLimit(_dcId)));
 	}
 	_queue = &i.value();
 }
@@ -411,7 +631,7 @@ mtpFileLoader::mtpFileLoader(int32 dc, uint64 id, uint64 accessHash, int32 versi
 	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
 	auto i = queues.find(shiftedDcId);
 	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
+		i = queues.insert(shiftedDcId, FileLoaderQueue(_downloader->queriesLimit(_dcId)));
 	}
 	_queue = &i.value();
 }
@@ -423,21 +643,199 @@ mtpFileLoader::mtpFileLoader(const WebFileLocation *location, int32 size, LoadFr
 	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
 	auto i = queues.find(shiftedDcId);
 	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
+		i = queues.insert(shiftedDcId, FileLoaderQueue(_downloader->queriesLimit(_dcId)));
 	}
 	_queue = &i.value();
 }
 
 int32 mtpFileLoader::currentOffset(bool includeSkipped) const {
+	if (_streaming) {
+		return _streamedOffset + _streamedAheadBytes;
+	}
 	return (_fileIsOpen ? _file.size() : _data.size()) - (includeSkipped ? 0 : _skippedBytes);
 }
 
+bool mtpFileLoader::streaming() const {
+	return (_locationType != UnknownFileLocation)
+		&& (_size >= kMinStreamingFileSize);
+}
+
+QString mtpFileLoader::streamingFilePath() const {
+	// Loaded only to the cache, the partial file is in the temp folder.
+	const auto path = _filename.isEmpty()
+		? (cTempDir() + QString("%1_%2").arg(_id, 0, 16).arg(_version))
+		: _filename;
+	return path + qstr(kStreamingFilePostfix);
+}
+
+bool mtpFileLoader::openFile() {
+	_streaming = streaming();
+	if (!_streaming) {
+		return FileLoader::openFile();
+	}
+	if (_filename.isEmpty()) {
+		QDir().mkpath(cTempDir());
+	}
+	_file.setFileName(streamingFilePath());
+	_streamingState.setFileName(
+		streamingFilePath() + qstr(kStreamingStatePostfix));
+	if (!_file.open(QIODevice::ReadWrite)
+		|| !_streamingState.open(QIODevice::ReadWrite)) {
+		_file.close();
+		return false;
+	}
+	if (!readStreamingState()) {
+		_streamedOffset = 0;
+	}
+	_streamedStateOffset = _streamedOffset;
+	_streamedAhead.clear();
+	_streamedAheadBytes = 0;
+	_nextRequestOffset = _streamedOffset;
+
+	// Parts received after the prefix are requested once again.
+	if (!_file.resize(_streamedOffset)) {
+		_file.close();
+		_streamingState.close();
+		return false;
+	}
+	return true;
+}
+
+void mtpFileLoader::removeFile() {
+	FileLoader::removeFile();
+	if (_streamingState.isOpen()) {
+		_streamingState.close();
+		_streamingState.remove();
+	}
+}
+
+void mtpFileLoader::removePartialFile() {
+	// Cancelled before opening, the partial file of a previous launch
+	// is not going to be resumed anymore.
+	if (streaming()) {
+		QFile::remove(streamingFilePath());
+		QFile::remove(streamingFilePath() + qstr(kStreamingStatePostfix));
+	}
+}
+
+bool mtpFileLoader::readStreamingState() {
+	auto state = StreamingState();
+	const auto read = _streamingState.read(
+		reinterpret_cast<char*>(&state),
+		sizeof(StreamingState));
+	if (read != qint64(sizeof(StreamingState))
+		|| state.magic != kStreamingStateMagic
+		|| state.checksum != StreamingStateChecksum(state)
+		|| state.size != _size
+		|| state.id != _id
+		|| state.version != _version
+		|| state.offset < 0
+		|| state.offset >= _size
+		|| (state.offset % partSize())
+		|| _file.size() < state.offset) {
+		return false;
+	}
+	_streamedOffset = state.offset;
+	return true;
+}
+
+void mtpFileLoader::writeStreamingState() {
+	auto state = StreamingState();
+	state.magic = kStreamingStateMagic;
+	state.size = _size;
+	state.id = _id;
+	state.version = _version;
+	state.offset = _streamedOffset;
+	state.checksum = StreamingStateChecksum(state);
+	_streamedStateOffset = _streamedOffset;
+
+	// The prefix is handed to the system before the state referring to
+	// it, so that the state is not ahead of the data if the app crashes.
+	// There is no fsync, after a system crash both may be behind.
+	if (!_file.flush()
+		|| !_streamingState.seek(0)
+		|| _streamingState.write(reinterpret_cast<const char*>(&state), sizeof(StreamingState)) != qint64(sizeof(StreamingState))
+		|| !_streamingState.flush()) {
+		LOG(("File Error: Could not write streaming state for '%1'."
+			).arg(_file.fileName()));
+	}
+}
+
+void mtpFileLoader::streamedPart(int offset, int size) {
+	if (offset < _streamedOffset) {
+		return;
+	} else if (offset > _streamedOffset) {
+		if (_streamedAhead.emplace(offset, size).second) {
+			_streamedAheadBytes += size;
+		}
+		return;
+	}
+	_streamedOffset += size;
+	for (auto i = _streamedAhead.begin(); i != _streamedAhead.end();) {
+		if (i->first != _streamedOffset) {
+			break;
+		}
+		_streamedOffset += i->second;
+		_streamedAheadBytes -= i->second;
+		i = _streamedAhead.erase(i);
+	}
+
+	// Rewriting the state for each part is not worth it, at most the
+	// last interval is loaded once again if the state is not written.
+	if (_streamedOffset - _streamedStateOffset >= kStreamingStateWriteInterval) {
+		writeStreamingState();
+	}
+}
+
+QByteArray mtpFileLoader::readLoadedFile() const {
+	QFile file(_filename);
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool mtpFileLoader::finishStreaming() {
+	Expects(_fileIsOpen);
+
+	if (!_file.resize(_size)) {
+		return false;
+	}
+	_streamingState.close();
+	_streamingState.remove();
+	if (_filename.isEmpty()) {
+		// Loaded only to the cache, the consumer needs the bytes.
+		_file.seek(0);
+		_data = _file.readAll();
+		_file.close();
+		_fileIsOpen = false;
+		_file.remove();
+		_streaming = false;
+		return (_data.size() == _size);
+	}
+	_file.close();
+	_fileIsOpen = false;
+	QFile::remove(_filename);
+	if (!_file.rename(_filename)) {
+		LOG(("File Error: Could not rename '%1' to '%2'."
+			).arg(_file.fileName()
+			).arg(_filename));
+		_file.remove();
+		return false;
+	}
+	_streaming = false;
+	Platform::File::PostprocessDownloaded(
+		QFileInfo(_file).absoluteFilePath());
+	return true;
+}
+
 bool mtpFileLoader::loadPart() {
 	if (_finished || _lastComplete || (!_sentRequests.empty() && !_size)) {
 		return false;
 	} else if (_size && _nextRequestOffset >= _size) {
 		return false;
 	}
+	const auto limit = _downloader->loaderQueriesLimit(_dcId);
+	if (_sentRequests.size() >= size_t(limit)) {
+		return false;
+	}
 
 	makeRequest(_nextRequestOffset);
 	_nextRequestOffset += partSize();
@@ -524,19 +922,23 @@ void mtpFileLoader::normalPartLoaded(const MTPupload_File &result, mtpRequestId
 	Expects(!_finished);
 	Expects(result.type() == mtpc_upload_fileCdnRedirect || result.type() == mtpc_upload_file);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
+		auto offset = finishSentRequestGetOffset(requestId);
 		return switchToCDN(offset, result.c_upload_fileCdnRedirect());
 	}
-	auto bytes = gsl::as_bytes(gsl::make_span(result.c_upload_file().vbytes.v));
+	auto &data = result.c_upload_file().vbytes.v;
+	auto offset = finishReceivedPartGetOffset(requestId, data.size());
+	auto bytes = gsl::as_bytes(gsl::make_span(data));
 	return partLoaded(offset, bytes);
 }
 
 void mtpFileLoader::webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId) {
 	Expects(result.type() == mtpc_upload_webFile);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	auto &webFile = result.c_upload_webFile();
+	auto offset = finishReceivedPartGetOffset(
+		requestId,
+		webFile.vbytes.v.size());
 	if (!_size) {
 		_size = webFile.vsize.v;
 	} else if (webFile.vsize.v != _size) {
@@ -550,8 +952,8 @@ void mtpFileLoader::webPartLoaded(const MTPupload_WebFile &result, mtpRequestId
 void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId) {
 	Expects(!_finished);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	if (result.type() == mtpc_upload_cdnFileReuploadNeeded) {
+		auto offset = finishSentRequestGetOffset(requestId);
 		auto requestData = RequestData();
 		requestData.dcId = _dcId;
 		requestData.dcIndex = 0;
@@ -563,6 +965,9 @@ void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId
 	}
 	Expects(result.type() == mtpc_upload_cdnFile);
 
+	auto offset = finishReceivedPartGetOffset(
+		requestId,
+		result.c_upload_cdnFile().vbytes.v.size());
 	auto key = gsl::as_bytes(gsl::make_span(_cdnEncryptionKey));
 	auto iv = gsl::as_bytes(gsl::make_span(_cdnEncryptionIV));
 	Expects(key.size() == MTP::CTRState::KeySize);
@@ -672,9 +1077,10 @@ void mtpFileLoader::getCdnFileHashesDone(const MTPVector<MTPFileHash> &result, m
 void mtpFileLoader::placeSentRequest(mtpRequestId requestId, const RequestData &requestData) {
 	Expects(!_finished);
 
-	_downloader->requestedAmountIncrement(requestData.dcId, requestData.dcIndex, partSize());
+	_downloader->requestSent(requestData.dcId, requestData.dcIndex, partSize());
 	++_queue->queriesCount;
-	_sentRequests.emplace(requestId, requestData);
+	auto &sent = _sentRequests.emplace(requestId, requestData).first->second;
+	sent.sent = getms(true);
 }
 
 int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
@@ -682,7 +1088,7 @@ int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
 	Expects(it != _sentRequests.cend());
 
 	auto requestData = it->second;
-	_downloader->requestedAmountIncrement(requestData.dcId, requestData.dcIndex, -partSize());
+	_downloader->requestFinished(requestData.dcId, requestData.dcIndex, partSize());
 
 	--_queue->queriesCount;
 	_sentRequests.erase(it);
@@ -690,11 +1096,35 @@ int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
 	return requestData.offset;
 }
 
+int mtpFileLoader::finishReceivedPartGetOffset(mtpRequestId requestId, int amount) {
+	auto it = _sentRequests.find(requestId);
+	Expects(it != _sentRequests.cend());
+
+	const auto &requestData = it->second;
+	_downloader->partReceived(
+		requestData.dcId,
+		requestData.dcIndex,
+		amount,
+		getms(true) - requestData.sent);
+	// The queue is shared by all the loaders of the main dc, even if the
+	// parts of some of them are requested from a cdn dc.
+	_queue->queriesLimit = _downloader->queriesLimit(_dcId);
+
+	return finishSentRequestGetOffset(requestId);
+}
+
 bool mtpFileLoader::feedPart(int offset, base::const_byte_span bytes) {
 	Expects(!_finished);
 
 	if (bytes.size()) {
-		if (_fileIsOpen) {
+		if (_streaming) {
+			if (!_file.seek(offset)
+				|| _file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size()) != qint64(bytes.size())) {
+				cancel(true);
+				return false;
+			}
+			streamedPart(offset, bytes.size());
+		} else if (_fileIsOpen) {
 			auto fsize = _file.size();
 			if (offset < fsize) {
 				_skippedBytes -= bytes.size();
@@ -706,7 +1136,8 @@ bool mtpFileLoader::feedPart(int offset, base::const_byte_span bytes) {
 				cancel(true);
 				return false;
 			}
-		} else {
+		}
+		if (!_fileIsOpen) {
 			if (offset > 100 * 1024 * 1024) {
 				// Debugging weird out of memory crashes.
 				auto info = QString("offset: %1, size: %2, cancelled: %3, finished: %4, filename: '%5', tocache: %6, fromcloud: %7, data: %8, fullsize: %9").arg(offset).arg(bytes.size()).arg(Logs::b(_cancelled)).arg(Logs::b(_finished)).arg(_filename).arg(int(_toCache)).arg(int(_fromCloud)).arg(_data.size()).arg(_size);
@@ -741,7 +1172,9 @@ bool mtpFileLoader::feedPart(int offset, base::const_byte_span bytes) {
 	if (_sentRequests.empty()
 		&& _cdnUncheckedParts.empty()
 		&& (_lastComplete || (_size && _nextRequestOffset >= _size))) {
-		if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
+		if (!_filename.isEmpty()
+			&& (_toCache == LoadToCacheAsWell)
+			&& !_streaming) {
 			if (!_fileIsOpen) {
 				_fileIsOpen = _file.open(QIODevice::WriteOnly);
 			}
@@ -750,6 +1183,10 @@ bool mtpFileLoader::feedPart(int offset, base::const_byte_span bytes) {
 				return false;
 			}
 		}
+		if (_streaming && !finishStreaming()) {
+			cancel(true);
+			return false;
+		}
 		_finished = true;
 		if (_fileIsOpen) {
 			_file.close();
@@ -767,10 +1204,14 @@ bool mtpFileLoader::feedPart(int offset, base::const_byte_span bytes) {
 					Local::writeFileLocation(mkey, FileLocation(_filename));
 				}
 				if (_toCache == LoadToCacheAsWell) {
+					// Streamed to a file, it is read only for the cache.
+					const auto data = (_data.isEmpty() && !_filename.isEmpty())
+						? readLoadedFile()
+						: _data;
 					if (_locationType == DocumentFileLocation) {
-						Local::writeStickerImage(mkey, _data);
+						Local::writeStickerImage(mkey, data);
 					} else if (_locationType == AudioFileLocation) {
-						Local::writeAudio(mkey, _data);
+						Local::writeAudio(mkey, data);
 					}
 				}
 			} else {
@@ -912,6 +1353,12 @@ bool mtpFileLoader::tryLoadLocal() {
 
 mtpFileLoader::~mtpFileLoader() {
 	cancelRequests();
+	if (_streaming && _fileIsOpen) {
+		// Keep the partial file to resume loading after restart.
+		writeStreamingState();
+		_file.close();
+		_streamingState.close();
+	}
 }
 
 webFileLoader::webFileLoader(const QString &url, const QString &to, LoadFromCloudSetting fromCloud, bool autoLoading)
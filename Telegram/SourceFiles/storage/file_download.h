@@ -32,8 +32,19 @@ public:
 		return _taskFinishedObservable;
 	}
 
-	void requestedAmountIncrement(MTP::DcId dcId, int index, int amount);
+	// Each download session keeps an adaptive window of parts in flight,
+	// it grows while the measured throughput keeps up with the window and
+	// shrinks when the round trip time grows because of queueing.
+	void requestSent(MTP::DcId dcId, int index, int amount);
+	void requestFinished(MTP::DcId dcId, int index, int amount);
+	void partReceived(
+		MTP::DcId dcId,
+		int index,
+		int amount,
+		TimeMs duration);
 	int chooseDcIndexForRequest(MTP::DcId dcId) const;
+	int queriesLimit(MTP::DcId dcId) const;
+	int loaderQueriesLimit(MTP::DcId dcId) const;
 
 	~Downloader();
 
@@ -44,11 +55,31 @@ private:
 	SingleQueuedInvokation _delayedLoadersDestroyer;
 	std::vector<std::unique_ptr<FileLoader>> _delayedDestroyedLoaders;
 
-	using RequestedInDc = std::array<int64, MTP::kDownloadSessionsCount>;
-	std::map<MTP::DcId, RequestedInDc> _requestedBytesAmount;
+	struct SessionState {
+		int64 requested = 0;
+		int queries = 0;
+		int window = 0;
+		bool windowLimited = false;
+		bool slowStart = true;
+		TimeMs rtt = 0;
+		TimeMs minRtt = 0;
+		TimeMs minRttTime = 0;
+		TimeMs sampleStart = 0;
+		int64 sampleReceived = 0;
+		int sampleParts = 0;
+	};
+	using SessionsInDc = std::array<SessionState, MTP::kDownloadSessionsCount>;
+	SessionsInDc &sessionsInDc(MTP::DcId dcId);
+	void updateWindow(SessionState &session, TimeMs now);
+
+	std::map<MTP::DcId, SessionsInDc> _sessions;
 
 };
 
+// Partial files of the streamed downloads are kept to resume loading
+// after restart, the ones not modified for a long time are removed.
+void ClearStalePartialDownloads();
+
 } // namespace Storage
 
 struct StorageImageSaved {
@@ -102,6 +133,7 @@ public:
 	void permitLoadFromCloud();
 
 	void pause();
+	void cancelLocalTask();
 	void start(bool loadFirst = false, bool prior = true);
 	void cancel();
 
@@ -149,6 +181,13 @@ protected:
 
 	virtual bool tryLoadLocal() = 0;
 	virtual void cancelRequests() = 0;
+	virtual bool openFile();
+	virtual void removeFile();
+	virtual void removePartialFile() {
+	}
+	virtual bool streaming() const {
+		return false;
+	}
 
 	void startLoading(bool loadFirst, bool prior);
 	void removeFromQueue();
@@ -202,6 +241,7 @@ private:
 		MTP::DcId dcId = 0;
 		int dcIndex = 0;
 		int offset = 0;
+		TimeMs sent = 0;
 	};
 	struct CdnFileHash {
 		CdnFileHash(int limit, QByteArray hash) : limit(limit), hash(hash) {
@@ -212,6 +252,20 @@ private:
 
 	bool tryLoadLocal() override;
 	void cancelRequests() override;
+	bool openFile() override;
+	void removeFile() override;
+	void removePartialFile() override;
+
+	// Large documents loaded to a file are streamed to a partial file
+	// next to the target one, the received prefix length is kept in a
+	// small state file near it so that loading can be resumed.
+	bool streaming() const override;
+	QString streamingFilePath() const;
+	bool readStreamingState();
+	void writeStreamingState();
+	void streamedPart(int offset, int size);
+	bool finishStreaming();
+	QByteArray readLoadedFile() const;
 
 	int partSize() const;
 	RequestData prepareRequest(int offset) const;
@@ -234,6 +288,7 @@ private:
 
 	void placeSentRequest(mtpRequestId requestId, const RequestData &requestData);
 	int finishSentRequestGetOffset(mtpRequestId requestId);
+	int finishReceivedPartGetOffset(mtpRequestId requestId, int amount);
 	void switchToCDN(int offset, const MTPDupload_fileCdnRedirect &redirect);
 	void addCdnHashes(const QVector<MTPFileHash> &hashes);
 	void changeCDNParams(int offset, MTP::DcId dcId, const QByteArray &token, const QByteArray &encryptionKey, const QByteArray &encryptionIV, const QVector<MTPFileHash> &hashes);
@@ -251,6 +306,13 @@ private:
 	int32 _skippedBytes = 0;
 	int32 _nextRequestOffset = 0;
 
+	bool _streaming = false;
+	QFile _streamingState;
+	int32 _streamedOffset = 0; // all the bytes before were received
+	int32 _streamedStateOffset = 0; // the offset in the state file
+	int32 _streamedAheadBytes = 0;
+	base::flat_map<int32, int32> _streamedAhead; // offset -> size
+
 	MTP::DcId _dcId = 0; // for photo locations
 	const StorageImageLocation *_location = nullptr;
 
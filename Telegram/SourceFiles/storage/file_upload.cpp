@@ -7,6 +7,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "storage/file_upload.h"
 
+#include "storage/file_upload_reader.h"
 #include "storage/localimageloader.h"
 #include "data/data_document.h"
 #include "data/data_photo.h"
@@ -16,7 +17,18 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace Storage {
 namespace {
 
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024; // max 512kb uploaded at the same time in each session
+// Each upload session keeps an adaptive window of bytes in flight.
+constexpr auto kWindowStep = 128 * 1024;
+constexpr auto kDefaultSessionWindow = 512 * 1024;
+constexpr auto kMinSessionWindow = kWindowStep;
+constexpr auto kMaxSessionWindow = 8 * 1024 * 1024;
+constexpr auto kWindowQueuedMin = float64(kWindowStep);
+constexpr auto kWindowQueuedMax = float64(3 * kWindowStep);
+constexpr auto kMinSampleDuration = TimeMs(500);
+constexpr auto kMinRttResetTimeout = TimeMs(30000);
+
+// Sessions are shared between this count of first files in the queue.
+constexpr auto kUploadingFilesLimit = 3;
 
 } // namespace
 
@@ -26,6 +38,7 @@ struct Uploader::File {
 
 	void setDocSize(int32 size);
 	bool setPartSize(uint32 partSize);
+	bool hasPartsToSend() const;
 
 	std::shared_ptr<FileLoadResult> file;
 	SendMediaReady media;
@@ -36,15 +49,22 @@ struct Uploader::File {
 	SendMediaType type() const;
 	uint64 thumbId() const;
 	const QString &filename() const;
+	UploadFileParts &parts();
+	uint64 partsOfId() const;
 
 	HashMd5 md5Hash;
 
-	std::unique_ptr<QFile> docFile;
+	std::unique_ptr<UploadPartsReader> docReader;
 	int32 docSentParts = 0;
 	int32 docSize = 0;
 	int32 docPartSize = 0;
 	int32 docPartsCount = 0;
 
+	int64 inFlight = 0;
+	int requests = 0;
+	int docRequests = 0;
+	bool started = false;
+
 };
 
 Uploader::File::File(const SendMediaReady &media) : media(media) {
@@ -109,11 +129,33 @@ const QString &Uploader::File::filename() const {
 	return file ? file->filename : media.filename;
 }
 
+UploadFileParts &Uploader::File::parts() {
+	return file
+		? (type() == SendMediaType::Photo ? file->fileparts : file->thumbparts)
+		: media.parts;
+}
+
+uint64 Uploader::File::partsOfId() const {
+	return file
+		? (type() == SendMediaType::Photo ? file->id : file->thumbId)
+		: media.thumbId;
+}
+
+bool Uploader::File::hasPartsToSend() const {
+	const auto &parts = file
+		? (type() == SendMediaType::Photo ? file->fileparts : file->thumbparts)
+		: media.parts;
+	return !parts.isEmpty() || (docSentParts < docPartsCount);
+}
+
 Uploader::Uploader() {
 	nextTimer.setSingleShot(true);
 	connect(&nextTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
 	killSessionsTimer.setSingleShot(true);
 	connect(&killSessionsTimer, SIGNAL(timeout()), this, SLOT(killSessions()));
+	for (auto &session : _sessions) {
+		session.window = kDefaultSessionWindow;
+	}
 }
 
 void Uploader::uploadMedia(const FullMsgId &msgId, const SendMediaReady &media) {
@@ -156,31 +198,37 @@ void Uploader::upload(
 	sendNext();
 }
 
-void Uploader::currentFailed() {
-	auto j = queue.find(uploadingId);
+void Uploader::fileFailed(const FullMsgId &msgId) {
+	cancelRequests(msgId);
+
+	auto j = queue.find(msgId);
 	if (j != queue.end()) {
-		if (j->second.type() == SendMediaType::Photo) {
-			emit photoFailed(j->first);
-		} else if (j->second.type() == SendMediaType::File) {
-			const auto document = Auth().data().document(j->second.id());
+		const auto type = j->second.type();
+		const auto id = j->second.id();
+		queue.erase(j);
+
+		if (type == SendMediaType::Photo) {
+			emit photoFailed(msgId);
+		} else if (type == SendMediaType::File) {
+			const auto document = Auth().data().document(id);
 			if (document->uploading()) {
 				document->status = FileUploadFailed;
 			}
-			emit documentFailed(j->first);
+			emit documentFailed(msgId);
 		}
-		queue.erase(j);
 	}
+}
 
-	requestsSent.clear();
-	docRequestsSent.clear();
-	dcMap.clear();
-	uploadingId = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
-		sentSizes[i] = 0;
+void Uploader::cancelRequests(const FullMsgId &msgId) {
+	for (auto i = _requests.begin(); i != _requests.end();) {
+		if (i->second.msgId == msgId) {
+			MTP::cancel(i->first);
+			requestFinished(i->second);
+			i = _requests.erase(i);
+		} else {
+			++i;
+		}
 	}
-
-	sendNext();
 }
 
 void Uploader::killSessions() {
@@ -190,7 +238,9 @@ void Uploader::killSessions() {
 }
 
 void Uploader::sendNext() {
-	if (sentSize >= kMaxUploadFileParallelSize || _pausedId.msg) return;
+	if (_pausedId.msg) return;
+
+	finishUploaded();
 
 	bool killing = killSessionsTimer.isActive();
 	if (queue.empty()) {
@@ -203,187 +253,347 @@ void Uploader::sendNext() {
 	if (killing) {
 		killSessionsTimer.stop();
 	}
-	auto i = uploadingId.msg ? queue.find(uploadingId) : queue.begin();
-	if (!uploadingId.msg) {
-		uploadingId = i->first;
-	} else if (i == queue.end()) {
-		i = queue.begin();
-		uploadingId = i->first;
+
+	while (!_pausedId.msg) {
+		const auto session = chooseSession();
+		if (session < 0 || !sendPart(session)) {
+			break;
+		}
 	}
-	auto &uploadingData = i->second;
+	nextTimer.start(UploadRequestInterval);
+}
 
-	auto todc = 0;
-	for (auto dc = 1; dc != MTP::kUploadSessionsCount; ++dc) {
-		if (sentSizes[dc] < sentSizes[todc]) {
-			todc = dc;
+void Uploader::finishUploaded() {
+	for (auto i = queue.begin(); i != queue.end();) {
+		if (!i->second.requests && !i->second.hasPartsToSend()) {
+			uploaded.emplace(i->first, std::move(i->second));
+			i = queue.erase(i);
+		} else {
+			++i;
 		}
 	}
 
-	auto &parts = uploadingData.file
-		? (uploadingData.type() == SendMediaType::Photo
-			? uploadingData.file->fileparts
-			: uploadingData.file->thumbparts)
-		: uploadingData.media.parts;
-	const auto partsOfId = uploadingData.file
-		? (uploadingData.type() == SendMediaType::Photo
-			? uploadingData.file->id
-			: uploadingData.file->thumbId)
-		: uploadingData.media.thumbId;
-	if (parts.isEmpty()) {
-		if (uploadingData.docSentParts >= uploadingData.docPartsCount) {
-			if (requestsSent.empty() && docRequestsSent.empty()) {
-				const auto silent = uploadingData.file
-					&& uploadingData.file->to.silent;
-				if (uploadingData.type() == SendMediaType::Photo) {
-					auto photoFilename = uploadingData.filename();
-					if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
-						// Server has some extensions checking for inputMediaUploadedPhoto,
-						// so force the extension to be .jpg anyway. It doesn't matter,
-						// because the filename from inputFile is not used anywhere.
-						photoFilename += qstr(".jpg");
-					}
-					const auto md5 = uploadingData.file
-						? uploadingData.file->filemd5
-						: uploadingData.media.jpeg_md5;
-					const auto file = MTP_inputFile(
-						MTP_long(uploadingData.id()),
-						MTP_int(uploadingData.partsCount),
-						MTP_string(photoFilename),
-						MTP_bytes(md5));
-					emit photoReady(uploadingId, silent, file);
-				} else if (uploadingData.type() == SendMediaType::File
-					|| uploadingData.type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
-
-					const auto file = (uploadingData.docSize > UseBigFilesFrom)
-						? MTP_inputFileBig(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()))
-						: MTP_inputFile(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()),
-							MTP_bytes(docMd5));
-					if (uploadingData.partsCount) {
-						const auto thumbFilename = uploadingData.file
-							? uploadingData.file->thumbname
-							: (qsl("thumb.") + uploadingData.media.thumbExt);
-						const auto thumbMd5 = uploadingData.file
-							? uploadingData.file->thumbmd5
-							: uploadingData.media.jpeg_md5;
-						const auto thumb = MTP_inputFile(
-							MTP_long(uploadingData.thumbId()),
-							MTP_int(uploadingData.partsCount),
-							MTP_string(thumbFilename),
-							MTP_bytes(thumbMd5));
-						emit thumbDocumentReady(
-							uploadingId,
-							silent,
-							file,
-							thumb);
-					} else {
-						emit documentReady(uploadingId, silent, file);
-					}
-				}
-				queue.erase(uploadingId);
-				uploadingId = FullMsgId();
-				sendNext();
-			}
-			return;
+	// The messages are sent in the order the files were queued, so an
+	// uploaded file waits for all the files that were queued before it.
+	while (!uploaded.empty()
+		&& (queue.empty() || uploaded.begin()->first < queue.begin()->first)) {
+		const auto i = uploaded.begin();
+		const auto fullId = i->first;
+		auto file = std::move(i->second);
+		uploaded.erase(i);
+		fileUploaded(fullId, file);
+	}
+}
+
+void Uploader::fileUploaded(const FullMsgId &fullId, File &uploadingData) {
+	const auto silent = uploadingData.file
+		&& uploadingData.file->to.silent;
+	if (uploadingData.type() == SendMediaType::Photo) {
+		auto photoFilename = uploadingData.filename();
+		if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
+			// Server has some extensions checking for inputMediaUploadedPhoto,
+			// so force the extension to be .jpg anyway. It doesn't matter,
+			// because the filename from inputFile is not used anywhere.
+			photoFilename += qstr(".jpg");
+		}
+		const auto md5 = uploadingData.file
+			? uploadingData.file->filemd5
+			: uploadingData.media.jpeg_md5;
+		const auto file = MTP_inputFile(
+			MTP_long(uploadingData.id()),
+			MTP_int(uploadingData.partsCount),
+			MTP_string(photoFilename),
+			MTP_bytes(md5));
+		emit photoReady(fullId, silent, file);
+	} else if (uploadingData.type() == SendMediaType::File
+		|| uploadingData.type() == SendMediaType::Audio) {
+		auto docMd5 = QByteArray(32, Qt::Uninitialized);
+		if (uploadingData.docReader) {
+			docMd5 = uploadingData.docReader->md5Hex();
+		} else {
+			hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
 		}
 
-		auto &content = uploadingData.file
-			? uploadingData.file->content
-			: uploadingData.media.data;
-		QByteArray toSend;
-		if (content.isEmpty()) {
-			if (!uploadingData.docFile) {
-				const auto filepath = uploadingData.file
-					? uploadingData.file->filepath
-					: uploadingData.media.file;
-				uploadingData.docFile = std::make_unique<QFile>(filepath);
-				if (!uploadingData.docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
-				}
-			}
-			toSend = uploadingData.docFile->read(uploadingData.docPartSize);
-			if (uploadingData.docSize <= UseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
-			}
+		const auto file = (uploadingData.docSize > UseBigFilesFrom)
+			? MTP_inputFileBig(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docPartsCount),
+				MTP_string(uploadingData.filename()))
+			: MTP_inputFile(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docPartsCount),
+				MTP_string(uploadingData.filename()),
+				MTP_bytes(docMd5));
+		if (uploadingData.partsCount) {
+			const auto thumbFilename = uploadingData.file
+				? uploadingData.file->thumbname
+				: (qsl("thumb.") + uploadingData.media.thumbExt);
+			const auto thumbMd5 = uploadingData.file
+				? uploadingData.file->thumbmd5
+				: uploadingData.media.jpeg_md5;
+			const auto thumb = MTP_inputFile(
+				MTP_long(uploadingData.thumbId()),
+				MTP_int(uploadingData.partsCount),
+				MTP_string(thumbFilename),
+				MTP_bytes(thumbMd5));
+			emit thumbDocumentReady(
+				fullId,
+				silent,
+				file,
+				thumb);
 		} else {
-			const auto offset = uploadingData.docSentParts
-				* uploadingData.docPartSize;
-			toSend = content.mid(offset, uploadingData.docPartSize);
-			if ((uploadingData.type() == SendMediaType::File
-				|| uploadingData.type() == SendMediaType::Audio)
-				&& uploadingData.docSentParts <= UseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
-			}
+			emit documentReady(fullId, silent, file);
 		}
-		if ((toSend.size() > uploadingData.docPartSize)
-			|| ((toSend.size() < uploadingData.docPartSize
-				&& uploadingData.docSentParts + 1 != uploadingData.docPartsCount))) {
-			currentFailed();
-			return;
+	}
+}
+
+int Uploader::chooseSession() const {
+	auto result = -1;
+	auto resultFree = int64(0);
+	for (auto i = 0; i != MTP::kUploadSessionsCount; ++i) {
+		const auto free = _sessions[i].window - _sessions[i].inFlight;
+		if (free > resultFree) {
+			result = i;
+			resultFree = free;
 		}
-		mtpRequestId requestId;
-		if (uploadingData.docSize > UseBigFilesFrom) {
-			requestId = MTP::send(
-				MTPupload_SaveBigFilePart(
-					MTP_long(uploadingData.id()),
-					MTP_int(uploadingData.docSentParts),
-					MTP_int(uploadingData.docPartsCount),
-					MTP_bytes(toSend)),
-				rpcDone(&Uploader::partLoaded),
-				rpcFail(&Uploader::partFailed),
-				MTP::uploadDcId(todc));
-		} else {
-			requestId = MTP::send(
-				MTPupload_SaveFilePart(
-					MTP_long(uploadingData.id()),
-					MTP_int(uploadingData.docSentParts),
-					MTP_bytes(toSend)),
-				rpcDone(&Uploader::partLoaded),
-				rpcFail(&Uploader::partFailed),
-				MTP::uploadDcId(todc));
+	}
+	return result;
+}
+
+bool Uploader::sendPart(int session) {
+	// The part is sent for the file with the least bytes in flight
+	// among the first files in the queue, so they share the sessions.
+	auto candidates = std::vector<std::pair<int64, FullMsgId>>();
+	for (const auto &[fullId, file] : queue) {
+		if (file.hasPartsToSend()) {
+			candidates.emplace_back(file.inFlight, fullId);
+			if (int(candidates.size()) == kUploadingFilesLimit) {
+				break;
+			}
+		}
+	}
+	std::stable_sort(
+		candidates.begin(),
+		candidates.end(),
+		[](const auto &a, const auto &b) { return a.first < b.first; });
+	for (const auto &[inFlight, fullId] : candidates) {
+		const auto i = queue.find(fullId);
+		Assert(i != queue.end());
+		switch (sendFilePart(fullId, i->second, session)) {
+		case SendPartResult::Sent: return true;
+		case SendPartResult::Failed: fileFailed(fullId); return true;
+		case SendPartResult::NotReady: break;
 		}
-		docRequestsSent.emplace(requestId, uploadingData.docSentParts);
-		dcMap.emplace(requestId, todc);
-		sentSize += uploadingData.docPartSize;
-		sentSizes[todc] += uploadingData.docPartSize;
+	}
+	return false;
+}
 
-		uploadingData.docSentParts++;
-	} else {
+Uploader::SendPartResult Uploader::sendFilePart(
+		const FullMsgId &fullId,
+		File &uploadingData,
+		int session) {
+	auto &parts = uploadingData.parts();
+	if (!parts.isEmpty()) {
 		auto part = parts.begin();
 
 		const auto requestId = MTP::send(
 			MTPupload_SaveFilePart(
-				MTP_long(partsOfId),
+				MTP_long(uploadingData.partsOfId()),
 				MTP_int(part.key()),
 				MTP_bytes(part.value())),
 			rpcDone(&Uploader::partLoaded),
 			rpcFail(&Uploader::partFailed),
-			MTP::uploadDcId(todc));
-		requestsSent.emplace(requestId, part.value());
-		dcMap.emplace(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
+			MTP::uploadDcId(session));
+		requestSent(requestId, fullId, uploadingData, session, part.value().size(), false);
 
 		parts.erase(part);
+		return SendPartResult::Sent;
 	}
-	nextTimer.start(UploadRequestInterval);
+
+	auto &content = uploadingData.file
+		? uploadingData.file->content
+		: uploadingData.media.data;
+	QByteArray toSend;
+	if (content.isEmpty()) {
+		if (!uploadingData.docReader) {
+			const auto filepath = uploadingData.file
+				? uploadingData.file->filepath
+				: uploadingData.media.file;
+			uploadingData.docReader = std::make_unique<UploadPartsReader>(
+				filepath,
+				uploadingData.docPartSize,
+				uploadingData.docPartsCount,
+				(uploadingData.docSize <= UseBigFilesFrom),
+				[=] { sendNext(); });
+		}
+		if (uploadingData.docReader->failed()) {
+			return SendPartResult::Failed;
+		}
+		auto part = uploadingData.docReader->takePart();
+		if (!part) {
+			// sendNext() will be called when the part is read.
+			return SendPartResult::NotReady;
+		}
+		toSend = std::move(*part);
+	} else {
+		const auto offset = uploadingData.docSentParts
+			* uploadingData.docPartSize;
+		toSend = content.mid(offset, uploadingData.docPartSize);
+		if ((uploadingData.type() == SendMediaType::File
+			|| uploadingData.type() == SendMediaType::Audio)
+			&& uploadingData.docSentParts <= UseBigFilesFrom) {
+			uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
+		}
+	}
+	if ((toSend.size() > uploadingData.docPartSize)
+		|| ((toSend.size() < uploadingData.docPartSize
+			&& uploadingData.docSentParts + 1 != uploadingData.docPartsCount))) {
+		return SendPartResult::Failed;
+	}
+	mtpRequestId requestId;
+	if (uploadingData.docSize > UseBigFilesFrom) {
+		requestId = MTP::send(
+			MTPupload_SaveBigFilePart(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docSentParts),
+				MTP_int(uploadingData.docPartsCount),
+				MTP_bytes(toSend)),
+			rpcDone(&Uploader::partLoaded),
+			rpcFail(&Uploader::partFailed),
+			MTP::uploadDcId(session));
+	} else {
+		requestId = MTP::send(
+			MTPupload_SaveFilePart(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docSentParts),
+				MTP_bytes(toSend)),
+			rpcDone(&Uploader::partLoaded),
+			rpcFail(&Uploader::partFailed),
+			MTP::uploadDcId(session));
+	}
+	requestSent(requestId, fullId, uploadingData, session, toSend.size(), true);
+
+	uploadingData.docSentParts++;
+	return SendPartResult::Sent;
+}
+
+void Uploader::requestSent(
+		mtpRequestId requestId,
+		const FullMsgId &fullId,
+		File &file,
+		int session,
+		int size,
+		bool docPart) {
+	const auto now = getms(true);
+	auto &state = _sessions[session];
+	if (!state.inFlight && !state.sampleStart) {
+		state.sampleStart = now;
+	}
+	state.inFlight += size;
+	if (state.inFlight >= state.window) {
+		state.windowLimited = true;
+	}
+	file.started = true;
+	file.inFlight += size;
+	++file.requests;
+	if (docPart) {
+		++file.docRequests;
+	}
+	_requests.emplace(requestId, Request{ fullId, session, size, now, docPart });
+}
+
+void Uploader::requestFinished(const Request &request) {
+	_sessions[request.session].inFlight -= request.size;
+
+	const auto i = queue.find(request.msgId);
+	if (i != queue.end()) {
+		auto &file = i->second;
+		file.inFlight -= request.size;
+		--file.requests;
+		if (request.docPart) {
+			--file.docRequests;
+		}
+	}
+}
+
+void Uploader::partAcknowledged(int index, int size, TimeMs duration) {
+	auto &session = _sessions[index];
+	const auto now = getms(true);
+	const auto sample = std::max(duration, TimeMs(1));
+	session.rtt = session.rtt
+		? ((session.rtt * 7 + sample) / 8)
+		: sample;
+	if (!session.minRtt
+		|| sample < session.minRtt
+		|| now - session.minRttTime > kMinRttResetTimeout) {
+		session.minRtt = sample;
+		session.minRttTime = now;
+	}
+	session.sampleAcknowledged += size;
+	session.uploaded += size;
+	if (!session.sampleStart) {
+		session.sampleStart = now - sample;
+	}
+	if (now - session.sampleStart >= std::max(session.rtt, kMinSampleDuration)) {
+		updateWindow(session, now);
+	}
+}
+
+void Uploader::updateWindow(Session &session, TimeMs now) {
+	const auto duration = now - session.sampleStart;
+	const auto acknowledged = base::take(session.sampleAcknowledged);
+	const auto limited = base::take(session.windowLimited);
+	session.sampleStart = session.inFlight ? now : 0;
+	if (duration <= 0) {
+		return;
+	}
+	session.throughput = acknowledged * 1000 / duration;
+	if (!limited) {
+		// Not enough parts were sent to tell anything about the link.
+		return;
+	}
+
+	// Compare the throughput we would have with an empty link queue
+	// (window / minRtt) to the measured one, the difference multiplied
+	// by minRtt is the amount of bytes waiting in the queues somewhere.
+	const auto expected = float64(session.window) / session.minRtt;
+	const auto actual = float64(acknowledged) / duration;
+	const auto queued = (expected - actual) * session.minRtt;
+	if (queued < kWindowQueuedMin) {
+		const auto add = session.slowStart ? session.window : kWindowStep;
+		session.window = std::min(session.window + add, int64(kMaxSessionWindow));
+	} else if (queued > kWindowQueuedMax) {
+		session.slowStart = false;
+		session.window = std::max(session.window - kWindowStep, int64(kMinSessionWindow));
+	}
+}
+
+Uploader::SessionStats Uploader::sessionStats(int index) const {
+	Expects(index >= 0 && index < MTP::kUploadSessionsCount);
+
+	const auto &session = _sessions[index];
+	auto result = SessionStats();
+	result.inFlight = session.inFlight;
+	result.window = session.window;
+	result.uploaded = session.uploaded;
+	result.throughput = session.throughput;
+	result.rtt = session.rtt;
+	return result;
 }
 
 void Uploader::cancel(const FullMsgId &msgId) {
 	uploaded.erase(msgId);
-	if (uploadingId == msgId) {
-		currentFailed();
+	const auto i = queue.find(msgId);
+	if (i == queue.end()) {
+		return;
+	} else if (i->second.started) {
+		fileFailed(msgId);
 	} else {
-		queue.erase(msgId);
+		queue.erase(i);
 	}
+
+	// The files uploaded after this one may be waiting for it.
+	sendNext();
 }
 
 void Uploader::pause(const FullMsgId &msgId) {
@@ -401,57 +611,43 @@ void Uploader::confirm(const FullMsgId &msgId) {
 void Uploader::clear() {
 	uploaded.clear();
 	queue.clear();
-	for (const auto &requestData : requestsSent) {
+	for (const auto &requestData : _requests) {
 		MTP::cancel(requestData.first);
 	}
-	requestsSent.clear();
-	for (const auto &requestData : docRequestsSent) {
-		MTP::cancel(requestData.first);
+	_requests.clear();
+	for (auto &session : _sessions) {
+		session.inFlight = 0;
+		session.windowLimited = false;
+		session.sampleStart = 0;
+		session.sampleAcknowledged = 0;
 	}
-	docRequestsSent.clear();
-	dcMap.clear();
-	sentSize = 0;
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
-		sentSizes[i] = 0;
 	}
 	killSessionsTimer.stop();
 }
 
 void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
-	auto j = docRequestsSent.end();
-	auto i = requestsSent.find(requestId);
-	if (i == requestsSent.cend()) {
-		j = docRequestsSent.find(requestId);
-	}
-	if (i != requestsSent.cend() || j != docRequestsSent.cend()) {
+	const auto i = _requests.find(requestId);
+	if (i != _requests.end()) {
+		const auto request = i->second;
+		_requests.erase(i);
+		requestFinished(request);
 		if (mtpIsFalse(result)) { // failed to upload current file
-			currentFailed();
+			fileFailed(request.msgId);
+			sendNext();
 			return;
-		} else {
-			auto dcIt = dcMap.find(requestId);
-			if (dcIt == dcMap.cend()) { // must not happen
-				currentFailed();
-				return;
-			}
-			auto dc = dcIt->second;
-			dcMap.erase(dcIt);
+		}
+		partAcknowledged(
+			request.session,
+			request.size,
+			getms(true) - request.sent);
 
-			int32 sentPartSize = 0;
-			auto k = queue.find(uploadingId);
-			Assert(k != queue.cend());
+		const auto k = queue.find(request.msgId);
+		if (k != queue.end()) {
 			auto &[fullId, file] = *k;
-			if (i != requestsSent.cend()) {
-				sentPartSize = i->second.size();
-				requestsSent.erase(i);
-			} else {
-				sentPartSize = file.docPartSize;
-				docRequestsSent.erase(j);
-			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
 			if (file.type() == SendMediaType::Photo) {
-				file.fileSentSize += sentPartSize;
+				file.fileSentSize += request.size;
 				const auto photo = Auth().data().photo(file.id());
 				if (photo->uploading() && file.file) {
 					photo->uploadingData->size = file.file->partssize;
@@ -463,7 +659,7 @@ void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
 				const auto document = Auth().data().document(file.id());
 				if (document->uploading()) {
 					const auto doneParts = file.docSentParts
-						- int(docRequestsSent.size());
+						- file.docRequests;
 					document->uploadingData->offset = std::min(
 						document->uploadingData->size,
 						doneParts * file.docPartSize);
@@ -480,9 +676,12 @@ bool Uploader::partFailed(const RPCError &error, mtpRequestId requestId) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
 	// failed to upload current file
-	if ((requestsSent.find(requestId) != requestsSent.cend())
-		|| (docRequestsSent.find(requestId) != docRequestsSent.cend())) {
-		currentFailed();
+	const auto i = _requests.find(requestId);
+	if (i != _requests.end()) {
+		const auto request = i->second;
+		_requests.erase(i);
+		requestFinished(request);
+		fileFailed(request.msgId);
 	}
 	sendNext();
 	return true;
@@ -25,6 +25,18 @@ public:
 	int32 currentOffset(const FullMsgId &msgId) const; // -1 means file not found
 	int32 fullSize(const FullMsgId &msgId) const;
 
+	// Each upload session keeps an adaptive window of bytes in flight,
+	// it grows while the measured throughput keeps up with the window and
+	// shrinks when the acknowledgement latency grows because of queueing.
+	struct SessionStats {
+		int64 inFlight = 0; // sent and not acknowledged yet
+		int64 window = 0;
+		int64 uploaded = 0; // acknowledged since the start
+		int64 throughput = 0; // bytes per second in the last sample
+		TimeMs rtt = 0; // smoothed acknowledgement latency
+	};
+	SessionStats sessionStats(int index) const;
+
 	void cancel(const FullMsgId &msgId);
 	void pause(const FullMsgId &msgId);
 	void confirm(const FullMsgId &msgId);
@@ -51,22 +63,63 @@ signals:
 
 private:
 	struct File;
+	struct Request {
+		FullMsgId msgId;
+		int session = 0;
+		int size = 0;
+		TimeMs sent = 0;
+		bool docPart = false;
+	};
+	struct Session {
+		int64 inFlight = 0;
+		int64 window = 0;
+		bool windowLimited = false;
+		bool slowStart = true;
+		TimeMs rtt = 0;
+		TimeMs minRtt = 0;
+		TimeMs minRttTime = 0;
+		TimeMs sampleStart = 0;
+		int64 sampleAcknowledged = 0;
+		int64 uploaded = 0;
+		int64 throughput = 0;
+	};
+	enum class SendPartResult {
+		Sent,
+		NotReady,
+		Failed,
+	};
+
+	void finishUploaded();
+	void fileUploaded(const FullMsgId &fullId, File &uploadingData);
+	int chooseSession() const;
+	bool sendPart(int session);
+	SendPartResult sendFilePart(
+		const FullMsgId &fullId,
+		File &uploadingData,
+		int session);
+	void requestSent(
+		mtpRequestId requestId,
+		const FullMsgId &fullId,
+		File &file,
+		int session,
+		int size,
+		bool docPart);
+	void requestFinished(const Request &request);
+	void partAcknowledged(int index, int size, TimeMs duration);
+	void updateWindow(Session &session, TimeMs now);
 
 	void partLoaded(const MTPBool &result, mtpRequestId requestId);
 	bool partFailed(const RPCError &err, mtpRequestId requestId);
 
-	void currentFailed();
+	void fileFailed(const FullMsgId &msgId);
+	void cancelRequests(const FullMsgId &msgId);
 
-	base::flat_map<mtpRequestId, QByteArray> requestsSent;
-	base::flat_map<mtpRequestId, int32> docRequestsSent;
-	base::flat_map<mtpRequestId, int32> dcMap;
-	uint32 sentSize = 0;
-	uint32 sentSizes[MTP::kUploadSessionsCount] = { 0 };
+	base::flat_map<mtpRequestId, Request> _requests;
+	std::array<Session, MTP::kUploadSessionsCount> _sessions;
 
-	FullMsgId uploadingId;
 	FullMsgId _pausedId;
 	std::map<FullMsgId, File> queue;
-	std::map<FullMsgId, File> uploaded;
+	std::map<FullMsgId, File> uploaded; // wait for the ones queued before
 	QTimer nextTimer, killSessionsTimer;
 
 };
@@ -0,0 +1,187 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/file_upload_reader.h"
+
+#include <deque>
+
+namespace Storage {
+namespace {
+
+constexpr auto kReadAheadSize = 4 * 1024 * 1024;
+
+} // namespace
+
+struct UploadPartsReader::State {
+	State(
+		const QString &path,
+		int partSize,
+		int partsCount,
+		bool computeMd5,
+		base::lambda<void()> ready);
+
+	const int partSize = 0;
+	const int partsCount = 0;
+	const int readAheadCount = 0;
+	const bool computeMd5 = false;
+	base::lambda<void()> ready; // used only in the main thread
+
+	QFile file; // used only by the reading task
+	HashMd5 md5;
+
+	QMutex mutex;
+	std::deque<QByteArray> parts; // guarded by mutex
+	int readCount = 0; // guarded by mutex
+	bool reading = false; // guarded by mutex
+	bool failed = false; // guarded by mutex
+	bool cancelled = false; // guarded by mutex
+
+};
+
+UploadPartsReader::State::State(
+	const QString &path,
+	int partSize,
+	int partsCount,
+	bool computeMd5,
+	base::lambda<void()> ready)
+: partSize(partSize)
+, partsCount(partsCount)
+, readAheadCount(std::max(kReadAheadSize / std::max(partSize, 1), 2))
+, computeMd5(computeMd5)
+, ready(std::move(ready))
+, file(path) {
+}
+
+UploadPartsReader::UploadPartsReader(
+	const QString &path,
+	int partSize,
+	int partsCount,
+	bool computeMd5,
+	base::lambda<void()> ready)
+: _state(std::make_shared<State>(
+	path,
+	partSize,
+	partsCount,
+	computeMd5,
+	std::move(ready))) {
+	startReading();
+}
+
+base::optional<QByteArray> UploadPartsReader::takePart() {
+	auto result = base::optional<QByteArray>();
+	{
+		QMutexLocker lock(&_state->mutex);
+		if (!_state->parts.empty()) {
+			result = std::move(_state->parts.front());
+			_state->parts.pop_front();
+		}
+	}
+	startReading();
+	return result;
+}
+
+bool UploadPartsReader::failed() const {
+	QMutexLocker lock(&_state->mutex);
+	return _state->failed;
+}
+
+QByteArray UploadPartsReader::md5Hex() const {
+	auto result = QByteArray(32, Qt::Uninitialized);
+
+	QMutexLocker lock(&_state->mutex);
+	Assert(_state->readCount == _state->partsCount);
+	Assert(_state->parts.empty());
+	hashMd5Hex(_state->md5.result(), result.data());
+	return result;
+}
+
+void UploadPartsReader::startReading() {
+	{
+		QMutexLocker lock(&_state->mutex);
+		if (_state->reading
+			|| _state->failed
+			|| _state->readCount == _state->partsCount
+			|| int(_state->parts.size()) >= _state->readAheadCount) {
+			return;
+		}
+		_state->reading = true;
+	}
+	crl::async([state = _state] {
+		Read(state);
+	});
+}
+
+void UploadPartsReader::Read(const std::shared_ptr<State> &state) {
+	const auto notify = [&] {
+		crl::on_main([weak = std::weak_ptr<State>(state)] {
+			const auto strong = weak.lock();
+			if (!strong) {
+				return;
+			}
+			{
+				QMutexLocker lock(&strong->mutex);
+				if (strong->cancelled) {
+					return;
+				}
+			}
+			strong->ready();
+		});
+	};
+	const auto fail = [&] {
+		{
+			QMutexLocker lock(&state->mutex);
+			state->failed = true;
+			state->reading = false;
+		}
+		notify();
+	};
+	if (!state->file.isOpen() && !state->file.open(QIODevice::ReadOnly)) {
+		fail();
+		return;
+	}
+	while (true) {
+		auto index = 0;
+		{
+			QMutexLocker lock(&state->mutex);
+			if (state->cancelled
+				|| state->readCount == state->partsCount
+				|| int(state->parts.size()) >= state->readAheadCount) {
+				state->reading = false;
+				return;
+			}
+			index = state->readCount;
+		}
+		auto part = state->file.read(state->partSize);
+		const auto last = (index + 1 == state->partsCount);
+		if (part.isEmpty()
+			|| part.size() > state->partSize
+			|| (part.size() < state->partSize && !last)) {
+			fail();
+			return;
+		}
+		if (state->computeMd5) {
+			state->md5.feed(part.constData(), part.size());
+		}
+		auto wasEmpty = false;
+		{
+			QMutexLocker lock(&state->mutex);
+			wasEmpty = state->parts.empty();
+			state->parts.push_back(std::move(part));
+			++state->readCount;
+		}
+		if (wasEmpty) {
+			notify();
+		}
+	}
+}
+
+UploadPartsReader::~UploadPartsReader() {
+	QMutexLocker lock(&_state->mutex);
+	_state->cancelled = true;
+}
+
+} // namespace Storage
@@ -0,0 +1,47 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+namespace Storage {
+
+// Reads the parts of a file for the upload in a background thread,
+// keeping a limited amount of parts read ahead of the taken ones.
+// The md5 hash of the file content is computed while reading as well.
+class UploadPartsReader {
+public:
+	// The ready callback is called in the main thread when a part
+	// becomes available after takePart() returned nothing or when
+	// the reading has failed.
+	UploadPartsReader(
+		const QString &path,
+		int partSize,
+		int partsCount,
+		bool computeMd5,
+		base::lambda<void()> ready);
+	UploadPartsReader(const UploadPartsReader &other) = delete;
+	UploadPartsReader &operator=(const UploadPartsReader &other) = delete;
+	~UploadPartsReader();
+
+	// Returns nothing while the next part is not read yet.
+	base::optional<QByteArray> takePart();
+	bool failed() const;
+
+	// Available after all the parts are taken if computeMd5 was passed.
+	QByteArray md5Hex() const;
+
+private:
+	struct State;
+
+	static void Read(const std::shared_ptr<State> &state);
+	void startReading();
+
+	std::shared_ptr<State> _state;
+
+};
+
+} // namespace Storage
@@ -21,7 +21,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 using Storage::ValidateThumbDimensions;
 
-TaskQueue::TaskQueue(TimeMs stopTimeoutMs) {
+TaskQueue::TaskQueue(TimeMs stopTimeoutMs, int threadsCount)
+: _threadsCount(std::max(threadsCount, 1)) {
 	if (stopTimeoutMs > 0) {
 		_stopTimer = new QTimer(this);
 		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
@@ -30,14 +31,14 @@ TaskQueue::TaskQueue(TimeMs stopTimeoutMs) {
 	}
 }
 
-TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task) {
+TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task, int priority) {
 	const auto result = task->id();
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
-		_tasksToProcess.push_back(std::move(task));
+		enqueue(std::move(task), priority);
 	}
 
-	wakeThread();
+	wakeThreads(1);
 
 	return result;
 }
@@ -46,48 +47,94 @@ void TaskQueue::addTasks(std::vector<std::unique_ptr<Task>> &&tasks) {
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
 		for (auto &task : tasks) {
-			_tasksToProcess.push_back(std::move(task));
+			enqueue(std::move(task), 0);
 		}
 	}
 
-	wakeThread();
+	wakeThreads(int(tasks.size()));
 }
 
-void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
+void TaskQueue::enqueue(std::unique_ptr<Task> &&task, int priority) {
+	// Keep FIFO order between tasks with the same priority.
+	const auto i = ranges::find_if(_tasksToProcess, [&](const QueuedTask &queued) {
+		return (queued.priority < priority);
+	});
+	auto queued = QueuedTask();
+	queued.task = std::move(task);
+	queued.priority = priority;
+	_tasksToProcess.insert(i, std::move(queued));
+}
 
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
+void TaskQueue::setTaskPriority(TaskId id, int priority) {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	const auto i = ranges::find_if(_tasksToProcess, [&](const QueuedTask &queued) {
+		return (queued.task->id() == id);
+	});
+	if (i == _tasksToProcess.end() || i->priority == priority) {
+		return;
+	}
+	auto task = std::move(i->task);
+	_tasksToProcess.erase(i);
+	enqueue(std::move(task), priority);
+}
 
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+void TaskQueue::wakeThreads(int tasksCount) {
+	if (_threads.empty()) {
+		for (auto i = 0; i != _threadsCount; ++i) {
+			const auto thread = new QThread();
+			const auto worker = new TaskQueueWorker(this);
+			worker->moveToThread(thread);
 
-		_thread->start();
+			connect(worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+
+			thread->start();
+			_threads.push_back(thread);
+			_workers.push_back(worker);
+		}
 	}
 	if (_stopTimer) _stopTimer->stop();
-	emit taskAdded();
+
+	// Busy workers take the new tasks when they're done with the current
+	// ones, so only the idle ones are woken and not more than required.
+	auto wake = std::vector<TaskQueueWorker*>();
+	{
+		QMutexLocker lock(&_tasksToProcessMutex);
+		for (const auto worker : _workers) {
+			if (int(wake.size()) == tasksCount) {
+				break;
+			} else if (!worker->_busy) {
+				worker->_busy = true;
+				wake.push_back(worker);
+			}
+		}
+	}
+	for (const auto worker : wake) {
+		QMetaObject::invokeMethod(worker, "onTaskAdded", Qt::QueuedConnection);
+	}
 }
 
 void TaskQueue::cancelTask(TaskId id) {
-	const auto removeFrom = [&](std::deque<std::unique_ptr<Task>> &queue) {
-		const auto proj = [](const std::unique_ptr<Task> &task) {
-			return task->id();
-		};
-		auto i = ranges::find(queue, id, proj);
-		if (i != queue.end()) {
-			queue.erase(i);
-		}
+	const auto proj = [](const std::unique_ptr<Task> &task) {
+		return task->id();
 	};
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
-		removeFrom(_tasksToProcess);
-		if (_taskInProcessId == id) {
-			_taskInProcessId = TaskId();
+		const auto i = ranges::find_if(_tasksToProcess, [&](const QueuedTask &queued) {
+			return (queued.task->id() == id);
+		});
+		if (i != _tasksToProcess.end()) {
+			_tasksToProcess.erase(i);
+		}
+		const auto j = ranges::find(_tasksInProcess, id);
+		if (j != _tasksInProcess.end()) {
+			_tasksInProcess.erase(j);
 		}
 	}
 	QMutexLocker lock(&_tasksToFinishMutex);
-	removeFrom(_tasksToFinish);
+	const auto i = ranges::find(_tasksToFinish, id, proj);
+	if (i != _tasksToFinish.end()) {
+		_tasksToFinish.erase(i);
+	}
 }
 
 void TaskQueue::onTaskProcessed() {
@@ -104,26 +151,32 @@ void TaskQueue::onTaskProcessed() {
 
 	if (_stopTimer) {
 		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.empty() && !_taskInProcessId) {
+		if (_tasksToProcess.empty() && _tasksInProcess.empty()) {
 			_stopTimer->start();
 		}
 	}
 }
 
 void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
+	for (const auto thread : _threads) {
+		thread->requestInterruption();
+		thread->quit();
+	}
+	if (!_threads.empty()) {
 		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete _worker;
-		delete _thread;
-		_worker = 0;
-		_thread = 0;
+	}
+	for (const auto thread : _threads) {
+		thread->wait();
+	}
+	for (const auto worker : base::take(_workers)) {
+		delete worker;
+	}
+	for (const auto thread : base::take(_threads)) {
+		delete thread;
 	}
 	_tasksToProcess.clear();
 	_tasksToFinish.clear();
-	_taskInProcessId = TaskId();
+	_tasksInProcess.clear();
 }
 
 TaskQueue::~TaskQueue() {
@@ -135,38 +188,40 @@ void TaskQueueWorker::onTaskAdded() {
 	if (_inTaskAdded) return;
 	_inTaskAdded = true;
 
-	bool someTasksLeft = false;
-	do {
+	while (!thread()->isInterruptionRequested()) {
 		auto task = std::unique_ptr<Task>();
 		{
 			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.empty()) {
-				task = std::move(_queue->_tasksToProcess.front());
-				_queue->_tasksToProcess.pop_front();
-				_queue->_taskInProcessId = task->id();
+			if (_queue->_tasksToProcess.empty()) {
+				// Cleared under the same lock the queue is checked with,
+				// so a task added right after this will wake us again.
+				_busy = false;
+				break;
 			}
+			task = std::move(_queue->_tasksToProcess.front().task);
+			_queue->_tasksToProcess.pop_front();
+			_queue->_tasksInProcess.push_back(task->id());
 		}
 
-		if (task) {
-			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (_queue->_taskInProcessId == task->id()) {
-					_queue->_taskInProcessId = TaskId();
-					someTasksLeft = !_queue->_tasksToProcess.empty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.empty();
-					_queue->_tasksToFinish.push_back(std::move(task));
-				}
-			}
-			if (emitTaskProcessed) {
-				emit taskProcessed();
+		task->process();
+		bool emitTaskProcessed = false;
+		{
+			QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
+			auto &inProcess = _queue->_tasksInProcess;
+			const auto i = ranges::find(inProcess, task->id());
+			if (i != inProcess.end()) {
+				inProcess.erase(i);
+
+				QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
+				emitTaskProcessed = _queue->_tasksToFinish.empty();
+				_queue->_tasksToFinish.push_back(std::move(task));
 			}
 		}
+		if (emitTaskProcessed) {
+			emit taskProcessed();
+		}
 		QCoreApplication::processEvents();
-	} while (someTasksLeft && !thread()->isInterruptionRequested());
+	}
 
 	_inTaskAdded = false;
 }
@@ -107,17 +107,16 @@ class TaskQueue : public QObject {
 	Q_OBJECT
 
 public:
-	explicit TaskQueue(TimeMs stopTimeoutMs = 0); // <= 0 - never stop worker
+	explicit TaskQueue(TimeMs stopTimeoutMs = 0, int threadsCount = 1); // <= 0 - never stop worker
 
-	TaskId addTask(std::unique_ptr<Task> &&task);
+	// Tasks with greater priority are processed first.
+	TaskId addTask(std::unique_ptr<Task> &&task, int priority = 0);
 	void addTasks(std::vector<std::unique_ptr<Task>> &&tasks);
+	void setTaskPriority(TaskId id, int priority);
 	void cancelTask(TaskId id); // this task finish() won't be called
 
 	~TaskQueue();
 
-signals:
-	void taskAdded();
-
 public slots:
 	void onTaskProcessed();
 	void stop();
@@ -125,14 +124,21 @@ public slots:
 private:
 	friend class TaskQueueWorker;
 
-	void wakeThread();
+	struct QueuedTask {
+		std::unique_ptr<Task> task;
+		int priority = 0;
+	};
 
-	std::deque<std::unique_ptr<Task>> _tasksToProcess;
+	void enqueue(std::unique_ptr<Task> &&task, int priority);
+	void wakeThreads(int tasksCount);
+
+	std::deque<QueuedTask> _tasksToProcess;
 	std::deque<std::unique_ptr<Task>> _tasksToFinish;
-	TaskId _taskInProcessId = TaskId();
+	std::vector<TaskId> _tasksInProcess;
 	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread = nullptr;
-	TaskQueueWorker *_worker = nullptr;
+	int _threadsCount = 1;
+	std::vector<QThread*> _threads;
+	std::vector<TaskQueueWorker*> _workers;
 	QTimer *_stopTimer = nullptr;
 
 };
@@ -151,8 +157,11 @@ public slots:
 	void onTaskAdded();
 
 private:
+	friend class TaskQueue;
+
 	TaskQueue *_queue;
 	bool _inTaskAdded = false;
+	bool _busy = false; // Guarded by _queue->_tasksToProcessMutex.
 
 };
 
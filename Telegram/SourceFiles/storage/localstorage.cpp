@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "storage/serialize_document.h"
 #include "storage/serialize_common.h"
+#include "storage/cache/storage_cache_database.h"
 #include "chat_helpers/stickers.h"
 #include "data/data_drafts.h"
 #include "boxes/send_files_box.h"
@@ -38,8 +39,17 @@ namespace {
 
 constexpr auto kThemeFileSizeLimit = 5 * 1024 * 1024;
 constexpr auto kFileLoaderQueueStopTimeout = TimeMs(5000);
+constexpr auto kFileLoaderQueueMaxThreads = 4;
 constexpr auto kDefaultStickerInstallDate = TimeId(1);
 constexpr auto kProxyTypeShift = 1024;
+constexpr auto kLegacyCacheChunkCount = 256;
+constexpr auto kLegacyCacheChunkSize = 4 * 1024 * 1024;
+constexpr auto kSearchIndexPartsLimit = 16;
+constexpr auto kHistorySlicesLimit = 8;
+
+// Negative, so that the single page records of the older versions that
+// were kept by the same key are not taken for the index records.
+constexpr auto kHistorySlicesIndexVersion = qint32(-1);
 
 using FileKey = quint64;
 
@@ -63,6 +73,13 @@ bool _started = false;
 internal::Manager *_manager = nullptr;
 TaskQueue *_localLoader = nullptr;
 
+int LocalLoaderThreadsCount() {
+	// Leave one core for the main thread, decrypting and decoding
+	// of the cached images is done in parallel on the rest.
+	const auto cores = QThread::idealThreadCount();
+	return snap(cores - 1, 1, kFileLoaderQueueMaxThreads);
+}
+
 bool _working() {
 	return _manager && !_basePath.isEmpty();
 }
@@ -637,10 +654,59 @@ bool _recentHashtagsAndBotsWereRead = false;
 FileKey _savedPeersKey = 0;
 FileKey _langPackKey = 0;
 
+// Legacy per-file cache maps, they're only read and migrated to _cache.
 typedef QMap<StorageKey, FileDesc> StorageMap;
 StorageMap _imagesMap, _stickerImagesMap, _audiosMap;
 qint64 _storageImagesSize = 0, _storageStickersSize = 0, _storageAudiosSize = 0;
 
+enum CacheTag : uint8 {
+	CacheImage = 0x01,
+	CacheStickerImage = 0x02,
+	CacheAudio = 0x03,
+	CacheWebFile = 0x04,
+	CacheHistorySlice = 0x05,
+	CacheSearchIndex = 0x06,
+};
+
+// Set when the database is opened, the loader tasks hold it while they're
+// reading from it on the _localLoader threads.
+std::shared_ptr<Storage::Cache::Database> _cache;
+
+// Changes made while the database is being opened, an empty value removes
+// the key. They're applied when it is opened, then the callbacks are called.
+struct CacheWrite {
+	CacheTag tag = CacheImage;
+	Storage::Cache::Key key;
+	QByteArray value;
+};
+std::shared_ptr<Storage::Cache::Database> _cacheOpening;
+std::vector<CacheWrite> _cacheOpeningWrites;
+std::vector<base::lambda_once<void()>> _cacheOpenedCallbacks;
+
+// Set when the database could not be opened, it is not reopened until the
+// next start() and the uncached paths are used instead.
+bool _cacheOpenFailed = false;
+
+// Ranges of the cached history pages of a peer, oldest written first.
+struct HistorySliceInfo {
+	int slot = 0;
+	MsgRange range;
+	bool bottom = false;
+};
+using HistorySlicesIndex = std::vector<HistorySliceInfo>;
+std::map<PeerId, HistorySlicesIndex> _historySlices;
+
+struct LegacyCacheItem {
+	FileKey file = 0;
+	qint32 size = 0;
+	CacheTag tag = CacheImage;
+	StorageKey location;
+	QString url;
+};
+std::vector<LegacyCacheItem> _legacyCacheItems;
+int _legacyCacheMigrated = 0;
+bool _legacyWebFilesMigrated = false;
+
 bool _mapChanged = false;
 int32 _oldMapVersion = 0, _oldSettingsVersion = 0;
 
@@ -803,6 +869,337 @@ void _readLocations() {
 	}
 }
 
+Storage::Cache::Key _cacheKey(const StorageKey &location) {
+	auto result = Storage::Cache::Key();
+	result.high = location.first;
+	result.low = location.second;
+	return result;
+}
+
+Storage::Cache::Key _cacheKey(const QString &url) {
+	const auto utf8 = url.toUtf8();
+	uint64 hash[2] = { 0 };
+	hashMd5(utf8.constData(), utf8.size(), hash);
+
+	auto result = Storage::Cache::Key();
+	result.high = hash[0];
+	result.low = hash[1];
+	return result;
+}
+
+void _scheduleLegacyCacheChunk(std::vector<FileKey> &&clear);
+
+// The database waits for its background queue when it is destroyed and
+// it owns a main thread timer, so the last reference is released there.
+void _destroyCacheDatabase(Storage::Cache::Database *cache) {
+	if (QThread::currentThread() == qApp->thread()) {
+		delete cache;
+	} else {
+		crl::on_main([=] { delete cache; });
+	}
+}
+
+void _cacheDatabaseOpened(
+		const std::shared_ptr<Storage::Cache::Database> &cache,
+		bool opened) {
+	if (_cacheOpening != cache) {
+		return;
+	}
+	_cacheOpening = nullptr;
+	auto writes = base::take(_cacheOpeningWrites);
+	if (opened) {
+		_cache = cache;
+		for (auto &write : writes) {
+			if (write.value.isEmpty()) {
+				_cache->remove(write.tag, write.key);
+			} else {
+				_cache->put(write.tag, write.key, std::move(write.value));
+			}
+		}
+		_scheduleLegacyCacheChunk({});
+	} else {
+		_cacheOpenFailed = true;
+		LOG(("App Error: could not open cache database."));
+	}
+	for (auto &callback : base::take(_cacheOpenedCallbacks)) {
+		callback();
+	}
+}
+
+// The binlog is replayed on a background thread, until it is done the
+// cache is empty for the readers.
+void _openCacheDatabase() {
+	if (_cache || _cacheOpening || _cacheOpenFailed || !_userWorking()) {
+		return;
+	}
+	const auto cache = std::shared_ptr<Storage::Cache::Database>(
+		new Storage::Cache::Database(_userBasePath + qsl("cache/")),
+		_destroyCacheDatabase);
+	_cacheOpening = cache;
+	crl::async([=] {
+		const auto opened = cache->open();
+		crl::on_main([=] {
+			_cacheDatabaseOpened(cache, opened);
+		});
+	});
+}
+
+Storage::Cache::Database *_cacheDatabase() {
+	if (!_cache) {
+		_openCacheDatabase();
+	}
+	return _cache.get();
+}
+
+// The files are recreated on a background thread, the readers already
+// holding the database see it empty after that.
+void _clearCacheDatabase() {
+	_cacheOpeningWrites.clear();
+	_historySlices.clear();
+	if (const auto cache = _cache ? _cache : _cacheOpening) {
+		crl::async([=] {
+			cache->clear();
+		});
+	}
+}
+
+bool _cacheContains(CacheTag tag, const Storage::Cache::Key &key) {
+	const auto cache = _cacheDatabase();
+	return cache && cache->contains(tag, key);
+}
+
+void _writeEncryptedCache(CacheTag tag, const Storage::Cache::Key &key, EncryptedDescriptor &data) {
+	if (const auto cache = _cacheDatabase()) {
+		cache->put(tag, key, FileWriteDescriptor::prepareEncrypted(data));
+	} else if (_cacheOpening) {
+		_cacheOpeningWrites.push_back({
+			tag,
+			key,
+			FileWriteDescriptor::prepareEncrypted(data) });
+	}
+}
+
+// May be called from the _localLoader thread with the database it holds.
+bool _readEncryptedCache(Storage::Cache::Database *cache, FileReadDescriptor &result, CacheTag tag, const Storage::Cache::Key &key) {
+	const auto encrypted = cache ? cache->get(tag, key) : QByteArray();
+	if (encrypted.isEmpty()) {
+		return false;
+	}
+	EncryptedDescriptor data;
+	if (!decryptLocal(data, encrypted)) {
+		return false;
+	}
+	result.version = AppVersion;
+	result.data = data.data;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(data.buffer.pos());
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+	return true;
+}
+
+void _clearInCache(CacheTag tag, const Storage::Cache::Key &key) {
+	if (_cache) {
+		_cache->remove(tag, key);
+	} else if (_cacheOpening) {
+		_cacheOpeningWrites.push_back({ tag, key, QByteArray() });
+	}
+}
+
+bool _legacyCacheItemActual(const LegacyCacheItem &item) {
+	const auto check = [&](const StorageMap &map) {
+		const auto i = map.constFind(item.location);
+		return (i != map.cend()) && (i.value().first == item.file);
+	};
+	switch (item.tag) {
+	case CacheImage: return check(_imagesMap);
+	case CacheStickerImage: return check(_stickerImagesMap);
+	case CacheAudio: return check(_audiosMap);
+	case CacheWebFile: {
+		const auto i = _webFilesMap.constFind(item.url);
+		return (i != _webFilesMap.cend()) && (i.value().first == item.file);
+	}
+	}
+	return false;
+}
+
+void _removeLegacyCacheItem(const LegacyCacheItem &item) {
+	const auto remove = [&](StorageMap &map, qint64 &size) {
+		const auto i = map.find(item.location);
+		size -= i.value().second;
+		map.erase(i);
+		_mapChanged = true;
+	};
+	switch (item.tag) {
+	case CacheImage: remove(_imagesMap, _storageImagesSize); break;
+	case CacheStickerImage: remove(_stickerImagesMap, _storageStickersSize); break;
+	case CacheAudio: remove(_audiosMap, _storageAudiosSize); break;
+	case CacheWebFile: {
+		const auto i = _webFilesMap.find(item.url);
+		_storageWebFilesSize -= i.value().second;
+		_webFilesMap.erase(i);
+	} break;
+	}
+}
+
+Storage::Cache::Key _cacheKey(const LegacyCacheItem &item) {
+	return (item.tag == CacheWebFile)
+		? _cacheKey(item.url)
+		: _cacheKey(item.location);
+}
+
+class MigrateLegacyCacheTask : public Task {
+public:
+	MigrateLegacyCacheTask(
+		std::vector<LegacyCacheItem> &&items,
+		std::vector<FileKey> &&clear)
+	: _items(std::move(items))
+	, _clear(std::move(clear)) {
+	}
+
+	void process() override {
+		for (const auto key : _clear) {
+			clearKey(key, FileOption::User);
+		}
+
+		// The stored encrypted part is moved to the cache as it is.
+		_blobs.reserve(_items.size());
+		auto previous = FileKey(0);
+		for (const auto &item : _items) {
+			if (item.file == previous) {
+				_blobs.push_back(_blobs.back());
+				continue;
+			}
+			previous = item.file;
+
+			auto encrypted = QByteArray();
+			FileReadDescriptor file;
+			if (readFile(file, toFilePart(item.file), FileOption::User)) {
+				file.stream >> encrypted;
+				if (!_checkStreamStatus(file.stream)) {
+					encrypted = QByteArray();
+				}
+			}
+			_blobs.push_back(encrypted);
+		}
+	}
+
+	void finish() override {
+		if (_items.empty()) {
+			return;
+		}
+		const auto cache = _cacheDatabase();
+		auto cleared = std::vector<FileKey>();
+		for (auto i = 0, count = int(_items.size()); i != count; ++i) {
+			const auto &item = _items[i];
+			if (!_legacyCacheItemActual(item)) {
+				continue;
+			}
+			const auto key = _cacheKey(item);
+			if (cache && !_blobs[i].isEmpty() && !cache->contains(item.tag, key)) {
+				cache->put(item.tag, key, _blobs[i]);
+			}
+			_removeLegacyCacheItem(item);
+			if (item.tag == CacheWebFile) {
+				_legacyWebFilesMigrated = true;
+			}
+			if (cleared.empty() || cleared.back() != item.file) {
+				cleared.push_back(item.file);
+			}
+		}
+		_scheduleLegacyCacheChunk(std::move(cleared));
+
+		// Write the maps once, before the files of the last chunk are
+		// cleared. The files of the previous chunks are still listed in
+		// the written map, but they're skipped if they can't be read.
+		if (_legacyCacheItems.empty()) {
+			if (_mapChanged) {
+				_writeMap();
+			}
+			if (base::take(_legacyWebFilesMigrated)) {
+				_writeLocations();
+			}
+		}
+	}
+
+private:
+	std::vector<LegacyCacheItem> _items;
+	std::vector<FileKey> _clear;
+	std::vector<QByteArray> _blobs;
+
+};
+
+void _scheduleLegacyCacheChunk(std::vector<FileKey> &&clear) {
+	if (!_localLoader || !_cache) {
+		// Continued when the database is opened.
+		return;
+	}
+	auto items = std::vector<LegacyCacheItem>();
+	auto size = qint64(0);
+	const auto count = int(_legacyCacheItems.size());
+	while (_legacyCacheMigrated < count) {
+		const auto &item = _legacyCacheItems[_legacyCacheMigrated];
+		const auto boundary = items.empty()
+			|| (items.back().file != item.file);
+		if (boundary
+			&& (int(items.size()) >= kLegacyCacheChunkCount
+				|| size >= kLegacyCacheChunkSize)) {
+			break;
+		}
+		items.push_back(item);
+		size += item.size;
+		++_legacyCacheMigrated;
+	}
+	if (_legacyCacheMigrated >= count) {
+		_legacyCacheItems.clear();
+		_legacyCacheMigrated = 0;
+	}
+	if (items.empty() && clear.empty()) {
+		return;
+	}
+	_localLoader->addTask(std::make_unique<MigrateLegacyCacheTask>(
+		std::move(items),
+		std::move(clear)));
+}
+
+void _startLegacyCacheMigration() {
+	_legacyCacheItems.clear();
+	_legacyCacheMigrated = 0;
+
+	const auto add = [](CacheTag tag, const StorageMap &map) {
+		for (auto i = map.cbegin(), e = map.cend(); i != e; ++i) {
+			auto item = LegacyCacheItem();
+			item.file = i.value().first;
+			item.size = i.value().second;
+			item.tag = tag;
+			item.location = i.key();
+			_legacyCacheItems.push_back(std::move(item));
+		}
+	};
+	add(CacheImage, _imagesMap);
+	add(CacheStickerImage, _stickerImagesMap);
+	add(CacheAudio, _audiosMap);
+	for (auto i = _webFilesMap.cbegin(), e = _webFilesMap.cend(); i != e; ++i) {
+		auto item = LegacyCacheItem();
+		item.file = i.value().first;
+		item.size = i.value().second;
+		item.tag = CacheWebFile;
+		item.url = i.key();
+		_legacyCacheItems.push_back(std::move(item));
+	}
+	if (_legacyCacheItems.empty()) {
+		return;
+	}
+	LOG(("App Info: migrating %1 legacy cache files.").arg(_legacyCacheItems.size()));
+
+	// Group items sharing a file, so that the file is read only once.
+	ranges::stable_sort(_legacyCacheItems, [](const LegacyCacheItem &a, const LegacyCacheItem &b) {
+		return a.file < b.file;
+	});
+	_scheduleLegacyCacheChunk({});
+}
+
 void _writeReportSpamStatuses() {
 	if (!_working()) return;
 
@@ -2247,6 +2644,8 @@ ReadMapState _readMap(const QByteArray &pass) {
 	if (_reportSpamStatusesKey) {
 		_readReportSpamStatuses();
 	}
+	_openCacheDatabase();
+	_startLegacyCacheMigration();
 
 	_readUserSettings();
 	_readMtpData();
@@ -2406,6 +2805,12 @@ void finish() {
 		_manager->deleteLater();
 		_manager = 0;
 		delete base::take(_localLoader);
+		_cacheOpening = nullptr;
+		_cacheOpeningWrites.clear();
+		_cacheOpenedCallbacks.clear();
+		_cache = nullptr;
+		_cacheOpenFailed = false;
+		_historySlices.clear();
 	}
 }
 
@@ -2416,7 +2821,9 @@ void start() {
 	Expects(!_manager);
 
 	_manager = new internal::Manager();
-	_localLoader = new TaskQueue(kFileLoaderQueueStopTimeout);
+	_localLoader = new TaskQueue(
+		kFileLoaderQueueStopTimeout,
+		LocalLoaderThreadsCount());
 
 	_basePath = cWorkingDir() + qsl("tdata/");
 	if (!QDir().exists(_basePath)) QDir().mkpath(_basePath);
@@ -2641,6 +3048,9 @@ void reset() {
 	_storageImagesSize = _storageStickersSize = _storageAudiosSize = 0;
 	_webFilesMap.clear();
 	_storageWebFilesSize = 0;
+	_legacyCacheItems.clear();
+	_legacyCacheMigrated = 0;
+	_clearCacheDatabase();
 	_locationsKey = _reportSpamStatusesKey = _trustedBotsKey = 0;
 	_recentStickersKeyOld = 0;
 	_installedStickersKey = _featuredStickersKey = _recentStickersKey = _favedStickersKey = _archivedStickersKey = 0;
@@ -2922,33 +3332,9 @@ FileLocation readFileLocation(MediaKey location, bool check) {
 	return FileLocation();
 }
 
-qint32 _storageImageSize(qint32 rawlen) {
-	// fulllen + storagekey + type + len + data
-	qint32 result = sizeof(uint32) + sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + rawlen;
-	if (result & 0x0F) result += 0x10 - (result & 0x0F);
-	result += tdfMagicLen + sizeof(qint32) + sizeof(quint32) + 0x10 + 0x10; // magic + version + len of encrypted + part of sha1 + md5
-	return result;
-}
-
-qint32 _storageStickerSize(qint32 rawlen) {
-	// fulllen + storagekey + len + data
-	qint32 result = sizeof(uint32) + sizeof(quint64) * 2 + sizeof(quint32) + rawlen;
-	if (result & 0x0F) result += 0x10 - (result & 0x0F);
-	result += tdfMagicLen + sizeof(qint32) + sizeof(quint32) + 0x10 + 0x10; // magic + version + len of encrypted + part of sha1 + md5
-	return result;
-}
-
-qint32 _storageAudioSize(qint32 rawlen) {
-	// fulllen + storagekey + len + data
-	qint32 result = sizeof(uint32) + sizeof(quint64) * 2 + sizeof(quint32) + rawlen;
-	if (result & 0x0F) result += 0x10 - (result & 0x0F);
-	result += tdfMagicLen + sizeof(qint32) + sizeof(quint32) + 0x10 + 0x10; // magic + version + len of encrypted + part of sha1 + md5
-	return result;
-}
-
 void writeImage(const StorageKey &location, const ImagePtr &image) {
 	if (image->isNull() || !image->loaded()) return;
-	if (_imagesMap.constFind(location) != _imagesMap.cend()) return;
+	if (willImageLoad(location)) return;
 
 	image->forget();
 	writeImage(location, StorageImageSaved(image->savedData()), false);
@@ -2956,47 +3342,32 @@ void writeImage(const StorageKey &location, const ImagePtr &image) {
 
 void writeImage(const StorageKey &location, const StorageImageSaved &image, bool overwrite) {
 	if (!_working()) return;
-
-	qint32 size = _storageImageSize(image.data.size());
-	StorageMap::const_iterator i = _imagesMap.constFind(location);
-	if (i == _imagesMap.cend()) {
-		i = _imagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
-		_storageImagesSize += size;
-		_mapChanged = true;
-		_writeMap();
-	} else if (!overwrite) {
-		return;
-	}
+	if (!overwrite && willImageLoad(location)) return;
 
 	auto legacyTypeField = 0;
 
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + image.data.size());
 	data.stream << quint64(location.first) << quint64(location.second) << quint32(legacyTypeField) << image.data;
-
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
-	if (i.value().second != size) {
-		_storageImagesSize += size;
-		_storageImagesSize -= i.value().second;
-		_imagesMap[location].second = size;
-	}
+	_writeEncryptedCache(CacheImage, _cacheKey(location), data);
 }
 
 class AbstractCachedLoadTask : public Task {
 public:
 
-	AbstractCachedLoadTask(const FileKey &key, const StorageKey &location, bool readImageFlag, mtpFileLoader *loader) :
-		_key(key), _location(location), _readImageFlag(readImageFlag), _loader(loader), _result(0) {
+	AbstractCachedLoadTask(const FileKey &key, CacheTag tag, const StorageKey &location, bool readImageFlag, mtpFileLoader *loader) :
+		_key(key), _database(key ? nullptr : _cache), _tag(tag), _location(location), _readImageFlag(readImageFlag), _loader(loader), _result(0) {
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		const auto read = _key
+			? readEncryptedFile(image, _key, FileOption::User)
+			: _readEncryptedCache(_database.get(), image, _tag, _cacheKey(_location));
+		if (!read) {
 			return;
 		}
 
 		QByteArray imageData;
 		quint64 locFirst, locSecond;
-		quint32 legacyTypeField = 0;
 		readFromStream(image.stream, locFirst, locSecond, imageData);
 
 		// we're saving files now before we have actual location
@@ -3010,7 +3381,11 @@ public:
 		if (_result) {
 			_loader->localLoaded(_result->image, _result->format, _result->pixmap);
 		} else {
-			clearInMap();
+			if (_key) {
+				clearInMap();
+			} else {
+				_clearInCache(_tag, _cacheKey(_location));
+			}
 			_loader->localLoaded(StorageImageSaved());
 		}
 	}
@@ -3021,7 +3396,9 @@ public:
 	}
 
 protected:
-	FileKey _key;
+	FileKey _key; // legacy file, if not set the data is in _cache
+	std::shared_ptr<Storage::Cache::Database> _database;
+	CacheTag _tag;
 	StorageKey _location;
 	bool _readImageFlag;
 	struct Result {
@@ -3047,7 +3424,7 @@ protected:
 class ImageLoadTask : public AbstractCachedLoadTask {
 public:
 	ImageLoadTask(const FileKey &key, const StorageKey &location, mtpFileLoader *loader) :
-	AbstractCachedLoadTask(key, location, true, loader) {
+	AbstractCachedLoadTask(key, CacheImage, location, true, loader) {
 	}
 	void readFromStream(QDataStream &stream, quint64 &first, quint64 &second, QByteArray &data) override {
 		qint32 legacyTypeField = 0;
@@ -3064,8 +3441,14 @@ public:
 };
 
 TaskId startImageLoad(const StorageKey &location, mtpFileLoader *loader) {
+	if (!_localLoader) {
+		return 0;
+	} else if (_cacheContains(CacheImage, _cacheKey(location))) {
+		return _localLoader->addTask(
+			std::make_unique<ImageLoadTask>(0, location, loader));
+	}
 	StorageMap::const_iterator j = _imagesMap.constFind(location);
-	if (j == _imagesMap.cend() || !_localLoader) {
+	if (j == _imagesMap.cend()) {
 		return 0;
 	}
 	return _localLoader->addTask(
@@ -3073,45 +3456,33 @@ TaskId startImageLoad(const StorageKey &location, mtpFileLoader *loader) {
 }
 
 bool willImageLoad(const StorageKey &location) {
-	return _imagesMap.constFind(location) != _imagesMap.cend();
+	return _cacheContains(CacheImage, _cacheKey(location))
+		|| (_imagesMap.constFind(location) != _imagesMap.cend());
 }
 
 int32 hasImages() {
-	return _imagesMap.size();
+	const auto cache = _cacheDatabase();
+	return _imagesMap.size() + (cache ? cache->stats(CacheImage).count : 0);
 }
 
 qint64 storageImagesSize() {
-	return _storageImagesSize;
+	const auto cache = _cacheDatabase();
+	return _storageImagesSize + (cache ? cache->stats(CacheImage).size : 0);
 }
 
 void writeStickerImage(const StorageKey &location, const QByteArray &sticker, bool overwrite) {
 	if (!_working()) return;
+	if (!overwrite && willStickerImageLoad(location)) return;
 
-	qint32 size = _storageStickerSize(sticker.size());
-	StorageMap::const_iterator i = _stickerImagesMap.constFind(location);
-	if (i == _stickerImagesMap.cend()) {
-		i = _stickerImagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
-		_storageStickersSize += size;
-		_mapChanged = true;
-		_writeMap();
-	} else if (!overwrite) {
-		return;
-	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + sticker.size());
 	data.stream << quint64(location.first) << quint64(location.second) << sticker;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
-	if (i.value().second != size) {
-		_storageStickersSize += size;
-		_storageStickersSize -= i.value().second;
-		_stickerImagesMap[location].second = size;
-	}
+	_writeEncryptedCache(CacheStickerImage, _cacheKey(location), data);
 }
 
 class StickerImageLoadTask : public AbstractCachedLoadTask {
 public:
 	StickerImageLoadTask(const FileKey &key, const StorageKey &location, mtpFileLoader *loader) :
-	AbstractCachedLoadTask(key, location, true, loader) {
+	AbstractCachedLoadTask(key, CacheStickerImage, location, true, loader) {
 	}
 	void readFromStream(QDataStream &stream, quint64 &first, quint64 &second, QByteArray &data) {
 		stream >> first >> second >> data;
@@ -3127,8 +3498,14 @@ public:
 };
 
 TaskId startStickerImageLoad(const StorageKey &location, mtpFileLoader *loader) {
+	if (!_localLoader) {
+		return 0;
+	} else if (_cacheContains(CacheStickerImage, _cacheKey(location))) {
+		return _localLoader->addTask(
+			std::make_unique<StickerImageLoadTask>(0, location, loader));
+	}
 	auto j = _stickerImagesMap.constFind(location);
-	if (j == _stickerImagesMap.cend() || !_localLoader) {
+	if (j == _stickerImagesMap.cend()) {
 		return 0;
 	}
 	return _localLoader->addTask(
@@ -3136,10 +3513,15 @@ TaskId startStickerImageLoad(const StorageKey &location, mtpFileLoader *loader)
 }
 
 bool willStickerImageLoad(const StorageKey &location) {
-	return _stickerImagesMap.constFind(location) != _stickerImagesMap.cend();
+	return _cacheContains(CacheStickerImage, _cacheKey(location))
+		|| (_stickerImagesMap.constFind(location) != _stickerImagesMap.cend());
 }
 
 bool copyStickerImage(const StorageKey &oldLocation, const StorageKey &newLocation) {
+	const auto cache = _cacheDatabase();
+	if (cache && cache->copy(CacheStickerImage, _cacheKey(oldLocation), _cacheKey(newLocation))) {
+		return true;
+	}
 	auto i = _stickerImagesMap.constFind(oldLocation);
 	if (i == _stickerImagesMap.cend()) {
 		return false;
@@ -3151,41 +3533,28 @@ bool copyStickerImage(const StorageKey &oldLocation, const StorageKey &newLocati
 }
 
 int32 hasStickers() {
-	return _stickerImagesMap.size();
+	const auto cache = _cacheDatabase();
+	return _stickerImagesMap.size() + (cache ? cache->stats(CacheStickerImage).count : 0);
 }
 
 qint64 storageStickersSize() {
-	return _storageStickersSize;
+	const auto cache = _cacheDatabase();
+	return _storageStickersSize + (cache ? cache->stats(CacheStickerImage).size : 0);
 }
 
 void writeAudio(const StorageKey &location, const QByteArray &audio, bool overwrite) {
 	if (!_working()) return;
+	if (!overwrite && willAudioLoad(location)) return;
 
-	qint32 size = _storageAudioSize(audio.size());
-	StorageMap::const_iterator i = _audiosMap.constFind(location);
-	if (i == _audiosMap.cend()) {
-		i = _audiosMap.insert(location, FileDesc(genKey(FileOption::User), size));
-		_storageAudiosSize += size;
-		_mapChanged = true;
-		_writeMap();
-	} else if (!overwrite) {
-		return;
-	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + audio.size());
 	data.stream << quint64(location.first) << quint64(location.second) << audio;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
-	if (i.value().second != size) {
-		_storageAudiosSize += size;
-		_storageAudiosSize -= i.value().second;
-		_audiosMap[location].second = size;
-	}
+	_writeEncryptedCache(CacheAudio, _cacheKey(location), data);
 }
 
 class AudioLoadTask : public AbstractCachedLoadTask {
 public:
 	AudioLoadTask(const FileKey &key, const StorageKey &location, mtpFileLoader *loader) :
-	AbstractCachedLoadTask(key, location, false, loader) {
+	AbstractCachedLoadTask(key, CacheAudio, location, false, loader) {
 	}
 	void readFromStream(QDataStream &stream, quint64 &first, quint64 &second, QByteArray &data) {
 		stream >> first >> second >> data;
@@ -3201,8 +3570,14 @@ public:
 };
 
 TaskId startAudioLoad(const StorageKey &location, mtpFileLoader *loader) {
+	if (!_localLoader) {
+		return 0;
+	} else if (_cacheContains(CacheAudio, _cacheKey(location))) {
+		return _localLoader->addTask(
+			std::make_unique<AudioLoadTask>(0, location, loader));
+	}
 	auto j = _audiosMap.constFind(location);
-	if (j == _audiosMap.cend() || !_localLoader) {
+	if (j == _audiosMap.cend()) {
 		return 0;
 	}
 	return _localLoader->addTask(
@@ -3210,6 +3585,10 @@ TaskId startAudioLoad(const StorageKey &location, mtpFileLoader *loader) {
 }
 
 bool copyAudio(const StorageKey &oldLocation, const StorageKey &newLocation) {
+	const auto cache = _cacheDatabase();
+	if (cache && cache->copy(CacheAudio, _cacheKey(oldLocation), _cacheKey(newLocation))) {
+		return true;
+	}
 	auto i = _audiosMap.constFind(oldLocation);
 	if (i == _audiosMap.cend()) {
 		return false;
@@ -3221,65 +3600,53 @@ bool copyAudio(const StorageKey &oldLocation, const StorageKey &newLocation) {
 }
 
 bool willAudioLoad(const StorageKey &location) {
-	return _audiosMap.constFind(location) != _audiosMap.cend();
+	return _cacheContains(CacheAudio, _cacheKey(location))
+		|| (_audiosMap.constFind(location) != _audiosMap.cend());
 }
 
 int32 hasAudios() {
-	return _audiosMap.size();
+	const auto cache = _cacheDatabase();
+	return _audiosMap.size() + (cache ? cache->stats(CacheAudio).count : 0);
 }
 
 qint64 storageAudiosSize() {
-	return _storageAudiosSize;
-}
-
-qint32 _storageWebFileSize(const QString &url, qint32 rawlen) {
-	// fulllen + url + len + data
-	qint32 result = sizeof(uint32) + Serialize::stringSize(url) + sizeof(quint32) + rawlen;
-	if (result & 0x0F) result += 0x10 - (result & 0x0F);
-	result += tdfMagicLen + sizeof(qint32) + sizeof(quint32) + 0x10 + 0x10; // magic + version + len of encrypted + part of sha1 + md5
-	return result;
+	const auto cache = _cacheDatabase();
+	return _storageAudiosSize + (cache ? cache->stats(CacheAudio).size : 0);
 }
 
 void writeWebFile(const QString &url, const QByteArray &content, bool overwrite) {
 	if (!_working()) return;
+	if (!overwrite && willWebFileLoad(url)) return;
 
-	qint32 size = _storageWebFileSize(url, content.size());
-	WebFilesMap::const_iterator i = _webFilesMap.constFind(url);
-	if (i == _webFilesMap.cend()) {
-		i = _webFilesMap.insert(url, FileDesc(genKey(FileOption::User), size));
-		_storageWebFilesSize += size;
-		_writeLocations();
-	} else if (!overwrite) {
-		return;
-	}
 	EncryptedDescriptor data(Serialize::stringSize(url) + sizeof(quint32) + sizeof(quint32) + content.size());
 	data.stream << url << content;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
-	if (i.value().second != size) {
-		_storageWebFilesSize += size;
-		_storageWebFilesSize -= i.value().second;
-		_webFilesMap[url].second = size;
-	}
+	_writeEncryptedCache(CacheWebFile, _cacheKey(url), data);
 }
 
 class WebFileLoadTask : public Task {
 public:
 	WebFileLoadTask(const FileKey &key, const QString &url, webFileLoader *loader)
 		: _key(key)
+		, _database(key ? nullptr : _cache)
 		, _url(url)
 		, _loader(loader)
 		, _result(0) {
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		const auto read = _key
+			? readEncryptedFile(image, _key, FileOption::User)
+			: _readEncryptedCache(_database.get(), image, CacheWebFile, _cacheKey(_url));
+		if (!read) {
 			return;
 		}
 
 		QByteArray imageData;
 		QString url;
 		image.stream >> url >> imageData;
+		if (url != _url) {
+			return;
+		}
 
 		_result = new Result(imageData);
 	}
@@ -3287,11 +3654,15 @@ public:
 		if (_result) {
 			_loader->localLoaded(_result->image, _result->format, _result->pixmap);
 		} else {
-			WebFilesMap::iterator j = _webFilesMap.find(_url);
-			if (j != _webFilesMap.cend() && j->first == _key) {
-				clearKey(j.value().first, FileOption::User);
-				_storageWebFilesSize -= j.value().second;
-				_webFilesMap.erase(j);
+			if (!_key) {
+				_clearInCache(CacheWebFile, _cacheKey(_url));
+			} else {
+				WebFilesMap::iterator j = _webFilesMap.find(_url);
+				if (j != _webFilesMap.cend() && j->first == _key) {
+					clearKey(j.value().first, FileOption::User);
+					_storageWebFilesSize -= j.value().second;
+					_webFilesMap.erase(j);
+				}
 			}
 			_loader->localLoaded(StorageImageSaved());
 		}
@@ -3301,7 +3672,8 @@ public:
 	}
 
 protected:
-	FileKey _key;
+	FileKey _key; // legacy file, if not set the data is in _cache
+	std::shared_ptr<Storage::Cache::Database> _database;
 	QString _url;
 	struct Result {
 		explicit Result(const QByteArray &data) : image(data) {
@@ -3322,8 +3694,14 @@ protected:
 };
 
 TaskId startWebFileLoad(const QString &url, webFileLoader *loader) {
+	if (!_localLoader) {
+		return 0;
+	} else if (_cacheContains(CacheWebFile, _cacheKey(url))) {
+		return _localLoader->addTask(
+			std::make_unique<WebFileLoadTask>(0, url, loader));
+	}
 	WebFilesMap::const_iterator j = _webFilesMap.constFind(url);
-	if (j == _webFilesMap.cend() || !_localLoader) {
+	if (j == _webFilesMap.cend()) {
 		return 0;
 	}
 	return _localLoader->addTask(
@@ -3331,15 +3709,18 @@ TaskId startWebFileLoad(const QString &url, webFileLoader *loader) {
 }
 
 bool willWebFileLoad(const QString &url) {
-	return _webFilesMap.constFind(url) != _webFilesMap.cend();
+	return _cacheContains(CacheWebFile, _cacheKey(url))
+		|| (_webFilesMap.constFind(url) != _webFilesMap.cend());
 }
 
 int32 hasWebFiles() {
-	return _webFilesMap.size();
+	const auto cache = _cacheDatabase();
+	return _webFilesMap.size() + (cache ? cache->stats(CacheWebFile).count : 0);
 }
 
 qint64 storageWebFilesSize() {
-	return _storageWebFilesSize;
+	const auto cache = _cacheDatabase();
+	return _storageWebFilesSize + (cache ? cache->stats(CacheWebFile).size : 0);
 }
 
 class CountWaveformTask : public Task {
@@ -3414,6 +3795,12 @@ void cancelTask(TaskId id) {
 	}
 }
 
+void prioritizeTask(TaskId id, int priority) {
+	if (_localLoader) {
+		_localLoader->setTaskPriority(id, priority);
+	}
+}
+
 void _writeStickerSet(QDataStream &stream, const Stickers::Set &set) {
 	bool notLoaded = (set.flags & MTPDstickerSet_ClientFlag::f_not_loaded);
 	if (notLoaded) {
@@ -4722,6 +5109,423 @@ void writeReportSpamStatuses() {
 	_writeReportSpamStatuses();
 }
 
+Storage::Cache::Key _historySlicesIndexKey(PeerId peerId) {
+	auto result = Storage::Cache::Key();
+	result.high = quint64(peerId);
+	return result;
+}
+
+Storage::Cache::Key _historySliceKey(PeerId peerId, int slot) {
+	auto result = _historySlicesIndexKey(peerId);
+	result.low = quint64(slot + 1);
+	return result;
+}
+
+HistorySlicesIndex &_historySlicesIndex(PeerId peerId) {
+	const auto i = _historySlices.find(peerId);
+	if (i != _historySlices.end()) {
+		return i->second;
+	}
+	auto &result = _historySlices[peerId];
+	const auto key = _historySlicesIndexKey(peerId);
+	FileReadDescriptor index;
+	if (!_readEncryptedCache(_cacheDatabase(), index, CacheHistorySlice, key)) {
+		return result;
+	}
+
+	quint64 storedPeerId = 0;
+	qint32 version = 0, count = 0;
+	index.stream >> storedPeerId >> version >> count;
+	if (!_checkStreamStatus(index.stream)
+		|| storedPeerId != quint64(peerId)
+		|| version != kHistorySlicesIndexVersion
+		|| count < 0
+		|| count > kHistorySlicesLimit) {
+		_clearInCache(CacheHistorySlice, key);
+		return result;
+	}
+	auto slots = base::flat_set<int>();
+	for (auto i = 0; i != count; ++i) {
+		qint32 slot = 0, from = 0, till = 0, bottom = 0;
+		index.stream >> slot >> from >> till >> bottom;
+		if (slot < 0
+			|| slot >= kHistorySlicesLimit
+			|| from > till
+			|| !slots.emplace(slot).second) {
+			break;
+		}
+		result.push_back({ slot, MsgRange(from, till), (bottom == 1) });
+	}
+	if (!_checkStreamStatus(index.stream) || int(result.size()) != count) {
+		result.clear();
+		_clearInCache(CacheHistorySlice, key);
+	}
+	return result;
+}
+
+void _writeHistorySlicesIndex(PeerId peerId) {
+	const auto &index = _historySlicesIndex(peerId);
+	const auto key = _historySlicesIndexKey(peerId);
+	if (index.empty()) {
+		_clearInCache(CacheHistorySlice, key);
+		return;
+	}
+	EncryptedDescriptor data(sizeof(quint64)
+		+ 2 * sizeof(qint32)
+		+ index.size() * 4 * sizeof(qint32));
+	data.stream
+		<< quint64(peerId)
+		<< kHistorySlicesIndexVersion
+		<< qint32(index.size());
+	for (const auto &info : index) {
+		data.stream
+			<< qint32(info.slot)
+			<< qint32(info.range.from)
+			<< qint32(info.range.till)
+			<< qint32(info.bottom ? 1 : 0);
+	}
+	_writeEncryptedCache(CacheHistorySlice, key, data);
+}
+
+// Returns the slot of the page with the message or of the newest page.
+int _historySliceSlot(PeerId peerId, MsgId aroundId) {
+	for (const auto &info : _historySlicesIndex(peerId)) {
+		if (aroundId
+			? (info.range.from <= aroundId && aroundId <= info.range.till)
+			: info.bottom) {
+			return info.slot;
+		}
+	}
+	return -1;
+}
+
+void _removeHistorySlice(PeerId peerId, int slot) {
+	auto &index = _historySlicesIndex(peerId);
+	const auto i = ranges::find(index, slot, &HistorySliceInfo::slot);
+	if (i != index.end()) {
+		index.erase(i);
+		_clearInCache(CacheHistorySlice, _historySliceKey(peerId, slot));
+		_writeHistorySlicesIndex(peerId);
+	}
+}
+
+void writeHistorySlice(PeerId peerId, const HistorySlice &slice) {
+	if (!_working() || slice.messages.isEmpty()) return;
+
+	// The pages index can't be read while the database is being opened.
+	if (!_cacheDatabase()) return;
+
+	auto range = MsgRange(ServerMaxMsgId, 0);
+	for (const auto &message : slice.messages) {
+		const auto id = idFromMessage(message);
+		range.from = std::min(range.from, id);
+		range.till = std::max(range.till, id);
+	}
+	if (range.from > range.till) {
+		return;
+	}
+
+	// The new page replaces the pages it overlaps, and if it is newer
+	// than the bottom page that one is not at the bottom anymore.
+	auto &index = _historySlicesIndex(peerId);
+	for (auto i = index.begin(); i != index.end();) {
+		if (i->range.from <= range.till && range.from <= i->range.till) {
+			_clearInCache(CacheHistorySlice, _historySliceKey(peerId, i->slot));
+			i = index.erase(i);
+		} else {
+			if (slice.bottom || i->range.till < range.from) {
+				i->bottom = false;
+			}
+			++i;
+		}
+	}
+	if (index.size() >= kHistorySlicesLimit) {
+		const auto slot = index.front().slot;
+		_clearInCache(CacheHistorySlice, _historySliceKey(peerId, slot));
+		index.erase(index.begin());
+	}
+	auto slot = 0;
+	while (ranges::find(index, slot, &HistorySliceInfo::slot) != index.end()) {
+		++slot;
+	}
+	index.push_back({ slot, range, slice.bottom });
+
+	const MTPVector<MTPMessage> messages = MTP_vector<MTPMessage>(slice.messages);
+	const MTPVector<MTPUser> users = MTP_vector<MTPUser>(slice.users);
+	const MTPVector<MTPChat> chats = MTP_vector<MTPChat>(slice.chats);
+	auto buffer = mtpBuffer();
+	buffer.reserve((messages.innerLength()
+		+ users.innerLength()
+		+ chats.innerLength()) >> 2);
+	messages.write(buffer);
+	users.write(buffer);
+	chats.write(buffer);
+	const auto serialized = QByteArray::fromRawData(
+		reinterpret_cast<const char*>(buffer.constData()),
+		buffer.size() * sizeof(mtpPrime));
+
+	EncryptedDescriptor data(sizeof(quint64) + sizeof(qint32) + sizeof(quint32) + serialized.size());
+	data.stream << quint64(peerId) << qint32(MTP::internal::CurrentLayer) << serialized;
+	_writeEncryptedCache(CacheHistorySlice, _historySliceKey(peerId, slot), data);
+	_writeHistorySlicesIndex(peerId);
+}
+
+// May be called from the _localLoader thread.
+bool _readHistorySlice(Storage::Cache::Database *cache, HistorySlice &result, PeerId peerId, int slot) {
+	FileReadDescriptor slice;
+	if (!_readEncryptedCache(cache, slice, CacheHistorySlice, _historySliceKey(peerId, slot))) {
+		return false;
+	}
+
+	quint64 storedPeerId = 0;
+	qint32 layer = 0;
+	QByteArray serialized;
+	slice.stream >> storedPeerId >> layer >> serialized;
+	if (!_checkStreamStatus(slice.stream)
+		|| storedPeerId != quint64(peerId)
+		|| layer != MTP::internal::CurrentLayer
+		|| (serialized.size() % sizeof(mtpPrime)) != 0) {
+		return false;
+	}
+
+	auto from = reinterpret_cast<const mtpPrime*>(serialized.constData());
+	const auto end = from + (serialized.size() / sizeof(mtpPrime));
+	auto messages = MTPVector<MTPMessage>();
+	auto users = MTPVector<MTPUser>();
+	auto chats = MTPVector<MTPChat>();
+	try {
+		messages.read(from, end);
+		users.read(from, end);
+		chats.read(from, end);
+	} catch (Exception &) {
+		LOG(("App Error: could not read cached history slice."));
+		return false;
+	}
+	result = { messages.v, users.v, chats.v };
+	return true;
+}
+
+class HistorySliceLoadTask : public Task {
+public:
+	HistorySliceLoadTask(
+		PeerId peerId,
+		int slot,
+		base::lambda<void(HistorySlice&&)> done)
+	: _database(_cache)
+	, _peerId(peerId)
+	, _slot(slot)
+	, _done(std::move(done)) {
+	}
+
+	void process() override {
+		_read = _readHistorySlice(_database.get(), _slice, _peerId, _slot);
+	}
+	void finish() override {
+		if (!_read) {
+			_removeHistorySlice(_peerId, _slot);
+		}
+		_done(std::move(_slice));
+	}
+
+private:
+	std::shared_ptr<Storage::Cache::Database> _database;
+	PeerId _peerId = 0;
+	int _slot = 0;
+	base::lambda<void(HistorySlice&&)> _done;
+	HistorySlice _slice;
+	bool _read = false;
+
+};
+
+bool hasHistorySlice(PeerId peerId, MsgId aroundId) {
+	return _working()
+		&& _localLoader
+		&& _cacheDatabase()
+		&& (_historySliceSlot(peerId, aroundId) >= 0);
+}
+
+void readHistorySlice(
+		PeerId peerId,
+		MsgId aroundId,
+		base::lambda<void(HistorySlice&&)> done) {
+	if (!hasHistorySlice(peerId, aroundId)) {
+		done(HistorySlice());
+		return;
+	}
+	_localLoader->addTask(std::make_unique<HistorySliceLoadTask>(
+		peerId,
+		_historySliceSlot(peerId, aroundId),
+		std::move(done)));
+}
+
+void clearHistorySlice(PeerId peerId) {
+	if (!_working()) return;
+
+	// The index could be evicted or broken, so all the slots are cleared.
+	for (auto slot = 0; slot != kHistorySlicesLimit; ++slot) {
+		_clearInCache(CacheHistorySlice, _historySliceKey(peerId, slot));
+	}
+	_clearInCache(CacheHistorySlice, _historySlicesIndexKey(peerId));
+	_historySlices.erase(peerId);
+}
+
+// Part zero is the whole index, the next ones are the changes after it.
+//
+// The cache may evict any of the records, so after each part one more
+// empty record is written with the count of the parts in its key, and
+// the index is used only if it is there with all the parts it counts.
+Storage::Cache::Key _searchIndexKey(PeerId peerId, int part) {
+	auto result = Storage::Cache::Key();
+	result.high = quint64(peerId);
+	result.low = quint64(part);
+	return result;
+}
+
+Storage::Cache::Key _searchIndexCountKey(PeerId peerId, int count) {
+	return _searchIndexKey(peerId, kSearchIndexPartsLimit + 1 + count);
+}
+
+void _writeSearchIndexPart(PeerId peerId, int part, const QByteArray &segment) {
+	EncryptedDescriptor data(sizeof(quint64) + Serialize::bytearraySize(segment));
+	data.stream << quint64(peerId) << segment;
+	_writeEncryptedCache(CacheSearchIndex, _searchIndexKey(peerId, part), data);
+}
+
+void _writeSearchIndexCount(PeerId peerId, int count) {
+	EncryptedDescriptor data(sizeof(quint64));
+	data.stream << quint64(peerId);
+	_writeEncryptedCache(CacheSearchIndex, _searchIndexCountKey(peerId, count), data);
+}
+
+// May be called from the _localLoader thread.
+bool _readSearchIndexPart(Storage::Cache::Database *cache, QByteArray &result, PeerId peerId, int part) {
+	FileReadDescriptor file;
+	if (!_readEncryptedCache(cache, file, CacheSearchIndex, _searchIndexKey(peerId, part))) {
+		return false;
+	}
+	quint64 storedPeerId = 0;
+	file.stream >> storedPeerId >> result;
+	return _checkStreamStatus(file.stream) && (storedPeerId == quint64(peerId));
+}
+
+void _clearSearchIndex(PeerId peerId) {
+	for (auto part = 0; part <= kSearchIndexPartsLimit; ++part) {
+		_clearInCache(CacheSearchIndex, _searchIndexKey(peerId, part));
+		_clearInCache(CacheSearchIndex, _searchIndexCountKey(peerId, part + 1));
+	}
+}
+
+// Returns the count of the saved parts or zero if there is no index
+// or if some of its records were evicted.
+int _searchIndexPartsCount(PeerId peerId) {
+	if (!_working()) {
+		return 0;
+	}
+	for (auto count = kSearchIndexPartsLimit + 1; count > 0; --count) {
+		if (!_cacheContains(CacheSearchIndex, _searchIndexCountKey(peerId, count))) {
+			continue;
+		}
+		for (auto part = 0; part != count; ++part) {
+			if (!_cacheContains(CacheSearchIndex, _searchIndexKey(peerId, part))) {
+				return 0;
+			}
+		}
+		return count;
+	}
+	return 0;
+}
+
+class SearchIndexLoadTask : public Task {
+public:
+	SearchIndexLoadTask(
+		PeerId peerId,
+		int parts,
+		base::lambda<void(std::vector<QByteArray>&&)> done)
+	: _database(_cache)
+	, _peerId(peerId)
+	, _parts(parts)
+	, _done(std::move(done)) {
+	}
+
+	void process() override {
+		for (auto part = 0; part != _parts; ++part) {
+			auto segment = QByteArray();
+			if (!_readSearchIndexPart(_database.get(), segment, _peerId, part)) {
+				_broken = true;
+				return;
+			}
+			_segments.push_back(std::move(segment));
+		}
+	}
+	void finish() override {
+		if (_broken) {
+			LOG(("App Error: could not read search index of %1, dropping."
+				).arg(_peerId));
+			_clearSearchIndex(_peerId);
+			_segments.clear();
+		}
+		_done(std::move(_segments));
+	}
+
+private:
+	std::shared_ptr<Storage::Cache::Database> _database;
+	PeerId _peerId = 0;
+	int _parts = 0;
+	base::lambda<void(std::vector<QByteArray>&&)> _done;
+	std::vector<QByteArray> _segments;
+	bool _broken = false;
+
+};
+
+bool hasSearchIndex(PeerId peerId) {
+	// While the database is being opened the index is supposed to exist,
+	// so that it isn't replaced with the changes made meanwhile.
+	return (!_cacheDatabase() && _cacheOpening)
+		|| (_searchIndexPartsCount(peerId) > 0);
+}
+
+void writeSearchIndex(PeerId peerId, const QByteArray &segment) {
+	if (!_working()) return;
+
+	_clearSearchIndex(peerId);
+	if (!segment.isEmpty()) {
+		_writeSearchIndexPart(peerId, 0, segment);
+		_writeSearchIndexCount(peerId, 1);
+	}
+}
+
+bool appendSearchIndex(PeerId peerId, const QByteArray &changes) {
+	const auto part = _searchIndexPartsCount(peerId);
+	if (!part || part > kSearchIndexPartsLimit) {
+		return false;
+	}
+	_writeSearchIndexPart(peerId, part, changes);
+	_writeSearchIndexCount(peerId, part + 1);
+	_clearInCache(CacheSearchIndex, _searchIndexCountKey(peerId, part));
+	return true;
+}
+
+void readSearchIndex(
+		PeerId peerId,
+		base::lambda<void(std::vector<QByteArray>&&)> done) {
+	if (!_cacheDatabase() && _cacheOpening) {
+		// The saved index would be replaced if it was loaded empty now.
+		_cacheOpenedCallbacks.push_back([=] {
+			readSearchIndex(peerId, done);
+		});
+		return;
+	}
+	const auto parts = _searchIndexPartsCount(peerId);
+	if (!parts || !_localLoader) {
+		done({});
+		return;
+	}
+	_localLoader->addTask(std::make_unique<SearchIndexLoadTask>(
+		peerId,
+		parts,
+		std::move(done)));
+}
+
 void writeTrustedBots() {
 	if (!_working()) return;
 
@@ -4820,6 +5624,11 @@ bool ClearManager::addTask(int task) {
 	if (!data->working) return false;
 
 	if (!data->tasks.isEmpty() && (data->tasks.at(0) == ClearManagerAll)) return true;
+	if (task & ClearManagerStorage) {
+		_legacyCacheItems.clear();
+		_legacyCacheMigrated = 0;
+		_clearCacheDatabase();
+	}
 	if (task == ClearManagerAll) {
 		data->tasks.clear();
 		if (!_imagesMap.isEmpty()) {
@@ -5008,6 +5817,9 @@ void ClearManager::onStart() {
 				di.next();
 				const QFileInfo& fi = di.fileInfo();
 				if (fi.isDir() && !fi.isSymLink()) {
+					if (fi.fileName() == qstr("cache")) {
+						continue; // cleared in addTask()
+					}
 					if (!QDir(di.filePath()).removeRecursively()) result = false;
 				} else {
 					QString path = di.filePath();
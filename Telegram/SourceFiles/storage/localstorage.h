@@ -127,6 +127,7 @@ qint64 storageWebFilesSize();
 void countVoiceWaveform(DocumentData *document);
 
 void cancelTask(TaskId id);
+void prioritizeTask(TaskId id, int priority);
 
 void writeInstalledStickers();
 void writeFeaturedStickers();
@@ -168,6 +169,45 @@ void readSavedPeers();
 
 void writeReportSpamStatuses();
 
+// Pages of a history as they were received from the server, they are
+// shown while the actual ones are requested after the restart. A few
+// pages are kept for each history by their message id ranges, the one
+// received at the bottom of the history is found by the zero id.
+struct HistorySlice {
+	QVector<MTPMessage> messages;
+	QVector<MTPUser> users;
+	QVector<MTPChat> chats;
+	bool bottom = false;
+};
+void writeHistorySlice(PeerId peerId, const HistorySlice &slice);
+bool hasHistorySlice(PeerId peerId, MsgId aroundId);
+
+// Reads and decrypts the slice on the local loader thread, the callback
+// is invoked on the main thread with an empty slice if it was not read.
+void readHistorySlice(
+	PeerId peerId,
+	MsgId aroundId,
+	base::lambda<void(HistorySlice&&)> done);
+void clearHistorySlice(PeerId peerId);
+
+// Search index segment of a peer is saved as a whole with the changes
+// appended after it in separate parts, so that frequent saves are small.
+bool hasSearchIndex(PeerId peerId);
+void writeSearchIndex(PeerId peerId, const QByteArray &segment);
+
+// Returns false if there is no whole segment, if there are too many parts
+// already or if some of them were evicted from the cache, then the whole
+// segment should be written again.
+bool appendSearchIndex(PeerId peerId, const QByteArray &changes);
+
+// Reads the whole segment and the parts in the order they were written
+// on the local loader thread, the callback is invoked on the main thread.
+// If some of the parts were evicted or can't be read the callback gets
+// nothing, so that the changes are never applied out of order.
+void readSearchIndex(
+	PeerId peerId,
+	base::lambda<void(std::vector<QByteArray>&&)> done);
+
 void makeBotTrusted(UserData *bot);
 bool isBotTrusted(UserData *bot);
 
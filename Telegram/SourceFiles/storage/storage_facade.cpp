@@ -10,11 +10,22 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_shared_media.h"
 #include "storage/storage_user_photos.h"
 #include "storage/storage_feed_messages.h"
+#include "storage/storage_search_index.h"
+#include "storage/localstorage.h"
+#include "base/timer.h"
+#include "base/weak_ptr.h"
 
 namespace Storage {
+namespace {
 
-class Facade::Impl {
+constexpr auto kSearchIndexSaveDelay = TimeMs(5000);
+
+} // namespace
+
+class Facade::Impl : public base::has_weak_ptr {
 public:
+	Impl();
+
 	void add(SharedMediaAddNew &&query);
 	void add(SharedMediaAddExisting &&query);
 	void add(SharedMediaAddSlice &&query);
@@ -48,13 +59,40 @@ public:
 	rpl::producer<FeedMessagesInvalidate> feedMessagesInvalidated() const;
 	rpl::producer<FeedMessagesInvalidateBottom> feedMessagesBottomInvalidated() const;
 
+	void add(SearchIndexAddNew &&query);
+	void remove(SearchIndexRemoveOne &&query);
+	void remove(SearchIndexRemoveAll &&query);
+	rpl::producer<SearchIndexResult> query(SearchIndexQuery &&query);
+
 private:
+	void prepareSearchIndexWords();
+	void searchIndexWordsPrepared(std::vector<SearchIndexAddNew> &&added);
+	bool searchIndexRemoveRequired(PeerId peerId) const;
+	void loadSearchIndex(PeerId peerId);
+	void searchIndexLoaded(
+		PeerId peerId,
+		std::vector<QByteArray> &&segments);
+	void searchIndexChanged();
+	void saveSearchIndex();
+
 	SharedMedia _sharedMedia;
 	UserPhotos _userPhotos;
 	FeedMessages _feedMessages;
+	SearchIndex _searchIndex;
+	std::vector<SearchIndexAddNew> _searchIndexAdding;
+	bool _searchIndexPreparing = false;
+	std::vector<SearchIndexRemoveOne> _searchIndexRemovedWhilePreparing;
+	std::vector<SearchIndexRemoveAll> _searchIndexClearedWhilePreparing;
+	base::flat_set<PeerId> _searchIndexLoading;
+	rpl::event_stream<PeerId> _searchIndexLoaded;
+	base::Timer _searchIndexSaveTimer;
 
 };
 
+Facade::Impl::Impl()
+: _searchIndexSaveTimer([=] { saveSearchIndex(); }) {
+}
+
 void Facade::Impl::add(SharedMediaAddNew &&query) {
 	_sharedMedia.add(std::move(query));
 }
@@ -172,6 +210,165 @@ rpl::producer<FeedMessagesInvalidateBottom> Facade::Impl::feedMessagesBottomInva
 	return _feedMessages.bottomInvalidated();
 }
 
+void Facade::Impl::add(SearchIndexAddNew &&query) {
+	_searchIndexAdding.push_back(std::move(query));
+	if (_searchIndexAdding.size() == 1 && !_searchIndexPreparing) {
+		InvokeQueued(this, [=] { prepareSearchIndexWords(); });
+	}
+}
+
+void Facade::Impl::remove(SearchIndexRemoveOne &&query) {
+	const auto peerId = query.peerId;
+	const auto messageId = query.messageId;
+	_searchIndexAdding.erase(
+		ranges::remove_if(_searchIndexAdding, [&](
+				const SearchIndexAddNew &adding) {
+			return (adding.peerId == peerId)
+				&& (adding.messageId == messageId);
+		}),
+		end(_searchIndexAdding));
+	if (_searchIndexPreparing) {
+		_searchIndexRemovedWhilePreparing.push_back(query);
+	}
+	if (searchIndexRemoveRequired(peerId)) {
+		_searchIndex.remove(std::move(query));
+		searchIndexChanged();
+	}
+}
+
+void Facade::Impl::remove(SearchIndexRemoveAll &&query) {
+	const auto peerId = query.peerId;
+	_searchIndexAdding.erase(
+		ranges::remove_if(_searchIndexAdding, [&](
+				const SearchIndexAddNew &adding) {
+			return (adding.peerId == peerId);
+		}),
+		end(_searchIndexAdding));
+	if (_searchIndexPreparing) {
+		_searchIndexClearedWhilePreparing.push_back(query);
+	}
+	if (searchIndexRemoveRequired(peerId)) {
+		_searchIndex.remove(std::move(query));
+		searchIndexChanged();
+	}
+}
+
+rpl::producer<SearchIndexResult> Facade::Impl::query(
+		SearchIndexQuery &&query) {
+	const auto peerId = query.peerId;
+	if (_searchIndex.loaded(peerId)) {
+		return rpl::single(_searchIndex.query(std::move(query)));
+	}
+	loadSearchIndex(peerId);
+	return _searchIndexLoaded.events(
+	) | rpl::filter([=](PeerId loadedId) {
+		return (loadedId == peerId);
+	}) | rpl::take(1) | rpl::map([=, query = std::move(query)](PeerId) {
+		auto copy = query;
+		return _searchIndex.query(std::move(copy));
+	});
+}
+
+// The words are prepared in batches outside of the main thread.
+void Facade::Impl::prepareSearchIndexWords() {
+	if (_searchIndexPreparing || _searchIndexAdding.empty()) {
+		return;
+	}
+	_searchIndexPreparing = true;
+	const auto guard = base::make_weak(this);
+	crl::async([=, adding = base::take(_searchIndexAdding)]() mutable {
+		for (auto &query : adding) {
+			query.words = TextUtilities::PrepareSearchWords(query.text);
+			query.text = QString();
+		}
+		crl::on_main(guard, [=, added = std::move(adding)]() mutable {
+			searchIndexWordsPrepared(std::move(added));
+		});
+	});
+}
+
+void Facade::Impl::searchIndexWordsPrepared(
+		std::vector<SearchIndexAddNew> &&added) {
+	_searchIndexPreparing = false;
+	for (auto &query : added) {
+		_searchIndex.add(std::move(query));
+	}
+
+	// Removed after these messages were added, but before they're indexed.
+	for (auto &query : base::take(_searchIndexRemovedWhilePreparing)) {
+		_searchIndex.remove(std::move(query));
+	}
+	for (auto &query : base::take(_searchIndexClearedWhilePreparing)) {
+		_searchIndex.remove(std::move(query));
+	}
+	searchIndexChanged();
+	prepareSearchIndexWords();
+}
+
+bool Facade::Impl::searchIndexRemoveRequired(PeerId peerId) const {
+	return _searchIndex.contains(peerId) || Local::hasSearchIndex(peerId);
+}
+
+void Facade::Impl::loadSearchIndex(PeerId peerId) {
+	if (!_searchIndexLoading.emplace(peerId).second) {
+		return;
+	}
+	const auto guard = base::make_weak(this);
+	Local::readSearchIndex(peerId, [=](std::vector<QByteArray> &&segments) {
+		if (guard) {
+			searchIndexLoaded(peerId, std::move(segments));
+		}
+	});
+}
+
+void Facade::Impl::searchIndexLoaded(
+		PeerId peerId,
+		std::vector<QByteArray> &&segments) {
+	_searchIndexLoading.remove(peerId);
+	if (!_searchIndex.load(peerId, segments)) {
+		LOG(("App Error: could not read search index segment for %1."
+			).arg(peerId));
+	}
+	searchIndexChanged();
+	_searchIndexLoaded.fire_copy(peerId);
+}
+
+void Facade::Impl::searchIndexChanged() {
+	if (!_searchIndexSaveTimer.isActive()) {
+		_searchIndexSaveTimer.callOnce(kSearchIndexSaveDelay);
+	}
+}
+
+// Only the changes are saved usually, the whole segment is saved again
+// when it is loaded with the changes, when there are too many of them or
+// when some of them were evicted from the cache.
+void Facade::Impl::saveSearchIndex() {
+	for (const auto peerId : _searchIndex.takeChanged()) {
+		if (_searchIndexLoading.contains(peerId)) {
+			// It will be marked as changed again when it is loaded.
+			continue;
+		} else if (_searchIndex.wholeSaveRequired(peerId)
+			|| !Local::hasSearchIndex(peerId)) {
+			// Nothing is saved yet or the saved parts were evicted.
+			Local::writeSearchIndex(peerId, _searchIndex.serialize(peerId));
+		} else {
+			const auto changes = _searchIndex.serializeChanges(peerId);
+			if (!changes.isEmpty()
+				&& !Local::appendSearchIndex(peerId, changes)) {
+				if (!_searchIndex.loaded(peerId)) {
+					// Kept in memory until the segment is loaded.
+					continue;
+				}
+				Local::writeSearchIndex(
+					peerId,
+					_searchIndex.serialize(peerId));
+			}
+		}
+		_searchIndex.saved(peerId);
+	}
+	_searchIndex.shrink();
+}
+
 Facade::Facade() : _impl(std::make_unique<Impl>()) {
 }
 
@@ -292,6 +489,22 @@ rpl::producer<FeedMessagesInvalidateBottom> Facade::feedMessagesBottomInvalidate
 	return _impl->feedMessagesBottomInvalidated();
 }
 
+void Facade::add(SearchIndexAddNew &&query) {
+	_impl->add(std::move(query));
+}
+
+void Facade::remove(SearchIndexRemoveOne &&query) {
+	_impl->remove(std::move(query));
+}
+
+void Facade::remove(SearchIndexRemoveAll &&query) {
+	_impl->remove(std::move(query));
+}
+
+rpl::producer<SearchIndexResult> Facade::query(SearchIndexQuery &&query) {
+	return _impl->query(std::move(query));
+}
+
 Facade::~Facade() = default;
 
 } // namespace Storage
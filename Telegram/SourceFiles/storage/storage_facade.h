@@ -46,6 +46,12 @@ struct FeedMessagesQuery;
 using FeedMessagesResult = Data::MessagesResult;
 struct FeedMessagesSliceUpdate;
 
+struct SearchIndexAddNew;
+struct SearchIndexRemoveOne;
+struct SearchIndexRemoveAll;
+struct SearchIndexQuery;
+struct SearchIndexResult;
+
 class Facade {
 public:
 	Facade();
@@ -86,6 +92,11 @@ public:
 	rpl::producer<FeedMessagesInvalidate> feedMessagesInvalidated() const;
 	rpl::producer<FeedMessagesInvalidateBottom> feedMessagesBottomInvalidated() const;
 
+	void add(SearchIndexAddNew &&query);
+	void remove(SearchIndexRemoveOne &&query);
+	void remove(SearchIndexRemoveAll &&query);
+	rpl::producer<SearchIndexResult> query(SearchIndexQuery &&query);
+
 	~Facade();
 
 private:
@@ -0,0 +1,313 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_search_index.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kMessagesLimit = 65536;
+constexpr auto kPeerMessagesLimit = 8192;
+constexpr auto kMessageWordsLimit = 128;
+constexpr auto kWordLengthLimit = 32;
+
+// Segment: quint32 version, quint32 messages count and for each message
+// qint32 message id, qint32 date and QStringList of its words, empty if
+// the message is removed.
+constexpr auto kSegmentVersion = quint32(3);
+
+} // namespace
+
+void SearchIndex::add(SearchIndexAddNew &&query) {
+	auto &peer = peerEntry(query.peerId);
+	const auto removed = removeMessage(peer, query.messageId);
+	const auto added = addMessage(
+		peer,
+		query.messageId,
+		query.date,
+		std::move(query.words));
+	if (removed || added || !peer.loaded) {
+		const auto i = peer.wordsByMessage.find(query.messageId);
+		peer.changes[query.messageId] = (i != peer.wordsByMessage.end())
+			? i->second
+			: Message();
+		touch(peer);
+		_changed.emplace(query.peerId);
+	}
+}
+
+void SearchIndex::remove(SearchIndexRemoveOne &&query) {
+	auto &peer = peerEntry(query.peerId);
+	if (removeMessage(peer, query.messageId) || !peer.loaded) {
+		peer.changes[query.messageId] = Message();
+		_changed.emplace(query.peerId);
+	}
+}
+
+void SearchIndex::remove(SearchIndexRemoveAll &&query) {
+	auto &peer = peerEntry(query.peerId);
+	_messagesCount -= int(peer.wordsByMessage.size());
+	peer.wordsByMessage.clear();
+	peer.messagesByWord.clear();
+	peer.changes.clear();
+
+	// The saved segment is not needed anymore.
+	peer.loaded = true;
+	peer.wholeSaveRequired = true;
+	_changed.emplace(query.peerId);
+}
+
+SearchIndexResult SearchIndex::query(SearchIndexQuery &&query) {
+	auto result = SearchIndexResult();
+	result.peerId = query.peerId;
+	const auto i = _peers.find(query.peerId);
+	if (i == _peers.end() || query.words.isEmpty() || query.limit <= 0) {
+		return result;
+	}
+	auto &peer = i->second;
+	touch(peer);
+
+	auto found = base::flat_set<MsgId>();
+	auto first = true;
+	for (const auto &word : query.words) {
+		const auto prefix = word.left(kWordLengthLimit);
+		auto matched = std::vector<MsgId>();
+		for (auto j = peer.messagesByWord.lower_bound(prefix)
+			; j != peer.messagesByWord.end() && j->first.startsWith(prefix)
+			; ++j) {
+			for (const auto messageId : j->second) {
+				if (first || found.contains(messageId)) {
+					matched.push_back(messageId);
+				}
+			}
+		}
+		found = base::flat_set<MsgId>(matched.begin(), matched.end());
+		first = false;
+		if (found.empty()) {
+			return result;
+		}
+	}
+
+	auto till = query.maxId
+		? std::lower_bound(found.begin(), found.end(), query.maxId)
+		: found.end();
+	const auto from = found.begin();
+	while (till != from && int(result.messages.size()) < query.limit) {
+		const auto messageId = *--till;
+		const auto j = peer.wordsByMessage.find(messageId);
+		Assert(j != peer.wordsByMessage.end());
+		result.messages.push_back({ messageId, j->second.date });
+	}
+	return result;
+}
+
+bool SearchIndex::contains(PeerId peerId) const {
+	return _peers.find(peerId) != _peers.end();
+}
+
+bool SearchIndex::loaded(PeerId peerId) const {
+	const auto i = _peers.find(peerId);
+	return (i != _peers.end()) && i->second.loaded;
+}
+
+bool SearchIndex::load(
+		PeerId peerId,
+		const std::vector<QByteArray> &segments) {
+	auto &peer = peerEntry(peerId);
+	auto result = true;
+	if (!peer.loaded) {
+		peer.loaded = true;
+		for (const auto &segment : segments) {
+			if (!readSegment(peer, segment)) {
+				result = false;
+				break;
+			}
+		}
+
+		// Merge the saved changes into the whole segment.
+		if (!result || segments.size() > 1) {
+			peer.wholeSaveRequired = true;
+		}
+	}
+
+	// Changes are not saved while the segment is being loaded.
+	if (peer.wholeSaveRequired || !peer.changes.empty()) {
+		_changed.emplace(peerId);
+	}
+	return result;
+}
+
+base::flat_set<PeerId> SearchIndex::takeChanged() {
+	return base::take(_changed);
+}
+
+bool SearchIndex::wholeSaveRequired(PeerId peerId) const {
+	const auto i = _peers.find(peerId);
+	return (i != _peers.end()) && i->second.wholeSaveRequired;
+}
+
+QByteArray SearchIndex::serialize(PeerId peerId) const {
+	const auto i = _peers.find(peerId);
+	return (i != _peers.end())
+		? serializeMessages(i->second.wordsByMessage)
+		: QByteArray();
+}
+
+QByteArray SearchIndex::serializeChanges(PeerId peerId) const {
+	const auto i = _peers.find(peerId);
+	return (i != _peers.end())
+		? serializeMessages(i->second.changes)
+		: QByteArray();
+}
+
+void SearchIndex::saved(PeerId peerId) {
+	if (const auto i = _peers.find(peerId); i != _peers.end()) {
+		i->second.changes.clear();
+		i->second.wholeSaveRequired = false;
+	}
+}
+
+void SearchIndex::shrink() {
+	const auto saved = [](const Peer &peer) {
+		return peer.changes.empty() && !peer.wholeSaveRequired;
+	};
+	while (_messagesCount > kMessagesLimit) {
+		auto oldest = _peers.end();
+		for (auto i = _peers.begin(); i != _peers.end(); ++i) {
+			if (!saved(i->second) || _changed.contains(i->first)) {
+				continue;
+			} else if (oldest == _peers.end()
+				|| oldest->second.lastUsed > i->second.lastUsed) {
+				oldest = i;
+			}
+		}
+		if (oldest == _peers.end()) {
+			return;
+		}
+		_messagesCount -= int(oldest->second.wordsByMessage.size());
+		_peers.erase(oldest);
+	}
+}
+
+auto SearchIndex::peerEntry(PeerId peerId) -> Peer& {
+	auto &result = _peers[peerId];
+	if (!result.lastUsed) {
+		touch(result);
+	}
+	return result;
+}
+
+QByteArray SearchIndex::serializeMessages(
+		const std::map<MsgId, Message> &messages) {
+	auto result = QByteArray();
+	if (messages.empty()) {
+		return result;
+	}
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << kSegmentVersion << quint32(messages.size());
+		for (const auto &[messageId, message] : messages) {
+			stream
+				<< qint32(messageId)
+				<< qint32(message.date)
+				<< message.words;
+		}
+	}
+	return result;
+}
+
+bool SearchIndex::addMessage(
+		Peer &peer,
+		MsgId messageId,
+		TimeId date,
+		QStringList &&words) {
+	auto unique = base::flat_set<QString>();
+	for (const auto &word : words) {
+		if (!word.isEmpty()) {
+			unique.emplace(word.left(kWordLengthLimit));
+			if (int(unique.size()) == kMessageWordsLimit) {
+				break;
+			}
+		}
+	}
+	if (unique.empty()) {
+		return false;
+	}
+	words = QStringList();
+	words.reserve(unique.size());
+	for (const auto &word : unique) {
+		peer.messagesByWord[word].emplace(messageId);
+		words.push_back(word);
+	}
+	peer.wordsByMessage.emplace(messageId, Message{ date, std::move(words) });
+	++_messagesCount;
+
+	// The oldest message is removed from the saved segment as well.
+	if (int(peer.wordsByMessage.size()) > kPeerMessagesLimit) {
+		const auto oldestId = peer.wordsByMessage.begin()->first;
+		removeMessage(peer, oldestId);
+		peer.changes[oldestId] = Message();
+	}
+	return true;
+}
+
+bool SearchIndex::removeMessage(Peer &peer, MsgId messageId) {
+	const auto i = peer.wordsByMessage.find(messageId);
+	if (i == peer.wordsByMessage.end()) {
+		return false;
+	}
+	for (const auto &word : i->second.words) {
+		const auto j = peer.messagesByWord.find(word);
+		if (j != peer.messagesByWord.end()) {
+			j->second.remove(messageId);
+			if (j->second.empty()) {
+				peer.messagesByWord.erase(j);
+			}
+		}
+	}
+	peer.wordsByMessage.erase(i);
+	--_messagesCount;
+	return true;
+}
+
+bool SearchIndex::readSegment(Peer &peer, const QByteArray &segment) {
+	if (segment.isEmpty()) {
+		return true;
+	}
+	QDataStream stream(segment);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto version = quint32();
+	auto count = quint32();
+	stream >> version >> count;
+	if (stream.status() != QDataStream::Ok || version != kSegmentVersion) {
+		return false;
+	}
+	for (auto i = quint32(); i != count; ++i) {
+		auto messageId = qint32();
+		auto date = qint32();
+		auto words = QStringList();
+		stream >> messageId >> date >> words;
+		if (stream.status() != QDataStream::Ok) {
+			return false;
+		}
+
+		// Messages changed before loading are more recent.
+		if (peer.changes.find(messageId) == peer.changes.end()) {
+			removeMessage(peer, messageId);
+			addMessage(peer, messageId, date, std::move(words));
+		}
+	}
+	return true;
+}
+
+void SearchIndex::touch(Peer &peer) {
+	peer.lastUsed = ++_useCounter;
+}
+
+} // namespace Storage
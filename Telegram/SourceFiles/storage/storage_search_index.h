@@ -0,0 +1,153 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "storage/storage_facade.h"
+
+namespace Storage {
+
+struct SearchIndexAddNew {
+	SearchIndexAddNew(
+		PeerId peerId,
+		MsgId messageId,
+		TimeId date,
+		const QString &text)
+		: peerId(peerId)
+		, messageId(messageId)
+		, date(date)
+		, text(text) {
+	}
+
+	PeerId peerId = 0;
+	MsgId messageId = 0;
+	TimeId date = 0;
+	QString text;
+	QStringList words; // Prepared from the text by the storage.
+
+};
+
+struct SearchIndexRemoveOne {
+	SearchIndexRemoveOne(PeerId peerId, MsgId messageId)
+		: peerId(peerId)
+		, messageId(messageId) {
+	}
+
+	PeerId peerId = 0;
+	MsgId messageId = 0;
+
+};
+
+struct SearchIndexRemoveAll {
+	SearchIndexRemoveAll(PeerId peerId) : peerId(peerId) {
+	}
+
+	PeerId peerId = 0;
+
+};
+
+struct SearchIndexQuery {
+	SearchIndexQuery(
+		PeerId peerId,
+		QStringList &&words,
+		MsgId maxId,
+		int limit)
+		: peerId(peerId)
+		, words(std::move(words))
+		, maxId(maxId)
+		, limit(limit) {
+	}
+
+	PeerId peerId = 0;
+	QStringList words;
+	MsgId maxId = 0; // Only messages with smaller ids, 0 for all.
+	int limit = 0;
+
+};
+
+// Enough to show the message or to request it if it is not loaded.
+struct SearchIndexMessage {
+	MsgId messageId = 0;
+	TimeId date = 0;
+};
+
+struct SearchIndexResult {
+	PeerId peerId = 0;
+	std::vector<SearchIndexMessage> messages; // Starting from the newest.
+};
+
+// Inverted index of the message text words, a message is found if each
+// of the query words is a prefix of one of the message words.
+//
+// Index of each peer is loaded from its segment only when it is queried,
+// the changes made before that are kept and saved separately, so that
+// they're applied after the segment when it is loaded. The least recently
+// used saved peers are unloaded when the messages count limit is exceeded.
+class SearchIndex {
+public:
+	void add(SearchIndexAddNew &&query);
+	void remove(SearchIndexRemoveOne &&query);
+	void remove(SearchIndexRemoveAll &&query);
+	SearchIndexResult query(SearchIndexQuery &&query);
+
+	bool contains(PeerId peerId) const;
+	bool loaded(PeerId peerId) const;
+
+	// The whole segment and the changes saved after it, in that order.
+	// Messages changed before loading are kept as they are in the index,
+	// returns false if some of the segments could not be read.
+	bool load(PeerId peerId, const std::vector<QByteArray> &segments);
+
+	// Peers changed since the last call.
+	base::flat_set<PeerId> takeChanged();
+
+	// If the whole segment should be saved instead of the changes.
+	bool wholeSaveRequired(PeerId peerId) const;
+	QByteArray serialize(PeerId peerId) const;
+	QByteArray serializeChanges(PeerId peerId) const;
+	void saved(PeerId peerId);
+
+	// Unloads the least recently used saved peers over the limit.
+	void shrink();
+
+private:
+	struct Message {
+		TimeId date = 0;
+		QStringList words;
+	};
+	struct Peer {
+		std::map<QString, base::flat_set<MsgId>> messagesByWord;
+		std::map<MsgId, Message> wordsByMessage;
+
+		// Not saved changes, empty words for the removed messages.
+		std::map<MsgId, Message> changes;
+		bool wholeSaveRequired = false;
+		bool loaded = false;
+		uint64 lastUsed = 0;
+	};
+
+	static QByteArray serializeMessages(
+		const std::map<MsgId, Message> &messages);
+
+	Peer &peerEntry(PeerId peerId);
+	bool addMessage(
+		Peer &peer,
+		MsgId messageId,
+		TimeId date,
+		QStringList &&words);
+	bool removeMessage(Peer &peer, MsgId messageId);
+	bool readSegment(Peer &peer, const QByteArray &segment);
+	void touch(Peer &peer);
+
+	std::map<PeerId, Peer> _peers;
+	base::flat_set<PeerId> _changed;
+	int _messagesCount = 0;
+	uint64 _useCounter = 0;
+
+};
+
+} // namespace Storage
@@ -9,6 +9,9 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "media/media_clip_reader.h"
 
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+
 namespace Media {
 namespace Clip {
 
@@ -26,6 +29,10 @@ ReaderPointer::~ReaderPointer() {
 
 namespace {
 
+constexpr auto kDefaultRefreshRate = 60.;
+constexpr auto kMaxFrameInterval = TimeMs(33);
+constexpr auto kHiddenFrameInterval = TimeMs(250);
+
 AnimationManager *_manager = nullptr;
 bool AnimationsDisabled = false;
 
@@ -94,7 +101,7 @@ void stopManager() {
 }
 
 void registerClipManager(Media::Clip::Manager *manager) {
-	manager->connect(manager, SIGNAL(callback(Media::Clip::Reader*,qint32,qint32)), _manager, SLOT(clipCallback(Media::Clip::Reader*,qint32,qint32)));
+	manager->connect(manager, SIGNAL(callback(Media::Clip::Reader*,qint32)), _manager, SLOT(clipCallback(Media::Clip::Reader*,qint32)));
 }
 
 bool Disabled() {
@@ -108,6 +115,10 @@ void SetDisabled(bool disabled) {
 	}
 }
 
+FrameStats GetFrameStats() {
+	return _manager ? _manager->frameStats() : FrameStats();
+}
+
 } // anim
 
 void BasicAnimation::start() {
@@ -126,7 +137,8 @@ void BasicAnimation::stop() {
 }
 
 AnimationManager::AnimationManager() : _timer(this), _iterating(false) {
-	_timer.setSingleShot(false);
+	_timer.setSingleShot(true);
+	_timer.setTimerType(Qt::PreciseTimer);
 	connect(&_timer, SIGNAL(timeout()), this, SLOT(timeout()));
 }
 
@@ -137,10 +149,8 @@ void AnimationManager::start(BasicAnimation *obj) {
 			_stopping.remove(obj);
 		}
 	} else {
-		if (_objects.isEmpty()) {
-			_timer.start(AnimationTimerDelta);
-		}
 		_objects.insert(obj);
+		schedule();
 	}
 }
 
@@ -154,16 +164,113 @@ void AnimationManager::stop(BasicAnimation *obj) {
 		auto i = _objects.find(obj);
 		if (i != _objects.cend()) {
 			_objects.erase(i);
-			if (_objects.empty()) {
-				_timer.stop();
+			if (_objects.empty() && _clipNotifications.empty()) {
+				stopClock();
 			}
 		}
 	}
 }
 
+anim::FrameStats AnimationManager::frameStats() const {
+	auto result = _stats;
+	result.interval = _frameInterval;
+	return result;
+}
+
+void AnimationManager::updateFrameInterval() {
+	// Use the highest refresh rate of the screens with exposed windows.
+	auto refreshRate = 0.;
+	for (const auto window : QGuiApplication::topLevelWindows()) {
+		if (window->isExposed()) {
+			const auto screen = window->screen();
+			refreshRate = std::max(
+				refreshRate,
+				screen ? screen->refreshRate() : kDefaultRefreshRate);
+		}
+	}
+	if (refreshRate <= 0.) {
+		_frameInterval = kHiddenFrameInterval;
+		return;
+	}
+	_frameInterval = snap(
+		TimeMs(1000. / refreshRate),
+		TimeMs(AnimationTimerDelta),
+		kMaxFrameInterval);
+}
+
+void AnimationManager::schedule() {
+	if (_objects.empty() && _clipNotifications.empty()) {
+		stopClock();
+		return;
+	} else if (_timer.isActive()) {
+		return;
+	}
+	updateFrameInterval();
+	watchExposure(_frameInterval == kHiddenFrameInterval);
+
+	// Keep the frames on the same grid while the clock is running,
+	// the first frame after the clock is started waits for one interval.
+	const auto now = getms();
+	const auto passed = _lastFrame ? (now - _lastFrame) : 0;
+	const auto delay = (passed < _frameInterval)
+		? (_frameInterval - passed)
+		: (_frameInterval - (passed % _frameInterval));
+	_timer.start(delay);
+}
+
+void AnimationManager::stopClock() {
+	_timer.stop();
+
+	// The time the clock was stopped for is not counted as late frames.
+	_lastFrame = 0;
+	watchExposure(false);
+}
+
+void AnimationManager::watchExposure(bool watch) {
+	if (_watchingExposure != watch) {
+		_watchingExposure = watch;
+		if (watch) {
+			QCoreApplication::instance()->installEventFilter(this);
+		} else {
+			QCoreApplication::instance()->removeEventFilter(this);
+		}
+	}
+}
+
+bool AnimationManager::eventFilter(QObject *o, QEvent *e) {
+	if (e->type() == QEvent::Expose && _timer.isActive()) {
+		// Don't wait for the rest of the hidden windows interval when
+		// some window is shown, start from the new frame interval.
+		updateFrameInterval();
+		if (_frameInterval != kHiddenFrameInterval) {
+			_timer.stop();
+			_lastFrame = 0;
+			schedule();
+		}
+	}
+	return QObject::eventFilter(o, e);
+}
+
+void AnimationManager::processClipNotifications() {
+	for (const auto &entry : base::take(_clipNotifications)) {
+		Media::Clip::Reader::callback(
+			entry.reader,
+			Media::Clip::Notification(entry.notification));
+	}
+}
+
 void AnimationManager::timeout() {
+	const auto ms = getms();
+	if (_lastFrame
+		&& _frameInterval < kHiddenFrameInterval
+		&& ms - _lastFrame > _frameInterval + _frameInterval / 2) {
+		++_stats.late;
+	}
+	_lastFrame = ms;
+
+	processClipNotifications();
+
 	_iterating = true;
-	auto ms = getms();
 	for_const (auto object, _objects) {
 		if (!_stopping.contains(object)) {
 			object->step(ms, true);
@@ -183,12 +290,25 @@ void AnimationManager::timeout() {
 		}
 		_stopping.clear();
 	}
-	if (_objects.empty()) {
-		_timer.stop();
-	}
+
+	const auto work = getms() - ms;
+	++_stats.frames;
+	_stats.workTotal += work;
+	accumulate_max(_stats.workMax, work);
+
+	schedule();
 }
 
-void AnimationManager::clipCallback(Media::Clip::Reader *reader, qint32 threadIndex, qint32 notification) {
-	Media::Clip::Reader::callback(reader, threadIndex, Media::Clip::Notification(notification));
+void AnimationManager::clipCallback(Media::Clip::Reader *reader, qint32 notification) {
+	// Frames of the clips are shown in the next animation frame.
+	const auto already = ranges::find_if(_clipNotifications, [&](
+			const ClipNotification &entry) {
+		return (entry.reader == reader)
+			&& (entry.notification == notification);
+	});
+	if (already == end(_clipNotifications)) {
+		_clipNotifications.push_back({ reader, notification });
+	}
+	schedule();
 }
 
@@ -417,6 +417,18 @@ QPainterPath path(QPointF (&from)[N]) {
 bool Disabled();
 void SetDisabled(bool disabled);
 
+// All the animations and clip frame notifications are processed in a
+// single pass per frame, at the refresh rate of the screens showing the
+// windows and rarely while none of the windows is exposed.
+struct FrameStats {
+	int frames = 0;
+	int late = 0; // started more than a half of the interval late
+	TimeMs interval = 0; // current frame interval
+	TimeMs workTotal = 0; // time spent in all the frames
+	TimeMs workMax = 0; // time spent in the longest frame
+};
+FrameStats GetFrameStats();
+
 };
 
 class BasicAnimation;
@@ -699,15 +711,36 @@ public:
 	void start(BasicAnimation *obj);
 	void stop(BasicAnimation *obj);
 
+	anim::FrameStats frameStats() const;
+
 public slots:
 	void timeout();
 
-	void clipCallback(Media::Clip::Reader *reader, qint32 threadIndex, qint32 notification);
+	void clipCallback(Media::Clip::Reader *reader, qint32 notification);
+
+protected:
+	bool eventFilter(QObject *o, QEvent *e) override;
 
 private:
+	struct ClipNotification {
+		Media::Clip::Reader *reader = nullptr;
+		qint32 notification = 0;
+	};
+
+	void schedule();
+	void stopClock();
+	void watchExposure(bool watch);
+	void updateFrameInterval();
+	void processClipNotifications();
+
 	using AnimatingObjects = OrderedSet<BasicAnimation*>;
 	AnimatingObjects _objects, _starting, _stopping;
+	std::vector<ClipNotification> _clipNotifications;
 	QTimer _timer;
+	TimeMs _frameInterval = 0;
+	TimeMs _lastFrame = 0;
+	anim::FrameStats _stats;
 	bool _iterating;
+	bool _watchingExposure = false;
 
 };
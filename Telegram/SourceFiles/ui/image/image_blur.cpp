@@ -0,0 +1,156 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "ui/image/image_blur.h"
+
+#include "base/assertion.h"
+#include "ui/image/image_blur_kernel.h"
+
+#include <vector>
+
+#if defined IMAGES_BLUR_AVX2 && defined COMPILER_MSVC
+#include <intrin.h>
+#endif // IMAGES_BLUR_AVX2 && COMPILER_MSVC
+
+namespace Images {
+namespace Blur {
+namespace {
+
+#ifdef IMAGES_BLUR_AVX2
+
+bool DetectAvx2() {
+#ifdef COMPILER_MSVC
+	int info[4] = { 0 };
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	const auto osxsave = (info[2] & (1 << 27)) != 0;
+	const auto avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) {
+		return false;
+	}
+
+	// The OS must save the AVX registers on context switch.
+	if ((_xgetbv(0) & 0x06) != 0x06) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else // COMPILER_MSVC
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif // COMPILER_MSVC
+}
+
+#endif // IMAGES_BLUR_AVX2
+
+void ApplyScalar(uchar *pixels, int width, int height, int stride) {
+	using namespace details;
+
+	auto sums = std::vector<quint64>(width * height);
+	BlurRowsFrom<ScalarLanes>(0, pixels, sums.data(), width, height, stride);
+	BlurColumnsFrom<ScalarLanes>(0, pixels, sums.data(), width, height, stride);
+}
+
+} // namespace
+
+bool Supported(Implementation implementation) {
+	switch (implementation) {
+	case Implementation::Scalar: return true;
+	case Implementation::Sse2: {
+#ifdef IMAGES_BLUR_SSE2
+		return true;
+#else // IMAGES_BLUR_SSE2
+		return false;
+#endif // IMAGES_BLUR_SSE2
+	} break;
+	case Implementation::Avx2: {
+#ifdef IMAGES_BLUR_AVX2
+		static const auto result = DetectAvx2();
+		return result;
+#else // IMAGES_BLUR_AVX2
+		return false;
+#endif // IMAGES_BLUR_AVX2
+	} break;
+	}
+	Unexpected("Implementation in Images::Blur::Supported.");
+}
+
+Implementation Best() {
+	static const auto result = [] {
+		if (Supported(Implementation::Avx2)) {
+			return Implementation::Avx2;
+		} else if (Supported(Implementation::Sse2)) {
+			return Implementation::Sse2;
+		}
+		return Implementation::Scalar;
+	}();
+	return result;
+}
+
+void Apply(uchar *pixels, int width, int height, int stride) {
+	Apply(Best(), pixels, width, height, stride);
+}
+
+void Apply(
+		Implementation implementation,
+		uchar *pixels,
+		int width,
+		int height,
+		int stride) {
+	Expects(Supported(implementation));
+	Expects(width > 2 * details::kRadius + 1);
+	Expects(height > 2 * details::kRadius + 1);
+
+	switch (implementation) {
+	case Implementation::Scalar:
+		return ApplyScalar(pixels, width, height, stride);
+	case Implementation::Sse2:
+		return details::ApplySse2(pixels, width, height, stride);
+	case Implementation::Avx2:
+		return details::ApplyAvx2(pixels, width, height, stride);
+	}
+	Unexpected("Implementation in Images::Blur::Apply.");
+}
+
+namespace details {
+
+#ifdef IMAGES_BLUR_SSE2
+
+void ApplySse2(uchar *pixels, int width, int height, int stride) {
+	auto sums = std::vector<quint64>(width * height);
+	const auto y = BlurRowsFrom<Sse2Lanes>(
+		0,
+		pixels,
+		sums.data(),
+		width,
+		height,
+		stride);
+	BlurRowsFrom<ScalarLanes>(y, pixels, sums.data(), width, height, stride);
+	const auto x = BlurColumnsFrom<Sse2Lanes>(
+		0,
+		pixels,
+		sums.data(),
+		width,
+		height,
+		stride);
+	BlurColumnsFrom<ScalarLanes>(x, pixels, sums.data(), width, height, stride);
+}
+
+#else // IMAGES_BLUR_SSE2
+
+void ApplySse2(uchar*, int, int, int) {
+	Unexpected("SSE2 blur is not supported.");
+}
+
+#endif // IMAGES_BLUR_SSE2
+
+} // namespace details
+} // namespace Blur
+} // namespace Images
@@ -0,0 +1,57 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/build_config.h"
+
+#include <QtCore/QtGlobal>
+
+#if defined ARCH_CPU_X86_64 || (defined ARCH_CPU_X86 && (defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2)))
+#define IMAGES_BLUR_SSE2 1
+#endif // ARCH_CPU_X86_64 || (ARCH_CPU_X86 && SSE2)
+
+#if defined ARCH_CPU_X86_64
+#if defined COMPILER_MSVC || defined COMPILER_GCC
+#define IMAGES_BLUR_AVX2 1
+#elif defined COMPILER_CLANG // COMPILER_MSVC || COMPILER_GCC
+#if __has_extension(pragma_clang_attribute)
+#define IMAGES_BLUR_AVX2 1
+#endif // __has_extension(pragma_clang_attribute)
+#endif // COMPILER_MSVC || COMPILER_GCC || COMPILER_CLANG
+#endif // ARCH_CPU_X86_64
+
+namespace Images {
+namespace Blur {
+
+enum class Implementation {
+	Scalar,
+	Sse2,
+	Avx2,
+};
+
+bool Supported(Implementation implementation);
+Implementation Best();
+
+// Stack blur with radius 3 of 32 bit pixels, all the implementations
+// produce exactly the same result. The image must be larger than 7x7.
+void Apply(uchar *pixels, int width, int height, int stride);
+void Apply(
+	Implementation implementation,
+	uchar *pixels,
+	int width,
+	int height,
+	int stride);
+
+namespace details {
+
+void ApplySse2(uchar *pixels, int width, int height, int stride);
+void ApplyAvx2(uchar *pixels, int width, int height, int stride);
+
+} // namespace details
+} // namespace Blur
+} // namespace Images
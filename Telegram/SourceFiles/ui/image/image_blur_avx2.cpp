@@ -0,0 +1,140 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "ui/image/image_blur.h"
+
+#include "base/assertion.h"
+
+#include <cstring>
+#include <vector>
+
+#ifdef IMAGES_BLUR_AVX2
+
+#include <emmintrin.h>
+
+// Only the code below is compiled for AVX2, it runs after the check
+// in Images::Blur::Supported(), the rest of the app is not affected.
+#if defined COMPILER_GCC
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#elif defined COMPILER_CLANG // COMPILER_GCC
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#endif // COMPILER_GCC || COMPILER_CLANG
+
+#include <immintrin.h>
+
+#include "ui/image/image_blur_kernel.h"
+
+namespace Images {
+namespace Blur {
+namespace details {
+namespace {
+
+// Four pixels in an __m256i: four rows in rows pass, four columns in
+// columns pass, with the same 16 bit lanes layout as in Sse2Lanes.
+struct Avx2Lanes {
+	static constexpr auto kCount = 4;
+	using Vector = __m256i;
+
+	static inline Vector LoadPixels(const uchar *p, int stride) {
+		const auto bytes = _mm_setr_epi32(
+			Sse2Lanes::LoadPixel(p),
+			Sse2Lanes::LoadPixel(p + stride),
+			Sse2Lanes::LoadPixel(p + 2 * stride),
+			Sse2Lanes::LoadPixel(p + 3 * stride));
+		return _mm256_cvtepu8_epi16(bytes);
+	}
+	static inline Vector LoadSums(const quint64 *sums) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums));
+	}
+	static inline void StoreSums(quint64 *sums, int width, Vector value) {
+		const auto result = _mm256_srli_epi16(value, 4);
+		const auto low = _mm256_castsi256_si128(result);
+		const auto high = _mm256_extracti128_si256(result, 1);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(sums), low);
+		_mm_storel_epi64(
+			reinterpret_cast<__m128i*>(sums + width),
+			_mm_unpackhi_epi64(low, low));
+		_mm_storel_epi64(
+			reinterpret_cast<__m128i*>(sums + 2 * width),
+			high);
+		_mm_storel_epi64(
+			reinterpret_cast<__m128i*>(sums + 3 * width),
+			_mm_unpackhi_epi64(high, high));
+	}
+	static inline void StorePixels(uchar *p, Vector value) {
+		const auto result = _mm256_srli_epi16(value, 4);
+
+		// Packing works inside 128 bit halves, so bring the first
+		// quad words of both halves together.
+		const auto packed = _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(result, result),
+			0x08);
+		_mm_storeu_si128(
+			reinterpret_cast<__m128i*>(p),
+			_mm256_castsi256_si128(packed));
+	}
+	static inline Vector Add(Vector a, Vector b) {
+		return _mm256_add_epi16(a, b);
+	}
+	static inline Vector Subtract(Vector a, Vector b) {
+		return _mm256_sub_epi16(a, b);
+	}
+	static inline Vector Multiply(Vector a, int b) {
+		return _mm256_mullo_epi16(a, _mm256_set1_epi16(short(b)));
+	}
+};
+
+} // namespace
+
+void ApplyAvx2(uchar *pixels, int width, int height, int stride) {
+	auto sums = std::vector<quint64>(width * height);
+	auto y = BlurRowsFrom<Avx2Lanes>(
+		0,
+		pixels,
+		sums.data(),
+		width,
+		height,
+		stride);
+	y = BlurRowsFrom<Sse2Lanes>(y, pixels, sums.data(), width, height, stride);
+	BlurRowsFrom<ScalarLanes>(y, pixels, sums.data(), width, height, stride);
+	auto x = BlurColumnsFrom<Avx2Lanes>(
+		0,
+		pixels,
+		sums.data(),
+		width,
+		height,
+		stride);
+	x = BlurColumnsFrom<Sse2Lanes>(x, pixels, sums.data(), width, height, stride);
+	BlurColumnsFrom<ScalarLanes>(x, pixels, sums.data(), width, height, stride);
+}
+
+} // namespace details
+} // namespace Blur
+} // namespace Images
+
+#if defined COMPILER_GCC
+#pragma GCC pop_options
+#elif defined COMPILER_CLANG // COMPILER_GCC
+#pragma clang attribute pop
+#endif // COMPILER_GCC || COMPILER_CLANG
+
+#else // IMAGES_BLUR_AVX2
+
+namespace Images {
+namespace Blur {
+namespace details {
+
+void ApplyAvx2(uchar*, int, int, int) {
+	Unexpected("AVX2 blur is not supported.");
+}
+
+} // namespace details
+} // namespace Blur
+} // namespace Images
+
+#endif // IMAGES_BLUR_AVX2
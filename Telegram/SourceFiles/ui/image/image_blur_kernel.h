@@ -0,0 +1,223 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "ui/image/image_blur.h"
+
+#include <cstring>
+
+#ifdef IMAGES_BLUR_SSE2
+#include <emmintrin.h>
+#endif // IMAGES_BLUR_SSE2
+
+// This header is included in the code compiled for different instruction
+// sets, so everything here is either a template or has internal linkage.
+
+namespace Images {
+namespace Blur {
+namespace details {
+
+constexpr auto kRadius = 3;
+constexpr auto kR1 = kRadius + 1;
+constexpr auto kFirstWeight = (kR1 * (kR1 + 1)) >> 1;
+
+// The weights of the kernel sum up to kR1 * kR1 == 16, so the sums
+// are shifted by 4 to get the result and fit in 16 bit channels.
+static_assert(kR1 * kR1 == 16, "Bad blur radius.");
+
+// Lanes::Vector keeps four 16 bit channels for each of the Lanes::kCount
+// pixels that are processed together. In rows pass those are pixels of
+// consequent rows, in columns pass those are pixels of consequent columns.
+//
+// All the arithmetic is wrapping, it gives the same channel values as
+// the original scalar implementation with four channels in an uint64.
+
+template <typename Lanes>
+inline void BlurRows(
+		const uchar *pixels,
+		quint64 *sums,
+		int width,
+		int stride) {
+	using Vector = typename Lanes::Vector;
+
+	auto cur = Lanes::LoadPixels(pixels, stride);
+	auto rgballsum = Lanes::Multiply(cur, -kRadius);
+	auto rgbsum = Lanes::Multiply(cur, kFirstWeight);
+	for (auto i = 1; i <= kRadius; ++i) {
+		cur = Lanes::LoadPixels(pixels + i * 4, stride);
+		rgbsum = Lanes::Add(rgbsum, Lanes::Multiply(cur, kR1 - i));
+		rgballsum = Lanes::Add(rgballsum, cur);
+	}
+
+	const auto we = width - kR1;
+	for (auto x = 0; x != width; ++x) {
+		const auto start = (x < kR1) ? 0 : (x - kR1);
+		const auto end = (x < we) ? (x + kR1) : (width - 1);
+		Lanes::StoreSums(sums + x, width, rgbsum);
+		const Vector delta = Lanes::Subtract(
+			Lanes::Add(
+				Lanes::LoadPixels(pixels + start * 4, stride),
+				Lanes::LoadPixels(pixels + end * 4, stride)),
+			Lanes::Multiply(Lanes::LoadPixels(pixels + x * 4, stride), 2));
+		rgballsum = Lanes::Add(rgballsum, delta);
+		rgbsum = Lanes::Add(rgbsum, rgballsum);
+	}
+}
+
+template <typename Lanes>
+inline void BlurColumns(
+		uchar *pixels,
+		const quint64 *sums,
+		int width,
+		int height,
+		int stride) {
+	using Vector = typename Lanes::Vector;
+
+	auto cur = Lanes::LoadSums(sums);
+	auto rgballsum = Lanes::Multiply(cur, -kRadius);
+	auto rgbsum = Lanes::Multiply(cur, kFirstWeight);
+	for (auto i = 1; i <= kRadius; ++i) {
+		cur = Lanes::LoadSums(sums + i * width);
+		rgbsum = Lanes::Add(rgbsum, Lanes::Multiply(cur, kR1 - i));
+		rgballsum = Lanes::Add(rgballsum, cur);
+	}
+
+	const auto he = height - kR1;
+	for (auto y = 0; y != height; ++y) {
+		const auto start = (y < kR1) ? 0 : (y - kR1);
+		const auto end = (y < he) ? (y + kR1) : (height - 1);
+		Lanes::StorePixels(pixels + y * stride, rgbsum);
+		const Vector delta = Lanes::Subtract(
+			Lanes::Add(
+				Lanes::LoadSums(sums + start * width),
+				Lanes::LoadSums(sums + end * width)),
+			Lanes::Multiply(Lanes::LoadSums(sums + y * width), 2));
+		rgballsum = Lanes::Add(rgballsum, delta);
+		rgbsum = Lanes::Add(rgbsum, rgballsum);
+	}
+}
+
+template <typename Lanes>
+inline int BlurRowsFrom(
+		int y,
+		uchar *pixels,
+		quint64 *sums,
+		int width,
+		int height,
+		int stride) {
+	for (; y + Lanes::kCount <= height; y += Lanes::kCount) {
+		BlurRows<Lanes>(pixels + y * stride, sums + y * width, width, stride);
+	}
+	return y;
+}
+
+template <typename Lanes>
+inline int BlurColumnsFrom(
+		int x,
+		uchar *pixels,
+		const quint64 *sums,
+		int width,
+		int height,
+		int stride) {
+	for (; x + Lanes::kCount <= width; x += Lanes::kCount) {
+		BlurColumns<Lanes>(pixels + x * 4, sums + x, width, height, stride);
+	}
+	return x;
+}
+
+namespace {
+
+struct ScalarLanes {
+	static constexpr auto kCount = 1;
+	using Vector = quint64;
+
+	// Only a single pixel is loaded and stored, the stride and the
+	// width are not needed.
+	static inline Vector LoadPixels(const uchar *p, int) {
+		return quint64(p[0])
+			| (quint64(p[1]) << 16)
+			| (quint64(p[2]) << 32)
+			| (quint64(p[3]) << 48);
+	}
+	static inline Vector LoadSums(const quint64 *sums) {
+		return *sums;
+	}
+	static inline void StoreSums(quint64 *sums, int, Vector value) {
+		*sums = (value >> 4) & 0x00FF00FF00FF00FFULL;
+	}
+	static inline void StorePixels(uchar *p, Vector value) {
+		const auto result = value >> 4;
+		p[0] = result & 0xFF;
+		p[1] = (result >> 16) & 0xFF;
+		p[2] = (result >> 32) & 0xFF;
+		p[3] = (result >> 48) & 0xFF;
+	}
+	static inline Vector Add(Vector a, Vector b) {
+		return a + b;
+	}
+	static inline Vector Subtract(Vector a, Vector b) {
+		return a - b;
+	}
+	static inline Vector Multiply(Vector a, int b) {
+		return a * quint64(b);
+	}
+};
+
+#ifdef IMAGES_BLUR_SSE2
+
+// Two pixels in an __m128i: two rows in rows pass, two columns in
+// columns pass. The 16 bit lanes of each pixel have the same layout
+// in memory as the quint64 values of the ScalarLanes.
+struct Sse2Lanes {
+	static constexpr auto kCount = 2;
+	using Vector = __m128i;
+
+	static inline int LoadPixel(const uchar *p) {
+		auto result = 0;
+		std::memcpy(&result, p, sizeof(result));
+		return result;
+	}
+	static inline Vector LoadPixels(const uchar *p, int stride) {
+		const auto bytes = _mm_unpacklo_epi32(
+			_mm_cvtsi32_si128(LoadPixel(p)),
+			_mm_cvtsi32_si128(LoadPixel(p + stride)));
+		return _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+	}
+	static inline Vector LoadSums(const quint64 *sums) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums));
+	}
+	static inline void StoreSums(quint64 *sums, int width, Vector value) {
+		const auto result = _mm_srli_epi16(value, 4);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(sums), result);
+		_mm_storel_epi64(
+			reinterpret_cast<__m128i*>(sums + width),
+			_mm_unpackhi_epi64(result, result));
+	}
+	static inline void StorePixels(uchar *p, Vector value) {
+		const auto result = _mm_srli_epi16(value, 4);
+		_mm_storel_epi64(
+			reinterpret_cast<__m128i*>(p),
+			_mm_packus_epi16(result, result));
+	}
+	static inline Vector Add(Vector a, Vector b) {
+		return _mm_add_epi16(a, b);
+	}
+	static inline Vector Subtract(Vector a, Vector b) {
+		return _mm_sub_epi16(a, b);
+	}
+	static inline Vector Multiply(Vector a, int b) {
+		return _mm_mullo_epi16(a, _mm_set1_epi16(short(b)));
+	}
+};
+
+#endif // IMAGES_BLUR_SSE2
+
+} // namespace
+} // namespace details
+} // namespace Blur
+} // namespace Images
@@ -0,0 +1,199 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "ui/image/image_blur.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace Images::Blur;
+
+namespace {
+
+constexpr Implementation kImplementations[] = {
+	Implementation::Scalar,
+	Implementation::Sse2,
+	Implementation::Avx2,
+};
+
+const char *Name(Implementation implementation) {
+	switch (implementation) {
+	case Implementation::Scalar: return "scalar";
+	case Implementation::Sse2: return "sse2";
+	case Implementation::Avx2: return "avx2";
+	}
+	return "unknown";
+}
+
+std::vector<uchar> RandomPixels(std::mt19937 &generator, int width, int height) {
+	auto result = std::vector<uchar>(width * height * 4);
+	for (auto &value : result) {
+		value = uchar(generator() & 0xFF);
+	}
+	return result;
+}
+
+quint64 BlurGetColors(const uchar *p) {
+	return quint64(p[0])
+		+ (quint64(p[1]) << 16)
+		+ (quint64(p[2]) << 32)
+		+ (quint64(p[3]) << 48);
+}
+
+// The kernel of Images::prepareBlur as it was before the implementations
+// were moved to ui/image/image_blur, all of them must give its result.
+void OriginalBlur(uchar *pix, int w, int h) {
+	const int radius = 3;
+	const int r1 = radius + 1;
+	const int stride = w * 4;
+	auto rgb = std::vector<quint64>(w * h);
+
+	int x, y, i;
+
+	int yw = 0;
+	const int we = w - r1;
+	for (y = 0; y < h; y++) {
+		quint64 cur = BlurGetColors(&pix[yw]);
+		quint64 rgballsum = -radius * cur;
+		quint64 rgbsum = cur * ((r1 * (r1 + 1)) >> 1);
+
+		for (i = 1; i <= radius; i++) {
+			quint64 cur = BlurGetColors(&pix[yw + i * 4]);
+			rgbsum += cur * (r1 - i);
+			rgballsum += cur;
+		}
+
+		x = 0;
+
+#define update(start, middle, end) \
+rgb[y * w + x] = (rgbsum >> 4) & 0x00FF00FF00FF00FFLL; \
+rgballsum += BlurGetColors(&pix[yw + (start) * 4]) - 2 * BlurGetColors(&pix[yw + (middle) * 4]) + BlurGetColors(&pix[yw + (end) * 4]); \
+rgbsum += rgballsum; \
+x++;
+
+		while (x < r1) {
+			update(0, x, x + r1);
+		}
+		while (x < we) {
+			update(x - r1, x, x + r1);
+		}
+		while (x < w) {
+			update(x - r1, x, w - 1);
+		}
+
+#undef update
+
+		yw += stride;
+	}
+
+	const int he = h - r1;
+	for (x = 0; x < w; x++) {
+		quint64 rgballsum = -radius * rgb[x];
+		quint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
+		for (i = 1; i <= radius; i++) {
+			rgbsum += rgb[i * w + x] * (r1 - i);
+			rgballsum += rgb[i * w + x];
+		}
+
+		y = 0;
+		int yi = x * 4;
+
+#define update(start, middle, end) \
+quint64 res = rgbsum >> 4; \
+pix[yi] = res & 0xFF; \
+pix[yi + 1] = (res >> 16) & 0xFF; \
+pix[yi + 2] = (res >> 32) & 0xFF; \
+pix[yi + 3] = (res >> 48) & 0xFF; \
+rgballsum += rgb[x + (start) * w] - 2 * rgb[x + (middle) * w] + rgb[x + (end) * w]; \
+rgbsum += rgballsum; \
+y++; \
+yi += stride;
+
+		while (y < r1) {
+			update(0, y, y + r1);
+		}
+		while (y < he) {
+			update(y - r1, y, y + r1);
+		}
+		while (y < h) {
+			update(y - r1, y, h - 1);
+		}
+
+#undef update
+	}
+}
+
+} // namespace
+
+TEST_CASE("blur implementations match the original kernel", "[blur]") {
+	auto generator = std::mt19937(42);
+	auto check = [&](int width, int height) {
+		const auto source = RandomPixels(generator, width, height);
+		auto expected = source;
+		OriginalBlur(expected.data(), width, height);
+		for (const auto implementation : kImplementations) {
+			if (!Supported(implementation)) {
+				continue;
+			}
+			auto blurred = source;
+			Apply(implementation, blurred.data(), width, height, width * 4);
+			INFO(Name(implementation) << " " << width << "x" << height);
+			REQUIRE(blurred == expected);
+		}
+	};
+	SECTION("small sizes") {
+		for (auto width = 8; width != 24; ++width) {
+			for (auto height = 8; height != 24; ++height) {
+				check(width, height);
+			}
+		}
+	}
+	SECTION("thumbnail sizes") {
+		check(90, 90);
+		check(90, 51);
+		check(320, 320);
+		check(320, 181);
+	}
+	SECTION("flat color stays the same") {
+		const auto width = 33;
+		const auto height = 17;
+		auto pixels = std::vector<uchar>(width * height * 4, uchar(0x80));
+		const auto expected = pixels;
+		Apply(pixels.data(), width, height, width * 4);
+		REQUIRE(pixels == expected);
+	}
+}
+
+TEST_CASE("blur implementations benchmark", "[.][benchmark]") {
+	using namespace std::chrono;
+
+	auto generator = std::mt19937(42);
+	constexpr auto kIterations = 1000;
+	for (const auto size : { 90, 320 }) {
+		const auto source = RandomPixels(generator, size, size);
+		for (const auto implementation : kImplementations) {
+			if (!Supported(implementation)) {
+				continue;
+			}
+			auto pixels = source;
+			const auto start = steady_clock::now();
+			for (auto i = 0; i != kIterations; ++i) {
+				Apply(implementation, pixels.data(), size, size, size * 4);
+			}
+			const auto time = duration_cast<microseconds>(
+				steady_clock::now() - start).count();
+			std::cout
+				<< size << "x" << size << " "
+				<< Name(implementation) << ": "
+				<< (double(time) / kIterations) << " us" << std::endl;
+		}
+	}
+}
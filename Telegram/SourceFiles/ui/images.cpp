@@ -7,6 +7,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "ui/images.h"
 
+#include "ui/image/image_blur.h"
+
 #include "mainwidget.h"
 #include "storage/localstorage.h"
 #include "platform/platform_specific.h"
@@ -17,10 +19,6 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace Images {
 namespace {
 
-FORCE_INLINE uint64 blurGetColors(const uchar *p) {
-	return (uint64)p[0] + ((uint64)p[1] << 16) + ((uint64)p[2] << 32) + ((uint64)p[3] << 48);
-}
-
 const QPixmap &circleMask(int width, int height) {
 	Assert(Global::started());
 
@@ -68,7 +66,6 @@ QImage prepareBlur(QImage img) {
 	if (pix) {
 		int w = img.width(), h = img.height(), wold = w, hold = h;
 		const int radius = 3;
-		const int r1 = radius + 1;
 		const int div = radius * 2 + 1;
 		const int stride = w * 4;
 		if (radius < 16 && div < w && div < h && stride <= w * 4) {
@@ -92,83 +89,7 @@ QImage prepareBlur(QImage img) {
 				pix = img.bits();
 				if (!pix) return was;
 			}
-			uint64 *rgb = new uint64[w * h];
-
-			int x, y, i;
-
-			int yw = 0;
-			const int we = w - r1;
-			for (y = 0; y < h; y++) {
-				uint64 cur = blurGetColors(&pix[yw]);
-				uint64 rgballsum = -radius * cur;
-				uint64 rgbsum = cur * ((r1 * (r1 + 1)) >> 1);
-
-				for (i = 1; i <= radius; i++) {
-					uint64 cur = blurGetColors(&pix[yw + i * 4]);
-					rgbsum += cur * (r1 - i);
-					rgballsum += cur;
-				}
-
-				x = 0;
-
-#define update(start, middle, end) \
-rgb[y * w + x] = (rgbsum >> 4) & 0x00FF00FF00FF00FFLL; \
-rgballsum += blurGetColors(&pix[yw + (start) * 4]) - 2 * blurGetColors(&pix[yw + (middle) * 4]) + blurGetColors(&pix[yw + (end) * 4]); \
-rgbsum += rgballsum; \
-x++;
-
-				while (x < r1) {
-					update(0, x, x + r1);
-				}
-				while (x < we) {
-					update(x - r1, x, x + r1);
-				}
-				while (x < w) {
-					update(x - r1, x, w - 1);
-				}
-
-#undef update
-
-				yw += stride;
-			}
-
-			const int he = h - r1;
-			for (x = 0; x < w; x++) {
-				uint64 rgballsum = -radius * rgb[x];
-				uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
-				for (i = 1; i <= radius; i++) {
-					rgbsum += rgb[i * w + x] * (r1 - i);
-					rgballsum += rgb[i * w + x];
-				}
-
-				y = 0;
-				int yi = x * 4;
-
-#define update(start, middle, end) \
-uint64 res = rgbsum >> 4; \
-pix[yi] = res & 0xFF; \
-pix[yi + 1] = (res >> 16) & 0xFF; \
-pix[yi + 2] = (res >> 32) & 0xFF; \
-pix[yi + 3] = (res >> 48) & 0xFF; \
-rgballsum += rgb[x + (start) * w] - 2 * rgb[x + (middle) * w] + rgb[x + (end) * w]; \
-rgbsum += rgballsum; \
-y++; \
-yi += stride;
-
-				while (y < r1) {
-					update(0, y, y + r1);
-				}
-				while (y < he) {
-					update(y - r1, y, y + r1);
-				}
-				while (y < h) {
-					update(y - r1, y, h - 1);
-				}
-
-#undef update
-			}
-
-			delete[] rgb;
+			Blur::Apply(pix, w, h, stride);
 		}
 	}
 	return img;
@@ -189,7 +110,7 @@ void prepareCircle(QImage &img) {
 
 void prepareRound(
 		QImage &image,
-		QImage *cornerMasks,
+		const QImage *cornerMasks,
 		RectParts corners,
 		QRect target) {
 	if (target.isNull()) {
@@ -303,7 +224,9 @@ QImage prepareOpaque(QImage image) {
 	return image;
 }
 
-QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, int outerh, const style::color *colored) {
+namespace {
+
+QImage PrepareWith(QImage img, int w, int h, Images::Options options, int outerw, int outerh, const PrepareContext &context, const style::color *colored) {
 	Assert(!img.isNull());
 	if (options & Images::Option::Blurred) {
 		img = prepareBlur(std::move(img));
@@ -330,7 +253,7 @@ QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, in
 			{
 				QPainter p(&result);
 				if (w < outerw || h < outerh) {
-					p.fillRect(0, 0, result.width(), result.height(), st::imageBg);
+					p.fillRect(0, 0, result.width(), result.height(), context.background);
 				}
 				p.drawImage((result.width() - img.width()) / (2 * cIntRetinaFactor()), (result.height() - img.height()) / (2 * cIntRetinaFactor()), img);
 			}
@@ -347,11 +270,13 @@ QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, in
 	if (options & Images::Option::Circled) {
 		prepareCircle(img);
 		Assert(!img.isNull());
-	} else if (options & Images::Option::RoundedLarge) {
-		prepareRound(img, ImageRoundRadius::Large, corners(options));
-		Assert(!img.isNull());
-	} else if (options & Images::Option::RoundedSmall) {
-		prepareRound(img, ImageRoundRadius::Small, corners(options));
+	} else if (options & (Images::Option::RoundedLarge | Images::Option::RoundedSmall)) {
+		const auto parts = corners(options);
+		if (static_cast<int>(parts)) {
+			img.setDevicePixelRatio(cRetinaFactor());
+			img = std::move(img).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+			prepareRound(img, context.cornerMasks.data(), parts);
+		}
 		Assert(!img.isNull());
 	}
 	if (options & Images::Option::Colored) {
@@ -362,6 +287,30 @@ QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, in
 	return img;
 }
 
+} // namespace
+
+PrepareContext CapturePrepareContext(Options options) {
+	auto result = PrepareContext();
+	if (options & (Option::RoundedLarge | Option::RoundedSmall)) {
+		const auto masks = App::cornersMask((options & Option::RoundedLarge)
+			? ImageRoundRadius::Large
+			: ImageRoundRadius::Small);
+		std::copy(masks, masks + 4, result.cornerMasks.begin());
+	}
+	result.background = st::imageBg->c;
+	return result;
+}
+
+QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, int outerh, const style::color *colored) {
+	return PrepareWith(std::move(img), w, h, options, outerw, outerh, CapturePrepareContext(options), colored);
+}
+
+QImage prepare(QImage img, int w, int h, Images::Options options, int outerw, int outerh, const PrepareContext &context) {
+	Expects(!(options & Images::Option::Colored));
+
+	return PrepareWith(std::move(img), w, h, options, outerw, outerh, context, nullptr);
+}
+
 } // namespace Images
 
 namespace {
@@ -390,7 +339,10 @@ StorageImages storageImages;
 using WebFileImages = QMap<StorageKey, WebFileImage*>;
 WebFileImages webFileImages;
 
-int64 globalAcquiredSize = 0;
+// Images::CacheManager entry for the decoded image itself, it never
+// equals a PixKey() because options take less than 16 bits.
+constexpr auto kDataCacheKey = ~uint64(0);
+constexpr auto kDefaultCacheBudget = int64(MemoryForImageCache);
 
 uint64 PixKey(int width, int height, Images::Options options) {
 	return static_cast<uint64>(width) | (static_cast<uint64>(height) << 24) | (static_cast<uint64>(options) << 48);
@@ -400,8 +352,212 @@ uint64 SinglePixKey(Images::Options options) {
 	return PixKey(0, 0, options);
 }
 
+// Smaller images are prepared right away, without a placeholder.
+constexpr auto kAsyncPrepareMinArea = 320 * 320;
+
+bool PrepareAsync(const QPixmap &data, Images::Options options) {
+	// Circle masks and style colors may be used only on the main thread.
+	const auto mainThreadOnly = Images::Option::Circled
+		| Images::Option::Colored;
+	return !data.isNull()
+		&& !(options & mainThreadOnly)
+		&& (data.width() * data.height() >= kAsyncPrepareMinArea);
+}
+
+QImage PreparePlaceholder(
+		QImage image,
+		int w,
+		int h,
+		Images::Options options,
+		int outerw,
+		int outerh) {
+	if ((options & Images::Option::Blurred) && w > 0 && w < image.width()) {
+		image = (h > 0)
+			? image.scaled(w, h, Qt::IgnoreAspectRatio, Qt::FastTransformation)
+			: image.scaledToWidth(w, Qt::FastTransformation);
+	}
+	return Images::prepare(
+		std::move(image),
+		w,
+		h,
+		options & ~Images::Option::Smooth,
+		outerw,
+		outerh);
+}
+
 } // namespace
 
+namespace Images {
+
+class CacheManager {
+public:
+	void acquired(not_null<const Image*> image, uint64 key, const QPixmap &pixmap);
+	void released(not_null<const Image*> image, uint64 key);
+	void used(not_null<const Image*> image, uint64 key);
+
+	void setBudget(int64 bytes);
+	CacheStats stats() const;
+
+private:
+	struct Key {
+		const Image *image = nullptr;
+		uint64 key = 0;
+
+		inline bool operator==(const Key &other) const {
+			return (image == other.image) && (key == other.key);
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key &value) const {
+			return std::hash<const Image*>()(value.image)
+				^ std::hash<uint64>()(value.key);
+		}
+	};
+	struct Entry {
+		Key key;
+		int64 bytes = 0;
+	};
+	using List = std::list<Entry>;
+
+	void scheduleEnforce();
+	void enforce();
+
+	List _list; // the most recently used first
+	std::unordered_map<Key, List::iterator, KeyHash> _entries;
+	CacheStats _stats;
+	bool _enforceScheduled = false;
+
+};
+
+void CacheManager::acquired(
+		not_null<const Image*> image,
+		uint64 key,
+		const QPixmap &pixmap) {
+	if (pixmap.isNull()) {
+		return released(image, key);
+	}
+	const auto bytes = int64(pixmap.width()) * pixmap.height() * 4;
+	const auto index = Key{ image, key };
+	const auto i = _entries.find(index);
+	if (i != _entries.end()) {
+		_stats.resident += bytes - i->second->bytes;
+		i->second->bytes = bytes;
+		_list.splice(_list.begin(), _list, i->second);
+	} else {
+		_list.push_front(Entry{ index, bytes });
+		_entries.emplace(index, _list.begin());
+		_stats.resident += bytes;
+		++_stats.count;
+	}
+	++_stats.misses;
+	if (_stats.resident > _stats.budget) {
+		scheduleEnforce();
+	}
+}
+
+void CacheManager::released(not_null<const Image*> image, uint64 key) {
+	const auto i = _entries.find(Key{ image, key });
+	if (i == _entries.end()) {
+		return;
+	}
+	_stats.resident -= i->second->bytes;
+	--_stats.count;
+	_list.erase(i->second);
+	_entries.erase(i);
+}
+
+void CacheManager::used(not_null<const Image*> image, uint64 key) {
+	const auto i = _entries.find(Key{ image, key });
+	if (i != _entries.end()) {
+		_list.splice(_list.begin(), _list, i->second);
+		++_stats.hits;
+	}
+	if (key != kDataCacheKey) {
+		// The decoded image of a shown pixmap is kept as well,
+		// it is needed to prepare this image of any other size.
+		const auto j = _entries.find(Key{ image, kDataCacheKey });
+		if (j != _entries.end()) {
+			_list.splice(_list.begin(), _list, j->second);
+		}
+	}
+}
+
+void CacheManager::setBudget(int64 bytes) {
+	_stats.budget = bytes;
+	if (_stats.resident > _stats.budget) {
+		scheduleEnforce();
+	}
+}
+
+CacheStats CacheManager::stats() const {
+	return _stats;
+}
+
+void CacheManager::scheduleEnforce() {
+	// Pixmaps are returned by reference from Image::pix*() methods,
+	// so they are never forgotten right in the middle of a paint.
+	if (_enforceScheduled) {
+		return;
+	}
+	_enforceScheduled = true;
+	crl::on_main([=] {
+		enforce();
+	});
+}
+
+void CacheManager::enforce() {
+	_enforceScheduled = false;
+	if (_stats.resident <= _stats.budget) {
+		return;
+	}
+	const auto target = _stats.budget - (_stats.budget / 4);
+	const auto was = _stats.resident;
+	auto attempts = _list.size();
+	while (_stats.resident > target && attempts-- > 0) {
+		const auto index = _list.back().key;
+		index.image->forgetCached(index.key);
+
+		const auto i = _entries.find(index);
+		if (i != _entries.end()) {
+			// Could not forget it, try the other ones first.
+			_list.splice(_list.begin(), _list, i->second);
+		} else {
+			++_stats.evictions;
+		}
+	}
+	DEBUG_LOG(("Images Info: forgot %1 bytes of decoded images, "
+		"resident: %2, count: %3, hits: %4, misses: %5, evictions: %6."
+		).arg(was - _stats.resident
+		).arg(_stats.resident
+		).arg(_stats.count
+		).arg(_stats.hits
+		).arg(_stats.misses
+		).arg(_stats.evictions));
+}
+
+namespace {
+
+CacheManager &Cache() {
+	static const auto result = [] {
+		const auto manager = new CacheManager();
+		manager->setBudget(kDefaultCacheBudget);
+		return manager;
+	}();
+	return *result;
+}
+
+} // namespace
+
+void SetCacheBudget(int64 bytes) {
+	Cache().setBudget(bytes);
+}
+
+CacheStats GetCacheStats() {
+	return Cache().stats();
+}
+
+} // namespace Images
+
 StorageImageLocation StorageImageLocation::Null;
 WebFileLocation WebFileLocation::Null;
 
@@ -419,33 +575,25 @@ ImagePtr::ImagePtr(int32 width, int32 height, const MTPFileLocation &location, I
 Image::Image(const QString &file, QByteArray fmt) : _forgot(false) {
 	_data = App::pixmapFromImageInPlace(App::readImage(file, &fmt, false, 0, &_saved));
 	_format = fmt;
-	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 }
 
 Image::Image(const QByteArray &filecontent, QByteArray fmt) : _forgot(false) {
 	_data = App::pixmapFromImageInPlace(App::readImage(filecontent, &fmt, false));
 	_format = fmt;
 	_saved = filecontent;
-	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 }
 
 Image::Image(const QPixmap &pixmap, QByteArray format) : _format(format), _forgot(false), _data(pixmap) {
-	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 }
 
 Image::Image(const QByteArray &filecontent, QByteArray fmt, const QPixmap &pixmap) : _saved(filecontent), _format(fmt), _forgot(false), _data(pixmap) {
 	_data = pixmap;
 	_format = fmt;
 	_saved = filecontent;
-	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 }
 
 const QPixmap &Image::pix(int32 w, int32 h) const {
@@ -461,12 +609,12 @@ const QPixmap &Image::pix(int32 w, int32 h) const {
 	auto k = PixKey(w, h, options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
+		auto p = pixPrepare(k, w, h, options);
         if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -497,12 +645,12 @@ const QPixmap &Image::pixRounded(int32 w, int32 h, ImageRoundRadius radius, Rect
 	auto k = PixKey(w, h, options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
+		auto p = pixPrepare(k, w, h, options);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -523,9 +671,9 @@ const QPixmap &Image::pixCircled(int32 w, int32 h) const {
 		auto p = pixNoCache(w, h, options);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -546,9 +694,9 @@ const QPixmap &Image::pixBlurredCircled(int32 w, int32 h) const {
 		auto p = pixNoCache(w, h, options);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -566,12 +714,12 @@ const QPixmap &Image::pixBlurred(int32 w, int32 h) const {
 	auto k = PixKey(w, h, options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend()) {
-		auto p = pixNoCache(w, h, options);
+		auto p = pixPrepare(k, w, h, options);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -592,9 +740,9 @@ const QPixmap &Image::pixColored(style::color add, int32 w, int32 h) const {
 		auto p = pixColoredNoCache(add, w, h, true);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -615,9 +763,9 @@ const QPixmap &Image::pixBlurredColored(style::color add, int32 w, int32 h) cons
 		auto p = pixBlurredColoredNoCache(add, w, h);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -653,15 +801,12 @@ const QPixmap &Image::pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, Im
 	auto k = SinglePixKey(options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
-		if (i != _sizesCache.cend()) {
-			globalAcquiredSize -= int64(i->width()) * i->height() * 4;
-		}
-		auto p = pixNoCache(w, h, options, outerw, outerh, colored);
+		auto p = pixPrepare(k, w, h, options, outerw, outerh, colored);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -694,15 +839,12 @@ const QPixmap &Image::pixBlurredSingle(int w, int h, int32 outerw, int32 outerh,
 	auto k = SinglePixKey(options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
-		if (i != _sizesCache.cend()) {
-			globalAcquiredSize -= int64(i->width()) * i->height() * 4;
-		}
-		auto p = pixNoCache(w, h, options, outerw, outerh);
+		auto p = pixPrepare(k, w, h, options, outerw, outerh);
 		if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		if (!p.isNull()) {
-			globalAcquiredSize += int64(p.width()) * p.height() * 4;
-		}
+		Images::Cache().acquired(this, k, p);
+	} else {
+		Images::Cache().used(this, k);
 	}
 	return i.value();
 }
@@ -761,6 +903,73 @@ QPixmap Image::pixNoCache(int w, int h, Images::Options options, int outerw, int
 	return Images::pixmap(_data.toImage(), w, h, options, outerw, outerh, colored);
 }
 
+QPixmap Image::pixPrepare(uint64 key, int w, int h, Images::Options options, int outerw, int outerh, const style::color *colored) const {
+	if (!loading()) const_cast<Image*>(this)->load();
+	restore();
+
+	if (isNull() || !PrepareAsync(_data, options)) {
+		return pixNoCache(w, h, options, outerw, outerh, colored);
+	}
+
+	auto image = _data.toImage();
+	const auto request = PrepareRequest{
+		w,
+		h,
+		outerw,
+		outerh,
+		options,
+		_prepareGeneration };
+	const auto i = _preparing.find(key);
+	if (i == _preparing.end() || i->second != request) {
+		// Coalesce all the paints until the result is ready.
+		_preparing[key] = request;
+		const auto guard = base::make_weak(this);
+		const auto context = Images::CapturePrepareContext(options);
+		crl::async([=, source = image]() mutable {
+			auto result = Images::prepare(
+				std::move(source),
+				w,
+				h,
+				options,
+				outerw,
+				outerh,
+				context);
+			crl::on_main(guard, [=, result = std::move(result)]() mutable {
+				pixPrepared(key, request, std::move(result));
+			});
+		});
+	}
+	return App::pixmapFromImageInPlace(PreparePlaceholder(
+		std::move(image),
+		w,
+		h,
+		options,
+		outerw,
+		outerh));
+}
+
+void Image::pixPrepared(uint64 key, const PrepareRequest &request, QImage result) const {
+	const auto i = _preparing.find(key);
+	if (i == _preparing.end() || i->second != request) {
+		return;
+	}
+	_preparing.erase(i);
+
+	// The placeholder could be already forgotten by the cache manager.
+	const auto j = _sizesCache.find(key);
+	if (j == _sizesCache.end()) {
+		return;
+	}
+	auto pixmap = App::pixmapFromImageInPlace(std::move(result));
+	if (cRetina()) pixmap.setDevicePixelRatio(cRetinaFactor());
+	j.value() = pixmap;
+	Images::Cache().acquired(this, key, pixmap);
+
+	if (AuthSession::Exists()) {
+		Auth().downloader().taskFinished().notify();
+	}
+}
+
 QPixmap Image::pixColoredNoCache(style::color add, int32 w, int32 h, bool smooth) const {
 	const_cast<Image*>(this)->load();
 	restore();
@@ -809,13 +1018,16 @@ void Image::forget() const {
 			}
 		}
 	}
-	globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+	Images::Cache().released(this, kDataCacheKey);
 	_data = QPixmap();
 	_forgot = true;
 }
 
 void Image::restore() const {
-	if (!_forgot) return;
+	if (!_forgot) {
+		Images::Cache().used(this, kDataCacheKey);
+		return;
+	}
 
 	QBuffer buffer(&_saved);
 	QImageReader reader(&buffer, _format);
@@ -824,26 +1036,41 @@ void Image::restore() const {
 #endif // OS_MAC_OLD
 	_data = QPixmap::fromImageReader(&reader, Qt::ColorOnly);
 
-	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 	_forgot = false;
 }
 
 void Image::invalidateSizeCache() const {
-	for (auto &pix : _sizesCache) {
-		if (!pix.isNull()) {
-			globalAcquiredSize -= int64(pix.width()) * pix.height() * 4;
-		}
+	for (auto i = _sizesCache.cbegin(), e = _sizesCache.cend(); i != e; ++i) {
+		Images::Cache().released(this, i.key());
 	}
 	_sizesCache.clear();
+	_preparing.clear();
+	++_prepareGeneration;
+}
+
+void Image::forgetData() const {
+	if (_forgot || _data.isNull() || _saved.isEmpty()) {
+		// Nothing to restore it from without encoding it again.
+		return;
+	}
+	Images::Cache().released(this, kDataCacheKey);
+	_data = QPixmap();
+	_forgot = true;
+}
+
+void Image::forgetCached(uint64 key) const {
+	if (key == kDataCacheKey) {
+		forgetData();
+	} else {
+		Images::Cache().released(this, key);
+		_sizesCache.remove(key);
+	}
 }
 
 Image::~Image() {
 	invalidateSizeCache();
-	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
-	}
+	Images::Cache().released(this, kDataCacheKey);
 }
 
 void clearStorageImages() {
@@ -865,10 +1092,6 @@ void clearAllImages() {
 	clearStorageImages();
 }
 
-int64 imageCacheSize() {
-	return globalAcquiredSize;
-}
-
 void RemoteImage::doCheckload() const {
 	if (!amLoading() || !_loader->finished()) return;
 
@@ -878,15 +1101,11 @@ void RemoteImage::doCheckload() const {
 		return;
 	}
 
-	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
-	}
-
 	_format = _loader->imageFormat(shrinkBox());
 	_data = data;
 	_saved = _loader->bytes();
 	const_cast<RemoteImage*>(this)->setInformation(_saved.size(), _data.width(), _data.height());
-	globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 
 	invalidateSizeCache();
 
@@ -911,13 +1130,10 @@ void RemoteImage::loadLocal() {
 void RemoteImage::setData(QByteArray &bytes, const QByteArray &bytesFormat) {
 	QBuffer buffer(&bytes);
 
-	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
-	}
 	QByteArray fmt(bytesFormat);
 	_data = App::pixmapFromImageInPlace(App::readImage(bytes, &fmt, false));
+	Images::Cache().acquired(this, kDataCacheKey, _data);
 	if (!_data.isNull()) {
-		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
 		setInformation(bytes.size(), _data.width(), _data.height());
 	}
 
@@ -947,6 +1163,7 @@ void RemoteImage::automaticLoad(const HistoryItem *item) {
 
 		if (_loader) {
 			if (loadFromCloud) _loader->permitLoadFromCloud();
+			if (_loader->paused()) _loader->start();
 		} else {
 			_loader = createLoader(loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
 			if (_loader) _loader->start();
@@ -975,10 +1192,19 @@ void RemoteImage::loadEvenCancelled(bool loadFirst, bool prior) {
 	return load(loadFirst, prior);
 }
 
-RemoteImage::~RemoteImage() {
-	if (!_data.isNull()) {
-		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
+void RemoteImage::pause() {
+	if (amLoading()) {
+		_loader->pause();
 	}
+}
+
+void RemoteImage::cancelLocalLoad() {
+	if (amLoading()) {
+		_loader->cancelLocalTask();
+	}
+}
+
+RemoteImage::~RemoteImage() {
 	if (amLoading()) {
 		destroyLoaderDelayed();
 	}
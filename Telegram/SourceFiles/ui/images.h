@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "base/flags.h"
+#include "base/weak_ptr.h"
 
 enum class ImageRoundRadius {
 	None,
@@ -28,7 +29,7 @@ void prepareRound(
 	QRect target = QRect());
 void prepareRound(
 	QImage &image,
-	QImage *cornerMasks,
+	const QImage *cornerMasks,
 	RectParts corners = RectPart::AllCorners,
 	QRect target = QRect());
 void prepareCircle(QImage &image);
@@ -59,10 +60,35 @@ inline constexpr auto is_flag_type(Option) { return true; };
 
 QImage prepare(QImage img, int w, int h, Options options, int outerw, int outerh, const style::color *colored = nullptr);
 
+// The main thread only state that prepare() uses, captured on the main
+// thread to prepare an image with the given options on any other thread.
+struct PrepareContext {
+	std::array<QImage, 4> cornerMasks;
+	QColor background;
+};
+PrepareContext CapturePrepareContext(Options options);
+QImage prepare(QImage img, int w, int h, Options options, int outerw, int outerh, const PrepareContext &context);
+
 inline QPixmap pixmap(QImage img, int w, int h, Options options, int outerw, int outerh, const style::color *colored = nullptr) {
 	return QPixmap::fromImage(prepare(img, w, h, options, outerw, outerh, colored), Qt::ColorOnly);
 }
 
+struct CacheStats {
+	int64 budget = 0;
+	int64 resident = 0;
+	int count = 0;
+	int64 hits = 0;
+	int64 misses = 0;
+	int64 evictions = 0;
+};
+
+// Decoded images and all their prepared (scaled, rounded, blurred) pixmaps
+// share one memory budget, the least recently used are forgotten first.
+void SetCacheBudget(int64 bytes);
+CacheStats GetCacheStats();
+
+class CacheManager;
+
 } // namespace Images
 
 class FileLoader;
@@ -224,7 +250,7 @@ inline bool operator!=(const WebFileLocation &a, const WebFileLocation &b) {
 class DelayedStorageImage;
 
 class HistoryItem;
-class Image {
+class Image : public base::has_weak_ptr {
 public:
 	Image(const QString &file, QByteArray format = QByteArray());
 	Image(const QByteArray &filecontent, QByteArray format = QByteArray());
@@ -281,6 +307,11 @@ public:
 	virtual void loadEvenCancelled(bool loadFirst = false, bool prior = true) {
 	}
 
+	virtual void pause() {
+	}
+	virtual void cancelLocalLoad() {
+	}
+
 	virtual const StorageImageLocation &location() const {
 		return StorageImageLocation::Null;
 	}
@@ -333,8 +364,44 @@ protected:
 	mutable QPixmap _data;
 
 private:
+	friend class Images::CacheManager;
+
+	struct PrepareRequest {
+		int w = 0;
+		int h = 0;
+		int outerw = -1;
+		int outerh = -1;
+		Images::Options options = 0;
+		int generation = 0;
+
+		inline bool operator==(const PrepareRequest &other) const {
+			return (w == other.w)
+				&& (h == other.h)
+				&& (outerw == other.outerw)
+				&& (outerh == other.outerh)
+				&& (options == other.options)
+				&& (generation == other.generation);
+		}
+		inline bool operator!=(const PrepareRequest &other) const {
+			return !(*this == other);
+		}
+	};
+
+	// Called by the cache manager. Dropping the decoded image keeps the
+	// prepared pixmaps, it is decoded again from _saved when needed.
+	void forgetCached(uint64 key) const;
+	void forgetData() const;
+
+	// Returns the final pixmap for small or circled / colored images,
+	// for the large ones returns a fast unsmoothed placeholder and
+	// schedules the full preparation on a background thread.
+	QPixmap pixPrepare(uint64 key, int w, int h, Images::Options options, int outerw = -1, int outerh = -1, const style::color *colored = nullptr) const;
+	void pixPrepared(uint64 key, const PrepareRequest &request, QImage result) const;
+
 	using Sizes = QMap<uint64, QPixmap>;
 	mutable Sizes _sizesCache;
+	mutable base::flat_map<uint64, PrepareRequest> _preparing;
+	mutable int _prepareGeneration = 0;
 
 };
 
@@ -378,6 +445,8 @@ public:
 
 	void load(bool loadFirst = false, bool prior = true);
 	void loadEvenCancelled(bool loadFirst = false, bool prior = true);
+	void pause();
+	void cancelLocalLoad();
 
 	~RemoteImage();
 
@@ -596,7 +665,6 @@ inline QSize shrinkToKeepAspect(int32 width, int32 height, int32 towidth, int32
 
 void clearStorageImages();
 void clearAllImages();
-int64 imageCacheSize();
 
 class PsFileBookmark;
 class ReadAccessEnabler {
@@ -188,13 +188,13 @@ public:
 			}
 			lastSkipped = false;
 			if (emoji) {
-				_t->_blocks.push_back(std::make_unique<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
+				_t->_blocks.push_back(TextBlockHolder::Create<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
 				emoji = 0;
 				lastSkipped = true;
 			} else if (newline) {
-				_t->_blocks.push_back(std::make_unique<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
+				_t->_blocks.push_back(TextBlockHolder::Create<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
 			} else {
-				_t->_blocks.push_back(std::make_unique<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex));
+				_t->_blocks.push_back(TextBlockHolder::Create<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex));
 			}
 			blockStart += len;
 			blockCreated();
@@ -204,7 +204,7 @@ public:
 	void createSkipBlock(int32 w, int32 h) {
 		createBlock();
 		_t->_text.push_back('_');
-		_t->_blocks.push_back(std::make_unique<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
+		_t->_blocks.push_back(TextBlockHolder::Create<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
 		blockCreated();
 	}
 
@@ -1613,7 +1613,7 @@ private:
 		_elideSavedIndex = blockIndex;
 		auto mutableText = const_cast<Text*>(_t);
 		_elideSavedBlock = std::move(mutableText->_blocks[blockIndex]);
-		mutableText->_blocks[blockIndex] = std::make_unique<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, _elideSavedBlock->flags(), _elideSavedBlock->lnkIndex());
+		mutableText->_blocks[blockIndex] = TextBlockHolder::Create<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, (*_elideSavedBlock)->flags(), (*_elideSavedBlock)->lnkIndex());
 		_blocksSize = blockIndex + 1;
 		_endBlock = (blockIndex + 1 < _t->_blocks.size() ? _t->_blocks[blockIndex + 1].get() : nullptr);
 	}
@@ -1738,7 +1738,8 @@ private:
 
 	void restoreAfterElided() {
 		if (_elideSavedBlock) {
-			const_cast<Text*>(_t)->_blocks[_elideSavedIndex] = std::move(_elideSavedBlock);
+			const_cast<Text*>(_t)->_blocks[_elideSavedIndex] = std::move(
+				*base::take(_elideSavedBlock));
 		}
 	}
 
@@ -2427,7 +2428,7 @@ private:
 	// elided hack support
 	int _blocksSize = 0;
 	int _elideSavedIndex = 0;
-	std::unique_ptr<ITextBlock> _elideSavedBlock;
+	base::optional<TextBlockHolder> _elideSavedBlock;
 
 	int _lineStart = 0;
 	int _localFrom = 0;
@@ -2474,12 +2475,9 @@ Text::Text(const Text &other)
 , _minHeight(other._minHeight)
 , _text(other._text)
 , _st(other._st)
+, _blocks(other._blocks)
 , _links(other._links)
 , _startDir(other._startDir) {
-	_blocks.reserve(other._blocks.size());
-	for (auto &block : other._blocks) {
-		_blocks.push_back(block->clone());
-	}
 }
 
 Text::Text(Text &&other)
@@ -2500,12 +2498,9 @@ Text &Text::operator=(const Text &other) {
 	_minHeight = other._minHeight;
 	_text = other._text;
 	_st = other._st;
-	_blocks = TextBlocks(other._blocks.size());
+	_blocks = other._blocks;
 	_links = other._links;
 	_startDir = other._startDir;
-	for (int32 i = 0, l = _blocks.size(); i < l; ++i) {
-		_blocks[i] = other._blocks.at(i)->clone();
-	}
 	return *this;
 }
 
@@ -2740,7 +2735,7 @@ bool Text::updateSkipBlock(int width, int height) {
 		_blocks.pop_back();
 	}
 	_text.push_back('_');
-	_blocks.push_back(std::make_unique<SkipBlock>(
+	_blocks.push_back(TextBlockHolder::Create<SkipBlock>(
 		_st->font,
 		_text,
 		_text.size() - 1,
@@ -2761,6 +2756,16 @@ bool Text::removeSkipBlock() {
 	return true;
 }
 
+int Text::skipBlockWidth() const {
+	return hasSkipBlock() ? _blocks.back()->width() : 0;
+}
+
+int Text::skipBlockHeight() const {
+	return hasSkipBlock()
+		? static_cast<const SkipBlock*>(_blocks.back().get())->height()
+		: 0;
+}
+
 int Text::countWidth(int width) const {
 	if (QFixed(width) >= _maxWidth) {
 		return _maxWidth.ceil().toInt();
@@ -3105,6 +3110,21 @@ QString Text::originalText(TextSelection selection, ExpandLinksMode mode) const
 	return result;
 }
 
+int Text::countMemoryUsage() const {
+	auto result = int(sizeof(QChar)) * _text.capacity()
+		+ int(sizeof(TextBlocks::value_type)) * int(_blocks.capacity())
+		+ int(sizeof(TextLinks::value_type)) * _links.capacity();
+	for (const auto &block : _blocks) {
+		if (block->type() == TextBlockTText) {
+			const auto text = static_cast<const TextBlock*>(block.get());
+			if (text->_words.isDetached()) {
+				result += int(sizeof(TextWord)) * text->_words.capacity();
+			}
+		}
+	}
+	return result;
+}
+
 void Text::clear() {
 	clearFields();
 	_text.clear();
@@ -69,6 +69,7 @@ typedef QPair<QString, QString> TextCustomTag; // open str and close str
 typedef QMap<QChar, TextCustomTag> TextCustomTagsMap;
 
 class ITextBlock;
+class TextBlockHolder;
 class Text {
 public:
 	Text(int32 minResizeWidth = QFIXED_MAX);
@@ -91,6 +92,8 @@ public:
 	bool hasSkipBlock() const;
 	bool updateSkipBlock(int width, int height);
 	bool removeSkipBlock();
+	int skipBlockWidth() const;
+	int skipBlockHeight() const;
 
 	int32 maxWidth() const {
 		return _maxWidth.ceil().toInt();
@@ -187,11 +190,15 @@ public:
 		return true;
 	}
 
+	// Approximate size of the parsed text in memory. Words shared with
+	// the parsed blocks cache are not counted.
+	int countMemoryUsage() const;
+
 	void clear();
 	~Text();
 
 private:
-	using TextBlocks = std::vector<std::unique_ptr<ITextBlock>>;
+	using TextBlocks = std::vector<TextBlockHolder>;
 	using TextLinks = QVector<ClickHandlerPtr>;
 
 	uint16 countBlockEnd(const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) const;
@@ -121,6 +121,104 @@ struct LineBreakHelper
 
 //const QFixed LineBreakHelper::RightBearingNotCalculated = QFixed(1);
 
+// Same words (names, dates, common phrases) are shaped again and again
+// in many messages and rows, so parsed blocks are cached by their text.
+constexpr auto kBlockCacheMaxLength = 256;
+constexpr auto kBlockCacheMaxSize = int64(4 * 1024 * 1024);
+
+class BlockCache {
+public:
+	struct Key {
+		style::FontData *font = nullptr;
+		QFixed minResizeWidth = 0;
+		bool link = false; // don't break after / in links
+		QString text;
+
+		inline bool operator==(const Key &other) const {
+			return (font == other.font)
+				&& (minResizeWidth == other.minResizeWidth)
+				&& (link == other.link)
+				&& (text == other.text);
+		}
+	};
+	struct Value {
+		QVector<TextWord> words; // with from() relative to the block
+		QFixed width = 0;
+		QFixed rpadding = 0;
+	};
+
+	bool find(const Key &key, Value &value);
+	void store(const Key &key, const Value &value);
+	TextBlockCacheStats stats() const;
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key &value) const {
+			return qHash(value.text)
+				^ std::hash<style::FontData*>()(value.font)
+				^ std::hash<int>()(value.minResizeWidth.value())
+				^ (value.link ? 1 : 0);
+		}
+	};
+	struct Entry {
+		Key key;
+		Value value;
+		int64 size = 0;
+	};
+	using List = std::list<Entry>;
+
+	mutable QMutex _mutex;
+	List _list; // the most recently used first
+	std::unordered_map<Key, List::iterator, KeyHash> _entries;
+	TextBlockCacheStats _stats;
+
+};
+
+bool BlockCache::find(const Key &key, Value &value) {
+	QMutexLocker lock(&_mutex);
+	const auto i = _entries.find(key);
+	if (i == _entries.end()) {
+		++_stats.misses;
+		return false;
+	}
+	_list.splice(_list.begin(), _list, i->second);
+	value = i->second->value;
+	++_stats.hits;
+	return true;
+}
+
+void BlockCache::store(const Key &key, const Value &value) {
+	const auto size = int64(sizeof(Entry))
+		+ key.text.size() * sizeof(QChar)
+		+ value.words.size() * sizeof(TextWord);
+
+	QMutexLocker lock(&_mutex);
+	if (_entries.find(key) != _entries.end()) {
+		return;
+	}
+	_list.push_front(Entry{ key, value, size });
+	_entries.emplace(key, _list.begin());
+	_stats.size += size;
+	++_stats.count;
+	while (_stats.size > kBlockCacheMaxSize) {
+		const auto &entry = _list.back();
+		_stats.size -= entry.size;
+		--_stats.count;
+		_entries.erase(entry.key);
+		_list.pop_back();
+	}
+}
+
+TextBlockCacheStats BlockCache::stats() const {
+	QMutexLocker lock(&_mutex);
+	return _stats;
+}
+
+BlockCache &Cache() {
+	static BlockCache result;
+	return result;
+}
+
 static inline void addNextCluster(int &pos, int end, ScriptLine &line, int &glyphCount,
 	const QScriptItem &current, const unsigned short *logClusters,
 	const QGlyphLayout &glyphs)
@@ -326,6 +424,16 @@ TextBlock::TextBlock(const style::font &font, const QString &str, QFixed minResi
 		}
 
 		const auto part = str.mid(_from, length);
+		const auto cacheable = (length <= kBlockCacheMaxLength);
+		auto key = BlockCache::Key();
+		if (cacheable) {
+			key = { blockFont.v(), minResizeWidth, (lnkIndex > 0), part };
+			auto cached = BlockCache::Value();
+			if (Cache().find(key, cached)) {
+				applyCached(cached.words, cached.width, cached.rpadding);
+				return;
+			}
+		}
 
 		// Attempt to catch a crash in text processing
 		CrashReports::SetAnnotationRef("CrashString", &part);
@@ -334,9 +442,45 @@ TextBlock::TextBlock(const style::font &font, const QString &str, QFixed minResi
 		BlockParser parser(&engine, this, minResizeWidth, _from, part);
 
 		CrashReports::ClearAnnotationRef("CrashString");
+
+		if (cacheable) {
+			auto words = _words;
+			if (_from) {
+				for (auto &word : words) {
+					word = TextWord(
+						word.from() - _from,
+						word.f_width(),
+						word.f_rbearing(),
+						word.f_rpadding());
+				}
+			}
+			Cache().store(key, { words, _width, _rpadding });
+		}
 	}
 }
 
+void TextBlock::applyCached(
+		const QVector<TextWord> &words,
+		QFixed width,
+		QFixed rpadding) {
+	_words = words;
+	if (_from) {
+		for (auto &word : _words) {
+			word = TextWord(
+				word.from() + _from,
+				word.f_width(),
+				word.f_rbearing(),
+				word.f_rpadding());
+		}
+	}
+	_width = width;
+	_rpadding = rpadding;
+}
+
+TextBlockCacheStats GetTextBlockCacheStats() {
+	return Cache().stats();
+}
+
 EmojiBlock::EmojiBlock(const style::font &font, const QString &str, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, EmojiPtr emoji) : ITextBlock(font, str, from, length, flags, lnkIndex)
 , emoji(emoji) {
 	_flags |= ((TextBlockTEmoji & 0x0F) << 8);
@@ -357,3 +501,83 @@ SkipBlock::SkipBlock(const style::font &font, const QString &str, uint16 from, i
 	_flags |= ((TextBlockTSkip & 0x0F) << 8);
 	_width = w;
 }
+
+TextBlockHolder::TextBlockHolder(const TextBlockHolder &other) {
+	copyFrom(other);
+}
+
+TextBlockHolder::TextBlockHolder(TextBlockHolder &&other) noexcept {
+	moveFrom(std::move(other));
+}
+
+TextBlockHolder &TextBlockHolder::operator=(const TextBlockHolder &other) {
+	if (this != &other) {
+		destroy();
+		copyFrom(other);
+	}
+	return *this;
+}
+
+TextBlockHolder &TextBlockHolder::operator=(
+		TextBlockHolder &&other) noexcept {
+	if (this != &other) {
+		destroy();
+		moveFrom(std::move(other));
+	}
+	return *this;
+}
+
+TextBlockHolder::~TextBlockHolder() {
+	destroy();
+}
+
+void TextBlockHolder::copyFrom(const TextBlockHolder &other) {
+	switch (other._type) {
+	case TextBlockTEmpty: break;
+	case TextBlockTNewline:
+		new (&_data) NewlineBlock(other.unsafe<NewlineBlock>());
+		break;
+	case TextBlockTText:
+		new (&_data) TextBlock(other.unsafe<TextBlock>());
+		break;
+	case TextBlockTEmoji:
+		new (&_data) EmojiBlock(other.unsafe<EmojiBlock>());
+		break;
+	case TextBlockTSkip:
+		new (&_data) SkipBlock(other.unsafe<SkipBlock>());
+		break;
+	default: Unexpected("Type in TextBlockHolder::copyFrom.");
+	}
+	_type = other._type;
+}
+
+void TextBlockHolder::moveFrom(TextBlockHolder &&other) {
+	switch (other._type) {
+	case TextBlockTEmpty: break;
+	case TextBlockTNewline:
+		new (&_data) NewlineBlock(std::move(other.unsafe<NewlineBlock>()));
+		break;
+	case TextBlockTText:
+		new (&_data) TextBlock(std::move(other.unsafe<TextBlock>()));
+		break;
+	case TextBlockTEmoji:
+		new (&_data) EmojiBlock(std::move(other.unsafe<EmojiBlock>()));
+		break;
+	case TextBlockTSkip:
+		new (&_data) SkipBlock(std::move(other.unsafe<SkipBlock>()));
+		break;
+	default: Unexpected("Type in TextBlockHolder::moveFrom.");
+	}
+	_type = other._type;
+}
+
+void TextBlockHolder::destroy() {
+	switch (base::take(_type)) {
+	case TextBlockTEmpty: break;
+	case TextBlockTNewline: unsafe<NewlineBlock>().~NewlineBlock(); break;
+	case TextBlockTText: unsafe<TextBlock>().~TextBlock(); break;
+	case TextBlockTEmoji: unsafe<EmojiBlock>().~EmojiBlock(); break;
+	case TextBlockTSkip: unsafe<SkipBlock>().~SkipBlock(); break;
+	default: Unexpected("Type in TextBlockHolder::destroy.");
+	}
+}
@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "private/qfontengine_p.h"
 
 enum TextBlockType {
+	TextBlockTEmpty = 0x00, // Only in a TextBlockHolder without a block.
 	TextBlockTNewline = 0x01,
 	TextBlockTText = 0x02,
 	TextBlockTEmoji = 0x03,
@@ -64,10 +65,6 @@ public:
 		return (_flags & 0xFF);
 	}
 
-	virtual std::unique_ptr<ITextBlock> clone() const = 0;
-	virtual ~ITextBlock() {
-	}
-
 protected:
 	uint16 _from = 0;
 
@@ -94,10 +91,6 @@ public:
 		return _nextDir;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<NewlineBlock>(*this);
-	}
-
 private:
 	Qt::LayoutDirection _nextDir;
 
@@ -144,11 +137,12 @@ class TextBlock : public ITextBlock {
 public:
 	TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex);
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<TextBlock>(*this);
-	}
-
 private:
+	void applyCached(
+		const QVector<TextWord> &words,
+		QFixed width,
+		QFixed rpadding);
+
 	friend class ITextBlock;
 	QFixed real_f_rbearing() const {
 		return _words.isEmpty() ? 0 : _words.back().f_rbearing();
@@ -169,10 +163,6 @@ class EmojiBlock : public ITextBlock {
 public:
 	EmojiBlock(const style::font &font, const QString &str, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, EmojiPtr emoji);
 
-	std::unique_ptr<ITextBlock> clone() const {
-		return std::make_unique<EmojiBlock>(*this);
-	}
-
 private:
 	EmojiPtr emoji = nullptr;
 
@@ -191,10 +181,6 @@ public:
 		return _height;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<SkipBlock>(*this);
-	}
-
 private:
 	int32 _height;
 
@@ -204,3 +190,62 @@ private:
 	friend class TextPainter;
 
 };
+
+// Any of the blocks stored inline, so that all the blocks of a Text are
+// allocated at once in a single array and not one by one.
+class TextBlockHolder {
+public:
+	template <typename FinalBlock, typename ...Args>
+	static TextBlockHolder Create(Args &&...args) {
+		auto result = TextBlockHolder();
+		new (&result._data) FinalBlock(std::forward<Args>(args)...);
+		result._type = result->type();
+		return result;
+	}
+
+	TextBlockHolder(const TextBlockHolder &other);
+	TextBlockHolder(TextBlockHolder &&other) noexcept;
+	TextBlockHolder &operator=(const TextBlockHolder &other);
+	TextBlockHolder &operator=(TextBlockHolder &&other) noexcept;
+	~TextBlockHolder();
+
+	// Like with a pointer, the block can be modified through a const holder.
+	ITextBlock *get() const {
+		return reinterpret_cast<ITextBlock*>(&_data);
+	}
+	ITextBlock *operator->() const {
+		return get();
+	}
+
+private:
+	TextBlockHolder() = default;
+
+	template <typename FinalBlock>
+	FinalBlock &unsafe() const {
+		return *reinterpret_cast<FinalBlock*>(&_data);
+	}
+
+	void copyFrom(const TextBlockHolder &other);
+	void moveFrom(TextBlockHolder &&other);
+	void destroy();
+
+	mutable std::aligned_union_t<
+		1,
+		NewlineBlock,
+		TextBlock,
+		EmojiBlock,
+		SkipBlock> _data;
+	TextBlockType _type = TextBlockTEmpty;
+
+};
+
+struct TextBlockCacheStats {
+	int64 hits = 0;
+	int64 misses = 0;
+	int count = 0;
+	int64 size = 0;
+};
+
+// Parsed text blocks are shared between all Text objects by their text,
+// font and flags, those counters show how well that works.
+TextBlockCacheStats GetTextBlockCacheStats();
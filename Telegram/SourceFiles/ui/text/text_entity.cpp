@@ -7,51 +7,13 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "ui/text/text_entity.h"
 
+#include "ui/text/text_entity_scanner.h"
 #include "auth_session.h"
 #include "lang/lang_tag.h"
 
 namespace TextUtilities {
 namespace {
 
-QString ExpressionDomain() {
-	// Matches any domain name, containing at least one '.', including "file.txt".
-	return QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])(?:([a-zA-Z]+)://)?((?:[A-Za-z" "\xD0\x90-\xD0\xAF\xD0\x81" "\xD0\xB0-\xD1\x8F\xD1\x91" "0-9\\-\\_]+\\.){1,10}([A-Za-z" "\xD1\x80\xD1\x84" "\\-\\d]{2,22})(\\:\\d+)?)");
-}
-
-QString ExpressionDomainExplicit() {
-	// Matches any domain name, containing a protocol, including "test://localhost".
-	return QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])(?:([a-zA-Z]+)://)((?:[A-Za-z" "\xD0\x90-\xD0\xAF\xD0\x81" "\xD0\xB0-\xD1\x8F\xD1\x91" "0-9\\-\\_]+\\.){0,10}([A-Za-z" "\xD1\x80\xD1\x84" "\\-\\d]{2,22})(\\:\\d+)?)");
-}
-
-QString ExpressionMailNameAtEnd() {
-	// Matches e-mail first part (before '@') at the end of the string.
-	// First we find a domain without protocol (like "gmail.com"), then
-	// we find '@' before it and then we look for the name before '@'.
-	return qsl("[a-zA-Z\\-_\\.0-9]{1,256}$");
-}
-
-QString ExpressionSeparators(const QString &additional) {
-	// UTF8 quotes and ellipsis
-	const auto quotes = QString::fromUtf8("\xC2\xAB\xC2\xBB\xE2\x80\x9C\xE2\x80\x9D\xE2\x80\x98\xE2\x80\x99\xE2\x80\xA6");
-	return qsl("\\s\\.,:;<>|'\"\\[\\]\\{\\}\\~\\!\\?\\%\\^\\(\\)\\-\\+=\\x10") + quotes + additional;
-}
-
-QString ExpressionHashtag() {
-	return qsl("(^|[") + ExpressionSeparators(qsl("`\\*/")) + qsl("])#[\\w]{2,64}([\\W]|$)");
-}
-
-QString ExpressionHashtagExclude() {
-	return qsl("^#?\\d+$");
-}
-
-QString ExpressionMention() {
-	return qsl("(^|[") + ExpressionSeparators(qsl("`\\*/")) + qsl("])@[A-Za-z_0-9]{1,32}([\\W]|$)");
-}
-
-QString ExpressionBotCommand() {
-	return qsl("(^|[") + ExpressionSeparators(qsl("`\\*")) + qsl("])/[A-Za-z_0-9]{1,64}(@[A-Za-z_0-9]{5,32})?([\\W]|$)");
-}
-
 QString ExpressionMarkdownBold() {
 	auto separators = ExpressionSeparators(qsl("`/"));
 	return qsl("(^|[") + separators + qsl("])(\\*\\*)[\\s\\S]+?(\\*\\*)([") + separators + qsl("]|$)");
@@ -1821,6 +1783,7 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 	int32 len = result.text.size(), commandOffset = rich ? 0 : len;
 	bool inLink = false, commandIsLink = false;
 	const QChar *start = result.text.constData(), *end = start + result.text.size();
+	auto scanner = EntityScanner(result.text);
 	for (int32 offset = 0, matchOffset = offset, mentionSkip = 0; offset < len;) {
 		if (commandOffset <= offset) {
 			for (commandOffset = offset; commandOffset < len; ++commandOffset) {
@@ -1831,54 +1794,54 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				}
 			}
 		}
-		auto mDomain = RegExpDomain().match(result.text, matchOffset);
-		auto mExplicitDomain = RegExpDomainExplicit().match(result.text, matchOffset);
-		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
-		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
-		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mDomain = scanner.domain(matchOffset);
+		const auto mExplicitDomain = scanner.explicitDomain(matchOffset);
+		const auto mHashtag = withHashtags ? scanner.hashtag(matchOffset) : TagMatch();
+		auto mMention = withMentions ? scanner.mention(qMax(mentionSkip, matchOffset)) : TagMatch();
+		const auto mBotCommand = withBotCommands ? scanner.botCommand(matchOffset) : TagMatch();
 
 		EntityInTextType lnkType = EntityInTextUrl;
 		int32 lnkStart = 0, lnkLength = 0;
-		auto domainStart = mDomain.hasMatch() ? mDomain.capturedStart() : kNotFound,
-			domainEnd = mDomain.hasMatch() ? mDomain.capturedEnd() : kNotFound,
-			explicitDomainStart = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedStart() : kNotFound,
-			explicitDomainEnd = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedEnd() : kNotFound,
-			hashtagStart = mHashtag.hasMatch() ? mHashtag.capturedStart() : kNotFound,
-			hashtagEnd = mHashtag.hasMatch() ? mHashtag.capturedEnd() : kNotFound,
-			mentionStart = mMention.hasMatch() ? mMention.capturedStart() : kNotFound,
-			mentionEnd = mMention.hasMatch() ? mMention.capturedEnd() : kNotFound,
-			botCommandStart = mBotCommand.hasMatch() ? mBotCommand.capturedStart() : kNotFound,
-			botCommandEnd = mBotCommand.hasMatch() ? mBotCommand.capturedEnd() : kNotFound;
+		auto domainStart = mDomain ? mDomain.start : kNotFound,
+			domainEnd = mDomain ? mDomain.end : kNotFound,
+			explicitDomainStart = mExplicitDomain ? mExplicitDomain.start : kNotFound,
+			explicitDomainEnd = mExplicitDomain ? mExplicitDomain.end : kNotFound,
+			hashtagStart = mHashtag ? mHashtag.start : kNotFound,
+			hashtagEnd = mHashtag ? mHashtag.end : kNotFound,
+			mentionStart = mMention ? mMention.start : kNotFound,
+			mentionEnd = mMention ? mMention.end : kNotFound,
+			botCommandStart = mBotCommand ? mBotCommand.start : kNotFound,
+			botCommandEnd = mBotCommand ? mBotCommand.end : kNotFound;
 		auto hashtagIgnore = false;
 		auto mentionIgnore = false;
 
-		if (mHashtag.hasMatch()) {
-			if (!mHashtag.capturedRef(1).isEmpty()) {
+		if (mHashtag) {
+			if (mHashtag.separatorBefore) {
 				++hashtagStart;
 			}
-			if (!mHashtag.capturedRef(2).isEmpty()) {
+			if (mHashtag.separatorAfter) {
 				--hashtagEnd;
 			}
-			if (RegExpHashtagExclude().match(
-				result.text.mid(
+			if (IsHashtagExcluded(
+					result.text,
 					hashtagStart + 1,
-					hashtagEnd - hashtagStart - 1)).hasMatch()) {
+					hashtagEnd)) {
 				hashtagIgnore = true;
 			}
 		}
-		while (mMention.hasMatch()) {
-			if (!mMention.capturedRef(1).isEmpty()) {
+		while (mMention) {
+			if (mMention.separatorBefore) {
 				++mentionStart;
 			}
-			if (!mMention.capturedRef(2).isEmpty()) {
+			if (mMention.separatorAfter) {
 				--mentionEnd;
 			}
 			if (!(start + mentionStart + 1)->isLetter() || !(start + mentionEnd - 1)->isLetterOrNumber()) {
 				mentionSkip = mentionEnd;
-				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
-				if (mMention.hasMatch()) {
-					mentionStart = mMention.capturedStart();
-					mentionEnd = mMention.capturedEnd();
+				mMention = scanner.mention(qMax(mentionSkip, matchOffset));
+				if (mMention) {
+					mentionStart = mMention.start;
+					mentionEnd = mMention.end;
 				} else {
 					mentionIgnore = true;
 				}
@@ -1886,19 +1849,19 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				break;
 			}
 		}
-		if (mBotCommand.hasMatch()) {
-			if (!mBotCommand.capturedRef(1).isEmpty()) {
+		if (mBotCommand) {
+			if (mBotCommand.separatorBefore) {
 				++botCommandStart;
 			}
-			if (!mBotCommand.capturedRef(3).isEmpty()) {
+			if (mBotCommand.separatorAfter) {
 				--botCommandEnd;
 			}
 		}
-		if (!mDomain.hasMatch()
-			&& !mExplicitDomain.hasMatch()
-			&& !mHashtag.hasMatch()
-			&& !mMention.hasMatch()
-			&& !mBotCommand.hasMatch()) {
+		if (!mDomain
+			&& !mExplicitDomain
+			&& !mHashtag
+			&& !mMention
+			&& !mBotCommand) {
 			break;
 		}
 
@@ -1979,19 +1942,23 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				continue;
 			}
 
-			auto protocol = mDomain.captured(1).toLower();
-			auto topDomain = mDomain.captured(3).toLower();
+			auto protocol = (mDomain.protocolStart >= 0)
+				? result.text.mid(
+					mDomain.protocolStart,
+					mDomain.protocolEnd - mDomain.protocolStart).toLower()
+				: QString();
+			auto topDomain = result.text.mid(
+				mDomain.topDomainStart,
+				mDomain.topDomainEnd - mDomain.topDomainStart).toLower();
 			auto isProtocolValid = protocol.isEmpty() || IsValidProtocol(protocol);
 			auto isTopDomainValid = !protocol.isEmpty() || IsValidTopDomain(topDomain);
 
 			if (protocol.isEmpty() && domainStart > offset + 1 && *(start + domainStart - 1) == QChar('@')) {
-				auto forMailName = result.text.mid(offset, domainStart - offset - 1);
-				auto mMailName = RegExpMailNameAtEnd().match(forMailName);
-				if (mMailName.hasMatch()) {
-					auto mailStart = offset + mMailName.capturedStart();
-					if (mailStart < offset) {
-						mailStart = offset;
-					}
+				auto mailStart = FindMailNameAtEnd(
+					result.text,
+					offset,
+					domainStart - 1);
+				if (mailStart >= 0) {
 					lnkType = EntityInTextEmail;
 					lnkStart = mailStart;
 					lnkLength = domainEnd - mailStart;
@@ -2005,7 +1972,7 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				lnkStart = domainStart;
 
 				QStack<const QChar*> parenth;
-				const QChar *domainEnd = start + mDomain.capturedEnd(), *p = domainEnd;
+				const QChar *domainEnd = start + mDomain.end, *p = domainEnd;
 				for (; p < end; ++p) {
 					QChar ch(*p);
 					if (chIsLinkEnd(ch)) break; // link finished
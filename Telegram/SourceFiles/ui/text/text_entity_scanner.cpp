@@ -0,0 +1,519 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "ui/text/text_entity_scanner.h"
+
+namespace TextUtilities {
+namespace {
+
+constexpr auto kMaxDomainLabels = 10;
+constexpr auto kMinTopDomainLength = 2;
+constexpr auto kMaxTopDomainLength = 22;
+constexpr auto kMaxMailNameLength = 256;
+constexpr auto kMinHashtagLength = 2;
+constexpr auto kMaxHashtagLength = 64;
+constexpr auto kMaxMentionLength = 32;
+constexpr auto kMaxBotCommandLength = 64;
+constexpr auto kMinBotUsernameLength = 5;
+constexpr auto kMaxBotUsernameLength = 32;
+
+// The regular expressions are matched by code points, not by QChars.
+struct Symbol {
+	uint code = 0;
+	int length = 0;
+};
+
+Symbol SymbolAt(const QChar *text, int size, int position) {
+	const auto ch = text[position];
+	if (ch.isHighSurrogate()
+		&& position + 1 < size
+		&& text[position + 1].isLowSurrogate()) {
+		return { QChar::surrogateToUcs4(ch, text[position + 1]), 2 };
+	}
+	return { ch.unicode(), 1 };
+}
+
+Symbol SymbolBefore(const QChar *text, int position) {
+	const auto ch = text[position - 1];
+	if (ch.isLowSurrogate()
+		&& position > 1
+		&& text[position - 2].isHighSurrogate()) {
+		return { QChar::surrogateToUcs4(text[position - 2], ch), 2 };
+	}
+	return { ch.unicode(), 1 };
+}
+
+// [\w] with QRegularExpression::UseUnicodePropertiesOption.
+bool IsWord(uint code) {
+	return (code == '_') || QChar::isLetterOrNumber(code);
+}
+
+// [\s] with QRegularExpression::UseUnicodePropertiesOption.
+bool IsSpace(uint code) {
+	return QChar::isSpace(code) || (code == 0x180E);
+}
+
+// [\d] with QRegularExpression::UseUnicodePropertiesOption.
+bool IsDigit(uint code) {
+	return QChar::isDigit(code);
+}
+
+bool IsAsciiLetter(uint code) {
+	return (code >= 'a' && code <= 'z') || (code >= 'A' && code <= 'Z');
+}
+
+bool IsAsciiDigit(uint code) {
+	return (code >= '0' && code <= '9');
+}
+
+// [A-Za-z_0-9]
+bool IsAsciiWord(uint code) {
+	return IsAsciiLetter(code) || IsAsciiDigit(code) || (code == '_');
+}
+
+// [a-zA-Z\-_\.0-9]
+bool IsMailNameSymbol(uint code) {
+	return IsAsciiWord(code) || (code == '-') || (code == '.');
+}
+
+// [A-Za-zА-ЯЁа-яё0-9\-\_]
+bool IsDomainLabelSymbol(uint code) {
+	return IsAsciiWord(code)
+		|| (code == '-')
+		|| (code >= 0x410 && code <= 0x44F)
+		|| (code == 0x401)
+		|| (code == 0x451);
+}
+
+// [A-Za-zрф\-\d]
+bool IsTopDomainSymbol(uint code) {
+	return IsAsciiLetter(code)
+		|| (code == '-')
+		|| (code == 0x440)
+		|| (code == 0x444)
+		|| IsDigit(code);
+}
+
+// [\w\$\-\_%=\.]
+bool IsDomainGlued(uint code) {
+	return IsWord(code)
+		|| (code == '$')
+		|| (code == '-')
+		|| (code == '%')
+		|| (code == '=')
+		|| (code == '.');
+}
+
+// ExpressionSeparators(QString()).
+bool IsSeparator(uint code) {
+	switch (code) {
+	case '.': case ',': case ':': case ';': case '<': case '>':
+	case '|': case '\'': case '"': case '[': case ']': case '{':
+	case '}': case '~': case '!': case '?': case '%': case '^':
+	case '(': case ')': case '-': case '+': case '=': case 0x10:
+	case 0xAB: case 0xBB: case 0x201C: case 0x201D: case 0x2018:
+	case 0x2019: case 0x2026:
+		return true;
+	}
+	return IsSpace(code);
+}
+
+bool IsHashtagSeparator(uint code) {
+	return IsSeparator(code)
+		|| (code == '`')
+		|| (code == '*')
+		|| (code == '/');
+}
+
+bool IsBotCommandSeparator(uint code) {
+	return IsSeparator(code) || (code == '`') || (code == '*');
+}
+
+// Counts (up to 'limit') code points satisfying 'check' from 'position'.
+template <typename Check>
+int CountSymbols(
+		const QChar *text,
+		int size,
+		int &position,
+		int limit,
+		Check check) {
+	auto result = 0;
+	while (result < limit && position < size) {
+		const auto symbol = SymbolAt(text, size, position);
+		if (!check(symbol.code)) {
+			break;
+		}
+		position += symbol.length;
+		++result;
+	}
+	return result;
+}
+
+// Matches "([\W]|$)" at 'position', fills 'match' on success.
+bool MatchTagEnd(
+		const QChar *text,
+		int size,
+		int position,
+		TagMatch &match) {
+	if (position == size) {
+		match.end = position;
+		match.separatorAfter = false;
+		return true;
+	}
+	const auto symbol = SymbolAt(text, size, position);
+	if (IsWord(symbol.code)) {
+		return false;
+	}
+	match.end = position + symbol.length;
+	match.separatorAfter = true;
+	return true;
+}
+
+// "#[\w]{2,64}([\W]|$)" after the '#'.
+bool MatchHashtagBody(
+		const QChar *text,
+		int size,
+		int position,
+		TagMatch &match) {
+	const auto length = CountSymbols(
+		text,
+		size,
+		position,
+		kMaxHashtagLength + 1,
+		IsWord);
+	return (length >= kMinHashtagLength)
+		&& (length <= kMaxHashtagLength)
+		&& MatchTagEnd(text, size, position, match);
+}
+
+// "@[A-Za-z_0-9]{1,32}([\W]|$)" after the '@'.
+bool MatchMentionBody(
+		const QChar *text,
+		int size,
+		int position,
+		TagMatch &match) {
+	const auto length = CountSymbols(
+		text,
+		size,
+		position,
+		kMaxMentionLength + 1,
+		IsAsciiWord);
+	return (length >= 1)
+		&& (length <= kMaxMentionLength)
+		&& MatchTagEnd(text, size, position, match);
+}
+
+// "/[A-Za-z_0-9]{1,64}(@[A-Za-z_0-9]{5,32})?([\W]|$)" after the '/'.
+bool MatchBotCommandBody(
+		const QChar *text,
+		int size,
+		int position,
+		TagMatch &match) {
+	const auto length = CountSymbols(
+		text,
+		size,
+		position,
+		kMaxBotCommandLength + 1,
+		IsAsciiWord);
+	if (length < 1 || length > kMaxBotCommandLength) {
+		return false;
+	}
+	if (position < size && text[position].unicode() == '@') {
+		auto username = position + 1;
+		const auto usernameLength = CountSymbols(
+			text,
+			size,
+			username,
+			kMaxBotUsernameLength + 1,
+			IsAsciiWord);
+		if (usernameLength >= kMinBotUsernameLength
+			&& usernameLength <= kMaxBotUsernameLength
+			&& MatchTagEnd(text, size, username, match)) {
+			return true;
+		}
+	}
+	return MatchTagEnd(text, size, position, match);
+}
+
+// Searches for "(^|[separators])<symbol><body>".
+template <typename IsTagSeparator, typename MatchBody>
+TagMatch FindTag(
+		const QString &string,
+		int from,
+		ushort tag,
+		IsTagSeparator isTagSeparator,
+		MatchBody matchBody) {
+	const auto text = string.constData();
+	const auto size = string.size();
+	auto result = TagMatch();
+	if (from == 0
+		&& size > 0
+		&& text[0].unicode() == tag
+		&& matchBody(text, size, 1, result)) {
+		result.start = 0;
+		result.separatorBefore = false;
+		return result;
+	}
+	for (auto position = from; position < size;) {
+		const auto symbol = SymbolAt(text, size, position);
+		const auto next = position + symbol.length;
+		if (next < size
+			&& text[next].unicode() == tag
+			&& isTagSeparator(symbol.code)
+			&& matchBody(text, size, next + 1, result)) {
+			result.start = position;
+			result.separatorBefore = true;
+			return result;
+		}
+		position = next;
+	}
+	return TagMatch();
+}
+
+// "((?:label\.){min,10}(top)(\:\d+)?)" at 'position'.
+bool MatchDomainName(
+		const QChar *text,
+		int size,
+		int position,
+		int minLabels,
+		DomainMatch &match) {
+	int labelsEnd[kMaxDomainLabels + 1] = { position };
+	auto labels = 0;
+	while (labels < kMaxDomainLabels) {
+		auto end = labelsEnd[labels];
+		const auto length = CountSymbols(
+			text,
+			size,
+			end,
+			size,
+			IsDomainLabelSymbol);
+		if (!length || end == size || text[end].unicode() != '.') {
+			break;
+		}
+		labelsEnd[++labels] = end + 1;
+	}
+	for (; labels >= minLabels; --labels) {
+		const auto topDomainStart = labelsEnd[labels];
+		auto end = topDomainStart;
+		const auto length = CountSymbols(
+			text,
+			size,
+			end,
+			kMaxTopDomainLength,
+			IsTopDomainSymbol);
+		if (length < kMinTopDomainLength) {
+			continue;
+		}
+		match.topDomainStart = topDomainStart;
+		match.topDomainEnd = end;
+		if (end < size && text[end].unicode() == ':') {
+			auto port = end + 1;
+			if (CountSymbols(text, size, port, size, IsDigit)) {
+				end = port;
+			}
+		}
+		match.end = end;
+		return true;
+	}
+	return false;
+}
+
+// RegExpDomain() or RegExpDomainExplicit() at 'position'.
+bool MatchDomain(
+		const QChar *text,
+		int size,
+		int position,
+		bool explicitProtocol,
+		DomainMatch &match) {
+	if (position > 0 && IsDomainGlued(SymbolBefore(text, position).code)) {
+		return false;
+	}
+	auto protocolEnd = position;
+	const auto protocolLength = CountSymbols(
+		text,
+		size,
+		protocolEnd,
+		size,
+		IsAsciiLetter);
+	if (protocolLength > 0
+		&& protocolEnd + 3 <= size
+		&& text[protocolEnd].unicode() == ':'
+		&& text[protocolEnd + 1].unicode() == '/'
+		&& text[protocolEnd + 2].unicode() == '/') {
+		const auto minLabels = explicitProtocol ? 0 : 1;
+		if (MatchDomainName(text, size, protocolEnd + 3, minLabels, match)) {
+			match.start = position;
+			match.protocolStart = position;
+			match.protocolEnd = protocolEnd;
+			return true;
+		}
+	}
+	if (!explicitProtocol && MatchDomainName(text, size, position, 1, match)) {
+		match.start = position;
+		match.protocolStart = match.protocolEnd = -1;
+		return true;
+	}
+	return false;
+}
+
+DomainMatch SearchDomain(
+		const QString &string,
+		int from,
+		bool explicitProtocol) {
+	const auto text = string.constData();
+	const auto size = string.size();
+	auto result = DomainMatch();
+	for (auto position = from; position < size;) {
+		if (MatchDomain(text, size, position, explicitProtocol, result)) {
+			return result;
+		}
+		position += SymbolAt(text, size, position).length;
+	}
+	return DomainMatch();
+}
+
+} // namespace
+
+QString ExpressionDomain() {
+	// Matches any domain name, containing at least one '.', including "file.txt".
+	return QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])(?:([a-zA-Z]+)://)?((?:[A-Za-z" "\xD0\x90-\xD0\xAF\xD0\x81" "\xD0\xB0-\xD1\x8F\xD1\x91" "0-9\\-\\_]+\\.){1,10}([A-Za-z" "\xD1\x80\xD1\x84" "\\-\\d]{2,22})(\\:\\d+)?)");
+}
+
+QString ExpressionDomainExplicit() {
+	// Matches any domain name, containing a protocol, including "test://localhost".
+	return QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])(?:([a-zA-Z]+)://)((?:[A-Za-z" "\xD0\x90-\xD0\xAF\xD0\x81" "\xD0\xB0-\xD1\x8F\xD1\x91" "0-9\\-\\_]+\\.){0,10}([A-Za-z" "\xD1\x80\xD1\x84" "\\-\\d]{2,22})(\\:\\d+)?)");
+}
+
+QString ExpressionMailNameAtEnd() {
+	// Matches e-mail first part (before '@') at the end of the string.
+	// First we find a domain without protocol (like "gmail.com"), then
+	// we find '@' before it and then we look for the name before '@'.
+	return QStringLiteral("[a-zA-Z\\-_\\.0-9]{1,256}$");
+}
+
+QString ExpressionSeparators(const QString &additional) {
+	// UTF8 quotes and ellipsis
+	const auto quotes = QString::fromUtf8("\xC2\xAB\xC2\xBB\xE2\x80\x9C\xE2\x80\x9D\xE2\x80\x98\xE2\x80\x99\xE2\x80\xA6");
+	return QStringLiteral("\\s\\.,:;<>|'\"\\[\\]\\{\\}\\~\\!\\?\\%\\^\\(\\)\\-\\+=\\x10") + quotes + additional;
+}
+
+QString ExpressionHashtag() {
+	return QStringLiteral("(^|[") + ExpressionSeparators(QStringLiteral("`\\*/")) + QStringLiteral("])#[\\w]{2,64}([\\W]|$)");
+}
+
+QString ExpressionHashtagExclude() {
+	return QStringLiteral("^#?\\d+$");
+}
+
+QString ExpressionMention() {
+	return QStringLiteral("(^|[") + ExpressionSeparators(QStringLiteral("`\\*/")) + QStringLiteral("])@[A-Za-z_0-9]{1,32}([\\W]|$)");
+}
+
+QString ExpressionBotCommand() {
+	return QStringLiteral("(^|[") + ExpressionSeparators(QStringLiteral("`\\*")) + QStringLiteral("])/[A-Za-z_0-9]{1,64}(@[A-Za-z_0-9]{5,32})?([\\W]|$)");
+}
+
+DomainMatch FindDomain(const QString &text, int from) {
+	return SearchDomain(text, from, false);
+}
+
+DomainMatch FindDomainExplicit(const QString &text, int from) {
+	return SearchDomain(text, from, true);
+}
+
+TagMatch FindHashtag(const QString &text, int from) {
+	return FindTag(text, from, '#', IsHashtagSeparator, MatchHashtagBody);
+}
+
+TagMatch FindMention(const QString &text, int from) {
+	return FindTag(text, from, '@', IsHashtagSeparator, MatchMentionBody);
+}
+
+TagMatch FindBotCommand(const QString &text, int from) {
+	return FindTag(
+		text,
+		from,
+		'/',
+		IsBotCommandSeparator,
+		MatchBotCommandBody);
+}
+
+int FindMailNameAtEnd(const QString &string, int from, int till) {
+	const auto text = string.constData();
+
+	// '$' matches before the final '\n' as well.
+	auto end = till;
+	if (end > from && text[end - 1].unicode() == '\n') {
+		--end;
+	}
+	auto result = end;
+	while (result > from
+		&& end - result < kMaxMailNameLength
+		&& IsMailNameSymbol(text[result - 1].unicode())) {
+		--result;
+	}
+	return (result < end) ? result : -1;
+}
+
+bool IsHashtagExcluded(const QString &string, int from, int till) {
+	const auto text = string.constData();
+	auto position = from;
+	if (position < till && text[position].unicode() == '#') {
+		++position;
+	}
+	const auto digits = CountSymbols(
+		text,
+		till,
+		position,
+		till,
+		IsDigit);
+	return (digits > 0)
+		&& (position == till
+			|| (position + 1 == till && text[position].unicode() == '\n'));
+}
+
+EntityScanner::EntityScanner(const QString &text) : _text(text) {
+}
+
+template <typename Match>
+const Match &EntityScanner::search(
+		Cached<Match> &cached,
+		int from,
+		Match (*find)(const QString &text, int from)) {
+	// The leftmost match starting after 'from' is the same for any
+	// search position between the previous one and its start.
+	const auto valid = (cached.from >= 0)
+		&& (cached.from <= from)
+		&& (!cached.match || cached.match.start >= from);
+	if (!valid) {
+		cached.match = find(_text, from);
+	}
+	cached.from = from;
+	return cached.match;
+}
+
+const DomainMatch &EntityScanner::domain(int from) {
+	return search(_domain, from, FindDomain);
+}
+
+const DomainMatch &EntityScanner::explicitDomain(int from) {
+	return search(_explicitDomain, from, FindDomainExplicit);
+}
+
+const TagMatch &EntityScanner::hashtag(int from) {
+	return search(_hashtag, from, FindHashtag);
+}
+
+const TagMatch &EntityScanner::mention(int from) {
+	return search(_mention, from, FindMention);
+}
+
+const TagMatch &EntityScanner::botCommand(int from) {
+	return search(_botCommand, from, FindBotCommand);
+}
+
+} // namespace TextUtilities
@@ -0,0 +1,104 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <QtCore/QString>
+
+namespace TextUtilities {
+
+// Patterns of the RegExp*() getters from text_entity.h.
+QString ExpressionDomain();
+QString ExpressionDomainExplicit();
+QString ExpressionMailNameAtEnd();
+QString ExpressionSeparators(const QString &additional);
+QString ExpressionHashtag();
+QString ExpressionHashtagExclude();
+QString ExpressionMention();
+QString ExpressionBotCommand();
+
+// Same as a match of RegExpHashtag(), RegExpMention() or
+// RegExpBotCommand(): it includes the separator before the tag if the
+// tag doesn't start the text and the non-word symbol after the tag
+// if the tag doesn't end the text.
+struct TagMatch {
+	explicit operator bool() const {
+		return (start >= 0);
+	}
+
+	int start = -1;
+	int end = -1;
+	bool separatorBefore = false;
+	bool separatorAfter = false;
+};
+
+// Same as a match of RegExpDomain() or RegExpDomainExplicit(),
+// protocol is empty if it was not found.
+struct DomainMatch {
+	explicit operator bool() const {
+		return (start >= 0);
+	}
+
+	int start = -1;
+	int end = -1;
+	int protocolStart = -1;
+	int protocolEnd = -1;
+	int topDomainStart = -1;
+	int topDomainEnd = -1;
+};
+
+// Hand-written scanners giving the same results as searching with
+// the corresponding regular expressions from the position 'from'.
+DomainMatch FindDomain(const QString &text, int from);
+DomainMatch FindDomainExplicit(const QString &text, int from);
+TagMatch FindHashtag(const QString &text, int from);
+TagMatch FindMention(const QString &text, int from);
+TagMatch FindBotCommand(const QString &text, int from);
+
+// Start of the RegExpMailNameAtEnd() match in [from, till) or -1.
+int FindMailNameAtEnd(const QString &text, int from, int till);
+
+// If RegExpHashtagExclude() matches [from, till).
+bool IsHashtagExcluded(const QString &text, int from, int till);
+
+// Searches for entities in a single text. The previous result of each
+// search is reused while it starts after the new search position, so
+// a text is scanned once even if the searches are repeated after each
+// found entity.
+class EntityScanner {
+public:
+	explicit EntityScanner(const QString &text);
+
+	const DomainMatch &domain(int from);
+	const DomainMatch &explicitDomain(int from);
+	const TagMatch &hashtag(int from);
+	const TagMatch &mention(int from);
+	const TagMatch &botCommand(int from);
+
+private:
+	template <typename Match>
+	struct Cached {
+		int from = -1;
+		Match match;
+	};
+
+	template <typename Match>
+	const Match &search(
+		Cached<Match> &cached,
+		int from,
+		Match (*find)(const QString &text, int from));
+
+	const QString &_text;
+	Cached<DomainMatch> _domain;
+	Cached<DomainMatch> _explicitDomain;
+	Cached<TagMatch> _hashtag;
+	Cached<TagMatch> _mention;
+	Cached<TagMatch> _botCommand;
+
+};
+
+} // namespace TextUtilities
@@ -0,0 +1,283 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "ui/text/text_entity_scanner.h"
+
+#include <QtCore/QRegularExpression>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace TextUtilities;
+
+namespace {
+
+QRegularExpression CreateRegExp(const QString &expression) {
+	return QRegularExpression(
+		expression,
+		QRegularExpression::UseUnicodePropertiesOption);
+}
+
+struct Expressions {
+	QRegularExpression domain = CreateRegExp(ExpressionDomain());
+	QRegularExpression explicitDomain = CreateRegExp(
+		ExpressionDomainExplicit());
+	QRegularExpression mailNameAtEnd = CreateRegExp(
+		ExpressionMailNameAtEnd());
+	QRegularExpression hashtag = CreateRegExp(ExpressionHashtag());
+	QRegularExpression hashtagExclude = CreateRegExp(
+		ExpressionHashtagExclude());
+	QRegularExpression mention = CreateRegExp(ExpressionMention());
+	QRegularExpression botCommand = CreateRegExp(ExpressionBotCommand());
+};
+
+const Expressions &GetExpressions() {
+	static const auto result = Expressions();
+	return result;
+}
+
+DomainMatch ToDomainMatch(const QRegularExpressionMatch &match) {
+	auto result = DomainMatch();
+	if (match.hasMatch()) {
+		result.start = match.capturedStart();
+		result.end = match.capturedEnd();
+		if (!match.capturedRef(1).isEmpty()) {
+			result.protocolStart = match.capturedStart(1);
+			result.protocolEnd = match.capturedEnd(1);
+		}
+		result.topDomainStart = match.capturedStart(3);
+		result.topDomainEnd = match.capturedEnd(3);
+	}
+	return result;
+}
+
+TagMatch ToTagMatch(const QRegularExpressionMatch &match, int lastGroup) {
+	auto result = TagMatch();
+	if (match.hasMatch()) {
+		result.start = match.capturedStart();
+		result.end = match.capturedEnd();
+		result.separatorBefore = !match.capturedRef(1).isEmpty();
+		result.separatorAfter = !match.capturedRef(lastGroup).isEmpty();
+	}
+	return result;
+}
+
+void CompareMatches(const DomainMatch &a, const DomainMatch &b) {
+	REQUIRE(a.start == b.start);
+	REQUIRE(a.end == b.end);
+	REQUIRE(a.protocolStart == b.protocolStart);
+	REQUIRE(a.protocolEnd == b.protocolEnd);
+	REQUIRE(a.topDomainStart == b.topDomainStart);
+	REQUIRE(a.topDomainEnd == b.topDomainEnd);
+}
+
+void CompareMatches(const TagMatch &a, const TagMatch &b) {
+	REQUIRE(a.start == b.start);
+	REQUIRE(a.end == b.end);
+	REQUIRE(a.separatorBefore == b.separatorBefore);
+	REQUIRE(a.separatorAfter == b.separatorAfter);
+}
+
+// Pieces of entities, separators and non-ASCII symbols glued randomly.
+std::vector<QString> CorpusPieces() {
+	auto result = std::vector<QString>();
+	const auto add = [&](const char *utf8) {
+		result.push_back(QString::fromUtf8(utf8));
+	};
+	for (const auto piece : {
+		"#", "#", "@", "@", "/", "/", ".", ".", "://", "http", "https",
+		"tg", "t.me", "com", "\xD1\x80\xD1\x84", "ru", "\xD1\x91\xD0\xB6",
+		"\xD0\xAF", "ab", "abcde", "botname", "_", "1", "123",
+		"\xD9\xA3", ":", "8080", " ", " ", " ", "\n", "\t", ",", "!",
+		"?", "(", ")", "[", "]", "`", "*", "$", "%", "=", "-", "+",
+		"\xC2\xAB", "\xC2\xBB", "\xE2\x80\xA6", "\x10",
+		"\xF0\x9F\x98\x80", "\xF0\x9D\x90\x80", "\xF0\x9D\x9F\x8E",
+		"\xC3\xA9", "\xC3\x9F", "\xE6\x97\xA5\xE6\x9C\xAC", "mail",
+		"user.name", "\xC2\xA0", "\xE2\x80\xA8", "|", "~", "^", "'",
+		"\"", ";", "<", ">", "{", "}", "\xD1\x84", "\xD1\x80", "---",
+	}) {
+		add(piece);
+	}
+	for (const auto &[symbol, count] : std::vector<std::pair<char, int>>{
+		{ 'x', 70 }, { 'y', 30 }, { 'z', 33 }, { '1', 65 }, { 'q', 250 },
+	}) {
+		result.push_back(QString(count, QChar(symbol)));
+	}
+	result.push_back(QString("a.").repeated(12));
+	return result;
+}
+
+QString GenerateText(std::mt19937 &generator, int minPieces, int maxPieces) {
+	static const auto pieces = CorpusPieces();
+	auto piece = std::uniform_int_distribution<int>(0, pieces.size() - 1);
+	auto count = std::uniform_int_distribution<int>(minPieces, maxPieces);
+	auto result = QString();
+	for (auto i = count(generator); i != 0; --i) {
+		result.append(pieces[piece(generator)]);
+	}
+	return result;
+}
+
+bool SplitsSurrogatePair(const QString &text, int position) {
+	return (position > 0)
+		&& (position < text.size())
+		&& text[position - 1].isHighSurrogate()
+		&& text[position].isLowSurrogate();
+}
+
+void CompareWithExpressions(const QString &text, std::mt19937 &generator) {
+	const auto &expressions = GetExpressions();
+	auto scanner = EntityScanner(text);
+	for (auto from = 0; from <= text.size(); ++from) {
+		if (SplitsSurrogatePair(text, from)) {
+			continue;
+		}
+		const auto domain = ToDomainMatch(
+			expressions.domain.match(text, from));
+		const auto explicitDomain = ToDomainMatch(
+			expressions.explicitDomain.match(text, from));
+		const auto hashtag = ToTagMatch(
+			expressions.hashtag.match(text, from),
+			2);
+		const auto mention = ToTagMatch(
+			expressions.mention.match(text, from),
+			2);
+		const auto botCommand = ToTagMatch(
+			expressions.botCommand.match(text, from),
+			3);
+		CompareMatches(FindDomain(text, from), domain);
+		CompareMatches(FindDomainExplicit(text, from), explicitDomain);
+		CompareMatches(FindHashtag(text, from), hashtag);
+		CompareMatches(FindMention(text, from), mention);
+		CompareMatches(FindBotCommand(text, from), botCommand);
+		CompareMatches(scanner.domain(from), domain);
+		CompareMatches(scanner.explicitDomain(from), explicitDomain);
+		CompareMatches(scanner.hashtag(from), hashtag);
+		CompareMatches(scanner.mention(from), mention);
+		CompareMatches(scanner.botCommand(from), botCommand);
+	}
+	auto position = std::uniform_int_distribution<int>(0, text.size());
+	for (auto i = 0; i != 5; ++i) {
+		auto from = position(generator);
+		auto till = position(generator);
+		if (from > till) {
+			std::swap(from, till);
+		}
+		if (SplitsSurrogatePair(text, from)
+			|| SplitsSurrogatePair(text, till)) {
+			continue;
+		}
+		const auto part = text.mid(from, till - from);
+		const auto mailName = expressions.mailNameAtEnd.match(part);
+		REQUIRE(FindMailNameAtEnd(text, from, till)
+			== (mailName.hasMatch() ? (from + mailName.capturedStart()) : -1));
+		REQUIRE(IsHashtagExcluded(text, from, till)
+			== expressions.hashtagExclude.match(part).hasMatch());
+	}
+}
+
+// Searches for all entities the way ParseEntities() does it:
+// all the searches are repeated after each found entity.
+template <typename Search>
+int CountEntities(const QString &text, Search search) {
+	auto result = 0;
+	for (auto offset = 0; offset < text.size(); ++result) {
+		const auto next = search(offset);
+		if (next < 0) {
+			break;
+		}
+		offset = next;
+	}
+	return result;
+}
+
+int NearestEnd(std::initializer_list<int> ends) {
+	auto result = -1;
+	for (const auto end : ends) {
+		if (end >= 0 && (result < 0 || end < result)) {
+			result = end;
+		}
+	}
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("entity scanner matches the regular expressions", "[text_entity]") {
+	auto generator = std::mt19937(20181016);
+
+	SECTION("simple texts") {
+		for (const auto text : {
+			"", "#", "#ab", "#a", "#12", "a#bc", " #bc,", "@a", "@user",
+			"a@user", "@user\xC3\xA9", "/start", "/start@botname ok",
+			"/start@bot", "t.me", "a.b", "http://t.me/x", "tg://resolve",
+			"test://localhost:80", "x.com:8080/", "mail@example.com",
+			"$t.me", "-t.me", "\xD0\xBF\xD1\x80\xD0\xB8.\xD1\x80\xD1\x84",
+			"#tag\xF0\x9F\x98\x80", "\xF0\x9F\x98\x80#tag",
+		}) {
+			CompareWithExpressions(QString::fromUtf8(text), generator);
+		}
+	}
+	SECTION("random texts") {
+		for (auto i = 0; i != 3000; ++i) {
+			CompareWithExpressions(GenerateText(generator, 1, 25), generator);
+		}
+	}
+}
+
+TEST_CASE("entity scanner benchmark", "[.][text_entity][benchmark]") {
+	auto generator = std::mt19937(20181016);
+	const auto &expressions = GetExpressions();
+	for (const auto pieces : { 100, 1000, 10000 }) {
+		const auto text = GenerateText(generator, pieces, pieces);
+		const auto end = [](const QRegularExpressionMatch &match) {
+			return match.hasMatch() ? match.capturedEnd() : -1;
+		};
+
+		const auto expressionsStart = std::chrono::steady_clock::now();
+		const auto expressionsCount = CountEntities(text, [&](int from) {
+			return NearestEnd({
+				end(expressions.domain.match(text, from)),
+				end(expressions.explicitDomain.match(text, from)),
+				end(expressions.hashtag.match(text, from)),
+				end(expressions.mention.match(text, from)),
+				end(expressions.botCommand.match(text, from)),
+			});
+		});
+		const auto expressionsFinish = std::chrono::steady_clock::now();
+
+		auto scanner = EntityScanner(text);
+		const auto scannerStart = std::chrono::steady_clock::now();
+		const auto scannerCount = CountEntities(text, [&](int from) {
+			return NearestEnd({
+				scanner.domain(from).end,
+				scanner.explicitDomain(from).end,
+				scanner.hashtag(from).end,
+				scanner.mention(from).end,
+				scanner.botCommand(from).end,
+			});
+		});
+		const auto scannerFinish = std::chrono::steady_clock::now();
+
+		REQUIRE(scannerCount == expressionsCount);
+		const auto ms = [](auto start, auto finish) {
+			return std::to_string(std::chrono::duration<double, std::milli>(
+				finish - start).count());
+		};
+		WARN(std::to_string(text.size())
+			+ " chars, "
+			+ std::to_string(scannerCount)
+			+ " entities: regular expressions "
+			+ ms(expressionsStart, expressionsFinish)
+			+ " ms, scanner "
+			+ ms(scannerStart, scannerFinish)
+			+ " ms");
+	}
+}
@@ -51,6 +51,15 @@
       '<(src_loc)/base/algorithm.h',
       '<(src_loc)/base/algorithm_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_dialogs_list_tree',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/dialogs/dialogs_list_tree.h',
+      '<(src_loc)/dialogs/dialogs_list_tree_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_flags',
     'includes': [
@@ -78,6 +87,46 @@
       '<(src_loc)/base/flat_set.h',
       '<(src_loc)/base/flat_set_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_mpsc_queue',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/mpsc_queue.h',
+      '<(src_loc)/base/mpsc_queue_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_ring_map',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/ring_map.h',
+      '<(src_loc)/base/ring_map_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_image_blur',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/ui/image/image_blur.cpp',
+      '<(src_loc)/ui/image/image_blur.h',
+      '<(src_loc)/ui/image/image_blur_avx2.cpp',
+      '<(src_loc)/ui/image/image_blur_kernel.h',
+      '<(src_loc)/ui/image/image_blur_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_text_entity_scanner',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/ui/text/text_entity_scanner.cpp',
+      '<(src_loc)/ui/text/text_entity_scanner.h',
+      '<(src_loc)/ui/text/text_entity_scanner_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_rpl',
     'includes': [